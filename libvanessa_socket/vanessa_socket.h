@@ -29,6 +29,7 @@
 #define TCP_PIPE_NYM
 
 #include <ctype.h>
+#include <stdint.h>
 #include <netdb.h>
 #include <sys/types.h>
 #include <netinet/in.h>
@@ -38,7 +39,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <sys/time.h>
+#include <sys/resource.h>
 #include <sys/wait.h>
 #include <unistd.h>
 #include <fcntl.h>
@@ -82,6 +85,8 @@ typedef unsigned int vanessa_socket_flag_t;
 #define VANESSA_SOCKET_NO_FROM         0x00000002
 #define VANESSA_SOCKET_NO_FORK         0x00000004
 #define VANESSA_SOCKET_TCP_KEEPALIVE   0x00000008
+#define VANESSA_SOCKET_UDP_GSO         0x00000010
+#define VANESSA_SOCKET_NONBLOCK        0x00000020
 
 #define VANESSA_SOCKET_PROTO_MASK      0x0000ff00
 #define __VANESSA_SOCKET_PROTO(_proto)   ((_proto&0xff)<<8)
@@ -90,6 +95,14 @@ typedef unsigned int vanessa_socket_flag_t;
 #define VANESSA_SOCKET_PROTO_STR_TCP   "tcp"
 #define VANESSA_SOCKET_PROTO_STR_UDP   "udp"
 
+/* Socket type to use for the protocol selected in a flag */
+#define vanessa_socket_flag_socktype(_flag) \
+  ((((_flag) & VANESSA_SOCKET_PROTO_MASK) == VANESSA_SOCKET_PROTO_UDP) ? \
+   SOCK_DGRAM : SOCK_STREAM)
+
+/* Host prefix used to name unix domain sockets, e.g. "unix:/path" */
+#define VANESSA_SOCKET_UNIX_PREFIX     "unix:"
+
 #ifndef INPORT_ANY
 #define INPORT_ANY     ((int)0)
 #endif
@@ -169,6 +182,9 @@ int vanessa_socket_client_open_src_sockaddr_in(struct sockaddr_in from,
  *                If NULL then the operating system will select
  *                an appropriate source port.
  *      dst_host: hostname or ipaddress to open socket to
+ *                If of the form "unix:/path" or "unix:@name" then
+ *                a unix domain socket is opened and src_host,
+ *                src_port and dst_port are ignored.
  *      dst_port: name or number to open
  *      flag: Logical or of VANESSA_SOCKET_NO_LOOKUP and 
  *            VANESSA_SOCKET_NO_FROM
@@ -177,6 +193,13 @@ int vanessa_socket_client_open_src_sockaddr_in(struct sockaddr_in from,
  *            If flag&VANESSA_SOCKET_NO_FROM then the from parameter 
  *            will not be used and the operating system will select a 
  *            source address and port
+ *            If flag&VANESSA_SOCKET_PROTO_UDP then a datagram socket
+ *            is opened, connect() only sets its default destination
+ *            If flag&VANESSA_SOCKET_NONBLOCK then the socket is
+ *            non-blocking and it is returned as soon as the connection
+ *            is in progress. Completion should be checked for using
+ *            SO_ERROR once the socket is writable. Later addresses
+ *            of dst_host are not tried if it fails.
  * post: socket is opened
  * return: open socket
  *         -1 on error
@@ -202,6 +225,52 @@ int vanessa_socket_client_src_open(const char *src_host,
 int vanessa_socket_str_is_digit(const char *str);
 
 
+/**********************************************************************
+ * vanessa_socket_host_is_unix
+ * Test if a host string names a unix domain socket
+ * pre: host: host string, may be NULL
+ * return: 1 if host begins with VANESSA_SOCKET_UNIX_PREFIX
+ *         0 otherwise
+ **********************************************************************/
+
+int vanessa_socket_host_is_unix(const char *host);
+
+
+/**********************************************************************
+ * vanessa_socket_unix_sockaddr
+ * Fill in a sockaddr_un from a unix domain socket host string
+ * pre: host: "unix:/path/to/socket" or "unix:@name". The latter
+ *            names a socket in the Linux abstract namespace.
+ *      addr: sockaddr_un to fill in
+ *      addrlen: where the length of addr will be written
+ * post: addr and addrlen are filled in
+ * return: 0 on success
+ *         -1 on error
+ **********************************************************************/
+
+int vanessa_socket_unix_sockaddr(const char *host, struct sockaddr_un *addr,
+				 socklen_t *addrlen);
+
+
+/**********************************************************************
+ * vanessa_socket_unix_ntop
+ * Format a unix domain socket address as a host string
+ * pre: addr: unix domain socket address
+ *      addrlen: length of addr, as returned by accept(), getsockname()
+ *               and friends
+ *      str: buffer to write the string to
+ *      len: length of str in bytes
+ * post: str is "unix:/path", "unix:@name" or "unix:" for an unnamed
+ *       socket. Non-printable bytes in abstract names are written as '?'
+ *       and trailing NUL bytes are not shown.
+ * return: 0 on success
+ *         -1 on error
+ **********************************************************************/
+
+int vanessa_socket_unix_ntop(const struct sockaddr_un *addr,
+			     socklen_t addrlen, char *str, size_t len);
+
+
 
 /**********************************************************************
  * Notes on read_func and write_func
@@ -491,8 +560,17 @@ int vanessa_socket_pipe_write_bytes_func(int fd,
  *            or an entry from /etc/services
  *      interface_address: If NULL bind to 0.0.0.0, else
  *                         bind to interface(es) with this address.
+ *                         If of the form "unix:/path" or "unix:@name"
+ *                         then bind a unix domain socket and ignore port.
+ *                         A stale socket at path is removed first,
+ *                         if something is still listening on it
+ *                         then -1 is returned with errno set to
+ *                         EADDRINUSE. Use vanessa_socket_server_unlink()
+ *                         to remove path once the socket is closed.
  *      flag: If VANESSA_SOCKET_NO_LOOKUP then no host and port lookups
  *            will be performed
+ *            If VANESSA_SOCKET_PROTO_UDP then bind a datagram socket.
+ *            listen() is not called on datagram sockets.
  * post: Bound socket is returned
  * return: socket
  *         -1 on error
@@ -575,6 +653,34 @@ int
 vanessa_socket_closev(int *sockv);
 
 
+/**********************************************************************
+ * vanessa_socket_server_unlink
+ * Remove the path that a unix domain socket is bound to
+ * pre: s: socket, as returned by vanessa_socket_server_bind()
+ * post: If s is a unix domain socket bound to a path then the path is
+ *       unlinked, otherwise nothing is done. Should only be called by
+ *       the process that bound s, not by children that close their copy.
+ * return: 0 on success
+ *         -1 on error
+ **********************************************************************/
+
+int vanessa_socket_server_unlink(int s);
+
+
+/**********************************************************************
+ * vanessa_socket_server_unlinkv
+ * Remove the paths that unix domain sockets are bound to
+ * pre: sockv: -1 terminated pointer of sockets, as returned by
+ *             vanessa_socket_server_bindv()
+ * post: vanessa_socket_server_unlink() is called for each socket,
+ *       the sockets are not closed
+ * return: 0 on success
+ *         -1 if any of the paths could not be removed
+ **********************************************************************/
+
+int vanessa_socket_server_unlinkv(const int *sockv);
+
+
 /**********************************************************************
  * vanessa_socket_server_accept
  * Accept connections on a bound socket.
@@ -734,6 +840,1223 @@ vanessa_socket_server_connectv(const const char **from,
 			       vanessa_socket_flag_t flag);
 
 
+/**********************************************************************
+ * vanessa_socket_server_drain_start
+ * Stop accepting connections
+ * pre: none
+ * post: vanessa_socket_server_acceptv() and the functions that use it
+ *       return -1 in the parent process, rather than waiting for
+ *       another connection, and vanessa_socket_server_draining()
+ *       returns non-zero. vanessa_socket_server_accept() does too if
+ *       it is interrupted by a signal, which it won't be if the
+ *       handler was installed with SA_RESTART, as signal() does with
+ *       glibc. Safe to call from a signal handler.
+ * return: none
+ **********************************************************************/
+
+void vanessa_socket_server_drain_start(void);
+
+
+/**********************************************************************
+ * vanessa_socket_server_draining
+ * return: non-zero if vanessa_socket_server_drain_start() has been
+ *         called
+ *         0 otherwise
+ **********************************************************************/
+
+int vanessa_socket_server_draining(void);
+
+
+/**********************************************************************
+ * vanessa_socket_server_reload_start
+ * Stop waiting for connections, so that settings can be reloaded
+ * pre: none
+ * post: vanessa_socket_server_acceptv() returns -1 with errno set to
+ *       EINTR in the parent process, rather than waiting for another
+ *       connection, and vanessa_socket_server_reload_pending() returns
+ *       non-zero. Unlike vanessa_socket_server_drain_start() this only
+ *       happens once, and the listening sockets are left open, so the
+ *       caller can change settings outside of signal context and call
+ *       vanessa_socket_server_acceptv() again. Safe to call from a
+ *       signal handler.
+ * return: none
+ **********************************************************************/
+
+void vanessa_socket_server_reload_start(void);
+
+
+/**********************************************************************
+ * vanessa_socket_server_reload_pending
+ * return: non-zero if vanessa_socket_server_reload_start() has been
+ *         called since this was last called
+ *         0 otherwise
+ **********************************************************************/
+
+int vanessa_socket_server_reload_pending(void);
+
+
+/**********************************************************************
+ * vanessa_socket_server_drain
+ * Wait for the children forked for connections to exit
+ * pre: timeout: maximum number of seconds to wait.
+ *               If 0 then wait for as long as it takes.
+ * post: Exited children are waited for, and their resource usage is
+ *       accounted for as by vanessa_socket_handler_reaper_rusage().
+ *       This works whether or not either reaper is the handler for
+ *       SIGCHLD.
+ * return: Number of connections still open
+ **********************************************************************/
+
+unsigned int vanessa_socket_server_drain(unsigned int timeout);
+
+
+/**********************************************************************
+ * vanessa_socket_server_children
+ * pre: none
+ * return: Number of children forked for connections by the server
+ *         functions that have not yet been reaped by
+ *         vanessa_socket_handler_reaper(),
+ *         vanessa_socket_handler_reaper_rusage() or
+ *         vanessa_socket_server_drain(). Only meaningful in the parent.
+ *         May be called from a thread other than the one that reaps.
+ **********************************************************************/
+
+unsigned int vanessa_socket_server_children(void);
+
+
+/**********************************************************************
+ * UDP relaying
+ **********************************************************************/
+
+/* Number of datagrams received or sent by a single system call */
+#define VANESSA_SOCKET_UDP_BATCH       32
+
+/* Default maximum number of flows relayed simultaneously */
+#define VANESSA_SOCKET_UDP_MAX_FLOWS   1024
+
+
+/**********************************************************************
+ * vanessa_socket_udp_relay
+ * Relay datagrams between clients and a server.
+ * Datagrams are received from the listening socket in batches using
+ * recvmmsg(2). A datagram socket connected to the server is opened for
+ * each client address seen, its flow, and datagrams are sent to the
+ * server over it in batches using sendmmsg(2). Replies received on the
+ * socket of a flow are sent back to the client of that flow from the
+ * listening socket.
+ * pre: listen_socket: datagram socket to receive from clients on,
+ *                     as returned by vanessa_socket_server_bind()
+ *                     with VANESSA_SOCKET_PROTO_UDP
+ *      dst_host: hostname or ipaddress of server
+ *      dst_port: name or number of server port
+ *      buffer_length: maximum size of datagrams to relay.
+ *                     Larger datagrams are truncated.
+ *                     If 0 then datagrams of any size are relayed.
+ *      idle_timeout: timeout in seconds after which a flow that has
+ *                    not relayed any datagrams is closed.
+ *                    timeout of 0 = infinite timeout
+ *      max_flows: maximum number of flows.
+ *                 If 0 then VANESSA_SOCKET_UDP_MAX_FLOWS is used.
+ *                 When the limit is reached the least recently
+ *                 used flow is closed to make way for a new client.
+ *      flag: If VANESSA_SOCKET_NO_LOOKUP then no host and port lookups
+ *            will be performed
+ *            If VANESSA_SOCKET_UDP_GSO then receive datagrams using
+ *            UDP GRO and send them using UDP GSO, if supported by the
+ *            operating system, so that a train of datagrams is handled
+ *            by a single system call
+ * post: Datagrams are relayed until an error occurs
+ * return: -1 on error
+ *         Does not return otherwise
+ **********************************************************************/
+
+int vanessa_socket_udp_relay(int listen_socket, const char *dst_host,
+			     const char *dst_port, size_t buffer_length,
+			     int idle_timeout, unsigned int max_flows,
+			     vanessa_socket_flag_t flag);
+
+
+/**********************************************************************
+ * Flow tables
+ *
+ * A flow table maps the addresses of datagram "connections" to state
+ * kept by the application, such as the socket used to relay them.
+ * All memory is allocated when a table is created, lookups and updates
+ * take constant time and do not allocate memory.
+ **********************************************************************/
+
+/* Addresses of a flow, in network byte order. AF_INET addresses only
+ * use the first 4 bytes of each address. */
+typedef struct {
+	uint8_t from_addr[16];
+	uint8_t to_addr[16];
+	uint16_t from_port;
+	uint16_t to_port;
+	uint16_t family;
+	uint16_t __pad;
+} vanessa_socket_flow_key_t;
+
+typedef struct {
+	vanessa_socket_flow_key_t key;
+	int fd;				/* For use by the application */
+	void *data;			/* For use by the application */
+	time_t last;			/* Time of last use */
+	/* Private to the flow table */
+	uint32_t __hash;
+	uint32_t __lru_prev;
+	uint32_t __lru_next;
+	uint32_t __wheel_prev;
+	uint32_t __wheel_next;
+	uint32_t __wheel_slot;
+} vanessa_socket_flow_t;
+
+typedef struct vanessa_socket_flow_table_struct vanessa_socket_flow_table_t;
+
+
+/**********************************************************************
+ * vanessa_socket_flow_key
+ * Fill in a flow key from a pair of addresses
+ * pre: key: key to fill in
+ *      from: address of the client. Must be AF_INET or AF_INET6
+ *      to: local address the client sent to, in the same family as
+ *          from. May be NULL, in which case only from is used
+ * post: key is filled in. Unused bytes are zeroed so that keys
+ *       may be compared and hashed as a whole.
+ * return: 0 on success
+ *         -1 on error
+ **********************************************************************/
+
+int vanessa_socket_flow_key(vanessa_socket_flow_key_t *key,
+			    const struct sockaddr *from,
+			    const struct sockaddr *to);
+
+
+/**********************************************************************
+ * vanessa_socket_flow_table_create
+ * Create a flow table
+ * pre: capacity: maximum number of flows. Space for all of them
+ *                is allocated up front.
+ *      idle_timeout: seconds after its last use that a flow is expired
+ *                    by vanessa_socket_flow_expire(). 0 for no expiry.
+ *      release: called when a flow is removed from the table by
+ *               eviction, expiry or vanessa_socket_flow_table_destroy(),
+ *               for instance to close flow->fd. May be NULL.
+ *      data: opaque data passed to release
+ * return: flow table
+ *         NULL on error
+ **********************************************************************/
+
+vanessa_socket_flow_table_t *
+vanessa_socket_flow_table_create(unsigned int capacity,
+				 unsigned int idle_timeout,
+				 void (*release)(vanessa_socket_flow_t *flow,
+						 void *data),
+				 void *data);
+
+
+/**********************************************************************
+ * vanessa_socket_flow_table_destroy
+ * Destroy a flow table
+ * pre: t: flow table
+ * post: release is called for each flow in the table and the
+ *       table is freed
+ **********************************************************************/
+
+void vanessa_socket_flow_table_destroy(vanessa_socket_flow_table_t *t);
+
+
+/**********************************************************************
+ * vanessa_socket_flow_lookup
+ * Find a flow and mark it as used
+ * pre: t: flow table
+ *      key: key of flow to find
+ *      now: current time in seconds, from a monotonic clock
+ * post: if found, the flow becomes the most recently used
+ *       and its idle timeout is restarted
+ * return: flow
+ *         NULL if not found
+ **********************************************************************/
+
+vanessa_socket_flow_t *
+vanessa_socket_flow_lookup(vanessa_socket_flow_table_t *t,
+			   const vanessa_socket_flow_key_t *key, time_t now);
+
+
+/**********************************************************************
+ * vanessa_socket_flow_insert
+ * Add a flow to a table
+ * pre: t: flow table
+ *      key: key of the flow, which must not already be in the table
+ *      now: current time in seconds, from a monotonic clock
+ * post: If the table is full then the least recently used flow is
+ *       evicted, and release is called for it, to make space.
+ *       The new flow becomes the most recently used. Its fd is -1 and
+ *       its data NULL, for the caller to fill in.
+ * return: flow
+ **********************************************************************/
+
+vanessa_socket_flow_t *
+vanessa_socket_flow_insert(vanessa_socket_flow_table_t *t,
+			   const vanessa_socket_flow_key_t *key, time_t now);
+
+
+/**********************************************************************
+ * vanessa_socket_flow_remove
+ * Remove a flow from a table
+ * pre: t: flow table
+ *      flow: flow to remove
+ * post: flow is removed, release is not called
+ **********************************************************************/
+
+void vanessa_socket_flow_remove(vanessa_socket_flow_table_t *t,
+				vanessa_socket_flow_t *flow);
+
+
+/**********************************************************************
+ * vanessa_socket_flow_expire
+ * Expire idle flows
+ * pre: t: flow table
+ *      now: current time in seconds, from a monotonic clock
+ * post: Flows that have not been used for idle_timeout seconds are
+ *       removed and release is called for them.
+ *       Should be called about once a second, each call handles
+ *       the timer wheel slots for the seconds since the last call.
+ * return: number of flows expired
+ **********************************************************************/
+
+unsigned int vanessa_socket_flow_expire(vanessa_socket_flow_table_t *t,
+					time_t now);
+
+
+/**********************************************************************
+ * vanessa_socket_flow_count
+ * Number of flows in a table
+ * pre: t: flow table
+ * return: number of flows
+ **********************************************************************/
+
+unsigned int vanessa_socket_flow_count(const vanessa_socket_flow_table_t *t);
+
+
+/**********************************************************************
+ * Timer wheels
+ *
+ * A hierarchical timer wheel for large numbers of timers, such as
+ * idle and lifetime timeouts of sessions. Time is counted in ticks of
+ * a fixed length. Adding and deleting a timer take constant time and
+ * do not allocate memory, timers are embedded in the caller's own
+ * structures. Timers that expire are handled in batches, a tick at a
+ * time, by vanessa_socket_timer_wheel_run().
+ **********************************************************************/
+
+typedef struct vanessa_socket_timer_wheel_struct vanessa_socket_timer_wheel_t;
+
+typedef struct vanessa_socket_timer_struct {
+	/* Called when the timer expires, after it has been removed from
+	 * the wheel. It may add this or any other timer, and delete any
+	 * other timer. */
+	void (*func)(struct vanessa_socket_timer_struct *timer, void *data);
+	void *data;			/* For use by the application */
+	/* Private to the timer wheel */
+	struct vanessa_socket_timer_struct *__next;
+	struct vanessa_socket_timer_struct *__prev;
+	uint64_t __expires;
+	vanessa_socket_timer_wheel_t *__wheel;
+} vanessa_socket_timer_t;
+
+
+/**********************************************************************
+ * vanessa_socket_timer_wheel_create
+ * Create a timer wheel
+ * pre: tick: length of a tick in milliseconds. Timers expire on the
+ *            first tick at or after their timeout.
+ * post: The current time of the wheel is now, from a monotonic clock
+ * return: timer wheel
+ *         NULL on error
+ **********************************************************************/
+
+vanessa_socket_timer_wheel_t *
+vanessa_socket_timer_wheel_create(unsigned int tick);
+
+
+/**********************************************************************
+ * vanessa_socket_timer_wheel_destroy
+ * Destroy a timer wheel
+ * pre: w: timer wheel
+ * post: Timers still in the wheel are removed, without being called,
+ *       and the wheel is freed
+ **********************************************************************/
+
+void vanessa_socket_timer_wheel_destroy(vanessa_socket_timer_wheel_t *w);
+
+
+/**********************************************************************
+ * vanessa_socket_timer_init
+ * Initialise a timer
+ * pre: timer: timer to initialise
+ *      func: function to call when the timer expires
+ *      data: opaque data passed to func
+ * post: timer is initialised and is not pending
+ **********************************************************************/
+
+void vanessa_socket_timer_init(vanessa_socket_timer_t *timer,
+			       void (*func)(vanessa_socket_timer_t *timer,
+					    void *data),
+			       void *data);
+
+
+/**********************************************************************
+ * vanessa_socket_timer_add
+ * Start, or restart, a timer
+ * pre: w: timer wheel
+ *      timer: initialised timer
+ *      timeout: milliseconds until the timer expires, counted from
+ *               the last time that vanessa_socket_timer_wheel_run()
+ *               was called, so that adding a timer does not need
+ *               to read the clock
+ * post: If timer was pending it is deleted first. It is added to w.
+ *       Timeouts longer than about 2^26 ticks are shortened to that.
+ **********************************************************************/
+
+void vanessa_socket_timer_add(vanessa_socket_timer_wheel_t *w,
+			      vanessa_socket_timer_t *timer,
+			      unsigned long timeout);
+
+
+/**********************************************************************
+ * vanessa_socket_timer_del
+ * Stop a timer
+ * pre: timer: initialised timer
+ * post: If timer is pending it is removed from its wheel without
+ *       being called
+ **********************************************************************/
+
+void vanessa_socket_timer_del(vanessa_socket_timer_t *timer);
+
+
+/**********************************************************************
+ * vanessa_socket_timer_pending
+ * pre: timer: initialised timer
+ * return: non-zero if timer has been added and has not expired
+ *         or been deleted
+ **********************************************************************/
+
+int vanessa_socket_timer_pending(const vanessa_socket_timer_t *timer);
+
+
+/**********************************************************************
+ * vanessa_socket_timer_wheel_run
+ * Expire timers
+ * pre: w: timer wheel
+ * post: The time of w is advanced to now, a tick at a time. The
+ *       timers that expire in each tick are removed and their func
+ *       is called.
+ * return: number of timers expired
+ **********************************************************************/
+
+unsigned int vanessa_socket_timer_wheel_run(vanessa_socket_timer_wheel_t *w);
+
+
+/**********************************************************************
+ * vanessa_socket_timer_wheel_next
+ * Time until vanessa_socket_timer_wheel_run() should next be called
+ * pre: w: timer wheel
+ * return: milliseconds until the next tick that may expire timers,
+ *         suitable for passing as the timeout to poll(2) or
+ *         epoll_wait(2). This may be earlier than the first timer
+ *         is due, as timers far in the future are only sorted into
+ *         ticks as they come closer.
+ *         -1 if there are no timers
+ **********************************************************************/
+
+int vanessa_socket_timer_wheel_next(vanessa_socket_timer_wheel_t *w);
+
+
+/**********************************************************************
+ * vanessa_socket_timer_wheel_count
+ * Number of timers in a wheel
+ * pre: w: timer wheel
+ * return: number of pending timers
+ **********************************************************************/
+
+unsigned int
+vanessa_socket_timer_wheel_count(const vanessa_socket_timer_wheel_t *w);
+
+
+/**********************************************************************
+ * Slab allocators
+ *
+ * Allocate objects of one size, such as the state of sessions, without
+ * calling malloc() and free() for each. Objects are allocated a slab
+ * at a time and kept on a free list once freed, so once the number of
+ * objects in use stops growing allocating and freeing them is a matter
+ * of taking them from and putting them back on the list. Each object
+ * starts on a cache line, so objects do not share cache lines. A slab
+ * whose objects are all freed is returned to the system, except for
+ * one that is kept spare, so memory taken at a peak is given back.
+ *
+ * A slab allocator is not safe to use from more than one thread at a
+ * time, which avoids locking. A program with several threads should
+ * give each its own, and free objects to the allocator they came from.
+ **********************************************************************/
+
+typedef struct vanessa_socket_slab_struct vanessa_socket_slab_t;
+
+
+/**********************************************************************
+ * vanessa_socket_slab_create
+ * Create a slab allocator
+ * pre: size: bytes in each object
+ *      per_slab: least number of objects to allocate at a time. Slabs
+ *                are a power of two bytes, and as many objects as fit
+ *                are allocated.
+ * return: slab allocator, with no memory allocated for objects yet
+ *         NULL on error
+ **********************************************************************/
+
+vanessa_socket_slab_t *vanessa_socket_slab_create(size_t size,
+						  unsigned int per_slab);
+
+
+/**********************************************************************
+ * vanessa_socket_slab_destroy
+ * Destroy a slab allocator
+ * pre: s: slab allocator
+ * post: All memory of s is freed, including that of objects still
+ *       in use
+ **********************************************************************/
+
+void vanessa_socket_slab_destroy(vanessa_socket_slab_t *s);
+
+
+/**********************************************************************
+ * vanessa_socket_slab_alloc
+ * Allocate an object
+ * pre: s: slab allocator
+ * post: If there are no free objects the spare slab is used, or
+ *       another slab is allocated.
+ * return: object, aligned to a cache line. Its contents are undefined.
+ *         NULL on error
+ **********************************************************************/
+
+void *vanessa_socket_slab_alloc(vanessa_socket_slab_t *s);
+
+
+/**********************************************************************
+ * vanessa_socket_slab_free
+ * Free an object
+ * pre: s: slab allocator that obj was allocated from
+ *      obj: object to free, may be NULL
+ * post: obj is put on the free list of its slab. If all the objects
+ *       of the slab are then free it becomes the spare slab, or is
+ *       freed if there already is one.
+ **********************************************************************/
+
+void vanessa_socket_slab_free(vanessa_socket_slab_t *s, void *obj);
+
+
+/**********************************************************************
+ * vanessa_socket_slab_count
+ * Number of objects in use
+ * pre: s: slab allocator
+ * return: number of objects allocated and not freed
+ **********************************************************************/
+
+unsigned int vanessa_socket_slab_count(const vanessa_socket_slab_t *s);
+
+
+/**********************************************************************
+ * Access control lists
+ *
+ * An access control list allows or denies connections by the longest
+ * IPv4 or IPv6 prefix that their source address falls in. Lists are
+ * built and then used without being changed, to change the rules in
+ * use a new list is built and swapped in.
+ **********************************************************************/
+
+#define VANESSA_SOCKET_ACL_ALLOW 0
+#define VANESSA_SOCKET_ACL_DENY  1
+
+typedef struct vanessa_socket_acl_struct vanessa_socket_acl_t;
+
+
+/**********************************************************************
+ * vanessa_socket_acl_create
+ * Create an empty access control list
+ * pre: action: VANESSA_SOCKET_ACL_ALLOW or VANESSA_SOCKET_ACL_DENY,
+ *              for addresses that match no prefix
+ * return: list
+ *         NULL on error
+ **********************************************************************/
+
+vanessa_socket_acl_t *vanessa_socket_acl_create(int action);
+
+
+/**********************************************************************
+ * vanessa_socket_acl_destroy
+ * Destroy an access control list
+ * pre: acl: list
+ * post: acl is freed
+ **********************************************************************/
+
+void vanessa_socket_acl_destroy(vanessa_socket_acl_t *acl);
+
+
+/**********************************************************************
+ * vanessa_socket_acl_add
+ * Add a prefix to an access control list
+ * pre: acl: list
+ *      prefix: IPv4 or IPv6 address, optionally followed by /length
+ *      action: VANESSA_SOCKET_ACL_ALLOW or VANESSA_SOCKET_ACL_DENY
+ * post: prefix is added with action, replacing its action if it has
+ *       already been added. Bits of the address after the prefix
+ *       length are ignored.
+ * return: 0 on success
+ *         -1 on error
+ **********************************************************************/
+
+int vanessa_socket_acl_add(vanessa_socket_acl_t *acl, const char *prefix,
+			   int action);
+
+
+/**********************************************************************
+ * vanessa_socket_acl_check
+ * Look up the action for an address
+ * pre: acl: list
+ *      from: address
+ * return: the action of the longest prefix that from falls in, or the
+ *         action acl was created with if there is none.
+ *         VANESSA_SOCKET_ACL_ALLOW if from is not AF_INET or AF_INET6.
+ **********************************************************************/
+
+int vanessa_socket_acl_check(const vanessa_socket_acl_t *acl,
+			     const struct sockaddr *from);
+
+
+/**********************************************************************
+ * vanessa_socket_server_acl
+ * Set the access control list of the server functions
+ * pre: acl: list, NULL to allow all connections
+ * post: vanessa_socket_server_accept(), _acceptv() and the functions
+ *       that use them close each connection they accept that acl
+ *       denies, before forking or checking limits. May be called from
+ *       a signal handler.
+ * return: the list that was set before. If this was called from a
+ *         signal handler it may be in use by a check that the handler
+ *         interrupted, so it should not be destroyed until the server
+ *         functions have accepted another connection. Otherwise, say
+ *         once vanessa_socket_server_acceptv() has returned for
+ *         vanessa_socket_server_reload_start(), it may be destroyed
+ *         straight away.
+ **********************************************************************/
+
+vanessa_socket_acl_t *vanessa_socket_server_acl(vanessa_socket_acl_t *acl);
+
+
+/**********************************************************************
+ * Connection limits
+ *
+ * A limiter caps the number of connections that are open at once, and
+ * the rate at which new ones may be made, for each source address and
+ * for each prefix that source addresses fall in. Rates are enforced
+ * using token buckets. All memory is allocated when a limiter is
+ * created, sources that have not connected for a while are expired.
+ **********************************************************************/
+
+typedef struct {
+	unsigned int max;		/* Open connections, 0 for no limit */
+	unsigned int rate;		/* New connections a second,
+					 * 0 for no limit */
+	unsigned int burst;		/* Connections that may be made at
+					 * once, at least 1 */
+} vanessa_socket_limit_rule_t;
+
+/* What a connection holds against the limits, to release it with */
+typedef struct {
+	uint32_t __entry[2];
+} vanessa_socket_limit_ticket_t;
+
+typedef struct vanessa_socket_limit_struct vanessa_socket_limit_t;
+
+
+/**********************************************************************
+ * vanessa_socket_limit_create
+ * Create a limiter
+ * pre: capacity: maximum number of source addresses and prefixes to
+ *                track at once. Space for all of them is allocated
+ *                up front.
+ *      source: limits for each source address
+ *      prefix: limits for each prefix
+ *      prefix4: length of IPv4 prefixes, 0 to 32
+ *      prefix6: length of IPv6 prefixes, 0 to 128
+ * return: limiter
+ *         NULL on error
+ **********************************************************************/
+
+vanessa_socket_limit_t *
+vanessa_socket_limit_create(unsigned int capacity,
+			    const vanessa_socket_limit_rule_t *source,
+			    const vanessa_socket_limit_rule_t *prefix,
+			    unsigned int prefix4, unsigned int prefix6);
+
+
+/**********************************************************************
+ * vanessa_socket_limit_destroy
+ * Destroy a limiter
+ * pre: l: limiter
+ * post: l is freed
+ **********************************************************************/
+
+void vanessa_socket_limit_destroy(vanessa_socket_limit_t *l);
+
+
+/**********************************************************************
+ * vanessa_socket_limit_rules
+ * Change the limits of a limiter
+ * pre: l: limiter
+ *      source: limits for each source address
+ *      prefix: limits for each prefix
+ * post: Connections admitted from now on are checked against the new
+ *       limits. Those already admitted are still counted. Thread safe,
+ *       but block SIGCHLD around it if the reaper uses l.
+ **********************************************************************/
+
+void vanessa_socket_limit_rules(vanessa_socket_limit_t *l,
+				const vanessa_socket_limit_rule_t *source,
+				const vanessa_socket_limit_rule_t *prefix);
+
+
+/**********************************************************************
+ * vanessa_socket_limit_admit
+ * Check whether a new connection is within the limits
+ * pre: l: limiter
+ *      from: address the connection is from
+ *      ticket: where to store what the connection holds
+ * post: If the connection is admitted it is counted against its
+ *       source address and prefix, and a token is taken from each of
+ *       their buckets. Connections that are not from AF_INET or
+ *       AF_INET6 addresses are always admitted, and not counted.
+ *       Thread safe.
+ * return: 0 if admitted, ticket must be passed to
+ *           vanessa_socket_limit_release() when the connection closes
+ *         -1 if the connection is over a limit
+ **********************************************************************/
+
+int vanessa_socket_limit_admit(vanessa_socket_limit_t *l,
+			       const struct sockaddr *from,
+			       vanessa_socket_limit_ticket_t *ticket);
+
+
+/**********************************************************************
+ * vanessa_socket_limit_release
+ * Release what a connection holds, when it closes
+ * pre: l: limiter
+ *      ticket: filled in by vanessa_socket_limit_admit()
+ * post: The connection is no longer counted. Thread safe.
+ **********************************************************************/
+
+void vanessa_socket_limit_release(vanessa_socket_limit_t *l,
+				  const vanessa_socket_limit_ticket_t *ticket);
+
+
+/**********************************************************************
+ * vanessa_socket_limit_child
+ * Record the child process that serves a connection
+ * pre: l: limiter
+ *      pid: process id of the child
+ *      ticket: filled in by vanessa_socket_limit_admit()
+ * post: The ticket is released by vanessa_socket_limit_reap() when
+ *       the child is reaped. If there are too many children to keep
+ *       track of the ticket is released straight away.
+ **********************************************************************/
+
+void vanessa_socket_limit_child(vanessa_socket_limit_t *l, pid_t pid,
+				const vanessa_socket_limit_ticket_t *ticket);
+
+
+/**********************************************************************
+ * vanessa_socket_limit_reap
+ * Release the ticket of a child process that has exited
+ * pre: l: limiter
+ *      pid: process id of the child
+ * post: If pid was recorded by vanessa_socket_limit_child() its ticket
+ *       is released. Not safe to call from a signal handler that
+ *       interrupts other calls on l, block the signal around them.
+ **********************************************************************/
+
+void vanessa_socket_limit_reap(vanessa_socket_limit_t *l, pid_t pid);
+
+
+/**********************************************************************
+ * vanessa_socket_server_limit
+ * Limit the connections accepted by the server functions
+ * pre: l: limiter, NULL for no limits
+ * post: vanessa_socket_server_accept(), _acceptv() and the functions
+ *       that use them check each connection they accept against l
+ *       before forking, and close it if it is over a limit. Children
+ *       are released by vanessa_socket_handler_reaper() and
+ *       vanessa_socket_server_drain().
+ **********************************************************************/
+
+void vanessa_socket_server_limit(vanessa_socket_limit_t *l);
+
+
+/**********************************************************************
+ * Scoreboard
+ *
+ * A scoreboard is an array of slots in shared memory, one for each
+ * child that the server functions fork for a connection, in which the
+ * child publishes the addresses of its session, what it is doing and
+ * how many bytes it has relayed. It may be mapped from a file so that
+ * other processes can read it too, without asking the server.
+ *
+ * The mapping starts with a vanessa_socket_scoreboard_head_t, slots
+ * follow at offset slot_size. Each slot has a sequence count that is
+ * odd while the slot is being written, so that readers can take a
+ * consistent copy without locking, as
+ * vanessa_socket_scoreboard_read() does.
+ **********************************************************************/
+
+#define VANESSA_SOCKET_SCOREBOARD_MAGIC   0x76737362	/* "vssb" */
+#define VANESSA_SOCKET_SCOREBOARD_VERSION 1
+
+#define VANESSA_SOCKET_SCOREBOARD_FREE    0	/* No child */
+#define VANESSA_SOCKET_SCOREBOARD_ACCEPT  1	/* Forked, starting up */
+#define VANESSA_SOCKET_SCOREBOARD_CONNECT 2	/* Connecting to the server */
+#define VANESSA_SOCKET_SCOREBOARD_RELAY   3	/* Relaying data */
+#define VANESSA_SOCKET_SCOREBOARD_CLOSE   4	/* Finished relaying */
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t nslot;
+	uint32_t slot_size;	/* Bytes, also the offset of the first slot */
+} vanessa_socket_scoreboard_head_t;
+
+typedef struct {
+	volatile uint32_t seq;
+	uint32_t state;			/* VANESSA_SOCKET_SCOREBOARD_* */
+	int32_t pid;
+	uint32_t __pad;
+	uint64_t start;			/* Accepted, microseconds since
+					 * the epoch */
+	uint64_t bytes[2];		/* Read from rfd_a and rfd_b of
+					 * vanessa_socket_pipe_func(), by
+					 * VANESSA_SOCKET_TRACE_A and _B */
+	struct sockaddr_storage from;	/* Client */
+	struct sockaddr_storage to;	/* Address the client connected to */
+	struct sockaddr_storage server;	/* Family 0 until connecting */
+} vanessa_socket_scoreboard_slot_t;
+
+typedef struct vanessa_socket_scoreboard_struct vanessa_socket_scoreboard_t;
+
+
+/**********************************************************************
+ * vanessa_socket_scoreboard_create
+ * Create a scoreboard
+ * pre: path: file to map the scoreboard to, NULL for memory that is
+ *            only shared with children
+ *      nslot: number of slots, children forked while all are in use
+ *             do not get one
+ * post: path is created, or truncated, and sized for the slots
+ * return: scoreboard with all slots free
+ *         NULL on error
+ **********************************************************************/
+
+vanessa_socket_scoreboard_t *
+vanessa_socket_scoreboard_create(const char *path, unsigned int nslot);
+
+
+/**********************************************************************
+ * vanessa_socket_scoreboard_open
+ * Open a scoreboard created by another process, to read it
+ * pre: path: file passed to vanessa_socket_scoreboard_create()
+ * return: scoreboard, which may only be passed to
+ *         vanessa_socket_scoreboard_nslot(), _read() and _destroy()
+ *         NULL on error, including if path is not a scoreboard
+ **********************************************************************/
+
+vanessa_socket_scoreboard_t *vanessa_socket_scoreboard_open(const char *path);
+
+
+/**********************************************************************
+ * vanessa_socket_scoreboard_destroy
+ * Destroy a scoreboard
+ * pre: sb: scoreboard
+ * post: sb is unmapped and freed. Its file, if any, is left alone.
+ **********************************************************************/
+
+void vanessa_socket_scoreboard_destroy(vanessa_socket_scoreboard_t *sb);
+
+
+/**********************************************************************
+ * vanessa_socket_scoreboard_nslot
+ * Get the number of slots of a scoreboard
+ * pre: sb: scoreboard
+ * return: number of slots
+ **********************************************************************/
+
+unsigned int vanessa_socket_scoreboard_nslot(vanessa_socket_scoreboard_t *sb);
+
+
+/**********************************************************************
+ * vanessa_socket_scoreboard_read
+ * Take a consistent copy of a slot
+ * pre: sb: scoreboard
+ *      i: index of the slot, less than vanessa_socket_scoreboard_nslot()
+ *      slot: where to store the copy
+ * post: slot is filled in. Does not make any system calls. If the
+ *       slot was being written to throughout, as when a child is
+ *       stopped part way through, the copy may be inconsistent and
+ *       its seq is odd.
+ * return: 0 on success
+ *         -1 if i is out of range
+ **********************************************************************/
+
+int vanessa_socket_scoreboard_read(vanessa_socket_scoreboard_t *sb,
+				   unsigned int i,
+				   vanessa_socket_scoreboard_slot_t *slot);
+
+
+/**********************************************************************
+ * vanessa_socket_scoreboard_claim
+ * vanessa_socket_scoreboard_child
+ * vanessa_socket_scoreboard_reap
+ * Give a slot to a child process for the connection it serves, and
+ * take it back. Used by the server functions, in the parent.
+ * pre: sb: scoreboard
+ *      slot: from vanessa_socket_scoreboard_claim(), may be -1
+ *      pid: process id of the child, -1 if fork() failed
+ * post: vanessa_socket_scoreboard_claim(): a free slot is taken
+ *       vanessa_socket_scoreboard_child(): slot is recorded as held
+ *       by pid, or freed again if pid is -1
+ *       vanessa_socket_scoreboard_reap(): the slot held by pid, if
+ *       any, is cleared and freed
+ *       Not safe to call from a signal handler that interrupts other
+ *       calls on sb, block the signal around them.
+ * return: vanessa_socket_scoreboard_claim(): index of the slot
+ *         -1 if all slots are in use
+ **********************************************************************/
+
+int vanessa_socket_scoreboard_claim(vanessa_socket_scoreboard_t *sb);
+void vanessa_socket_scoreboard_child(vanessa_socket_scoreboard_t *sb,
+				     int slot, pid_t pid);
+void vanessa_socket_scoreboard_reap(vanessa_socket_scoreboard_t *sb,
+				    pid_t pid);
+
+
+/**********************************************************************
+ * vanessa_socket_scoreboard_enter
+ * Start publishing to a slot, in the child that was given it
+ * pre: sb: scoreboard
+ *      slot: from vanessa_socket_scoreboard_claim(), may be -1
+ *      from: address of the client
+ *      to: address the client connected to, NULL if not known
+ * post: The slot is filled in for the calling process, in state
+ *       VANESSA_SOCKET_SCOREBOARD_ACCEPT. From then on
+ *       vanessa_socket_client_src_open(), vanessa_socket_pipe_func()
+ *       and the functions that use them, and the functions below,
+ *       publish to it.
+ **********************************************************************/
+
+void vanessa_socket_scoreboard_enter(vanessa_socket_scoreboard_t *sb,
+				     int slot, const struct sockaddr *from,
+				     const struct sockaddr *to);
+
+
+/**********************************************************************
+ * vanessa_socket_scoreboard_state
+ * vanessa_socket_scoreboard_peer
+ * vanessa_socket_scoreboard_server
+ * vanessa_socket_scoreboard_bytes
+ * Publish to the slot of the calling process, if it has one
+ * pre: state: VANESSA_SOCKET_SCOREBOARD_*
+ *      from: address of the client, for example as given by the PROXY
+ *            protocol
+ *      to: address the client connected to
+ *      server: address of the server
+ *      side: VANESSA_SOCKET_TRACE_A or VANESSA_SOCKET_TRACE_B
+ *      bytes: number of bytes read from side, for callers that relay
+ *             data themselves rather than using
+ *             vanessa_socket_pipe_func()
+ * post: The state, addresses or byte count of the slot are set
+ **********************************************************************/
+
+void vanessa_socket_scoreboard_state(uint32_t state);
+void vanessa_socket_scoreboard_peer(const struct sockaddr *from,
+				    const struct sockaddr *to);
+void vanessa_socket_scoreboard_server(const struct sockaddr *server);
+void vanessa_socket_scoreboard_bytes(int side, size_t bytes);
+
+
+/**********************************************************************
+ * vanessa_socket_server_scoreboard
+ * Give the children of the server functions slots in a scoreboard
+ * pre: sb: scoreboard, NULL for none
+ * post: vanessa_socket_server_accept(), _acceptv() and the functions
+ *       that use them claim a slot for each child they fork, which
+ *       enters it. Slots are taken back by
+ *       vanessa_socket_handler_reaper() and
+ *       vanessa_socket_server_drain().
+ **********************************************************************/
+
+void vanessa_socket_server_scoreboard(vanessa_socket_scoreboard_t *sb);
+
+
+/**********************************************************************
+ * Resource usage of children
+ *
+ * The resources used by each child that is reaped by
+ * vanessa_socket_handler_reaper_rusage() or
+ * vanessa_socket_server_drain() are added up, so that the cost of
+ * serving a connection in its own process can be seen. Histograms
+ * count children by the CPU time and largest resident set size they
+ * used. Bucket i holds those up to the bound of
+ * VANESSA_SOCKET_RUSAGE_CPU_MIN or _RSS_MIN shifted left by i, the
+ * last bucket holds the rest.
+ **********************************************************************/
+
+#define VANESSA_SOCKET_RUSAGE_BUCKETS 16
+#define VANESSA_SOCKET_RUSAGE_CPU_MIN 100	/* Microseconds */
+#define VANESSA_SOCKET_RUSAGE_RSS_MIN 1024	/* KiB */
+
+typedef struct {
+	uint64_t exited;		/* Children that exited with 0 */
+	uint64_t failed;		/* Exited with another status */
+	uint64_t signaled;		/* Were killed by a signal */
+	uint64_t utime;			/* User CPU time, microseconds */
+	uint64_t stime;			/* System CPU time, microseconds */
+	uint64_t nvcsw;			/* Voluntary context switches */
+	uint64_t nivcsw;		/* Involuntary context switches */
+	uint64_t maxrss;		/* Sum of max resident set size, KiB */
+	uint64_t cpu_max;		/* Most CPU time of a child */
+	uint64_t maxrss_max;		/* Largest max RSS of a child */
+	uint64_t cpu[VANESSA_SOCKET_RUSAGE_BUCKETS];
+	uint64_t rss[VANESSA_SOCKET_RUSAGE_BUCKETS];
+} vanessa_socket_rusage_t;
+
+
+/**********************************************************************
+ * vanessa_socket_rusage_add
+ * Account for a child that has been reaped
+ * pre: status: exit status from wait4() or waitpid()
+ *      ru: resource usage of the child, from wait4()
+ * post: The child is added to the totals and histograms. Safe to call
+ *       from a signal handler, for callers that reap children
+ *       themselves.
+ **********************************************************************/
+
+void vanessa_socket_rusage_add(int status, const struct rusage *ru);
+
+
+/**********************************************************************
+ * vanessa_socket_rusage_get
+ * Get the resource usage of children reaped so far
+ * pre: r: where to store the totals
+ * post: r is filled in. Children are not added part way through if
+ *       the caller is the thread that they are reaped in, otherwise
+ *       the copy may be taken while one is.
+ **********************************************************************/
+
+void vanessa_socket_rusage_get(vanessa_socket_rusage_t *r);
+
+
+/**********************************************************************
+ * PROXY protocol
+ *
+ * Version 2 of the PROXY protocol prefixes a connection with a binary
+ * header that carries the addresses of the connection it was relayed
+ * from, so that a server behind a proxy can see the real client.
+ **********************************************************************/
+
+/* Longest header built by vanessa_socket_proxy_v2_build() */
+#define VANESSA_SOCKET_PROXY_V2_MAX (16 + 216)
+
+
+/**********************************************************************
+ * vanessa_socket_proxy_v2_build
+ * Build a PROXY protocol version 2 header
+ * pre: buf: buffer to build the header in
+ *      len: length of buf, VANESSA_SOCKET_PROXY_V2_MAX is enough
+ *      from: address of the client. AF_INET, AF_INET6 or AF_UNIX.
+ *            If NULL, or of some other family, the header carries
+ *            no addresses.
+ *      to: local address the client connected to, of the same family
+ *          as from. Must not be NULL if from is not NULL.
+ * post: The header is written to buf
+ * return: length of the header
+ *         -1 on error, errno is EINVAL if from is given without to
+ **********************************************************************/
+
+ssize_t vanessa_socket_proxy_v2_build(char *buf, size_t len,
+				      const struct sockaddr *from,
+				      const struct sockaddr *to);
+
+
+/**********************************************************************
+ * vanessa_socket_proxy_v2_parse
+ * Parse a PROXY protocol version 2 header
+ * pre: buf: data received at the start of a connection
+ *      len: length of data in buf
+ *      from: address of the client, as seen by this host
+ *      to: local address the client connected to
+ * post: If the header is complete and carries addresses, from and to
+ *       are overwritten with them. Otherwise they are left as is.
+ * return: length of the header, data after it is from the client
+ *         0 if more data is needed
+ *         -1 if buf does not start with a valid header
+ **********************************************************************/
+
+ssize_t vanessa_socket_proxy_v2_parse(const char *buf, size_t len,
+				      struct sockaddr_storage *from,
+				      struct sockaddr_storage *to);
+
+
+/**********************************************************************
+ * vanessa_socket_proxy_v2_send
+ * Write a PROXY protocol version 2 header
+ * pre: fd: file descriptor to write to, which should block
+ *      from: address of the client
+ *      to: local address the client connected to
+ * post: A header built by vanessa_socket_proxy_v2_build() is written
+ * return: 0 on success
+ *         -1 on error
+ **********************************************************************/
+
+int vanessa_socket_proxy_v2_send(int fd, const struct sockaddr *from,
+				 const struct sockaddr *to);
+
+
+/**********************************************************************
+ * vanessa_socket_proxy_v2_recv
+ * Read a PROXY protocol version 2 header
+ * pre: fd: file descriptor to read from, which should block
+ *      from: address of the client, as seen by this host
+ *      to: local address the client connected to
+ *      timeout: seconds to wait for the whole header
+ *               0 to wait forever
+ * post: Exactly the header is read from fd, so that the data that
+ *       follows may be relayed. from and to are updated as per
+ *       vanessa_socket_proxy_v2_parse().
+ * return: 0 on success
+ *         -1 on error, including if there is no valid header or
+ *         if it does not arrive within timeout
+ **********************************************************************/
+
+int vanessa_socket_proxy_v2_recv(int fd, struct sockaddr_storage *from,
+				 struct sockaddr_storage *to, int timeout);
+
+
+/**********************************************************************
+ * Lifecycle tracing
+ *
+ * A trace holds the times that a session reached each point of its
+ * life, from CLOCK_MONOTONIC in nanoseconds, or 0 if it has not. Once
+ * a trace is set for a thread vanessa_socket_server_accept() and the
+ * functions that use it, vanessa_socket_client_src_open() and the
+ * functions that use it, and vanessa_socket_pipe_func() fill in the
+ * times for the session they are working on. A forked child inherits
+ * the trace its connection was accepted into.
+ **********************************************************************/
+
+#define VANESSA_SOCKET_TRACE_A 0	/* rfd_a of vanessa_socket_pipe_func() */
+#define VANESSA_SOCKET_TRACE_B 1	/* rfd_b of vanessa_socket_pipe_func() */
+
+typedef struct {
+	uint64_t accept;	/* accept() returned, the trace is cleared */
+	uint64_t open;		/* Opening a connection to the server began */
+	uint64_t resolve;	/* The address of the server was resolved */
+	uint64_t connect;	/* Connected to the server. Not filled in for
+				 * VANESSA_SOCKET_NONBLOCK connections. */
+	uint64_t first[2];	/* First byte read, from a and from b */
+	uint64_t last[2];	/* Last byte read, from a and from b */
+} vanessa_socket_trace_t;
+
+
+/**********************************************************************
+ * vanessa_socket_trace_set
+ * Set the trace for the calling thread
+ * pre: trace: trace to fill in, NULL to stop tracing
+ * return: the trace that was set before
+ **********************************************************************/
+
+vanessa_socket_trace_t *vanessa_socket_trace_set(vanessa_socket_trace_t *trace);
+
+
+/**********************************************************************
+ * vanessa_socket_trace_now
+ * Get the current time, as used for traces
+ * return: time from CLOCK_MONOTONIC in nanoseconds
+ **********************************************************************/
+
+uint64_t vanessa_socket_trace_now(void);
+
+
+/**********************************************************************
+ * vanessa_socket_trace_read
+ * Record that bytes have been read, for callers that relay data
+ * themselves rather than using vanessa_socket_pipe_func()
+ * pre: trace: trace
+ *      side: VANESSA_SOCKET_TRACE_A or VANESSA_SOCKET_TRACE_B
+ * post: The last byte time of side is set to now, and the first byte
+ *       time if it was not set.
+ **********************************************************************/
+
+void vanessa_socket_trace_read(vanessa_socket_trace_t *trace, int side);
+
+
+/**********************************************************************
+ * vanessa_socket_tcp_info
+ * Get the state of a TCP connection from the kernel
+ * pre: fd: TCP socket
+ *      info: where to store the state
+ * post: info is filled in. Fields that the kernel does not report
+ *       are 0. Linux only.
+ * return: 0 on success
+ *         -1 on error, including if fd is not a TCP socket
+ **********************************************************************/
+
+typedef struct {
+	uint32_t rtt;		/* Smoothed round trip time, microseconds */
+	uint32_t rttvar;	/* Variance of rtt, microseconds */
+	uint32_t retrans;	/* Segments retransmitted, in total */
+	uint32_t cwnd;		/* Congestion window, in segments */
+	uint32_t unacked;	/* Bytes sent but not yet acknowledged */
+	uint64_t delivery_rate;	/* Recent bytes a second, 0 if unknown */
+} vanessa_socket_tcp_info_t;
+
+int vanessa_socket_tcp_info(int fd, vanessa_socket_tcp_info_t *info);
+
+
+/**********************************************************************
+ * vanessa_socket_tcp_tune
+ * Size the kernel buffers that data relayed from one TCP connection
+ * to another passes through to suit the bandwidth-delay product
+ * pre: in: TCP socket that data is read from
+ *      out: TCP socket that the data is written to
+ *      min: smallest buffer to set, in bytes
+ *      max: largest buffer to set, in bytes
+ * post: The delivery rate of out and round trip times of in and out
+ *       are read using TCP_INFO. SO_SNDBUF of out and SO_RCVBUF of in
+ *       are set to twice the product of the delivery rate and their
+ *       round trip time, limited to min and max. Buffers are only
+ *       grown, those that are already that size, or within a quarter
+ *       of it, are left alone. Nothing is set until a delivery rate
+ *       has been measured. Intended to be called from time to time as
+ *       a session runs. Once a buffer has been set the kernel stops
+ *       tuning it itself. Without CAP_NET_ADMIN Linux limits sizes to
+ *       net.core.wmem_max and net.core.rmem_max, and a buffer that
+ *       would be clamped is left at least as large as it was.
+ *       Linux only.
+ * return: 0 on success
+ *         1 if a buffer was clamped by the kernel, in which case there
+ *           is little point in calling this again for in and out
+ *         -1 on error, including if in or out is not a TCP socket
+ **********************************************************************/
+
+int vanessa_socket_tcp_tune(int in, int out, int min, int max);
+
+
 /**********************************************************************
  * vanessa_socket_server_reaper
  * A signal handler that waits for SIGCHLD and runs wait3 to free
@@ -854,6 +2177,32 @@ void vanessa_socket_daemon_exit_cleanly(int i);
 void vanessa_socket_handler_noop(int sig);
 
 
+/**********************************************************************
+ * vanessa_socket_handler_drain
+ * A signal handler that stops a server from accepting connections,
+ * so that it can wait for the connections it has to finish using
+ * vanessa_socket_server_drain(). Designed to listen for SIGTERM.
+ * pre: sig: signal recieved by the process
+ * post: vanessa_socket_server_drain_start() is called
+ *       Signal handler for sig reset
+ **********************************************************************/
+
+void vanessa_socket_handler_drain(int sig);
+
+
+/**********************************************************************
+ * vanessa_socket_handler_reload
+ * A signal handler that makes a server stop waiting for connections,
+ * so that it can reload its settings and carry on accepting them.
+ * Designed to listen for SIGHUP.
+ * pre: sig: signal recieved by the process
+ * post: vanessa_socket_server_reload_start() is called
+ *       Signal handler for sig reset
+ **********************************************************************/
+
+void vanessa_socket_handler_reload(int sig);
+
+
 /**********************************************************************
  * vanessa_socket_handler_reaper
  * A signal handler that waits for a signal and runs wait3 to free
@@ -866,4 +2215,17 @@ void vanessa_socket_handler_noop(int sig);
 
 void vanessa_socket_handler_reaper(int sig);
 
+
+/**********************************************************************
+ * vanessa_socket_handler_reaper_rusage
+ * As vanessa_socket_handler_reaper(), but using wait4 and adding the
+ * exit status and resource usage of each child reaped to the totals
+ * read by vanessa_socket_rusage_get()
+ * pre: sig: signal is recieved by the process
+ * post: Resources of any exited children are freed and accounted for
+ *       Signal Handler for signal reset
+ **********************************************************************/
+
+void vanessa_socket_handler_reaper_rusage(int sig);
+
 #endif
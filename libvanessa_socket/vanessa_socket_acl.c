@@ -0,0 +1,400 @@
+/**********************************************************************
+ * vanessa_socket_acl.c                                    October 2026
+ * Simon Horman                                      horms@verge.net.au
+ *
+ * Access control lists of IPv4 and IPv6 prefixes
+ *
+ * vanessa_socket
+ * Library to simplify handling of TCP sockets
+ * Copyright (C) 1999-2008  Simon Horman <horms@verge.net.au>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307 USA
+ *
+ **********************************************************************/
+
+#include "vanessa_socket.h"
+
+/*
+ * Prefixes are kept in a path compressed binary trie, one for IPv4 and
+ * one for IPv6. Each node holds a prefix and, if the prefix was added,
+ * its action. A node only exists where a prefix was added or where two
+ * branches part, so a lookup visits at most one node for each added
+ * prefix that the address falls in, plus the branch points between
+ * them, and no more than 33 or 129 nodes. The action of the longest
+ * matching prefix wins.
+ *
+ * Nodes live in an array, linked by index, that grows as prefixes are
+ * added. Lists are not changed once they are in use, a new list is
+ * built and swapped in instead.
+ */
+
+#define __VANESSA_SOCKET_ACL_NIL  0xffffffffU
+#define __VANESSA_SOCKET_ACL_NONE (-1)		/* Node has no action */
+#define __VANESSA_SOCKET_ACL_ROOT4 0
+#define __VANESSA_SOCKET_ACL_ROOT6 1
+
+typedef struct {
+	uint32_t key[4];		/* Host byte order, masked to plen */
+	uint32_t child[2];
+	uint8_t plen;
+	int8_t action;
+} __vanessa_socket_acl_node_t;
+
+struct vanessa_socket_acl_struct {
+	__vanessa_socket_acl_node_t *node;
+	uint32_t nnode;
+	uint32_t size;
+	int action;			/* If no prefix matches */
+};
+
+
+static inline int __vanessa_socket_acl_bit(const uint32_t *key,
+					   unsigned int bit)
+{
+	return (key[bit >> 5] >> (31 - (bit & 31))) & 1;
+}
+
+
+/**********************************************************************
+ * __vanessa_socket_acl_common
+ * Length of the common prefix of two keys
+ * pre: a, b: keys
+ *      max: most bits to compare
+ * return: number of leading bits that a and b share, at most max
+ **********************************************************************/
+
+static unsigned int __vanessa_socket_acl_common(const uint32_t *a,
+						const uint32_t *b,
+						unsigned int max)
+{
+	unsigned int i, n;
+	uint32_t x;
+
+	for (i = 0; i * 32 < max; i++) {
+		x = a[i] ^ b[i];
+		if (x) {
+			n = i * 32 + __builtin_clz(x);
+			return n < max ? n : max;
+		}
+	}
+	return max;
+}
+
+
+static inline int __vanessa_socket_acl_match(const uint32_t *key,
+					     const __vanessa_socket_acl_node_t
+					     *n)
+{
+	unsigned int i, plen = n->plen;
+
+	for (i = 0; plen >= 32; i++, plen -= 32)
+		if (key[i] != n->key[i])
+			return 0;
+	return !plen || !((key[i] ^ n->key[i]) >> (32 - plen));
+}
+
+
+static void __vanessa_socket_acl_mask(uint32_t *key, unsigned int plen)
+{
+	unsigned int i;
+
+	for (i = 0; i < 4; i++, plen = plen > 32 ? plen - 32 : 0) {
+		if (!plen)
+			key[i] = 0;
+		else if (plen < 32)
+			key[i] &= ~(0xffffffffU >> plen);
+	}
+}
+
+
+static uint32_t __vanessa_socket_acl_node_new(vanessa_socket_acl_t *acl,
+					      const uint32_t *key,
+					      unsigned int plen, int action)
+{
+	__vanessa_socket_acl_node_t *n;
+	uint32_t size;
+
+	if (acl->nnode == acl->size) {
+		size = acl->size * 2;
+		n = realloc(acl->node, size * sizeof(*n));
+		if (!n) {
+			VANESSA_LOGGER_DEBUG_ERRNO("realloc");
+			return __VANESSA_SOCKET_ACL_NIL;
+		}
+		acl->node = n;
+		acl->size = size;
+	}
+
+	n = acl->node + acl->nnode;
+	memcpy(n->key, key, sizeof(n->key));
+	__vanessa_socket_acl_mask(n->key, plen);
+	n->child[0] = n->child[1] = __VANESSA_SOCKET_ACL_NIL;
+	n->plen = plen;
+	n->action = action;
+
+	return acl->nnode++;
+}
+
+
+/**********************************************************************
+ * __vanessa_socket_acl_key
+ * Get the key and root node for an address
+ * pre: from: address
+ *      key: where to store the key
+ * post: IPv4 mapped IPv6 addresses are looked up as IPv4 addresses
+ * return: index of the root node
+ *         __VANESSA_SOCKET_ACL_NIL if from is not AF_INET or AF_INET6
+ **********************************************************************/
+
+static uint32_t __vanessa_socket_acl_key(const struct sockaddr *from,
+					 uint32_t *key)
+{
+	const uint8_t *a;
+	int i;
+
+	memset(key, 0, sizeof(uint32_t) * 4);
+
+	if (from->sa_family == AF_INET) {
+		key[0] = ntohl(((struct sockaddr_in *)from)->sin_addr.s_addr);
+		return __VANESSA_SOCKET_ACL_ROOT4;
+	}
+	if (from->sa_family != AF_INET6)
+		return __VANESSA_SOCKET_ACL_NIL;
+
+	a = ((struct sockaddr_in6 *)from)->sin6_addr.s6_addr;
+	for (i = 0; i < 4; i++)
+		key[i] = (uint32_t)a[i * 4] << 24 | (uint32_t)a[i * 4 + 1] << 16 |
+			 (uint32_t)a[i * 4 + 2] << 8 | a[i * 4 + 3];
+	if (!key[0] && !key[1] && key[2] == 0xffff) {
+		key[0] = key[3];
+		key[2] = key[3] = 0;
+		return __VANESSA_SOCKET_ACL_ROOT4;
+	}
+	return __VANESSA_SOCKET_ACL_ROOT6;
+}
+
+
+/**********************************************************************
+ * vanessa_socket_acl_create
+ * Create an empty access control list
+ * pre: action: VANESSA_SOCKET_ACL_ALLOW or VANESSA_SOCKET_ACL_DENY,
+ *              for addresses that match no prefix
+ * return: list
+ *         NULL on error
+ **********************************************************************/
+
+vanessa_socket_acl_t *vanessa_socket_acl_create(int action)
+{
+	vanessa_socket_acl_t *acl;
+	uint32_t zero[4] = { 0, 0, 0, 0 };
+
+	acl = calloc(1, sizeof(*acl));
+	if (!acl) {
+		VANESSA_LOGGER_DEBUG_ERRNO("calloc");
+		return NULL;
+	}
+
+	acl->size = 64;
+	acl->node = malloc(acl->size * sizeof(*acl->node));
+	if (!acl->node) {
+		VANESSA_LOGGER_DEBUG_ERRNO("malloc");
+		free(acl);
+		return NULL;
+	}
+	acl->action = action;
+
+	/* Roots, for IPv4 and IPv6 */
+	__vanessa_socket_acl_node_new(acl, zero, 0, __VANESSA_SOCKET_ACL_NONE);
+	__vanessa_socket_acl_node_new(acl, zero, 0, __VANESSA_SOCKET_ACL_NONE);
+
+	return acl;
+}
+
+
+/**********************************************************************
+ * vanessa_socket_acl_destroy
+ * Destroy an access control list
+ * pre: acl: list
+ * post: acl is freed
+ **********************************************************************/
+
+void vanessa_socket_acl_destroy(vanessa_socket_acl_t *acl)
+{
+	if (!acl)
+		return;
+	free(acl->node);
+	free(acl);
+}
+
+
+/**********************************************************************
+ * vanessa_socket_acl_add
+ * Add a prefix to an access control list
+ * pre: acl: list
+ *      prefix: IPv4 or IPv6 address, optionally followed by /length
+ *      action: VANESSA_SOCKET_ACL_ALLOW or VANESSA_SOCKET_ACL_DENY
+ * post: prefix is added with action, replacing its action if it has
+ *       already been added. Bits of the address after the prefix
+ *       length are ignored.
+ * return: 0 on success
+ *         -1 on error
+ **********************************************************************/
+
+int vanessa_socket_acl_add(vanessa_socket_acl_t *acl, const char *prefix,
+			   int action)
+{
+	struct sockaddr_storage ss;
+	char addr[INET6_ADDRSTRLEN];
+	const char *slash;
+	size_t len;
+	char *end;
+	unsigned long plen;
+	unsigned int max, common;
+	uint32_t key[4];
+	uint32_t i, c, n, m;
+	int bit;
+
+	memset(&ss, 0, sizeof(ss));
+	slash = strchr(prefix, '/');
+	len = slash ? (size_t)(slash - prefix) : strlen(prefix);
+	if (len >= sizeof(addr))
+		goto bad;
+	memcpy(addr, prefix, len);
+	addr[len] = '\0';
+
+	if (inet_pton(AF_INET, addr,
+		      &((struct sockaddr_in *)&ss)->sin_addr) > 0) {
+		ss.ss_family = AF_INET;
+		max = 32;
+	} else if (inet_pton(AF_INET6, addr,
+			     &((struct sockaddr_in6 *)&ss)->sin6_addr) > 0) {
+		ss.ss_family = AF_INET6;
+		max = 128;
+	} else
+		goto bad;
+
+	plen = max;
+	if (slash) {
+		plen = strtoul(slash + 1, &end, 10);
+		if (!slash[1] || *end || plen > max)
+			goto bad;
+	}
+
+	i = __vanessa_socket_acl_key((struct sockaddr *)&ss, key);
+	if (i == __VANESSA_SOCKET_ACL_ROOT4 && max == 128) {
+		/* An IPv4 mapped prefix */
+		if (plen < 96)
+			goto bad;
+		plen -= 96;
+	}
+	__vanessa_socket_acl_mask(key, plen);
+
+	for (;;) {
+		if (acl->node[i].plen == plen) {
+			acl->node[i].action = action;
+			return 0;
+		}
+
+		bit = __vanessa_socket_acl_bit(key, acl->node[i].plen);
+		c = acl->node[i].child[bit];
+		if (c == __VANESSA_SOCKET_ACL_NIL) {
+			n = __vanessa_socket_acl_node_new(acl, key, plen,
+							  action);
+			if (n == __VANESSA_SOCKET_ACL_NIL)
+				return -1;
+			acl->node[i].child[bit] = n;
+			return 0;
+		}
+
+		common = __vanessa_socket_acl_common(key, acl->node[c].key,
+				plen < acl->node[c].plen ?
+				plen : acl->node[c].plen);
+		if (common == acl->node[c].plen) {
+			i = c;
+			continue;
+		}
+
+		/* The prefix parts from c, or is above it */
+		if (common == plen) {
+			n = __vanessa_socket_acl_node_new(acl, key, plen,
+							  action);
+			if (n == __VANESSA_SOCKET_ACL_NIL)
+				return -1;
+		} else {
+			n = __vanessa_socket_acl_node_new(acl, key, common,
+					__VANESSA_SOCKET_ACL_NONE);
+			if (n == __VANESSA_SOCKET_ACL_NIL)
+				return -1;
+			m = __vanessa_socket_acl_node_new(acl, key, plen,
+							  action);
+			if (m == __VANESSA_SOCKET_ACL_NIL)
+				return -1;
+			acl->node[n].child[__vanessa_socket_acl_bit(key,
+							common)] = m;
+		}
+		acl->node[n].child[__vanessa_socket_acl_bit(acl->node[c].key,
+							    common)] = c;
+		acl->node[i].child[bit] = n;
+		return 0;
+	}
+
+bad:
+	VANESSA_LOGGER_DEBUG_UNSAFE("invalid prefix: %s", prefix);
+	return -1;
+}
+
+
+/**********************************************************************
+ * vanessa_socket_acl_check
+ * Look up the action for an address
+ * pre: acl: list
+ *      from: address
+ * return: the action of the longest prefix that from falls in, or the
+ *         action acl was created with if there is none.
+ *         VANESSA_SOCKET_ACL_ALLOW if from is not AF_INET or AF_INET6.
+ **********************************************************************/
+
+int vanessa_socket_acl_check(const vanessa_socket_acl_t *acl,
+			     const struct sockaddr *from)
+{
+	const __vanessa_socket_acl_node_t *n;
+	uint32_t key[4];
+	unsigned int max;
+	uint32_t i;
+	int action;
+
+	i = __vanessa_socket_acl_key(from, key);
+	if (i == __VANESSA_SOCKET_ACL_NIL)
+		return VANESSA_SOCKET_ACL_ALLOW;
+	max = i == __VANESSA_SOCKET_ACL_ROOT4 ? 32 : 128;
+
+	action = acl->action;
+	n = acl->node + i;
+	for (;;) {
+		if (n->action != __VANESSA_SOCKET_ACL_NONE)
+			action = n->action;
+		if (n->plen == max)
+			break;
+		i = n->child[__vanessa_socket_acl_bit(key, n->plen)];
+		if (i == __VANESSA_SOCKET_ACL_NIL)
+			break;
+		n = acl->node + i;
+		if (!__vanessa_socket_acl_match(key, n))
+			break;
+	}
+
+	return action;
+}
@@ -27,6 +27,8 @@
 
 #include "vanessa_socket.h"
 
+#include <errno.h>
+
 
 /**********************************************************************
  * vanessa_socket_client_open_sockaddr_in
@@ -159,6 +161,77 @@ int vanessa_socket_client_open_src_sockaddr_in(struct sockaddr_in from,
 
 
 
+/**********************************************************************
+ * __vanessa_socket_client_nonblock
+ * Make a socket non-blocking
+ * pre: s: socket
+ * post: O_NONBLOCK is set on s
+ * return: 0 on success
+ *         -1 on error
+ **********************************************************************/
+
+static int __vanessa_socket_client_nonblock(int s)
+{
+	long opt;
+
+	opt = fcntl(s, F_GETFL, NULL);
+	if (opt < 0) {
+		VANESSA_LOGGER_DEBUG_ERRNO("fcntl: F_GETFL");
+		return -1;
+	}
+	if (fcntl(s, F_SETFL, opt | O_NONBLOCK) < 0) {
+		VANESSA_LOGGER_DEBUG_ERRNO("fcntl: F_SETFL");
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/**********************************************************************
+ * __vanessa_socket_client_open_unix
+ * Open a unix domain socket connection as a client
+ * pre: dst_host: "unix:/path" or "unix:@name"
+ *      flag: If VANESSA_SOCKET_NONBLOCK then the socket is non-blocking
+ * post: socket is opened
+ * return: open socket
+ *         -1 on error
+ **********************************************************************/
+
+static int __vanessa_socket_client_open_unix(const char *dst_host,
+					     const vanessa_socket_flag_t flag)
+{
+	int s;
+	struct sockaddr_un addr;
+	socklen_t addrlen;
+
+	if (vanessa_socket_unix_sockaddr(dst_host, &addr, &addrlen) < 0) {
+		VANESSA_LOGGER_DEBUG("vanessa_socket_unix_sockaddr");
+		return -1;
+	}
+
+	if ((s = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		VANESSA_LOGGER_DEBUG_ERRNO("socket");
+		return -1;
+	}
+
+	if (flag & VANESSA_SOCKET_NONBLOCK &&
+	    __vanessa_socket_client_nonblock(s) < 0)
+		goto err;
+
+	if (connect(s, (struct sockaddr *)&addr, addrlen) < 0) {
+		VANESSA_LOGGER_DEBUG_ERRNO("connect");
+		goto err;
+	}
+
+	return s;
+err:
+	if (close(s) < 0)
+		VANESSA_LOGGER_DEBUG_ERRNO("warning: close");
+	return -1;
+}
+
+
 /**********************************************************************
  * vanessa_socket_client_src_open
  * Open a socket connection as a client
@@ -169,6 +242,9 @@ int vanessa_socket_client_open_src_sockaddr_in(struct sockaddr_in from,
  *                If NULL then the operating system will select
  *                an appropriate source port.
  *      dst_host: hostname or ipaddress to open socket to
+ *                If of the form "unix:/path" or "unix:@name" then
+ *                a unix domain socket is opened and src_host,
+ *                src_port and dst_port are ignored.
  *      dst_port: name or number to open
  *      flag: Logical or of VANESSA_SOCKET_NO_LOOKUP and 
  *            VANESSA_SOCKET_NO_FROM
@@ -179,6 +255,13 @@ int vanessa_socket_client_open_src_sockaddr_in(struct sockaddr_in from,
  *            source address and port
  *            If flag&VANESSA_SOCKET_TCP_KEEPALIVE then turn on
  *            TCP-Keepalive
+ *            If flag&VANESSA_SOCKET_PROTO_UDP then a datagram socket
+ *            is opened, connect() only sets its default destination
+ *            If flag&VANESSA_SOCKET_NONBLOCK then the socket is
+ *            non-blocking and it is returned as soon as the connection
+ *            is in progress. Completion should be checked for using
+ *            SO_ERROR once the socket is writable. Later addresses
+ *            of dst_host are not tried if it fails.
  * post: socket is opened
  * return: open socket
  *         -1 on error
@@ -194,13 +277,37 @@ int vanessa_socket_client_src_open(const char *src_host,
 	struct addrinfo hints, *dst_ai, *src_ai;
 	struct addrinfo *dst_res = NULL, *src_res = NULL;
 	int g;
+	struct sockaddr_storage peer;
+	socklen_t peerlen;
+	extern __thread vanessa_socket_trace_t *__vanessa_socket_trace;
+	extern vanessa_socket_scoreboard_slot_t *__vanessa_socket_scoreboard_self;
+
+	if (__vanessa_socket_trace)
+		__vanessa_socket_trace->open = vanessa_socket_trace_now();
+	if (__vanessa_socket_scoreboard_self)
+		vanessa_socket_scoreboard_state(
+			VANESSA_SOCKET_SCOREBOARD_CONNECT);
+
+	if (vanessa_socket_host_is_unix(dst_host)) {
+		s = __vanessa_socket_client_open_unix(dst_host, flag);
+		if (s >= 0 && __vanessa_socket_trace &&
+		    !(flag & VANESSA_SOCKET_NONBLOCK))
+			__vanessa_socket_trace->connect =
+				vanessa_socket_trace_now();
+		peerlen = sizeof(peer);
+		if (s >= 0 && __vanessa_socket_scoreboard_self &&
+		    !getpeername(s, (struct sockaddr *)&peer, &peerlen))
+			vanessa_socket_scoreboard_server(
+				(struct sockaddr *)&peer);
+		return s;
+	}
 
 	src_res = NULL;
 	/* Get sockaddr list for source address */
 	if ((src_host || src_port) && !(flag & VANESSA_SOCKET_NO_FROM)) {
 		bzero(&hints, sizeof(hints));
 		hints.ai_family = AF_UNSPEC;
-		hints.ai_socktype = SOCK_STREAM;
+		hints.ai_socktype = vanessa_socket_flag_socktype(flag);
 		err = getaddrinfo(src_host, src_port, &hints, &src_res);
 		if (err) {
 			src_res = NULL;
@@ -221,7 +328,7 @@ int vanessa_socket_client_src_open(const char *src_host,
 	/* Get sockaddr list for destination address */
 	bzero(&hints, sizeof(hints));
 	hints.ai_family = AF_UNSPEC;
-	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_socktype = vanessa_socket_flag_socktype(flag);
 	err = getaddrinfo(dst_host, dst_port, &hints, &dst_res);
 	if (err) {
 		dst_res = NULL;
@@ -237,6 +344,8 @@ int vanessa_socket_client_src_open(const char *src_host,
 						    gai_strerror(err));
 		goto err;
 	}
+	if (__vanessa_socket_trace)
+		__vanessa_socket_trace->resolve = vanessa_socket_trace_now();
 
 	/* Try all combinations of destination and source until we get a
 	 * connection.
@@ -257,6 +366,12 @@ int vanessa_socket_client_src_open(const char *src_host,
 				   sizeof g);
 		}
 
+		if (flag & VANESSA_SOCKET_NONBLOCK &&
+		    __vanessa_socket_client_nonblock(s) < 0) {
+			close(s);
+			goto err;
+		}
+
 		src_ai = src_res;
 		/* Run through this loop at least once even if there is no 
 		 * explicit source address.
@@ -272,7 +387,14 @@ int vanessa_socket_client_src_open(const char *src_host,
 			}
 			/* Connect to destination server */
 			if (connect(s, dst_res->ai_addr,
-				    dst_res->ai_addrlen) == 0)
+				    dst_res->ai_addrlen) == 0) {
+				if (__vanessa_socket_trace)
+					__vanessa_socket_trace->connect =
+						vanessa_socket_trace_now();
+				goto out;
+			}
+			if (flag & VANESSA_SOCKET_NONBLOCK &&
+			    errno == EINPROGRESS)
 				goto out;
 			VANESSA_LOGGER_DEBUG_ERRNO("connect");
 		} while (src_ai && (src_ai = src_ai->ai_next));
@@ -287,6 +409,8 @@ int vanessa_socket_client_src_open(const char *src_host,
 err:
 	s = -1;
 out:
+	if (s >= 0 && __vanessa_socket_scoreboard_self)
+		vanessa_socket_scoreboard_server(dst_res->ai_addr);
 	if (dst_res)
 		freeaddrinfo(dst_res);
 	if (src_res)
@@ -0,0 +1,519 @@
+/**********************************************************************
+ * vanessa_socket_flow.c                                   October 2026
+ * Simon Horman                                      horms@verge.net.au
+ *
+ * Table of flows, keyed on their addresses, for datagram proxying
+ *
+ * vanessa_socket
+ * Library to simplify handling of TCP sockets
+ * Copyright (C) 1999-2008  Simon Horman <horms@verge.net.au>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307 USA
+ *
+ **********************************************************************/
+
+#include <time.h>
+
+#include "vanessa_socket.h"
+
+/*
+ * Flows live in an array of entries that is allocated when the table
+ * is created. Unused entries are kept on a free list.
+ *
+ * Lookups are made through an open addressing hash of entry indexes
+ * with linear probing. The hash has at least twice as many slots as
+ * there are entries, and deleted slots are filled in by shifting later
+ * members of their probe sequence back, so no tombstones are needed.
+ *
+ * Entries in use are on an LRU list, most recently used first. When the
+ * table is full the least recently used entry is evicted.
+ *
+ * Idle expiry uses a timer wheel with one slot per second. An entry is
+ * put in the slot for the time it would expire if unused. Using an
+ * entry only updates its last used time, so when its slot comes around
+ * an entry that has been used in the meantime is simply moved to the
+ * slot of its new expiry time.
+ *
+ * Links are entry indexes rather than pointers to keep entries small.
+ */
+
+#define __VANESSA_SOCKET_FLOW_NIL        0xffffffffU
+#define __VANESSA_SOCKET_FLOW_WHEEL_MAX  4096
+
+struct vanessa_socket_flow_table_struct {
+	vanessa_socket_flow_t *entry;
+	unsigned int capacity;
+	unsigned int count;
+	uint32_t *slot;			/* Entry index + 1, 0 if empty */
+	uint32_t slot_mask;
+	uint32_t seed;
+	uint32_t free;
+	uint32_t lru_head;
+	uint32_t lru_tail;
+	uint32_t *wheel;		/* First entry index of each slot */
+	uint32_t wheel_mask;
+	time_t wheel_time;
+	unsigned int idle_timeout;
+	void (*release)(vanessa_socket_flow_t *flow, void *data);
+	void *data;
+};
+
+
+/**********************************************************************
+ * vanessa_socket_flow_key
+ * Fill in a flow key from a pair of addresses
+ * pre: key: key to fill in
+ *      from: address of the client. Must be AF_INET or AF_INET6
+ *      to: local address the client sent to, in the same family as
+ *          from. May be NULL, in which case only from is used
+ * post: key is filled in. Unused bytes are zeroed so that keys
+ *       may be compared and hashed as a whole.
+ * return: 0 on success
+ *         -1 on error
+ **********************************************************************/
+
+int vanessa_socket_flow_key(vanessa_socket_flow_key_t *key,
+			    const struct sockaddr *from,
+			    const struct sockaddr *to)
+{
+	memset(key, 0, sizeof(*key));
+
+	if (to && to->sa_family != from->sa_family) {
+		VANESSA_LOGGER_DEBUG("address family mismatch");
+		return -1;
+	}
+
+	key->family = from->sa_family;
+	switch (from->sa_family) {
+	case AF_INET:
+		memcpy(key->from_addr,
+		       &((struct sockaddr_in *)from)->sin_addr, 4);
+		key->from_port = ((struct sockaddr_in *)from)->sin_port;
+		if (!to)
+			break;
+		memcpy(key->to_addr, &((struct sockaddr_in *)to)->sin_addr, 4);
+		key->to_port = ((struct sockaddr_in *)to)->sin_port;
+		break;
+	case AF_INET6:
+		memcpy(key->from_addr,
+		       &((struct sockaddr_in6 *)from)->sin6_addr, 16);
+		key->from_port = ((struct sockaddr_in6 *)from)->sin6_port;
+		if (!to)
+			break;
+		memcpy(key->to_addr,
+		       &((struct sockaddr_in6 *)to)->sin6_addr, 16);
+		key->to_port = ((struct sockaddr_in6 *)to)->sin6_port;
+		break;
+	default:
+		VANESSA_LOGGER_DEBUG_UNSAFE("unsupported address family: %d",
+					    from->sa_family);
+		return -1;
+	}
+
+	return 0;
+}
+
+
+static uint32_t __vanessa_socket_flow_hash(const vanessa_socket_flow_table_t
+					   *t,
+					   const vanessa_socket_flow_key_t *key)
+{
+	const uint32_t *p = (const uint32_t *)key;
+	uint32_t h = t->seed;
+	size_t i;
+
+	for (i = 0; i < sizeof(*key) / sizeof(*p); i++) {
+		h ^= p[i];
+		h *= 0x9e3779b1U;
+		h ^= h >> 15;
+	}
+	h ^= h >> 13;
+	h *= 0x85ebca6bU;
+	h ^= h >> 16;
+
+	return h;
+}
+
+
+/**********************************************************************
+ * vanessa_socket_flow_table_create
+ * Create a flow table
+ * pre: capacity: maximum number of flows. Space for all of them
+ *                is allocated up front.
+ *      idle_timeout: seconds after its last use that a flow is expired
+ *                    by vanessa_socket_flow_expire(). 0 for no expiry.
+ *      release: called when a flow is removed from the table by
+ *               eviction, expiry or vanessa_socket_flow_table_destroy(),
+ *               for instance to close flow->fd. May be NULL.
+ *      data: opaque data passed to release
+ * return: flow table
+ *         NULL on error
+ **********************************************************************/
+
+vanessa_socket_flow_table_t *
+vanessa_socket_flow_table_create(unsigned int capacity,
+				 unsigned int idle_timeout,
+				 void (*release)(vanessa_socket_flow_t *flow,
+						 void *data),
+				 void *data)
+{
+	vanessa_socket_flow_table_t *t;
+	uint32_t nslot, nwheel;
+	unsigned int i;
+
+	if (!capacity || capacity >= __VANESSA_SOCKET_FLOW_NIL / 4) {
+		VANESSA_LOGGER_DEBUG_UNSAFE("invalid capacity: %u", capacity);
+		return NULL;
+	}
+
+	t = calloc(1, sizeof(*t));
+	if (!t) {
+		VANESSA_LOGGER_DEBUG_ERRNO("calloc");
+		return NULL;
+	}
+	t->lru_head = t->lru_tail = __VANESSA_SOCKET_FLOW_NIL;
+
+	for (nslot = 2; nslot < capacity * 2; nslot <<= 1)
+		;
+	for (nwheel = 1; nwheel <= idle_timeout &&
+	     nwheel < __VANESSA_SOCKET_FLOW_WHEEL_MAX; nwheel <<= 1)
+		;
+
+	t->entry = calloc(capacity, sizeof(*t->entry));
+	t->slot = calloc(nslot, sizeof(*t->slot));
+	t->wheel = malloc(nwheel * sizeof(*t->wheel));
+	if (!t->entry || !t->slot || !t->wheel) {
+		VANESSA_LOGGER_DEBUG_ERRNO("calloc");
+		vanessa_socket_flow_table_destroy(t);
+		return NULL;
+	}
+
+	t->capacity = capacity;
+	t->slot_mask = nslot - 1;
+	t->seed = (uint32_t)time(NULL) ^ ((uint32_t)getpid() << 16) ^
+		  (uint32_t)(unsigned long)t;
+	t->wheel_mask = nwheel - 1;
+	t->idle_timeout = idle_timeout;
+	t->release = release;
+	t->data = data;
+
+	for (i = 0; i < nwheel; i++)
+		t->wheel[i] = __VANESSA_SOCKET_FLOW_NIL;
+	for (i = 0; i < capacity; i++) {
+		t->entry[i].fd = -1;
+		t->entry[i].__lru_next = i + 1 < capacity ?
+					 i + 1 : __VANESSA_SOCKET_FLOW_NIL;
+	}
+	t->free = 0;
+
+	return t;
+}
+
+
+static void __vanessa_socket_flow_lru_unlink(vanessa_socket_flow_table_t *t,
+					     vanessa_socket_flow_t *f)
+{
+	if (f->__lru_prev != __VANESSA_SOCKET_FLOW_NIL)
+		t->entry[f->__lru_prev].__lru_next = f->__lru_next;
+	else
+		t->lru_head = f->__lru_next;
+	if (f->__lru_next != __VANESSA_SOCKET_FLOW_NIL)
+		t->entry[f->__lru_next].__lru_prev = f->__lru_prev;
+	else
+		t->lru_tail = f->__lru_prev;
+}
+
+
+static void __vanessa_socket_flow_lru_push(vanessa_socket_flow_table_t *t,
+					   vanessa_socket_flow_t *f)
+{
+	uint32_t i = f - t->entry;
+
+	f->__lru_prev = __VANESSA_SOCKET_FLOW_NIL;
+	f->__lru_next = t->lru_head;
+	if (t->lru_head != __VANESSA_SOCKET_FLOW_NIL)
+		t->entry[t->lru_head].__lru_prev = i;
+	else
+		t->lru_tail = i;
+	t->lru_head = i;
+}
+
+
+static void __vanessa_socket_flow_wheel_unlink(vanessa_socket_flow_table_t *t,
+					       vanessa_socket_flow_t *f)
+{
+	if (f->__wheel_slot == __VANESSA_SOCKET_FLOW_NIL)
+		return;
+
+	if (f->__wheel_prev != __VANESSA_SOCKET_FLOW_NIL)
+		t->entry[f->__wheel_prev].__wheel_next = f->__wheel_next;
+	else
+		t->wheel[f->__wheel_slot] = f->__wheel_next;
+	if (f->__wheel_next != __VANESSA_SOCKET_FLOW_NIL)
+		t->entry[f->__wheel_next].__wheel_prev = f->__wheel_prev;
+}
+
+
+static void __vanessa_socket_flow_wheel_add(vanessa_socket_flow_table_t *t,
+					    vanessa_socket_flow_t *f)
+{
+	uint32_t i = f - t->entry;
+	uint32_t s;
+
+	if (!t->idle_timeout) {
+		f->__wheel_slot = __VANESSA_SOCKET_FLOW_NIL;
+		return;
+	}
+
+	s = (f->last + t->idle_timeout) & t->wheel_mask;
+	f->__wheel_slot = s;
+	f->__wheel_prev = __VANESSA_SOCKET_FLOW_NIL;
+	f->__wheel_next = t->wheel[s];
+	if (t->wheel[s] != __VANESSA_SOCKET_FLOW_NIL)
+		t->entry[t->wheel[s]].__wheel_prev = i;
+	t->wheel[s] = i;
+}
+
+
+static uint32_t __vanessa_socket_flow_find_slot(vanessa_socket_flow_table_t *t,
+					const vanessa_socket_flow_key_t *key,
+					uint32_t hash)
+{
+	uint32_t s, e;
+
+	for (s = hash & t->slot_mask; (e = t->slot[s]);
+	     s = (s + 1) & t->slot_mask) {
+		if (t->entry[e - 1].__hash == hash &&
+		    !memcmp(&t->entry[e - 1].key, key, sizeof(*key)))
+			return s;
+	}
+
+	return s;
+}
+
+
+static void __vanessa_socket_flow_unhash(vanessa_socket_flow_table_t *t,
+					 vanessa_socket_flow_t *f)
+{
+	uint32_t s, next, home, e;
+
+	s = __vanessa_socket_flow_find_slot(t, &f->key, f->__hash);
+	t->slot[s] = 0;
+
+	/* Shift back later members of the probe sequence that would
+	 * otherwise no longer be reachable from their home slot */
+	for (next = (s + 1) & t->slot_mask; (e = t->slot[next]);
+	     next = (next + 1) & t->slot_mask) {
+		home = t->entry[e - 1].__hash & t->slot_mask;
+		if (((next - home) & t->slot_mask) <
+		    ((next - s) & t->slot_mask))
+			continue;
+		t->slot[s] = e;
+		t->slot[next] = 0;
+		s = next;
+	}
+}
+
+
+static void __vanessa_socket_flow_del(vanessa_socket_flow_table_t *t,
+				      vanessa_socket_flow_t *f, int release)
+{
+	if (release && t->release)
+		t->release(f, t->data);
+
+	__vanessa_socket_flow_unhash(t, f);
+	__vanessa_socket_flow_lru_unlink(t, f);
+	__vanessa_socket_flow_wheel_unlink(t, f);
+
+	f->fd = -1;
+	f->data = NULL;
+	f->__lru_next = t->free;
+	t->free = f - t->entry;
+	t->count--;
+}
+
+
+/**********************************************************************
+ * vanessa_socket_flow_table_destroy
+ * Destroy a flow table
+ * pre: t: flow table
+ * post: release is called for each flow in the table and the
+ *       table is freed
+ **********************************************************************/
+
+void vanessa_socket_flow_table_destroy(vanessa_socket_flow_table_t *t)
+{
+	if (!t)
+		return;
+
+	while (t->lru_head != __VANESSA_SOCKET_FLOW_NIL && t->entry)
+		__vanessa_socket_flow_del(t, t->entry + t->lru_head, 1);
+
+	free(t->entry);
+	free(t->slot);
+	free(t->wheel);
+	free(t);
+}
+
+
+/**********************************************************************
+ * vanessa_socket_flow_lookup
+ * Find a flow and mark it as used
+ * pre: t: flow table
+ *      key: key of flow to find
+ *      now: current time in seconds, from a monotonic clock
+ * post: if found, the flow becomes the most recently used
+ *       and its idle timeout is restarted
+ * return: flow
+ *         NULL if not found
+ **********************************************************************/
+
+vanessa_socket_flow_t *
+vanessa_socket_flow_lookup(vanessa_socket_flow_table_t *t,
+			   const vanessa_socket_flow_key_t *key, time_t now)
+{
+	vanessa_socket_flow_t *f;
+	uint32_t s;
+
+	s = __vanessa_socket_flow_find_slot(t, key,
+					    __vanessa_socket_flow_hash(t, key));
+	if (!t->slot[s])
+		return NULL;
+
+	f = t->entry + t->slot[s] - 1;
+	f->last = now;
+	if (t->lru_head != t->slot[s] - 1) {
+		__vanessa_socket_flow_lru_unlink(t, f);
+		__vanessa_socket_flow_lru_push(t, f);
+	}
+
+	return f;
+}
+
+
+/**********************************************************************
+ * vanessa_socket_flow_insert
+ * Add a flow to a table
+ * pre: t: flow table
+ *      key: key of the flow, which must not already be in the table
+ *      now: current time in seconds, from a monotonic clock
+ * post: If the table is full then the least recently used flow is
+ *       evicted, and release is called for it, to make space.
+ *       The new flow becomes the most recently used. Its fd is -1 and
+ *       its data NULL, for the caller to fill in.
+ * return: flow
+ **********************************************************************/
+
+vanessa_socket_flow_t *
+vanessa_socket_flow_insert(vanessa_socket_flow_table_t *t,
+			   const vanessa_socket_flow_key_t *key, time_t now)
+{
+	vanessa_socket_flow_t *f;
+	uint32_t s;
+
+	if (t->free == __VANESSA_SOCKET_FLOW_NIL)
+		__vanessa_socket_flow_del(t, t->entry + t->lru_tail, 1);
+
+	f = t->entry + t->free;
+	t->free = f->__lru_next;
+	t->count++;
+
+	f->key = *key;
+	f->__hash = __vanessa_socket_flow_hash(t, key);
+	f->last = now;
+	s = __vanessa_socket_flow_find_slot(t, key, f->__hash);
+	t->slot[s] = f - t->entry + 1;
+
+	__vanessa_socket_flow_lru_push(t, f);
+	__vanessa_socket_flow_wheel_add(t, f);
+
+	return f;
+}
+
+
+/**********************************************************************
+ * vanessa_socket_flow_remove
+ * Remove a flow from a table
+ * pre: t: flow table
+ *      flow: flow to remove
+ * post: flow is removed, release is not called
+ **********************************************************************/
+
+void vanessa_socket_flow_remove(vanessa_socket_flow_table_t *t,
+				vanessa_socket_flow_t *flow)
+{
+	__vanessa_socket_flow_del(t, flow, 0);
+}
+
+
+/**********************************************************************
+ * vanessa_socket_flow_expire
+ * Expire idle flows
+ * pre: t: flow table
+ *      now: current time in seconds, from a monotonic clock
+ * post: Flows that have not been used for idle_timeout seconds are
+ *       removed and release is called for them.
+ *       Should be called about once a second, each call handles
+ *       the timer wheel slots for the seconds since the last call.
+ * return: number of flows expired
+ **********************************************************************/
+
+unsigned int vanessa_socket_flow_expire(vanessa_socket_flow_table_t *t,
+					time_t now)
+{
+	vanessa_socket_flow_t *f;
+	uint32_t i, next, s;
+	unsigned int expired = 0;
+
+	if (!t->idle_timeout)
+		return 0;
+
+	if (!t->wheel_time || now - t->wheel_time > (time_t)t->wheel_mask)
+		t->wheel_time = now - t->wheel_mask - 1;
+
+	for (; t->wheel_time < now; t->wheel_time++) {
+		s = (t->wheel_time + 1) & t->wheel_mask;
+		/* Detach the slot, as entries may be put back into it */
+		i = t->wheel[s];
+		t->wheel[s] = __VANESSA_SOCKET_FLOW_NIL;
+		for (; i != __VANESSA_SOCKET_FLOW_NIL; i = next) {
+			f = t->entry + i;
+			next = f->__wheel_next;
+			if (f->last + (time_t)t->idle_timeout <= now) {
+				f->__wheel_slot = __VANESSA_SOCKET_FLOW_NIL;
+				__vanessa_socket_flow_del(t, f, 1);
+				expired++;
+			} else {
+				__vanessa_socket_flow_wheel_add(t, f);
+			}
+		}
+	}
+
+	return expired;
+}
+
+
+/**********************************************************************
+ * vanessa_socket_flow_count
+ * Number of flows in a table
+ * pre: t: flow table
+ * return: number of flows
+ **********************************************************************/
+
+unsigned int vanessa_socket_flow_count(const vanessa_socket_flow_table_t *t)
+{
+	return t->count;
+}
@@ -41,12 +41,55 @@
 void vanessa_socket_handler_reaper(int sig)
 {
 	int status;
+	pid_t pid;
 
 	extern unsigned int noconnection;
+	extern vanessa_socket_limit_t *__vanessa_socket_server_limit;
+	extern vanessa_socket_scoreboard_t *__vanessa_socket_server_scoreboard;
 
 	signal(sig, (void (*)(int)) vanessa_socket_handler_reaper);
-	while (wait3(&status, WNOHANG, 0) > 0) {
+	while ((pid = wait3(&status, WNOHANG, 0)) > 0) {
 		noconnection--;
+		if (__vanessa_socket_server_limit)
+			vanessa_socket_limit_reap(__vanessa_socket_server_limit,
+						  pid);
+		if (__vanessa_socket_server_scoreboard)
+			vanessa_socket_scoreboard_reap(
+				__vanessa_socket_server_scoreboard, pid);
+	}
+}
+
+
+/**********************************************************************
+ * vanessa_socket_handler_reaper_rusage
+ * As vanessa_socket_handler_reaper(), but using wait4 and adding the
+ * exit status and resource usage of each child reaped to the totals
+ * read by vanessa_socket_rusage_get()
+ * pre: sig: signal is recieved by the process
+ * post: Resources of any exited children are freed and accounted for
+ *       Signal Handler for signal reset
+ **********************************************************************/
+
+void vanessa_socket_handler_reaper_rusage(int sig)
+{
+	int status;
+	pid_t pid;
+	struct rusage ru;
+
+	extern unsigned int noconnection;
+	extern vanessa_socket_limit_t *__vanessa_socket_server_limit;
+	extern vanessa_socket_scoreboard_t *__vanessa_socket_server_scoreboard;
+
+	signal(sig, (void (*)(int)) vanessa_socket_handler_reaper_rusage);
+	while ((pid = wait4(-1, &status, WNOHANG, &ru)) > 0) {
+		noconnection--;
+		vanessa_socket_rusage_add(status, &ru);
+		if (__vanessa_socket_server_limit)
+			vanessa_socket_limit_reap(__vanessa_socket_server_limit,
+						  pid);
+		if (__vanessa_socket_server_scoreboard)
+			vanessa_socket_scoreboard_reap(
+				__vanessa_socket_server_scoreboard, pid);
 	}
 }
 
@@ -63,3 +106,37 @@ void vanessa_socket_handler_noop(int sig)
 {
 	signal(sig, (void (*)(int)) vanessa_socket_handler_noop);
 }
+
+
+/**********************************************************************
+ * vanessa_socket_handler_drain
+ * A signal handler that stops a server from accepting connections,
+ * so that it can wait for the connections it has to finish using
+ * vanessa_socket_server_drain(). Designed to listen for SIGTERM.
+ * pre: sig: signal recieved by the process
+ * post: vanessa_socket_server_drain_start() is called
+ *       Signal handler for sig reset
+ **********************************************************************/
+
+void vanessa_socket_handler_drain(int sig)
+{
+	signal(sig, (void (*)(int)) vanessa_socket_handler_drain);
+	vanessa_socket_server_drain_start();
+}
+
+
+/**********************************************************************
+ * vanessa_socket_handler_reload
+ * A signal handler that makes a server stop waiting for connections,
+ * so that it can reload its settings and carry on accepting them.
+ * Designed to listen for SIGHUP.
+ * pre: sig: signal recieved by the process
+ * post: vanessa_socket_server_reload_start() is called
+ *       Signal handler for sig reset
+ **********************************************************************/
+
+void vanessa_socket_handler_reload(int sig)
+{
+	signal(sig, (void (*)(int)) vanessa_socket_handler_reload);
+	vanessa_socket_server_reload_start();
+}
@@ -0,0 +1,597 @@
+/**********************************************************************
+ * vanessa_socket_limit.c                                  October 2026
+ * Simon Horman                                      horms@verge.net.au
+ *
+ * Per source address and per prefix connection limits
+ *
+ * vanessa_socket
+ * Library to simplify handling of TCP sockets
+ * Copyright (C) 1999-2008  Simon Horman <horms@verge.net.au>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307 USA
+ *
+ **********************************************************************/
+
+#include <time.h>
+
+#include "vanessa_socket.h"
+#include "vanessa_socket_pidmap.h"
+
+/*
+ * Each source address, and each prefix, that has connected recently
+ * has an entry with the number of its connections that are open and
+ * a token bucket for the rate at which it may open more. Entries live
+ * in an array that is allocated when the limiter is created, unused
+ * ones are kept on a free list. Lookups are made through an open
+ * addressing hash of entry indexes with linear probing and backward
+ * shift deletion, as for flow tables.
+ *
+ * An entry expires once it has no open connections and its bucket has
+ * filled up again, as it then limits nothing. Each admission checks a
+ * few entries for expiry, sweeping through the array, so expiry takes
+ * no timer and constant time. If there are no free entries a source
+ * is let through without being limited, rather than refusing
+ * everyone.
+ *
+ * Children forked for connections are mapped to the entries they
+ * hold by pid, so that the entries can be released when the children
+ * are reaped. If there are too many children to keep track of their
+ * entries are released straight away.
+ */
+
+#define __VANESSA_SOCKET_LIMIT_NIL    0xffffffffU
+#define __VANESSA_SOCKET_LIMIT_SWEEP  2		/* Entries checked per call */
+#define __VANESSA_SOCKET_LIMIT_TOKEN  1000	/* Bucket units per token */
+
+#define __VANESSA_SOCKET_LIMIT_SOURCE 0
+#define __VANESSA_SOCKET_LIMIT_PREFIX 1
+
+typedef struct {
+	uint32_t addr[4];		/* Masked to the prefix length */
+	uint8_t family;			/* 0 if the entry is free */
+	uint8_t plen;
+	uint16_t kind;
+} __vanessa_socket_limit_key_t;
+
+typedef struct {
+	__vanessa_socket_limit_key_t key;
+	uint32_t hash;
+	uint32_t count;			/* Open connections */
+	uint32_t tokens;		/* In __VANESSA_SOCKET_LIMIT_TOKENs */
+	uint32_t next;			/* Next free */
+	uint64_t stamp;			/* Of tokens, in milliseconds */
+} __vanessa_socket_limit_entry_t;
+
+typedef struct {
+	__vanessa_socket_pidmap_entry_t pid;
+	vanessa_socket_limit_ticket_t ticket;
+} __vanessa_socket_limit_child_t;
+
+struct vanessa_socket_limit_struct {
+	__vanessa_socket_limit_entry_t *entry;
+	unsigned int capacity;
+	uint32_t *slot;			/* Entry index + 1, 0 if empty */
+	uint32_t slot_mask;
+	uint32_t seed;
+	uint32_t free;
+	uint32_t sweep;
+	__vanessa_socket_pidmap_t child;
+	vanessa_socket_limit_rule_t rule[2];
+	unsigned int plen[2];		/* Prefix lengths, IPv4 and IPv6 */
+	volatile int lock;
+};
+
+
+static void __vanessa_socket_limit_lock(vanessa_socket_limit_t *l)
+{
+	while (__sync_lock_test_and_set(&l->lock, 1))
+		while (l->lock)
+			;
+}
+
+
+static void __vanessa_socket_limit_unlock(vanessa_socket_limit_t *l)
+{
+	__sync_lock_release(&l->lock);
+}
+
+
+static uint64_t __vanessa_socket_limit_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+static uint32_t __vanessa_socket_limit_hash(const vanessa_socket_limit_t *l,
+					    const __vanessa_socket_limit_key_t
+					    *key)
+{
+	const uint32_t *p = (const uint32_t *)key;
+	uint32_t h = l->seed;
+	size_t i;
+
+	for (i = 0; i < sizeof(*key) / sizeof(*p); i++) {
+		h ^= p[i];
+		h *= 0x9e3779b1U;
+		h ^= h >> 15;
+	}
+	h ^= h >> 13;
+	h *= 0x85ebca6bU;
+	h ^= h >> 16;
+
+	return h;
+}
+
+
+/**********************************************************************
+ * __vanessa_socket_limit_key
+ * Fill in the key of a source address or of its prefix
+ * pre: l: limiter
+ *      key: key to fill in
+ *      from: source address
+ *      kind: __VANESSA_SOCKET_LIMIT_SOURCE or _PREFIX
+ * return: 0 on success
+ *         -1 if from is not AF_INET or AF_INET6
+ **********************************************************************/
+
+static int __vanessa_socket_limit_key(const vanessa_socket_limit_t *l,
+				      __vanessa_socket_limit_key_t *key,
+				      const struct sockaddr *from, int kind)
+{
+	uint8_t *addr = (uint8_t *)key->addr;
+	unsigned int plen, i;
+
+	memset(key, 0, sizeof(*key));
+	key->family = from->sa_family;
+	key->kind = kind;
+
+	switch (from->sa_family) {
+	case AF_INET:
+		memcpy(addr, &((struct sockaddr_in *)from)->sin_addr, 4);
+		plen = kind == __VANESSA_SOCKET_LIMIT_PREFIX ? l->plen[0] : 32;
+		break;
+	case AF_INET6:
+		memcpy(addr, &((struct sockaddr_in6 *)from)->sin6_addr, 16);
+		plen = kind == __VANESSA_SOCKET_LIMIT_PREFIX ? l->plen[1] : 128;
+		break;
+	default:
+		return -1;
+	}
+
+	key->plen = plen;
+	for (i = 0; i < 16; i++) {
+		if (i * 8 >= plen)
+			addr[i] = 0;
+		else if (i * 8 + 8 > plen)
+			addr[i] &= 0xff << (8 - plen % 8);
+	}
+
+	return 0;
+}
+
+
+static uint32_t __vanessa_socket_limit_find_slot(vanessa_socket_limit_t *l,
+					const __vanessa_socket_limit_key_t *key,
+					uint32_t hash)
+{
+	uint32_t s, e;
+
+	for (s = hash & l->slot_mask; (e = l->slot[s]);
+	     s = (s + 1) & l->slot_mask) {
+		if (l->entry[e - 1].hash == hash &&
+		    !memcmp(&l->entry[e - 1].key, key, sizeof(*key)))
+			return s;
+	}
+
+	return s;
+}
+
+
+static void __vanessa_socket_limit_del(vanessa_socket_limit_t *l,
+				       __vanessa_socket_limit_entry_t *e)
+{
+	uint32_t s, next, home, i;
+
+	s = __vanessa_socket_limit_find_slot(l, &e->key, e->hash);
+	l->slot[s] = 0;
+
+	/* Shift back later members of the probe sequence that would
+	 * otherwise no longer be reachable from their home slot */
+	for (next = (s + 1) & l->slot_mask; (i = l->slot[next]);
+	     next = (next + 1) & l->slot_mask) {
+		home = l->entry[i - 1].hash & l->slot_mask;
+		if (((next - home) & l->slot_mask) <
+		    ((next - s) & l->slot_mask))
+			continue;
+		l->slot[s] = i;
+		l->slot[next] = 0;
+		s = next;
+	}
+
+	e->key.family = 0;
+	e->next = l->free;
+	l->free = e - l->entry;
+}
+
+
+/**********************************************************************
+ * __vanessa_socket_limit_refill
+ * Add the tokens earned since an entry's bucket was last updated
+ * pre: e: entry
+ *      rule: rule of the entry
+ *      now: current time in milliseconds
+ * return: non-zero if the bucket is full
+ **********************************************************************/
+
+static int __vanessa_socket_limit_refill(__vanessa_socket_limit_entry_t *e,
+					 const vanessa_socket_limit_rule_t
+					 *rule, uint64_t now)
+{
+	uint64_t tokens;
+	uint64_t max;
+
+	if (!rule->rate)
+		return 1;
+
+	/* A token a second is rate units a millisecond */
+	max = (uint64_t)rule->burst * __VANESSA_SOCKET_LIMIT_TOKEN;
+	tokens = e->tokens + (now - e->stamp) * rule->rate;
+	e->tokens = tokens < max ? tokens : max;
+	e->stamp = now;
+
+	return e->tokens == max;
+}
+
+
+static void __vanessa_socket_limit_sweep(vanessa_socket_limit_t *l,
+					 uint64_t now)
+{
+	__vanessa_socket_limit_entry_t *e;
+	int i;
+
+	for (i = 0; i < __VANESSA_SOCKET_LIMIT_SWEEP; i++) {
+		e = l->entry + l->sweep;
+		l->sweep = (l->sweep + 1) % l->capacity;
+		if (!e->key.family || e->count)
+			continue;
+		if (__vanessa_socket_limit_refill(e, l->rule + e->key.kind,
+						  now))
+			__vanessa_socket_limit_del(l, e);
+	}
+}
+
+
+/**********************************************************************
+ * __vanessa_socket_limit_get
+ * Find the entry for a key, adding it if it is not there
+ * pre: l: limiter
+ *      key: key
+ *      now: current time in milliseconds
+ * return: index of entry
+ *         __VANESSA_SOCKET_LIMIT_NIL if there is no free entry
+ **********************************************************************/
+
+static uint32_t __vanessa_socket_limit_get(vanessa_socket_limit_t *l,
+					   const __vanessa_socket_limit_key_t
+					   *key, uint64_t now)
+{
+	__vanessa_socket_limit_entry_t *e;
+	uint32_t hash, s;
+
+	hash = __vanessa_socket_limit_hash(l, key);
+	s = __vanessa_socket_limit_find_slot(l, key, hash);
+	if (l->slot[s])
+		return l->slot[s] - 1;
+
+	if (l->free == __VANESSA_SOCKET_LIMIT_NIL)
+		return __VANESSA_SOCKET_LIMIT_NIL;
+
+	e = l->entry + l->free;
+	l->free = e->next;
+	e->key = *key;
+	e->hash = hash;
+	e->count = 0;
+	e->tokens = l->rule[key->kind].burst * __VANESSA_SOCKET_LIMIT_TOKEN;
+	e->stamp = now;
+	l->slot[s] = e - l->entry + 1;
+
+	return e - l->entry;
+}
+
+
+/**********************************************************************
+ * vanessa_socket_limit_create
+ * Create a limiter
+ * pre: capacity: maximum number of source addresses and prefixes to
+ *                track at once. Space for all of them is allocated
+ *                up front.
+ *      source: limits for each source address
+ *      prefix: limits for each prefix
+ *      prefix4: length of IPv4 prefixes, 0 to 32
+ *      prefix6: length of IPv6 prefixes, 0 to 128
+ * return: limiter
+ *         NULL on error
+ **********************************************************************/
+
+vanessa_socket_limit_t *
+vanessa_socket_limit_create(unsigned int capacity,
+			    const vanessa_socket_limit_rule_t *source,
+			    const vanessa_socket_limit_rule_t *prefix,
+			    unsigned int prefix4, unsigned int prefix6)
+{
+	vanessa_socket_limit_t *l;
+	uint32_t nslot;
+	unsigned int i;
+
+	if (!capacity || capacity >= __VANESSA_SOCKET_LIMIT_NIL / 4) {
+		VANESSA_LOGGER_DEBUG_UNSAFE("invalid capacity: %u", capacity);
+		return NULL;
+	}
+	if (prefix4 > 32 || prefix6 > 128) {
+		VANESSA_LOGGER_DEBUG_UNSAFE("invalid prefix length: %u/%u",
+					    prefix4, prefix6);
+		return NULL;
+	}
+
+	l = calloc(1, sizeof(*l));
+	if (!l) {
+		VANESSA_LOGGER_DEBUG_ERRNO("calloc");
+		return NULL;
+	}
+
+	for (nslot = 2; nslot < capacity * 2; nslot <<= 1)
+		;
+
+	l->entry = calloc(capacity, sizeof(*l->entry));
+	l->slot = calloc(nslot, sizeof(*l->slot));
+	if (!l->entry || !l->slot) {
+		VANESSA_LOGGER_DEBUG_ERRNO("calloc");
+		vanessa_socket_limit_destroy(l);
+		return NULL;
+	}
+	if (__vanessa_socket_pidmap_create(&l->child, capacity,
+					   sizeof(__vanessa_socket_limit_child_t))
+	    < 0) {
+		VANESSA_LOGGER_DEBUG("__vanessa_socket_pidmap_create");
+		vanessa_socket_limit_destroy(l);
+		return NULL;
+	}
+
+	l->capacity = capacity;
+	l->slot_mask = nslot - 1;
+	l->seed = (uint32_t)time(NULL) ^ ((uint32_t)getpid() << 16) ^
+		  (uint32_t)(unsigned long)l;
+	l->rule[__VANESSA_SOCKET_LIMIT_SOURCE] = *source;
+	l->rule[__VANESSA_SOCKET_LIMIT_PREFIX] = *prefix;
+	for (i = 0; i < 2; i++)
+		if (!l->rule[i].burst)
+			l->rule[i].burst = 1;
+	l->plen[0] = prefix4;
+	l->plen[1] = prefix6;
+
+	for (i = 0; i < capacity; i++)
+		l->entry[i].next = i + 1 < capacity ?
+				   i + 1 : __VANESSA_SOCKET_LIMIT_NIL;
+	l->free = 0;
+
+	return l;
+}
+
+
+/**********************************************************************
+ * vanessa_socket_limit_destroy
+ * Destroy a limiter
+ * pre: l: limiter
+ * post: l is freed
+ **********************************************************************/
+
+void vanessa_socket_limit_destroy(vanessa_socket_limit_t *l)
+{
+	if (!l)
+		return;
+
+	free(l->entry);
+	free(l->slot);
+	__vanessa_socket_pidmap_destroy(&l->child);
+	free(l);
+}
+
+
+/**********************************************************************
+ * vanessa_socket_limit_rules
+ * Change the limits of a limiter
+ * pre: l: limiter
+ *      source: limits for each source address
+ *      prefix: limits for each prefix
+ * post: Connections admitted from now on are checked against the new
+ *       limits. Those already admitted are still counted, and buckets
+ *       are refilled at the new rates up to the new bursts. Thread
+ *       safe, but as for vanessa_socket_limit_reap() block SIGCHLD
+ *       around it if the reaper uses l.
+ **********************************************************************/
+
+void vanessa_socket_limit_rules(vanessa_socket_limit_t *l,
+				const vanessa_socket_limit_rule_t *source,
+				const vanessa_socket_limit_rule_t *prefix)
+{
+	int i;
+
+	__vanessa_socket_limit_lock(l);
+	l->rule[__VANESSA_SOCKET_LIMIT_SOURCE] = *source;
+	l->rule[__VANESSA_SOCKET_LIMIT_PREFIX] = *prefix;
+	for (i = 0; i < 2; i++)
+		if (!l->rule[i].burst)
+			l->rule[i].burst = 1;
+	__vanessa_socket_limit_unlock(l);
+}
+
+
+/**********************************************************************
+ * vanessa_socket_limit_admit
+ * Check whether a new connection is within the limits
+ * pre: l: limiter
+ *      from: address the connection is from
+ *      ticket: where to store what the connection holds
+ * post: If the connection is admitted it is counted against its
+ *       source address and prefix, and a token is taken from each of
+ *       their buckets. Connections that are not from AF_INET or
+ *       AF_INET6 addresses are always admitted, and not counted.
+ *       Thread safe.
+ * return: 0 if admitted, ticket must be passed to
+ *           vanessa_socket_limit_release() when the connection closes
+ *         -1 if the connection is over a limit
+ **********************************************************************/
+
+int vanessa_socket_limit_admit(vanessa_socket_limit_t *l,
+			       const struct sockaddr *from,
+			       vanessa_socket_limit_ticket_t *ticket)
+{
+	__vanessa_socket_limit_key_t key;
+	__vanessa_socket_limit_entry_t *e;
+	const vanessa_socket_limit_rule_t *rule;
+	uint64_t now;
+	int i;
+
+	ticket->__entry[0] = ticket->__entry[1] = __VANESSA_SOCKET_LIMIT_NIL;
+
+	now = __vanessa_socket_limit_now();
+	__vanessa_socket_limit_lock(l);
+	__vanessa_socket_limit_sweep(l, now);
+
+	for (i = 0; i < 2; i++) {
+		rule = l->rule + i;
+		if (!rule->max && !rule->rate)
+			continue;
+		if (__vanessa_socket_limit_key(l, &key, from, i) < 0)
+			break;
+		ticket->__entry[i] = __vanessa_socket_limit_get(l, &key, now);
+		if (ticket->__entry[i] == __VANESSA_SOCKET_LIMIT_NIL)
+			continue;
+		e = l->entry + ticket->__entry[i];
+		__vanessa_socket_limit_refill(e, rule, now);
+		if ((rule->max && e->count >= rule->max) ||
+		    (rule->rate && e->tokens < __VANESSA_SOCKET_LIMIT_TOKEN))
+			goto over;
+	}
+
+	/* Nothing is taken unless both the source and prefix are within
+	 * their limits */
+	for (i = 0; i < 2; i++) {
+		if (ticket->__entry[i] == __VANESSA_SOCKET_LIMIT_NIL)
+			continue;
+		e = l->entry + ticket->__entry[i];
+		e->count++;
+		if (l->rule[i].rate)
+			e->tokens -= __VANESSA_SOCKET_LIMIT_TOKEN;
+	}
+
+	__vanessa_socket_limit_unlock(l);
+	return 0;
+
+over:
+	__vanessa_socket_limit_unlock(l);
+	ticket->__entry[0] = ticket->__entry[1] = __VANESSA_SOCKET_LIMIT_NIL;
+	return -1;
+}
+
+
+static void __vanessa_socket_limit_put(vanessa_socket_limit_t *l,
+				       const vanessa_socket_limit_ticket_t
+				       *ticket)
+{
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		if (ticket->__entry[i] == __VANESSA_SOCKET_LIMIT_NIL)
+			continue;
+		if (l->entry[ticket->__entry[i]].count)
+			l->entry[ticket->__entry[i]].count--;
+	}
+}
+
+
+/**********************************************************************
+ * vanessa_socket_limit_release
+ * Release what a connection holds, when it closes
+ * pre: l: limiter
+ *      ticket: filled in by vanessa_socket_limit_admit()
+ * post: The connection is no longer counted. Thread safe.
+ **********************************************************************/
+
+void vanessa_socket_limit_release(vanessa_socket_limit_t *l,
+				  const vanessa_socket_limit_ticket_t *ticket)
+{
+	__vanessa_socket_limit_lock(l);
+	__vanessa_socket_limit_put(l, ticket);
+	__vanessa_socket_limit_unlock(l);
+}
+
+
+/**********************************************************************
+ * vanessa_socket_limit_child
+ * Record the child process that serves a connection
+ * pre: l: limiter
+ *      pid: process id of the child
+ *      ticket: filled in by vanessa_socket_limit_admit()
+ * post: The ticket is released by vanessa_socket_limit_reap() when
+ *       the child is reaped. If there are too many children to keep
+ *       track of the ticket is released straight away.
+ **********************************************************************/
+
+void vanessa_socket_limit_child(vanessa_socket_limit_t *l, pid_t pid,
+				const vanessa_socket_limit_ticket_t *ticket)
+{
+	__vanessa_socket_limit_child_t *c;
+
+	__vanessa_socket_limit_lock(l);
+	c = __vanessa_socket_pidmap_find(&l->child, pid);
+	if (c)
+		__vanessa_socket_limit_put(l, &c->ticket);
+	else
+		c = __vanessa_socket_pidmap_add(&l->child, pid);
+	if (c)
+		c->ticket = *ticket;
+	else
+		__vanessa_socket_limit_put(l, ticket);
+	__vanessa_socket_limit_unlock(l);
+}
+
+
+/**********************************************************************
+ * vanessa_socket_limit_reap
+ * Release the ticket of a child process that has exited
+ * pre: l: limiter
+ *      pid: process id of the child
+ * post: If pid was recorded by vanessa_socket_limit_child() its ticket
+ *       is released. Not safe to call from a signal handler that
+ *       interrupts other calls on l, block the signal around them.
+ **********************************************************************/
+
+void vanessa_socket_limit_reap(vanessa_socket_limit_t *l, pid_t pid)
+{
+	__vanessa_socket_limit_child_t *c;
+
+	__vanessa_socket_limit_lock(l);
+	c = __vanessa_socket_pidmap_find(&l->child, pid);
+	if (c) {
+		__vanessa_socket_limit_put(l, &c->ticket);
+		__vanessa_socket_pidmap_remove(&l->child, c);
+	}
+	__vanessa_socket_limit_unlock(l);
+}
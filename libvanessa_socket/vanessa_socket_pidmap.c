@@ -0,0 +1,161 @@
+/**********************************************************************
+ * vanessa_socket_pidmap.c                                 October 2026
+ * Simon Horman                                      horms@verge.net.au
+ *
+ * Map of child process ids to what they hold, for use within the
+ * library only
+ *
+ * vanessa_socket
+ * Library to simplify handling of TCP sockets
+ * Copyright (C) 1999-2008  Simon Horman <horms@verge.net.au>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307 USA
+ *
+ **********************************************************************/
+
+#include "vanessa_socket.h"
+#include "vanessa_socket_pidmap.h"
+
+/*
+ * Open addressing with linear probing, kept at most half full so that
+ * probes are short. Removal shifts later entries of the same run back
+ * into the hole, rather than leaving a tombstone, so that lookups stay
+ * short however many children come and go.
+ */
+
+#define __VANESSA_SOCKET_PIDMAP_MUL 0x9e3779b1U	/* Fibonacci hashing */
+
+
+static __vanessa_socket_pidmap_entry_t *
+__vanessa_socket_pidmap_entry(__vanessa_socket_pidmap_t *m, uint32_t i)
+{
+	return (__vanessa_socket_pidmap_entry_t *)(m->entry + i * m->size);
+}
+
+
+static uint32_t __vanessa_socket_pidmap_home(__vanessa_socket_pidmap_t *m,
+					     pid_t pid)
+{
+	return (uint32_t)pid * __VANESSA_SOCKET_PIDMAP_MUL & m->mask;
+}
+
+
+/**********************************************************************
+ * __vanessa_socket_pidmap_slot
+ * Find where a child is, or would go
+ * pre: m: map, with at least one empty entry
+ *      pid: process id of the child
+ * return: index of the entry of pid if it is in m,
+ *         otherwise of the empty entry that it would be added at
+ **********************************************************************/
+
+static uint32_t __vanessa_socket_pidmap_slot(__vanessa_socket_pidmap_t *m,
+					     pid_t pid)
+{
+	__vanessa_socket_pidmap_entry_t *e;
+	uint32_t i;
+
+	for (i = __vanessa_socket_pidmap_home(m, pid);; i = (i + 1) & m->mask) {
+		e = __vanessa_socket_pidmap_entry(m, i);
+		if (!e->pid || e->pid == pid)
+			return i;
+	}
+}
+
+
+int __vanessa_socket_pidmap_create(__vanessa_socket_pidmap_t *m, uint32_t n,
+				   size_t size)
+{
+	uint32_t nentry;
+
+	memset(m, 0, sizeof(*m));
+
+	if (!n || n > 0x40000000U) {
+		VANESSA_LOGGER_DEBUG_UNSAFE("invalid n: %u", n);
+		return -1;
+	}
+	for (nentry = 2; nentry < n * 2; nentry <<= 1)
+		;
+
+	m->entry = calloc(nentry, size);
+	if (!m->entry) {
+		VANESSA_LOGGER_DEBUG_ERRNO("calloc");
+		return -1;
+	}
+	m->size = size;
+	m->mask = nentry - 1;
+
+	return 0;
+}
+
+
+void __vanessa_socket_pidmap_destroy(__vanessa_socket_pidmap_t *m)
+{
+	free(m->entry);
+	m->entry = NULL;
+}
+
+
+void *__vanessa_socket_pidmap_find(__vanessa_socket_pidmap_t *m, pid_t pid)
+{
+	__vanessa_socket_pidmap_entry_t *e;
+
+	e = __vanessa_socket_pidmap_entry(m,
+					  __vanessa_socket_pidmap_slot(m, pid));
+
+	return e->pid ? e : NULL;
+}
+
+
+void *__vanessa_socket_pidmap_add(__vanessa_socket_pidmap_t *m, pid_t pid)
+{
+	__vanessa_socket_pidmap_entry_t *e;
+
+	if (m->n >= (m->mask + 1) / 2)
+		return NULL;
+
+	e = __vanessa_socket_pidmap_entry(m,
+					  __vanessa_socket_pidmap_slot(m, pid));
+	e->pid = pid;
+	m->n++;
+
+	return e;
+}
+
+
+void __vanessa_socket_pidmap_remove(__vanessa_socket_pidmap_t *m,
+				    void *entry)
+{
+	__vanessa_socket_pidmap_entry_t *e;
+	uint32_t hole, next, home;
+
+	hole = ((char *)entry - m->entry) / m->size;
+	__vanessa_socket_pidmap_entry(m, hole)->pid = 0;
+	m->n--;
+
+	/* Move back each later entry of the run that may be moved into
+	 * the hole without passing its home */
+	for (next = (hole + 1) & m->mask;
+	     (e = __vanessa_socket_pidmap_entry(m, next))->pid;
+	     next = (next + 1) & m->mask) {
+		home = __vanessa_socket_pidmap_home(m, e->pid);
+		if (((next - home) & m->mask) < ((next - hole) & m->mask))
+			continue;
+		memcpy(__vanessa_socket_pidmap_entry(m, hole), e, m->size);
+		e->pid = 0;
+		hole = next;
+	}
+}
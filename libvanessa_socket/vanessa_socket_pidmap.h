@@ -0,0 +1,112 @@
+/**********************************************************************
+ * vanessa_socket_pidmap.h                                 October 2026
+ * Simon Horman                                      horms@verge.net.au
+ *
+ * Map of child process ids to what they hold, for use within the
+ * library only
+ *
+ * vanessa_socket
+ * Library to simplify handling of TCP sockets
+ * Copyright (C) 1999-2008  Simon Horman <horms@verge.net.au>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307 USA
+ *
+ **********************************************************************/
+
+#ifndef VANESSA_SOCKET_PIDMAP_H
+#define VANESSA_SOCKET_PIDMAP_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/* Entries are of a size given by the user, and begin with this */
+typedef struct {
+	pid_t pid;			/* 0 if empty */
+} __vanessa_socket_pidmap_entry_t;
+
+typedef struct {
+	char *entry;
+	size_t size;			/* Of each entry */
+	uint32_t mask;
+	uint32_t n;			/* Entries in use */
+} __vanessa_socket_pidmap_t;
+
+
+/**********************************************************************
+ * __vanessa_socket_pidmap_create
+ * Set up a map
+ * pre: m: map to set up
+ *      n: most children to map
+ *      size: size of each entry in bytes, entries must begin with
+ *            __vanessa_socket_pidmap_entry_t
+ * post: m has room for n children, and is at most half full then
+ * return: 0 on success
+ *         -1 on error
+ **********************************************************************/
+
+int __vanessa_socket_pidmap_create(__vanessa_socket_pidmap_t *m, uint32_t n,
+				   size_t size);
+
+
+/**********************************************************************
+ * __vanessa_socket_pidmap_destroy
+ * Free the entries of a map
+ * pre: m: map, may have been zeroed rather than set up
+ **********************************************************************/
+
+void __vanessa_socket_pidmap_destroy(__vanessa_socket_pidmap_t *m);
+
+
+/**********************************************************************
+ * __vanessa_socket_pidmap_find
+ * Look up a child
+ * pre: m: map
+ *      pid: process id of the child
+ * return: entry of pid
+ *         NULL if pid is not in m
+ **********************************************************************/
+
+void *__vanessa_socket_pidmap_find(__vanessa_socket_pidmap_t *m, pid_t pid);
+
+
+/**********************************************************************
+ * __vanessa_socket_pidmap_add
+ * Add a child
+ * pre: m: map
+ *      pid: process id of the child, not already in m
+ * post: An entry for pid is added. The rest of it is left for the
+ *       caller to fill in.
+ * return: entry of pid
+ *         NULL if m already has as many children as it was created for
+ **********************************************************************/
+
+void *__vanessa_socket_pidmap_add(__vanessa_socket_pidmap_t *m, pid_t pid);
+
+
+/**********************************************************************
+ * __vanessa_socket_pidmap_remove
+ * Remove a child
+ * pre: m: map
+ *      entry: entry of the child, from __vanessa_socket_pidmap_find()
+ * post: The entry is removed. Other entries may be moved, so pointers
+ *       to them are no longer valid.
+ **********************************************************************/
+
+void __vanessa_socket_pidmap_remove(__vanessa_socket_pidmap_t *m,
+				    void *entry);
+
+
+#endif
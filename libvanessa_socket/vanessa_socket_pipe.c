@@ -155,6 +155,8 @@ int vanessa_socket_pipe_func(int rfd_a, int wfd_a, int rfd_b, int wfd_b,
 	int status;
 	ssize_t bytes = 0;
 	int hifd;
+	extern __thread vanessa_socket_trace_t *__vanessa_socket_trace;
+	extern vanessa_socket_scoreboard_slot_t *__vanessa_socket_scoreboard_self;
 
 	if(read_func == NULL) {
 		read_func = vanessa_socket_pipe_fd_read;
@@ -168,6 +170,9 @@ int vanessa_socket_pipe_func(int rfd_a, int wfd_a, int rfd_b, int wfd_b,
 
 	hifd = (rfd_a > rfd_b) ? rfd_a : rfd_b;
 
+	if (__vanessa_socket_scoreboard_self)
+		vanessa_socket_scoreboard_state(VANESSA_SOCKET_SCOREBOARD_RELAY);
+
 	for (;;) {
 		FD_ZERO(&read_template);
 		FD_SET(rfd_a, &read_template);
@@ -201,11 +206,23 @@ int vanessa_socket_pipe_func(int rfd_a, int wfd_a, int rfd_b, int wfd_b,
 					wfd_b, buffer, buffer_length, 
 					read_func, write_func, data);
 			*return_a_read_bytes += (bytes > 0) ? (size_t)bytes : 0;
+			if (bytes > 0 && __vanessa_socket_trace)
+				vanessa_socket_trace_read(__vanessa_socket_trace,
+							  VANESSA_SOCKET_TRACE_A);
+			if (bytes > 0 && __vanessa_socket_scoreboard_self)
+				vanessa_socket_scoreboard_bytes(
+					VANESSA_SOCKET_TRACE_A, bytes);
 		} else if (FD_ISSET(rfd_b, &read_template)) {
 			bytes = vanessa_socket_pipe_read_write_func(rfd_b, 
 					wfd_a, buffer, buffer_length, 
 					read_func, write_func, data);
 			*return_b_read_bytes += (bytes > 0) ? (size_t)bytes : 0;
+			if (bytes > 0 && __vanessa_socket_trace)
+				vanessa_socket_trace_read(__vanessa_socket_trace,
+							  VANESSA_SOCKET_TRACE_B);
+			if (bytes > 0 && __vanessa_socket_scoreboard_self)
+				vanessa_socket_scoreboard_bytes(
+					VANESSA_SOCKET_TRACE_B, bytes);
 		}
 		if (bytes < 0) {
 			VANESSA_LOGGER_DEBUG
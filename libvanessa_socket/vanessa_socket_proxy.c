@@ -0,0 +1,372 @@
+/**********************************************************************
+ * vanessa_socket_proxy.c                                  October 2026
+ * Simon Horman                                      horms@verge.net.au
+ *
+ * PROXY protocol version 2 headers
+ *
+ * vanessa_socket
+ * Library to simplify handling of TCP sockets
+ * Copyright (C) 1999-2008  Simon Horman <horms@verge.net.au>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307 USA
+ *
+ **********************************************************************/
+
+#include <errno.h>
+#include <sys/poll.h>
+#include <time.h>
+
+#include "vanessa_socket.h"
+
+/*
+ * A header is a 16 byte fixed part followed by addresses and then
+ * optional type-length-value fields, which are skipped:
+ *
+ *   12 bytes  signature
+ *    1 byte   version (high nibble, 2) and command (low nibble)
+ *    1 byte   address family (high nibble) and protocol (low nibble)
+ *    2 bytes  length of the rest of the header, in network byte order
+ *
+ * Addresses are source then destination address, followed by source
+ * then destination port for AF_INET and AF_INET6.
+ */
+
+static const char __vanessa_socket_proxy_sig[] =
+	"\x0D\x0A\x0D\x0A\x00\x0D\x0A\x51\x55\x49\x54\x0A";
+
+#define __VANESSA_SOCKET_PROXY_SIG_LEN   12
+#define __VANESSA_SOCKET_PROXY_HDR_LEN   16
+
+#define __VANESSA_SOCKET_PROXY_VERSION   0x20
+#define __VANESSA_SOCKET_PROXY_LOCAL     0x00
+#define __VANESSA_SOCKET_PROXY_PROXY     0x01
+
+#define __VANESSA_SOCKET_PROXY_UNSPEC    0x00
+#define __VANESSA_SOCKET_PROXY_INET      0x10
+#define __VANESSA_SOCKET_PROXY_INET6     0x20
+#define __VANESSA_SOCKET_PROXY_UNIX      0x30
+#define __VANESSA_SOCKET_PROXY_STREAM    0x01
+
+#define __VANESSA_SOCKET_PROXY_UNIX_LEN  108
+
+
+ssize_t vanessa_socket_proxy_v2_build(char *buf, size_t len,
+				      const struct sockaddr *from,
+				      const struct sockaddr *to)
+{
+	unsigned char *p = (unsigned char *)buf;
+	unsigned char *a = p + __VANESSA_SOCKET_PROXY_HDR_LEN;
+	size_t addr_len;
+	int family;
+
+	if (from && !to) {
+		VANESSA_LOGGER_DEBUG("no local address");
+		errno = EINVAL;
+		return -1;
+	}
+	if (from && from->sa_family != to->sa_family) {
+		VANESSA_LOGGER_DEBUG("address families differ");
+		return -1;
+	}
+
+	family = from ? from->sa_family : AF_UNSPEC;
+	switch (family) {
+	case AF_INET:
+		addr_len = 12;
+		break;
+	case AF_INET6:
+		addr_len = 36;
+		break;
+	case AF_UNIX:
+		addr_len = __VANESSA_SOCKET_PROXY_UNIX_LEN * 2;
+		break;
+	default:
+		addr_len = 0;
+		break;
+	}
+
+	if (len < __VANESSA_SOCKET_PROXY_HDR_LEN + addr_len) {
+		VANESSA_LOGGER_DEBUG("buffer too short");
+		return -1;
+	}
+
+	memcpy(p, __vanessa_socket_proxy_sig, __VANESSA_SOCKET_PROXY_SIG_LEN);
+	p[12] = __VANESSA_SOCKET_PROXY_VERSION | __VANESSA_SOCKET_PROXY_PROXY;
+	p[14] = (addr_len >> 8) & 0xff;
+	p[15] = addr_len & 0xff;
+
+	switch (family) {
+	case AF_INET:
+		p[13] = __VANESSA_SOCKET_PROXY_INET |
+			__VANESSA_SOCKET_PROXY_STREAM;
+		memcpy(a, &((struct sockaddr_in *)from)->sin_addr, 4);
+		memcpy(a + 4, &((struct sockaddr_in *)to)->sin_addr, 4);
+		memcpy(a + 8, &((struct sockaddr_in *)from)->sin_port, 2);
+		memcpy(a + 10, &((struct sockaddr_in *)to)->sin_port, 2);
+		break;
+	case AF_INET6:
+		p[13] = __VANESSA_SOCKET_PROXY_INET6 |
+			__VANESSA_SOCKET_PROXY_STREAM;
+		memcpy(a, &((struct sockaddr_in6 *)from)->sin6_addr, 16);
+		memcpy(a + 16, &((struct sockaddr_in6 *)to)->sin6_addr, 16);
+		memcpy(a + 32, &((struct sockaddr_in6 *)from)->sin6_port, 2);
+		memcpy(a + 34, &((struct sockaddr_in6 *)to)->sin6_port, 2);
+		break;
+	case AF_UNIX:
+		p[13] = __VANESSA_SOCKET_PROXY_UNIX |
+			__VANESSA_SOCKET_PROXY_STREAM;
+		memcpy(a, ((struct sockaddr_un *)from)->sun_path,
+		       __VANESSA_SOCKET_PROXY_UNIX_LEN);
+		memcpy(a + __VANESSA_SOCKET_PROXY_UNIX_LEN,
+		       ((struct sockaddr_un *)to)->sun_path,
+		       __VANESSA_SOCKET_PROXY_UNIX_LEN);
+		break;
+	default:
+		p[13] = __VANESSA_SOCKET_PROXY_UNSPEC;
+		break;
+	}
+
+	return __VANESSA_SOCKET_PROXY_HDR_LEN + addr_len;
+}
+
+
+ssize_t vanessa_socket_proxy_v2_parse(const char *buf, size_t len,
+				      struct sockaddr_storage *from,
+				      struct sockaddr_storage *to)
+{
+	const unsigned char *p = (const unsigned char *)buf;
+	const unsigned char *a = p + __VANESSA_SOCKET_PROXY_HDR_LEN;
+	struct sockaddr_in *in_from, *in_to;
+	struct sockaddr_in6 *in6_from, *in6_to;
+	struct sockaddr_un *un_from, *un_to;
+	size_t addr_len;
+
+	/* Check as much of the signature as has arrived, so that
+	 * a connection without a header is rejected early */
+	if (memcmp(p, __vanessa_socket_proxy_sig,
+		   len < __VANESSA_SOCKET_PROXY_SIG_LEN ?
+		   len : __VANESSA_SOCKET_PROXY_SIG_LEN)) {
+		VANESSA_LOGGER_DEBUG("no PROXY protocol v2 signature");
+		return -1;
+	}
+	if (len < __VANESSA_SOCKET_PROXY_HDR_LEN)
+		return 0;
+
+	if ((p[12] & 0xf0) != __VANESSA_SOCKET_PROXY_VERSION) {
+		VANESSA_LOGGER_DEBUG_UNSAFE("unsupported PROXY protocol "
+					    "version: %d", p[12] >> 4);
+		return -1;
+	}
+
+	addr_len = (p[14] << 8) | p[15];
+	if (len < __VANESSA_SOCKET_PROXY_HDR_LEN + addr_len)
+		return 0;
+
+	switch (p[12] & 0x0f) {
+	case __VANESSA_SOCKET_PROXY_LOCAL:
+		/* Health checks and the like, keep the real addresses */
+		return __VANESSA_SOCKET_PROXY_HDR_LEN + addr_len;
+	case __VANESSA_SOCKET_PROXY_PROXY:
+		break;
+	default:
+		VANESSA_LOGGER_DEBUG_UNSAFE("unknown PROXY protocol "
+					    "command: %d", p[12] & 0x0f);
+		return -1;
+	}
+
+	switch (p[13] & 0xf0) {
+	case __VANESSA_SOCKET_PROXY_INET:
+		if (addr_len < 12)
+			goto err_len;
+		in_from = (struct sockaddr_in *)from;
+		in_to = (struct sockaddr_in *)to;
+		memset(from, 0, sizeof(*from));
+		memset(to, 0, sizeof(*to));
+		in_from->sin_family = in_to->sin_family = AF_INET;
+		memcpy(&in_from->sin_addr, a, 4);
+		memcpy(&in_to->sin_addr, a + 4, 4);
+		memcpy(&in_from->sin_port, a + 8, 2);
+		memcpy(&in_to->sin_port, a + 10, 2);
+		break;
+	case __VANESSA_SOCKET_PROXY_INET6:
+		if (addr_len < 36)
+			goto err_len;
+		in6_from = (struct sockaddr_in6 *)from;
+		in6_to = (struct sockaddr_in6 *)to;
+		memset(from, 0, sizeof(*from));
+		memset(to, 0, sizeof(*to));
+		in6_from->sin6_family = in6_to->sin6_family = AF_INET6;
+		memcpy(&in6_from->sin6_addr, a, 16);
+		memcpy(&in6_to->sin6_addr, a + 16, 16);
+		memcpy(&in6_from->sin6_port, a + 32, 2);
+		memcpy(&in6_to->sin6_port, a + 34, 2);
+		break;
+	case __VANESSA_SOCKET_PROXY_UNIX:
+		if (addr_len < __VANESSA_SOCKET_PROXY_UNIX_LEN * 2)
+			goto err_len;
+		un_from = (struct sockaddr_un *)from;
+		un_to = (struct sockaddr_un *)to;
+		memset(from, 0, sizeof(*from));
+		memset(to, 0, sizeof(*to));
+		un_from->sun_family = un_to->sun_family = AF_UNIX;
+		memcpy(un_from->sun_path, a, sizeof(un_from->sun_path));
+		memcpy(un_to->sun_path, a + __VANESSA_SOCKET_PROXY_UNIX_LEN,
+		       sizeof(un_to->sun_path));
+		break;
+	default:
+		/* Unknown to the sender, keep the real addresses */
+		break;
+	}
+
+	return __VANESSA_SOCKET_PROXY_HDR_LEN + addr_len;
+
+err_len:
+	VANESSA_LOGGER_DEBUG_UNSAFE("PROXY protocol addresses too short: %d",
+				    (int)addr_len);
+	return -1;
+}
+
+
+int vanessa_socket_proxy_v2_send(int fd, const struct sockaddr *from,
+				 const struct sockaddr *to)
+{
+	char buf[VANESSA_SOCKET_PROXY_V2_MAX];
+	ssize_t len;
+
+	len = vanessa_socket_proxy_v2_build(buf, sizeof(buf), from, to);
+	if (len < 0) {
+		VANESSA_LOGGER_DEBUG("vanessa_socket_proxy_v2_build");
+		return -1;
+	}
+
+	if (vanessa_socket_pipe_write_bytes(fd, buf, len) < 0) {
+		VANESSA_LOGGER_DEBUG("vanessa_socket_pipe_write_bytes");
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/**********************************************************************
+ * __vanessa_socket_proxy_read
+ * Read exactly count bytes
+ * pre: fd: file descriptor to read from
+ *      buf: buffer to read into
+ *      count: number of bytes to read
+ *      deadline: time by which the bytes must have arrived
+ *                0 for no deadline
+ * return: 0 on success
+ *         -1 on error, if fd is closed first or if deadline passes
+ **********************************************************************/
+
+static int __vanessa_socket_proxy_read(int fd, char *buf, size_t count,
+				       time_t deadline)
+{
+	struct pollfd pfd;
+	ssize_t bytes;
+	time_t now;
+	int status;
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+
+	while (count) {
+		if (deadline) {
+			now = time(NULL);
+			if (now >= deadline) {
+				VANESSA_LOGGER_DEBUG("timed out reading "
+						     "PROXY protocol header");
+				errno = ETIMEDOUT;
+				return -1;
+			}
+			status = poll(&pfd, 1, (deadline - now) * 1000);
+			if (status < 0) {
+				if (errno == EINTR)
+					continue;
+				VANESSA_LOGGER_DEBUG_ERRNO("poll");
+				return -1;
+			}
+			if (!status)
+				continue;
+		}
+
+		bytes = read(fd, buf, count);
+		if (bytes < 0) {
+			if (errno == EINTR)
+				continue;
+			VANESSA_LOGGER_DEBUG_ERRNO("read");
+			return -1;
+		}
+		if (!bytes) {
+			VANESSA_LOGGER_DEBUG("closed while reading "
+					     "PROXY protocol header");
+			return -1;
+		}
+		buf += bytes;
+		count -= bytes;
+	}
+
+	return 0;
+}
+
+
+int vanessa_socket_proxy_v2_recv(int fd, struct sockaddr_storage *from,
+				 struct sockaddr_storage *to, int timeout)
+{
+	char *buf;
+	size_t len;
+	ssize_t status;
+	time_t deadline;
+
+	deadline = timeout > 0 ? time(NULL) + timeout : 0;
+
+	buf = malloc(__VANESSA_SOCKET_PROXY_HDR_LEN + 0xffff);
+	if (!buf) {
+		VANESSA_LOGGER_DEBUG_ERRNO("malloc");
+		return -1;
+	}
+
+	/* Read no further than the header, the rest is for the server */
+	if (__vanessa_socket_proxy_read(fd, buf,
+					__VANESSA_SOCKET_PROXY_HDR_LEN,
+					deadline) < 0)
+		goto err;
+	status = vanessa_socket_proxy_v2_parse(buf,
+					       __VANESSA_SOCKET_PROXY_HDR_LEN,
+					       from, to);
+	if (status < 0)
+		goto err;
+	len = __VANESSA_SOCKET_PROXY_HDR_LEN +
+		(((unsigned char)buf[14] << 8) | (unsigned char)buf[15]);
+	if (!status) {
+		if (__vanessa_socket_proxy_read(fd,
+				buf + __VANESSA_SOCKET_PROXY_HDR_LEN,
+				len - __VANESSA_SOCKET_PROXY_HDR_LEN,
+				deadline) < 0)
+			goto err;
+		if (vanessa_socket_proxy_v2_parse(buf, len, from, to) < 0)
+			goto err;
+	}
+
+	free(buf);
+	return 0;
+
+err:
+	VANESSA_LOGGER_DEBUG("invalid PROXY protocol header");
+	free(buf);
+	return -1;
+}
@@ -0,0 +1,85 @@
+/**********************************************************************
+ * vanessa_socket_rusage.c                                 October 2026
+ * Simon Horman                                      horms@verge.net.au
+ *
+ * Resource usage of reaped children
+ *
+ * vanessa_socket
+ * Library to simplify handling of TCP sockets
+ * Copyright (C) 1999-2008  Simon Horman <horms@verge.net.au>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307 USA
+ *
+ **********************************************************************/
+
+#include "vanessa_socket.h"
+
+/*
+ * Children are usually reaped by a signal handler, so the totals are
+ * only ever added to, with no locks or allocation.
+ */
+static vanessa_socket_rusage_t __vanessa_socket_rusage;
+
+
+static void __vanessa_socket_rusage_observe(uint64_t *bucket,
+					    uint64_t min, uint64_t value)
+{
+	int i;
+
+	for (i = 0; i < VANESSA_SOCKET_RUSAGE_BUCKETS - 1 &&
+	     value > min << i; i++)
+		;
+	bucket[i]++;
+}
+
+
+void vanessa_socket_rusage_add(int status, const struct rusage *ru)
+{
+	vanessa_socket_rusage_t *r = &__vanessa_socket_rusage;
+	uint64_t utime, stime;
+
+	if (WIFSIGNALED(status))
+		r->signaled++;
+	else if (WIFEXITED(status) && !WEXITSTATUS(status))
+		r->exited++;
+	else
+		r->failed++;
+
+	utime = (uint64_t)ru->ru_utime.tv_sec * 1000000 +
+		ru->ru_utime.tv_usec;
+	stime = (uint64_t)ru->ru_stime.tv_sec * 1000000 +
+		ru->ru_stime.tv_usec;
+	r->utime += utime;
+	r->stime += stime;
+	r->nvcsw += ru->ru_nvcsw;
+	r->nivcsw += ru->ru_nivcsw;
+	r->maxrss += ru->ru_maxrss;
+	if (utime + stime > r->cpu_max)
+		r->cpu_max = utime + stime;
+	if ((uint64_t)ru->ru_maxrss > r->maxrss_max)
+		r->maxrss_max = ru->ru_maxrss;
+
+	__vanessa_socket_rusage_observe(r->cpu, VANESSA_SOCKET_RUSAGE_CPU_MIN,
+					utime + stime);
+	__vanessa_socket_rusage_observe(r->rss, VANESSA_SOCKET_RUSAGE_RSS_MIN,
+					ru->ru_maxrss);
+}
+
+
+void vanessa_socket_rusage_get(vanessa_socket_rusage_t *r)
+{
+	*r = __vanessa_socket_rusage;
+}
@@ -0,0 +1,441 @@
+/**********************************************************************
+ * vanessa_socket_scoreboard.c                             October 2026
+ * Simon Horman                                      horms@verge.net.au
+ *
+ * Scoreboard of what forked children are doing, in shared memory
+ *
+ * vanessa_socket
+ * Library to simplify handling of TCP sockets
+ * Copyright (C) 1999-2008  Simon Horman <horms@verge.net.au>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307 USA
+ *
+ **********************************************************************/
+
+#include "vanessa_socket.h"
+#include "vanessa_socket_pidmap.h"
+
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+/*
+ * Each slot is written by one process at a time: the parent while the
+ * slot is free, and the child it was given to until the child has
+ * been reaped. So writers only need to bump the sequence count around
+ * their writes for readers to be able to tell that they raced with
+ * one.
+ *
+ * The parent keeps the free slots on a stack, and maps the children
+ * that hold slots to them by pid, so that slots can be freed when
+ * children are reaped. Neither is shared.
+ */
+
+#define __VANESSA_SOCKET_SCOREBOARD_ALIGN 64	/* Bytes in a cache line */
+#define __VANESSA_SOCKET_SCOREBOARD_TRIES 1024	/* Reads of a busy slot */
+
+typedef struct {
+	__vanessa_socket_pidmap_entry_t pid;
+	uint32_t slot;
+} __vanessa_socket_scoreboard_child_t;
+
+struct vanessa_socket_scoreboard_struct {
+	vanessa_socket_scoreboard_head_t *head;
+	size_t len;			/* Of the mapping */
+	uint32_t *free;			/* Stack of free slots */
+	uint32_t nfree;
+	__vanessa_socket_pidmap_t child;
+};
+
+/* The slot of this process, if it is a child that was given one */
+vanessa_socket_scoreboard_slot_t *__vanessa_socket_scoreboard_self;
+
+
+static vanessa_socket_scoreboard_slot_t *
+__vanessa_socket_scoreboard_slot(vanessa_socket_scoreboard_head_t *head,
+				 uint32_t i)
+{
+	return (vanessa_socket_scoreboard_slot_t *)
+		((char *)head + (size_t)head->slot_size * (i + 1));
+}
+
+
+static void
+__vanessa_socket_scoreboard_begin(vanessa_socket_scoreboard_slot_t *slot)
+{
+	slot->seq++;
+	__sync_synchronize();
+}
+
+
+static void
+__vanessa_socket_scoreboard_end(vanessa_socket_scoreboard_slot_t *slot)
+{
+	__sync_synchronize();
+	slot->seq++;
+}
+
+
+static void __vanessa_socket_scoreboard_addr(struct sockaddr_storage *dst,
+					     const struct sockaddr *sa)
+{
+	size_t len;
+
+	switch (sa->sa_family) {
+	case AF_INET:
+		len = sizeof(struct sockaddr_in);
+		break;
+	case AF_INET6:
+		len = sizeof(struct sockaddr_in6);
+		break;
+	case AF_UNIX:
+		len = sizeof(struct sockaddr_un);
+		break;
+	default:
+		len = 0;
+		break;
+	}
+
+	memset(dst, 0, sizeof(*dst));
+	memcpy(dst, sa, len);
+}
+
+
+vanessa_socket_scoreboard_t *
+vanessa_socket_scoreboard_create(const char *path, unsigned int nslot)
+{
+	vanessa_socket_scoreboard_t *sb;
+	size_t slot_size;
+	uint32_t i;
+	void *p;
+	int fd = -1;
+
+	if (!nslot || nslot > 0x10000000U) {
+		VANESSA_LOGGER_DEBUG_UNSAFE("invalid nslot: %u", nslot);
+		return NULL;
+	}
+
+	sb = calloc(1, sizeof(*sb));
+	if (!sb) {
+		VANESSA_LOGGER_DEBUG_ERRNO("calloc");
+		return NULL;
+	}
+
+	sb->free = malloc(nslot * sizeof(*sb->free));
+	if (!sb->free) {
+		VANESSA_LOGGER_DEBUG_ERRNO("malloc");
+		goto err;
+	}
+	if (__vanessa_socket_pidmap_create(&sb->child, nslot,
+				sizeof(__vanessa_socket_scoreboard_child_t))
+	    < 0) {
+		VANESSA_LOGGER_DEBUG("__vanessa_socket_pidmap_create");
+		goto err;
+	}
+
+	slot_size = (sizeof(vanessa_socket_scoreboard_slot_t) +
+		     __VANESSA_SOCKET_SCOREBOARD_ALIGN - 1) &
+		    ~(size_t)(__VANESSA_SOCKET_SCOREBOARD_ALIGN - 1);
+	sb->len = slot_size * (nslot + 1);
+
+	if (path) {
+		fd = open(path, O_RDWR|O_CREAT|O_TRUNC, 0644);
+		if (fd < 0) {
+			VANESSA_LOGGER_DEBUG_UNSAFE("open \"%s\": %s", path,
+						    strerror(errno));
+			goto err;
+		}
+		if (ftruncate(fd, sb->len) < 0) {
+			VANESSA_LOGGER_DEBUG_ERRNO("ftruncate");
+			goto err;
+		}
+		p = mmap(NULL, sb->len, PROT_READ|PROT_WRITE, MAP_SHARED,
+			 fd, 0);
+	} else {
+		p = mmap(NULL, sb->len, PROT_READ|PROT_WRITE,
+			 MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+	}
+	if (p == MAP_FAILED) {
+		VANESSA_LOGGER_DEBUG_ERRNO("mmap");
+		goto err;
+	}
+	if (fd >= 0 && close(fd) < 0)
+		VANESSA_LOGGER_DEBUG_ERRNO("warning: close");
+	fd = -1;
+
+	/* The mapping is zeroed, so every slot is free */
+	sb->head = p;
+	sb->head->nslot = nslot;
+	sb->head->slot_size = slot_size;
+	sb->head->version = VANESSA_SOCKET_SCOREBOARD_VERSION;
+	__sync_synchronize();
+	sb->head->magic = VANESSA_SOCKET_SCOREBOARD_MAGIC;
+
+	/* Lowest first, so that readers find children near the start */
+	for (i = 0; i < nslot; i++)
+		sb->free[i] = nslot - 1 - i;
+	sb->nfree = nslot;
+
+	return sb;
+err:
+	if (fd >= 0 && close(fd) < 0)
+		VANESSA_LOGGER_DEBUG_ERRNO("warning: close");
+	vanessa_socket_scoreboard_destroy(sb);
+	return NULL;
+}
+
+
+vanessa_socket_scoreboard_t *vanessa_socket_scoreboard_open(const char *path)
+{
+	vanessa_socket_scoreboard_t *sb;
+	vanessa_socket_scoreboard_head_t head;
+	struct stat st;
+	void *p;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		VANESSA_LOGGER_DEBUG_UNSAFE("open \"%s\": %s", path,
+					    strerror(errno));
+		return NULL;
+	}
+
+	if (fstat(fd, &st) < 0) {
+		VANESSA_LOGGER_DEBUG_ERRNO("fstat");
+		goto err;
+	}
+	if ((size_t)st.st_size < sizeof(head) ||
+	    read(fd, &head, sizeof(head)) != sizeof(head) ||
+	    head.magic != VANESSA_SOCKET_SCOREBOARD_MAGIC ||
+	    head.version != VANESSA_SOCKET_SCOREBOARD_VERSION ||
+	    head.slot_size < sizeof(vanessa_socket_scoreboard_slot_t) ||
+	    (uint64_t)head.slot_size * (head.nslot + 1) >
+	    (uint64_t)st.st_size) {
+		VANESSA_LOGGER_DEBUG_UNSAFE("\"%s\" is not a scoreboard",
+					    path);
+		goto err;
+	}
+
+	sb = calloc(1, sizeof(*sb));
+	if (!sb) {
+		VANESSA_LOGGER_DEBUG_ERRNO("calloc");
+		goto err;
+	}
+	sb->len = (size_t)head.slot_size * (head.nslot + 1);
+
+	p = mmap(NULL, sb->len, PROT_READ, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED) {
+		VANESSA_LOGGER_DEBUG_ERRNO("mmap");
+		free(sb);
+		goto err;
+	}
+	sb->head = p;
+
+	if (close(fd) < 0)
+		VANESSA_LOGGER_DEBUG_ERRNO("warning: close");
+	return sb;
+err:
+	if (close(fd) < 0)
+		VANESSA_LOGGER_DEBUG_ERRNO("warning: close");
+	return NULL;
+}
+
+
+void vanessa_socket_scoreboard_destroy(vanessa_socket_scoreboard_t *sb)
+{
+	if (!sb)
+		return;
+
+	if (sb->head && munmap(sb->head, sb->len) < 0)
+		VANESSA_LOGGER_DEBUG_ERRNO("warning: munmap");
+	free(sb->free);
+	__vanessa_socket_pidmap_destroy(&sb->child);
+	free(sb);
+}
+
+
+unsigned int vanessa_socket_scoreboard_nslot(vanessa_socket_scoreboard_t *sb)
+{
+	return sb->head->nslot;
+}
+
+
+int vanessa_socket_scoreboard_read(vanessa_socket_scoreboard_t *sb,
+				   unsigned int i,
+				   vanessa_socket_scoreboard_slot_t *slot)
+{
+	vanessa_socket_scoreboard_slot_t *s;
+	unsigned int tries;
+	uint32_t seq;
+
+	if (i >= sb->head->nslot)
+		return -1;
+
+	/* A writer that was stopped mid-write would keep the count odd */
+	s = __vanessa_socket_scoreboard_slot(sb->head, i);
+	for (tries = 0; tries < __VANESSA_SOCKET_SCOREBOARD_TRIES; tries++) {
+		seq = s->seq;
+		if (seq & 1)
+			continue;
+		__sync_synchronize();
+		memcpy(slot, s, sizeof(*slot));
+		__sync_synchronize();
+		if (s->seq == seq)
+			return 0;
+	}
+	memcpy(slot, s, sizeof(*slot));
+	slot->seq |= 1;
+
+	return 0;
+}
+
+
+int vanessa_socket_scoreboard_claim(vanessa_socket_scoreboard_t *sb)
+{
+	if (!sb->nfree)
+		return -1;
+
+	return sb->free[--sb->nfree];
+}
+
+
+void vanessa_socket_scoreboard_child(vanessa_socket_scoreboard_t *sb,
+				     int slot, pid_t pid)
+{
+	__vanessa_socket_scoreboard_child_t *c;
+
+	if (slot < 0)
+		return;
+
+	/* There is room for as many children as slots */
+	if (pid < 0 || !(c = __vanessa_socket_pidmap_add(&sb->child, pid))) {
+		sb->free[sb->nfree++] = slot;
+		return;
+	}
+	c->slot = slot;
+}
+
+
+void vanessa_socket_scoreboard_reap(vanessa_socket_scoreboard_t *sb,
+				    pid_t pid)
+{
+	vanessa_socket_scoreboard_slot_t *slot;
+	__vanessa_socket_scoreboard_child_t *c;
+
+	c = __vanessa_socket_pidmap_find(&sb->child, pid);
+	if (!c)
+		return;
+
+	/* The child has exited, so the slot is the parent's again. It may
+	 * have been killed in the middle of a write. */
+	slot = __vanessa_socket_scoreboard_slot(sb->head, c->slot);
+	slot->seq |= 1;
+	__sync_synchronize();
+	memset((char *)slot + sizeof(slot->seq), 0,
+	       sizeof(*slot) - sizeof(slot->seq));
+	__vanessa_socket_scoreboard_end(slot);
+	sb->free[sb->nfree++] = c->slot;
+	__vanessa_socket_pidmap_remove(&sb->child, c);
+}
+
+
+void vanessa_socket_scoreboard_enter(vanessa_socket_scoreboard_t *sb,
+				     int slot, const struct sockaddr *from,
+				     const struct sockaddr *to)
+{
+	vanessa_socket_scoreboard_slot_t *s;
+	struct timespec ts;
+
+	if (slot < 0)
+		return;
+
+	s = __vanessa_socket_scoreboard_slot(sb->head, slot);
+	clock_gettime(CLOCK_REALTIME, &ts);
+
+	__vanessa_socket_scoreboard_begin(s);
+	s->state = VANESSA_SOCKET_SCOREBOARD_ACCEPT;
+	s->pid = getpid();
+	s->start = (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+	s->bytes[0] = s->bytes[1] = 0;
+	__vanessa_socket_scoreboard_addr(&s->from, from);
+	if (to)
+		__vanessa_socket_scoreboard_addr(&s->to, to);
+	else
+		memset(&s->to, 0, sizeof(s->to));
+	memset(&s->server, 0, sizeof(s->server));
+	__vanessa_socket_scoreboard_end(s);
+
+	__vanessa_socket_scoreboard_self = s;
+}
+
+
+void vanessa_socket_scoreboard_state(uint32_t state)
+{
+	vanessa_socket_scoreboard_slot_t *s = __vanessa_socket_scoreboard_self;
+
+	if (!s)
+		return;
+
+	__vanessa_socket_scoreboard_begin(s);
+	s->state = state;
+	__vanessa_socket_scoreboard_end(s);
+}
+
+
+void vanessa_socket_scoreboard_peer(const struct sockaddr *from,
+				    const struct sockaddr *to)
+{
+	vanessa_socket_scoreboard_slot_t *s = __vanessa_socket_scoreboard_self;
+
+	if (!s)
+		return;
+
+	__vanessa_socket_scoreboard_begin(s);
+	__vanessa_socket_scoreboard_addr(&s->from, from);
+	__vanessa_socket_scoreboard_addr(&s->to, to);
+	__vanessa_socket_scoreboard_end(s);
+}
+
+
+void vanessa_socket_scoreboard_server(const struct sockaddr *server)
+{
+	vanessa_socket_scoreboard_slot_t *s = __vanessa_socket_scoreboard_self;
+
+	if (!s)
+		return;
+
+	__vanessa_socket_scoreboard_begin(s);
+	__vanessa_socket_scoreboard_addr(&s->server, server);
+	__vanessa_socket_scoreboard_end(s);
+}
+
+
+void vanessa_socket_scoreboard_bytes(int side, size_t bytes)
+{
+	vanessa_socket_scoreboard_slot_t *s = __vanessa_socket_scoreboard_self;
+
+	if (!s)
+		return;
+
+	__vanessa_socket_scoreboard_begin(s);
+	s->bytes[side] += bytes;
+	__vanessa_socket_scoreboard_end(s);
+}
@@ -25,7 +25,10 @@
  *
  **********************************************************************/
 
+#include <stddef.h>
 #include <sys/poll.h>
+#include <sys/stat.h>
+#include <time.h>
 
 #include "vanessa_socket.h"
 #include "unused.h"
@@ -33,6 +36,135 @@
 /*Keep track of the total number of connections in the parent process*/
 unsigned int noconnection;
 
+/*Access control list checked before forking, NULL for none*/
+static vanessa_socket_acl_t *volatile __vanessa_socket_server_acl;
+
+/*Limits checked before forking, NULL for none*/
+vanessa_socket_limit_t *__vanessa_socket_server_limit;
+
+/*Scoreboard that children are given slots in, NULL for none*/
+vanessa_socket_scoreboard_t *__vanessa_socket_server_scoreboard;
+
+/*Set to stop accepting connections, maybe from a signal handler*/
+static volatile sig_atomic_t __vanessa_socket_server_draining;
+
+/*Set to return from vanessa_socket_server_acceptv() once, to reload*/
+static volatile sig_atomic_t __vanessa_socket_server_reloading;
+
+/*Written to, to wake vanessa_socket_server_acceptv() from poll(),
+  -1 until it is first called*/
+static volatile sig_atomic_t __vanessa_socket_server_wake_fd = -1;
+static int __vanessa_socket_server_wake_rfd = -1;
+
+/*Milliseconds between checks for children that have exited*/
+#define __VANESSA_SOCKET_DRAIN_INTERVAL 100
+
+
+/**********************************************************************
+ * __vanessa_socket_server_unix_stale
+ * Check if the socket at a path has been left behind by a process that
+ * is no longer listening on it
+ * pre: addr: unix domain socket address with a path
+ *      addrlen: length of addr
+ * return: 1 if nothing accepts connections on the socket
+ *         0 if something does, or it could not be told,
+ *           errno is set to EADDRINUSE
+ **********************************************************************/
+
+static int __vanessa_socket_server_unix_stale(const struct sockaddr_un *addr,
+					      socklen_t addrlen)
+{
+	int s, opt, err;
+
+	if ((s = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		VANESSA_LOGGER_DEBUG_ERRNO("socket");
+		goto in_use;
+	}
+
+	/* Don't wait if the listener's backlog is full, it's in use */
+	opt = fcntl(s, F_GETFL, NULL);
+	if (opt < 0 || fcntl(s, F_SETFL, opt | O_NONBLOCK) < 0) {
+		VANESSA_LOGGER_DEBUG_ERRNO("fcntl");
+		close(s);
+		goto in_use;
+	}
+
+	err = connect(s, (const struct sockaddr *)addr, addrlen) < 0 ?
+	      errno : 0;
+	close(s);
+	if (err == ECONNREFUSED)
+		return 1;
+
+in_use:
+	errno = EADDRINUSE;
+	return 0;
+}
+
+
+/**********************************************************************
+ * __vanessa_socket_server_bind_unix
+ * Open a unix domain socket and bind it to a path or abstract name
+ * pre: interface_address: "unix:/path" or "unix:@name"
+ * post: Bound socket is returned
+ *       If a socket that nothing is listening on already exists at
+ *       path it is unlinked first. If something is listening on it
+ *       an error is returned with errno set to EADDRINUSE. Other file
+ *       types are left alone and bind() will fail.
+ * return: socket
+ *         -1 on error
+ **********************************************************************/
+
+static int __vanessa_socket_server_bind_unix(const char *interface_address)
+{
+	int s;
+	struct sockaddr_un addr;
+	socklen_t addrlen;
+	struct stat st;
+
+	if (vanessa_socket_unix_sockaddr(interface_address, &addr,
+					 &addrlen) < 0) {
+		VANESSA_LOGGER_DEBUG("vanessa_socket_unix_sockaddr");
+		return -1;
+	}
+
+	/* Remove a stale socket left behind by a previous process,
+	 * but not one that another process is still listening on */
+	if (*addr.sun_path && !lstat(addr.sun_path, &st) &&
+	    S_ISSOCK(st.st_mode)) {
+		if (!__vanessa_socket_server_unix_stale(&addr, addrlen)) {
+			VANESSA_LOGGER_DEBUG_UNSAFE("%s: in use",
+						    addr.sun_path);
+			errno = EADDRINUSE;
+			return -1;
+		}
+		if (unlink(addr.sun_path) < 0) {
+			VANESSA_LOGGER_DEBUG_ERRNO("unlink");
+			return -1;
+		}
+	}
+
+	if ((s = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		VANESSA_LOGGER_DEBUG_ERRNO("socket");
+		return -1;
+	}
+
+	if (bind(s, (struct sockaddr *)&addr, addrlen) < 0) {
+		VANESSA_LOGGER_DEBUG_ERRNO("bind");
+		goto err;
+	}
+
+	if (listen(s, SOMAXCONN) < 0) {
+		VANESSA_LOGGER_DEBUG_ERRNO("listen");
+		goto err;
+	}
+
+	return s;
+err:
+	if (close(s) < 0)
+		VANESSA_LOGGER_DEBUG_ERRNO("warning: close");
+	return -1;
+}
+
 
 /**********************************************************************
  * vanessa_socket_server_bind
@@ -41,10 +173,19 @@ unsigned int noconnection;
  *            or an entry from /etc/services
  *      interface_address: If NULL bind to 0.0.0.0, else
  *                         bind to interface(es) with this address.
+ *                         If of the form "unix:/path" or "unix:@name"
+ *                         then bind a unix domain socket and ignore port.
+ *                         A stale socket at path is removed first,
+ *                         if something is still listening on it
+ *                         then -1 is returned with errno set to
+ *                         EADDRINUSE. Use vanessa_socket_server_unlink()
+ *                         to remove path once the socket is closed.
  *      flag: If VANESSA_SOCKET_NO_LOOKUP then no host and port lookups
  *            will be performed
  *            If VANESSA_SOCKET_TCP_KEEPALIVE then turn on
  *            TCP-Keepalive
+ *            If VANESSA_SOCKET_PROTO_UDP then bind a datagram socket.
+ *            listen() is not called on datagram sockets.
  * post: Bound socket is returned
  * return: socket
  *         -1 on error
@@ -57,11 +198,14 @@ int vanessa_socket_server_bind(const char *port,
 	int s, g, err;
 	struct addrinfo hints, *res;
 
+	if (vanessa_socket_host_is_unix(interface_address))
+		return __vanessa_socket_server_bind_unix(interface_address);
+
 	/* Get addrinfo list for the listening address */
 	bzero( &hints, sizeof hints );
 	hints.ai_flags = AI_PASSIVE;
 	hints.ai_family = AF_UNSPEC;
-	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_socktype = vanessa_socket_flag_socktype(flag);
 
 	err = getaddrinfo(interface_address, port, &hints, &res);
 	if (err) {
@@ -115,7 +259,8 @@ int vanessa_socket_server_bind(const char *port,
 				goto err_close;
 			continue;
 		}
-		if ((listen(s, SOMAXCONN))) {
+		if (res->ai_socktype == SOCK_STREAM &&
+		    (listen(s, SOMAXCONN))) {
 			VANESSA_LOGGER_DEBUG_ERRNO("listen");
 			if (close(s))
 				goto err_close;
@@ -173,6 +318,7 @@ vanessa_socket_server_bindv(const const char **fromv,
 		if (s[ns] >= 0)
 			continue;
 		VANESSA_LOGGER_DEBUG("vanessa_socket_server_bind_sockaddr_in");
+		vanessa_socket_server_unlinkv(s);
 		if (vanessa_socket_closev(s) < 0) {
 			VANESSA_LOGGER_DEBUG("vanessa_socket_closev");
 		}
@@ -336,6 +482,73 @@ vanessa_socket_closev(int *sockv)
 }
 
 
+/**********************************************************************
+ * vanessa_socket_server_unlink
+ * Remove the path that a unix domain socket is bound to
+ * pre: s: socket, as returned by vanessa_socket_server_bind()
+ * post: If s is a unix domain socket bound to a path then the path is
+ *       unlinked, otherwise nothing is done. Should only be called by
+ *       the process that bound s, not by children that close their copy.
+ * return: 0 on success
+ *         -1 on error
+ **********************************************************************/
+
+int vanessa_socket_server_unlink(int s)
+{
+	struct sockaddr_un addr;
+	socklen_t addrlen = sizeof(addr);
+	char path[sizeof(addr.sun_path) + 1];
+	size_t len;
+
+	memset(&addr, 0, sizeof(addr));
+	if (getsockname(s, (struct sockaddr *)&addr, &addrlen) < 0) {
+		VANESSA_LOGGER_DEBUG_ERRNO("getsockname");
+		return -1;
+	}
+
+	if (addr.sun_family != AF_UNIX || !*addr.sun_path ||
+	    addrlen <= offsetof(struct sockaddr_un, sun_path))
+		return 0;
+
+	/* sun_path need not be NUL terminated if it is full */
+	len = addrlen - offsetof(struct sockaddr_un, sun_path);
+	if (len > sizeof(addr.sun_path))
+		len = sizeof(addr.sun_path);
+	memcpy(path, addr.sun_path, len);
+	path[len] = '\0';
+
+	if (unlink(path) < 0 && errno != ENOENT) {
+		VANESSA_LOGGER_DEBUG_ERRNO("unlink");
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/**********************************************************************
+ * vanessa_socket_server_unlinkv
+ * Remove the paths that unix domain sockets are bound to
+ * pre: sockv: -1 terminated pointer of sockets, as returned by
+ *             vanessa_socket_server_bindv()
+ * post: vanessa_socket_server_unlink() is called for each socket,
+ *       the sockets are not closed
+ * return: 0 on success
+ *         -1 if any of the paths could not be removed
+ **********************************************************************/
+
+int vanessa_socket_server_unlinkv(const int *sockv)
+{
+	int status = 0;
+
+	for (; *sockv >= 0; sockv++)
+		if (vanessa_socket_server_unlink(*sockv) < 0)
+			status = -1;
+
+	return status;
+}
+
+
 /**********************************************************************
  * vanessa_socket_server_accept
  * Accept connections on a bound socket.
@@ -378,10 +591,16 @@ __vanessa_socket_server_accept(int *g, int listen_socket, int *listen_socketv,
 				      vanessa_socket_flag_t flag, long opt)
 {
 	unsigned int addrlen;
+	unsigned int tolen;
 	pid_t child = 0;
 	struct sockaddr_storage from;
+	vanessa_socket_limit_ticket_t ticket;
+	vanessa_socket_acl_t *acl;
+	sigset_t mask, omask;
+	int slot = -1;
 
 	extern unsigned int noconnection;
+	extern __thread vanessa_socket_trace_t *__vanessa_socket_trace;
 
 	*g = -1;
 
@@ -392,12 +611,34 @@ __vanessa_socket_server_accept(int *g, int listen_socket, int *listen_socketv,
 			if (opt & O_NONBLOCK &&
 			    (errno == EAGAIN || errno == EWOULDBLOCK))
 				return -1; /* Don't log EAGAIN or EWOULDBLOCK */
+			/* Only seen if the signal handler that started
+			 * draining was installed without SA_RESTART */
+			if (errno == EINTR && __vanessa_socket_server_draining)
+				return -1;
 			if (errno == EINTR || errno == ECONNABORTED ||
 			    errno == EAGAIN || errno == EWOULDBLOCK)
 				continue; /* Ignore */
 			VANESSA_LOGGER_DEBUG_ERRNO("accept");
 			return(-1);
 		}
+
+		if (__vanessa_socket_trace) {
+			memset(__vanessa_socket_trace, 0,
+			       sizeof(*__vanessa_socket_trace));
+			__vanessa_socket_trace->accept =
+				vanessa_socket_trace_now();
+		}
+
+		acl = __vanessa_socket_server_acl;
+		if (acl && vanessa_socket_acl_check(acl,
+				(struct sockaddr *) &from) ==
+		    VANESSA_SOCKET_ACL_DENY) {
+			VANESSA_LOGGER_DEBUG("denied by access control list");
+			if (close(*g) < 0)
+				VANESSA_LOGGER_DEBUG_ERRNO("warning: close");
+			*g = -1;
+			continue;
+		}
 	
 		if (flag & VANESSA_SOCKET_NO_FORK)
 			break;
@@ -407,17 +648,56 @@ __vanessa_socket_server_accept(int *g, int listen_socket, int *listen_socketv,
 			VANESSA_LOGGER_DEBUG("too many connections");
 			goto err;
 		}
+
+		/* Keep the reaper from seeing the child before it is
+		 * counted, and from updating the limits under us */
+		sigemptyset(&mask);
+		sigaddset(&mask, SIGCHLD);
+		sigprocmask(SIG_BLOCK, &mask, &omask);
+
+		if (__vanessa_socket_server_limit &&
+		    vanessa_socket_limit_admit(__vanessa_socket_server_limit,
+					       (struct sockaddr *) &from,
+					       &ticket) < 0) {
+			sigprocmask(SIG_SETMASK, &omask, NULL);
+			VANESSA_LOGGER_DEBUG("over source address limits");
+			if (close(*g) < 0)
+				VANESSA_LOGGER_DEBUG_ERRNO("warning: close");
+			*g = -1;
+			continue;
+		}
 		
+		if (__vanessa_socket_server_scoreboard)
+			slot = vanessa_socket_scoreboard_claim(
+				__vanessa_socket_server_scoreboard);
+
 		child = fork();
 		if (child < 0) {
 			VANESSA_LOGGER_DEBUG_ERRNO("fork");
+			if (__vanessa_socket_server_limit)
+				vanessa_socket_limit_release(
+					__vanessa_socket_server_limit, &ticket);
+			if (__vanessa_socket_server_scoreboard)
+				vanessa_socket_scoreboard_child(
+					__vanessa_socket_server_scoreboard,
+					slot, -1);
+			sigprocmask(SIG_SETMASK, &omask, NULL);
 			goto err;
 		}
-		else if(!child)
+		else if(!child) {
+			sigprocmask(SIG_SETMASK, &omask, NULL);
 			break;
+		}
 
 		/* Parent */
 		noconnection++;
+		if (__vanessa_socket_server_limit)
+			vanessa_socket_limit_child(__vanessa_socket_server_limit,
+						   child, &ticket);
+		if (__vanessa_socket_server_scoreboard)
+			vanessa_socket_scoreboard_child(
+				__vanessa_socket_server_scoreboard, slot, child);
+		sigprocmask(SIG_SETMASK, &omask, NULL);
 		if(close(*g) < 0) {
 			VANESSA_LOGGER_DEBUG_ERRNO("warning: close");
 			return -1;
@@ -441,10 +721,12 @@ __vanessa_socket_server_accept(int *g, int listen_socket, int *listen_socketv,
 	}
 
 	/* 'from', 'return_to', and 'return_from' are in the same address
-	   family so the sockaddr lengths are identical. */
+	   family. But the lengths may differ for unix domain sockets,
+	   where the peer is usually unnamed, so keep them apart. */
 	if (return_to) {
+		tolen = sizeof(from);
 		if (getsockname (*g, (struct sockaddr *) return_to, 
-				&addrlen) < 0) { 
+				&tolen) < 0) { 
 			VANESSA_LOGGER_DEBUG_ERRNO("getsockname"); 
 			return -1;
 		}
@@ -453,6 +735,11 @@ __vanessa_socket_server_accept(int *g, int listen_socket, int *listen_socketv,
 	if (return_from)
 		memcpy(return_from, &from, addrlen);
 
+	if (__vanessa_socket_server_scoreboard)
+		vanessa_socket_scoreboard_enter(__vanessa_socket_server_scoreboard,
+						slot, (struct sockaddr *)&from,
+						return_to);
+
 	return 0;
 err:
 	if (*g >= 0)
@@ -553,11 +840,13 @@ __vanessa_socket_server_acceptv(int *g, int listen_socket, int *listen_socketv,
 		return -1;
 	}
 
+	/* The socket is non-blocking now, so return to poll() once there
+	 * is nothing left to accept, say after a connection is denied */
 	status = child = __vanessa_socket_server_accept(g, listen_socket,
 							listen_socketv,
 							maximum_connections,
 							return_from, return_to,
-							flag, opt);
+							flag, opt | O_NONBLOCK);
 	if (child < 0) {
 		status = -1;
 		if (errno == EAGAIN || errno == EWOULDBLOCK) {
@@ -586,6 +875,66 @@ __vanessa_socket_server_acceptv(int *g, int listen_socket, int *listen_socketv,
 }
 
 
+/**********************************************************************
+ * __vanessa_socket_server_wake_init
+ * Open the pipe used to wake vanessa_socket_server_acceptv()
+ * pre: none
+ * post: If it isn't already open a non-blocking pipe is opened and
+ *       __vanessa_socket_server_wake_fd is set to its write end
+ * return: read end of the pipe
+ *         -1 on error
+ **********************************************************************/
+
+static int __vanessa_socket_server_wake_init(void)
+{
+	int fd[2];
+	int i;
+
+	if (__vanessa_socket_server_wake_rfd >= 0)
+		return __vanessa_socket_server_wake_rfd;
+
+	if (pipe(fd) < 0) {
+		VANESSA_LOGGER_DEBUG_ERRNO("pipe");
+		return -1;
+	}
+	for (i = 0; i < 2; i++) {
+		if (fcntl(fd[i], F_SETFL, O_NONBLOCK) < 0 ||
+		    fcntl(fd[i], F_SETFD, FD_CLOEXEC) < 0) {
+			VANESSA_LOGGER_DEBUG_ERRNO("fcntl");
+			close(fd[0]);
+			close(fd[1]);
+			return -1;
+		}
+	}
+
+	__vanessa_socket_server_wake_rfd = fd[0];
+	__vanessa_socket_server_wake_fd = fd[1];
+	return fd[0];
+}
+
+
+/**********************************************************************
+ * __vanessa_socket_server_wake
+ * Wake vanessa_socket_server_acceptv() from poll()
+ * pre: none
+ * post: A byte is written to the wake pipe, if it is open.
+ *       Safe to call from a signal handler.
+ **********************************************************************/
+
+static void __vanessa_socket_server_wake(void)
+{
+	int err = errno;
+	int fd = __vanessa_socket_server_wake_fd;
+
+	if (fd < 0)
+		return;
+
+	/* Only fails if the pipe is full, which wakes anyway */
+	if (write(fd, "", 1) < 0)
+		errno = err;
+}
+
+
 int 
 vanessa_socket_server_acceptv(int *listen_socketv,
 				      const unsigned int maximum_connections,
@@ -598,11 +947,14 @@ vanessa_socket_server_acceptv(int *listen_socketv,
 	size_t nfds;
 	size_t i;
 	struct pollfd *ufds;
+	char buf[64];
 
 	for (nfds = 0; listen_socketv[nfds] >= 0; nfds++)
 		;
 
-	ufds = (struct pollfd *)malloc(sizeof(struct pollfd) * nfds);
+	/* One more for the wake pipe, so that draining being started
+	 * between checking for it and calling poll() isn't missed */
+	ufds = (struct pollfd *)malloc(sizeof(struct pollfd) * (nfds + 1));
 	if (!ufds) {
 		VANESSA_LOGGER_DEBUG_ERRNO("malloc");
 		return -1;
@@ -612,11 +964,23 @@ vanessa_socket_server_acceptv(int *listen_socketv,
 		ufds[i].fd = listen_socketv[i];
 		ufds[i].events = POLLIN;
 	}
+	ufds[nfds].fd = __vanessa_socket_server_wake_init();
+	ufds[nfds].events = POLLIN;
+	if (ufds[nfds].fd < 0) {
+		VANESSA_LOGGER_DEBUG("__vanessa_socket_server_wake_init");
+		goto err;
+	}
 
 	for (;;) {
 		size_t i;
 
-		status = poll(ufds, nfds, -1);
+		if (__vanessa_socket_server_draining ||
+		    __vanessa_socket_server_reloading) {
+			errno = EINTR;
+			goto err;
+		}
+
+		status = poll(ufds, nfds + 1, -1);
 		if (status < 0) {
 			if (errno == EINTR)
 				continue;
@@ -624,6 +988,12 @@ vanessa_socket_server_acceptv(int *listen_socketv,
 			goto out;
 		}
 
+		if (ufds[nfds].revents) {
+			while (read(ufds[nfds].fd, buf, sizeof(buf)) > 0)
+				;
+			continue;
+		}
+
 		for (i = 0; i < nfds && status; i++) {
 			pid_t child;
 		
@@ -771,3 +1141,200 @@ vanessa_socket_server_connectv(const const char **fromv,
 
 	return (g);
 }
+
+
+/**********************************************************************
+ * vanessa_socket_server_drain_start
+ * Stop accepting connections
+ * pre: none
+ * post: vanessa_socket_server_acceptv() and the functions that use it
+ *       return -1 in the parent process, rather than waiting for
+ *       another connection, and vanessa_socket_server_draining()
+ *       returns non-zero. vanessa_socket_server_accept() does too if
+ *       it is interrupted by a signal, which it won't be if the
+ *       handler was installed with SA_RESTART, as signal() does with
+ *       glibc. Safe to call from a signal handler.
+ * return: none
+ **********************************************************************/
+
+void vanessa_socket_server_drain_start(void)
+{
+	__vanessa_socket_server_draining = 1;
+	__vanessa_socket_server_wake();
+}
+
+
+/**********************************************************************
+ * vanessa_socket_server_draining
+ * return: non-zero if vanessa_socket_server_drain_start() has been
+ *         called
+ *         0 otherwise
+ **********************************************************************/
+
+int vanessa_socket_server_draining(void)
+{
+	return __vanessa_socket_server_draining;
+}
+
+
+/**********************************************************************
+ * vanessa_socket_server_reload_start
+ * Stop waiting for connections, so that settings can be reloaded
+ * pre: none
+ * post: vanessa_socket_server_acceptv() returns -1 with errno set to
+ *       EINTR in the parent process, rather than waiting for another
+ *       connection, and vanessa_socket_server_reload_pending() returns
+ *       non-zero. Unlike vanessa_socket_server_drain_start() this only
+ *       happens once, and the listening sockets are left open, so the
+ *       caller can change settings outside of signal context and call
+ *       vanessa_socket_server_acceptv() again. Safe to call from a
+ *       signal handler.
+ * return: none
+ **********************************************************************/
+
+void vanessa_socket_server_reload_start(void)
+{
+	__vanessa_socket_server_reloading = 1;
+	__vanessa_socket_server_wake();
+}
+
+
+/**********************************************************************
+ * vanessa_socket_server_reload_pending
+ * return: non-zero if vanessa_socket_server_reload_start() has been
+ *         called since this was last called
+ *         0 otherwise
+ **********************************************************************/
+
+int vanessa_socket_server_reload_pending(void)
+{
+	/* Don't lose a reload started between reading and clearing */
+	return __sync_lock_test_and_set(&__vanessa_socket_server_reloading, 0);
+}
+
+
+/**********************************************************************
+ * vanessa_socket_server_drain
+ * Wait for the children forked for connections to exit
+ * pre: timeout: maximum number of seconds to wait.
+ *               If 0 then wait for as long as it takes.
+ * post: Exited children are waited for, and their resource usage is
+ *       accounted for as by vanessa_socket_handler_reaper_rusage().
+ *       This works whether or not either reaper is the handler for
+ *       SIGCHLD.
+ * return: Number of connections still open
+ **********************************************************************/
+
+unsigned int vanessa_socket_server_drain(unsigned int timeout)
+{
+	sigset_t mask, omask;
+	time_t deadline;
+	pid_t pid;
+	int status;
+	struct rusage ru;
+
+	extern unsigned int noconnection;
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGCHLD);
+
+	deadline = time(NULL) + timeout;
+	for (;;) {
+		/* Keep the reaper from counting the same children */
+		sigprocmask(SIG_BLOCK, &mask, &omask);
+		while (noconnection && (pid = wait4(-1, &status, WNOHANG,
+						     &ru)) > 0) {
+			noconnection--;
+			vanessa_socket_rusage_add(status, &ru);
+			if (__vanessa_socket_server_limit)
+				vanessa_socket_limit_reap(
+					__vanessa_socket_server_limit, pid);
+			if (__vanessa_socket_server_scoreboard)
+				vanessa_socket_scoreboard_reap(
+					__vanessa_socket_server_scoreboard, pid);
+		}
+		sigprocmask(SIG_SETMASK, &omask, NULL);
+
+		if (!noconnection || (timeout && time(NULL) >= deadline))
+			break;
+		poll(NULL, 0, __VANESSA_SOCKET_DRAIN_INTERVAL);
+	}
+
+	return noconnection;
+}
+
+
+/**********************************************************************
+ * vanessa_socket_server_children
+ * pre: none
+ * return: Number of children forked for connections by the server
+ *         functions that have not yet been reaped by
+ *         vanessa_socket_handler_reaper(),
+ *         vanessa_socket_handler_reaper_rusage() or
+ *         vanessa_socket_server_drain(). Only meaningful in the parent.
+ *         May be called from a thread other than the one that reaps.
+ **********************************************************************/
+
+unsigned int vanessa_socket_server_children(void)
+{
+	extern unsigned int noconnection;
+
+	return *(volatile unsigned int *)&noconnection;
+}
+
+
+/**********************************************************************
+ * vanessa_socket_server_limit
+ * Limit the connections accepted by the server functions
+ * pre: l: limiter, NULL for no limits
+ * post: vanessa_socket_server_accept(), _acceptv() and the functions
+ *       that use them check each connection they accept against l
+ *       before forking, and close it if it is over a limit. Children
+ *       are released by vanessa_socket_handler_reaper() and
+ *       vanessa_socket_server_drain().
+ **********************************************************************/
+
+void vanessa_socket_server_limit(vanessa_socket_limit_t *l)
+{
+	__vanessa_socket_server_limit = l;
+}
+
+
+/**********************************************************************
+ * vanessa_socket_server_scoreboard
+ * Give the children of the server functions slots in a scoreboard
+ * pre: sb: scoreboard, NULL for none
+ * post: vanessa_socket_server_accept(), _acceptv() and the functions
+ *       that use them claim a slot for each child they fork, which
+ *       enters it. Slots are taken back by
+ *       vanessa_socket_handler_reaper() and
+ *       vanessa_socket_server_drain().
+ **********************************************************************/
+
+void vanessa_socket_server_scoreboard(vanessa_socket_scoreboard_t *sb)
+{
+	__vanessa_socket_server_scoreboard = sb;
+}
+
+
+/**********************************************************************
+ * vanessa_socket_server_acl
+ * Set the access control list of the server functions
+ * pre: acl: list, NULL to allow all connections
+ * post: vanessa_socket_server_accept(), _acceptv() and the functions
+ *       that use them close each connection they accept that acl
+ *       denies, before forking or checking limits. May be called from
+ *       a signal handler.
+ * return: the list that was set before. If this was called from a
+ *         signal handler it may be in use by a check that the handler
+ *         interrupted, so it should not be destroyed until the server
+ *         functions have accepted another connection. Otherwise, say
+ *         once vanessa_socket_server_acceptv() has returned for
+ *         vanessa_socket_server_reload_start(), it may be destroyed
+ *         straight away.
+ **********************************************************************/
+
+vanessa_socket_acl_t *vanessa_socket_server_acl(vanessa_socket_acl_t *acl)
+{
+	return __sync_lock_test_and_set(&__vanessa_socket_server_acl, acl);
+}
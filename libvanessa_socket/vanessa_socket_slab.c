@@ -0,0 +1,250 @@
+/**********************************************************************
+ * vanessa_socket_slab.c                                   October 2026
+ * Simon Horman                                      horms@verge.net.au
+ *
+ * Slab allocator for objects of one size, such as sessions
+ *
+ * vanessa_socket
+ * Library to simplify handling of TCP sockets
+ * Copyright (C) 1999-2008  Simon Horman <horms@verge.net.au>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307 USA
+ *
+ **********************************************************************/
+
+
+#include "vanessa_socket.h"
+
+#include <errno.h>
+#include <stdint.h>
+
+/*
+ * Objects are carved out of slabs, each of which is allocated aligned
+ * to its size, a power of two, so that the slab an object is in is
+ * found by masking its address. The first cache line of a slab holds
+ * the list of its free objects, linked through their first word, and
+ * links it into the list of slabs in use. Slabs with free objects are
+ * kept at the head of that list and full ones at the tail. Objects are
+ * allocated from the slab at the head, last freed first as they are
+ * the most likely to still be in the cache.
+ *
+ * Once all the objects of a slab are free it is returned to the
+ * system, unless there is no spare slab, in which case it becomes the
+ * spare. So the memory of a peak is given back once it has passed,
+ * while an allocator whose use hovers around a slab boundary does not
+ * allocate and free a slab each time it crosses it.
+ */
+
+#define __VANESSA_SOCKET_SLAB_ALIGN 64	/* Bytes in a cache line */
+
+typedef struct __vanessa_socket_slab_hdr_struct __vanessa_socket_slab_hdr_t;
+
+struct __vanessa_socket_slab_hdr_struct {
+	__vanessa_socket_slab_hdr_t *next;
+	__vanessa_socket_slab_hdr_t *prev;
+	void *free;		/* First free object of this slab */
+	unsigned int nfree;
+};
+
+struct vanessa_socket_slab_struct {
+	size_t size;		/* Of objects, rounded up to a cache line */
+	size_t bytes;		/* Of slabs, a power of two */
+	unsigned int per_slab;
+	__vanessa_socket_slab_hdr_t list;	/* Of slabs in use */
+	__vanessa_socket_slab_hdr_t *spare;	/* All free, or NULL */
+	unsigned int count;	/* Objects in use */
+};
+
+
+static void __vanessa_socket_slab_unlink(__vanessa_socket_slab_hdr_t *h)
+{
+	h->prev->next = h->next;
+	h->next->prev = h->prev;
+}
+
+
+static void __vanessa_socket_slab_link(__vanessa_socket_slab_hdr_t *h,
+				       __vanessa_socket_slab_hdr_t *prev)
+{
+	h->prev = prev;
+	h->next = prev->next;
+	prev->next->prev = h;
+	prev->next = h;
+}
+
+
+vanessa_socket_slab_t *vanessa_socket_slab_create(size_t size,
+						  unsigned int per_slab)
+{
+	vanessa_socket_slab_t *s;
+	size_t bytes;
+
+	if (!size || !per_slab) {
+		VANESSA_LOGGER_DEBUG("size and per_slab must be non-zero");
+		return NULL;
+	}
+
+	size = (size + __VANESSA_SOCKET_SLAB_ALIGN - 1) &
+	       ~(size_t)(__VANESSA_SOCKET_SLAB_ALIGN - 1);
+	if (size > (SIZE_MAX / 4 - __VANESSA_SOCKET_SLAB_ALIGN) / per_slab) {
+		VANESSA_LOGGER_DEBUG("slabs too large");
+		return NULL;
+	}
+
+	/* Fill the slab with as many objects as fit */
+	for (bytes = __VANESSA_SOCKET_SLAB_ALIGN;
+	     bytes < __VANESSA_SOCKET_SLAB_ALIGN + size * per_slab;
+	     bytes <<= 1)
+		;
+
+	s = malloc(sizeof(*s));
+	if (!s) {
+		VANESSA_LOGGER_DEBUG_ERRNO("malloc");
+		return NULL;
+	}
+
+	s->size = size;
+	s->bytes = bytes;
+	s->per_slab = (bytes - __VANESSA_SOCKET_SLAB_ALIGN) / size;
+	s->list.next = s->list.prev = &s->list;
+	s->spare = NULL;
+	s->count = 0;
+
+	return s;
+}
+
+
+void vanessa_socket_slab_destroy(vanessa_socket_slab_t *s)
+{
+	__vanessa_socket_slab_hdr_t *h;
+
+	if (!s)
+		return;
+
+	while ((h = s->list.next) != &s->list) {
+		__vanessa_socket_slab_unlink(h);
+		free(h);
+	}
+	free(s->spare);
+
+	free(s);
+}
+
+
+/**********************************************************************
+ * __vanessa_socket_slab_grow
+ * Add a slab of free objects to the head of the list of slabs
+ * pre: s: slab allocator
+ * post: The spare slab is used if there is one, otherwise a slab is
+ *       allocated and its objects are put on its free list, lowest
+ *       address first
+ * return: 0 on success
+ *         -1 on error
+ **********************************************************************/
+
+static int __vanessa_socket_slab_grow(vanessa_socket_slab_t *s)
+{
+	__vanessa_socket_slab_hdr_t *h;
+	char *obj;
+	unsigned int i;
+	int err;
+
+	if (s->spare) {
+		__vanessa_socket_slab_link(s->spare, &s->list);
+		s->spare = NULL;
+		return 0;
+	}
+
+	err = posix_memalign((void **)&h, s->bytes, s->bytes);
+	if (err) {
+		errno = err;
+		VANESSA_LOGGER_DEBUG_ERRNO("posix_memalign");
+		return -1;
+	}
+
+	h->free = NULL;
+	for (i = s->per_slab; i > 0; i--) {
+		obj = (char *)h + __VANESSA_SOCKET_SLAB_ALIGN +
+		      s->size * (i - 1);
+		*(void **)obj = h->free;
+		h->free = obj;
+	}
+	h->nfree = s->per_slab;
+	__vanessa_socket_slab_link(h, &s->list);
+
+	return 0;
+}
+
+
+void *vanessa_socket_slab_alloc(vanessa_socket_slab_t *s)
+{
+	__vanessa_socket_slab_hdr_t *h;
+	void *obj;
+
+	h = s->list.next;
+	if (h == &s->list || !h->nfree) {
+		if (__vanessa_socket_slab_grow(s) < 0) {
+			VANESSA_LOGGER_DEBUG("__vanessa_socket_slab_grow");
+			return NULL;
+		}
+		h = s->list.next;
+	}
+
+	obj = h->free;
+	h->free = *(void **)obj;
+	s->count++;
+
+	/* Full slabs go to the tail, out of the way */
+	if (!--h->nfree) {
+		__vanessa_socket_slab_unlink(h);
+		__vanessa_socket_slab_link(h, s->list.prev);
+	}
+
+	return obj;
+}
+
+
+void vanessa_socket_slab_free(vanessa_socket_slab_t *s, void *obj)
+{
+	__vanessa_socket_slab_hdr_t *h;
+
+	if (!obj)
+		return;
+
+	h = (__vanessa_socket_slab_hdr_t *)((uintptr_t)obj &
+					    ~(uintptr_t)(s->bytes - 1));
+	*(void **)obj = h->free;
+	h->free = obj;
+	s->count--;
+
+	if (++h->nfree == s->per_slab) {
+		__vanessa_socket_slab_unlink(h);
+		if (s->spare)
+			free(h);
+		else
+			s->spare = h;
+	} else if (h->nfree == 1) {
+		/* No longer full, to the head to be allocated from */
+		__vanessa_socket_slab_unlink(h);
+		__vanessa_socket_slab_link(h, &s->list);
+	}
+}
+
+
+unsigned int vanessa_socket_slab_count(const vanessa_socket_slab_t *s)
+{
+	return s->count;
+}
@@ -0,0 +1,218 @@
+/**********************************************************************
+ * vanessa_socket_tcp_info.c                               October 2026
+ * Simon Horman                                      horms@verge.net.au
+ *
+ * State of TCP connections, as reported by the kernel
+ *
+ * vanessa_socket
+ * Library to simplify handling of TCP sockets
+ * Copyright (C) 1999-2008  Simon Horman <horms@verge.net.au>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307 USA
+ *
+ **********************************************************************/
+
+
+#include "vanessa_socket.h"
+#include "unused.h"
+
+#include <errno.h>
+
+#ifdef __linux__
+
+#include <sys/ioctl.h>
+#include <linux/sockios.h>
+#include <linux/tcp.h>
+
+int vanessa_socket_tcp_info(int fd, vanessa_socket_tcp_info_t *info)
+{
+	struct tcp_info ti;
+	socklen_t len;
+	int outq;
+
+	memset(info, 0, sizeof(*info));
+	memset(&ti, 0, sizeof(ti));
+
+	/* Older kernels fill in less, leaving the rest 0 */
+	len = sizeof(ti);
+	if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &ti, &len) < 0) {
+		VANESSA_LOGGER_DEBUG_ERRNO("getsockopt: TCP_INFO");
+		return -1;
+	}
+
+	info->rtt = ti.tcpi_rtt;
+	info->rttvar = ti.tcpi_rttvar;
+	info->retrans = ti.tcpi_total_retrans;
+	info->cwnd = ti.tcpi_snd_cwnd;
+	info->delivery_rate = ti.tcpi_delivery_rate;
+
+	/* The send queue holds bytes not yet sent as well as those
+	 * waiting to be acknowledged */
+	if (ioctl(fd, SIOCOUTQ, &outq) < 0) {
+		VANESSA_LOGGER_DEBUG_ERRNO("ioctl: SIOCOUTQ");
+		return -1;
+	}
+	if ((uint32_t)outq > ti.tcpi_notsent_bytes)
+		info->unacked = outq - ti.tcpi_notsent_bytes;
+
+	return 0;
+}
+
+
+/* Set if SO_SNDBUFFORCE and SO_RCVBUFFORCE are not permitted */
+static int __vanessa_socket_tcp_tune_noforce;
+
+
+/**********************************************************************
+ * __vanessa_socket_tcp_tune_buf
+ * Grow a kernel socket buffer
+ * pre: fd: socket
+ *      opt: SO_SNDBUF or SO_RCVBUF
+ *      want: size wanted, in bytes
+ *      min: smallest size to set
+ *      max: largest size to set
+ * post: The buffer is set to want, limited to min and max, if that is
+ *       more than a quarter larger than it is now. Buffers are never
+ *       made smaller, as one that the kernel has grown by itself may
+ *       already be larger than any size that would be set, and
+ *       setting a size stops the kernel growing it any further.
+ *       SO_SNDBUFFORCE or SO_RCVBUFFORCE are used if permitted, so
+ *       that net.core.wmem_max and net.core.rmem_max do not apply.
+ *       If the kernel clamps the size to less than was set then the
+ *       old size is put back if it was larger.
+ * return: 0 on success
+ *         1 if the kernel clamped the size, so growing the buffer
+ *           again would be pointless
+ *         -1 on error
+ **********************************************************************/
+
+static int __vanessa_socket_tcp_tune_buf(int fd, int opt, uint64_t want,
+					 int min, int max)
+{
+	int size, cur, got, force;
+	socklen_t len;
+
+	size = want < (uint64_t)min ? min :
+	       want > (uint64_t)max ? max : (int)want;
+
+	/*
+	 * The kernel reports twice what was set, allowing for overhead,
+	 * so compare with that. The size of a buffer it has tuned itself
+	 * is reported as it is.
+	 */
+	len = sizeof(cur);
+	if (getsockopt(fd, SOL_SOCKET, opt, &cur, &len) < 0) {
+		VANESSA_LOGGER_DEBUG_ERRNO("getsockopt");
+		return -1;
+	}
+	if ((int64_t)size * 2 <= (int64_t)cur + cur / 4)
+		return 0;
+
+	force = opt == SO_SNDBUF ? SO_SNDBUFFORCE : SO_RCVBUFFORCE;
+	if (__vanessa_socket_tcp_tune_noforce ||
+	    setsockopt(fd, SOL_SOCKET, force, &size, sizeof(size)) < 0) {
+		if (!__vanessa_socket_tcp_tune_noforce && errno != EPERM) {
+			VANESSA_LOGGER_DEBUG_ERRNO("setsockopt");
+			return -1;
+		}
+		__vanessa_socket_tcp_tune_noforce = 1;
+		if (setsockopt(fd, SOL_SOCKET, opt, &size, sizeof(size)) < 0) {
+			VANESSA_LOGGER_DEBUG_ERRNO("setsockopt");
+			return -1;
+		}
+	}
+
+	len = sizeof(got);
+	if (getsockopt(fd, SOL_SOCKET, opt, &got, &len) < 0) {
+		VANESSA_LOGGER_DEBUG_ERRNO("getsockopt");
+		return -1;
+	}
+	if (got >= size * 2)
+		return 0;
+
+	/* Clamped to wmem_max or rmem_max, don't end up smaller */
+	if (got < cur) {
+		cur /= 2;
+		if (setsockopt(fd, SOL_SOCKET, opt, &cur, sizeof(cur)) < 0) {
+			VANESSA_LOGGER_DEBUG_ERRNO("setsockopt");
+			return -1;
+		}
+	}
+
+	return 1;
+}
+
+
+int vanessa_socket_tcp_tune(int in, int out, int min, int max)
+{
+	vanessa_socket_tcp_info_t in_info, out_info;
+	uint64_t rate;
+	int status, clamped;
+
+	if (vanessa_socket_tcp_info(in, &in_info) < 0 ||
+	    vanessa_socket_tcp_info(out, &out_info) < 0) {
+		VANESSA_LOGGER_DEBUG("vanessa_socket_tcp_info");
+		return -1;
+	}
+
+	/* Nothing has been measured yet */
+	rate = out_info.delivery_rate;
+	if (!rate || !out_info.rtt)
+		return 0;
+
+	/*
+	 * Allow for twice the bandwidth-delay product. While the buffers
+	 * are what limits the session the delivery rate that is measured
+	 * is that allowed by the buffers, so this lets them grow until
+	 * the network is the limit.
+	 */
+	status = __vanessa_socket_tcp_tune_buf(out, SO_SNDBUF,
+					       rate * out_info.rtt * 2 / 1000000,
+					       min, max);
+	if (status < 0)
+		return -1;
+	if (in_info.rtt) {
+		clamped = __vanessa_socket_tcp_tune_buf(in, SO_RCVBUF,
+						rate * in_info.rtt * 2 / 1000000,
+						min, max);
+		if (clamped < 0)
+			return -1;
+		status |= clamped;
+	}
+
+	return status;
+}
+
+#else /* __linux__ */
+
+int vanessa_socket_tcp_info(int UNUSED(fd), vanessa_socket_tcp_info_t *info)
+{
+	memset(info, 0, sizeof(*info));
+	errno = ENOSYS;
+	VANESSA_LOGGER_DEBUG("TCP_INFO is not supported on this platform");
+	return -1;
+}
+
+
+int vanessa_socket_tcp_tune(int UNUSED(in), int UNUSED(out),
+			    int UNUSED(min), int UNUSED(max))
+{
+	errno = ENOSYS;
+	VANESSA_LOGGER_DEBUG("TCP_INFO is not supported on this platform");
+	return -1;
+}
+
+#endif /* __linux__ */
@@ -0,0 +1,366 @@
+/**********************************************************************
+ * vanessa_socket_timer.c                                  October 2026
+ * Simon Horman                                      horms@verge.net.au
+ *
+ * Hierarchical timer wheel
+ *
+ * vanessa_socket
+ * Library to simplify handling of TCP sockets
+ * Copyright (C) 1999-2008  Simon Horman <horms@verge.net.au>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307 USA
+ *
+ **********************************************************************/
+
+#include <time.h>
+
+#include "vanessa_socket.h"
+
+/*
+ * The wheel has four levels. The first has a slot for each of the next
+ * 256 ticks. Each slot of the second covers 256 ticks, of the third
+ * 256 * 64 ticks and of the fourth 256 * 64 * 64 ticks. A timer is put
+ * in the lowest level that has a slot covering its expiry time.
+ *
+ * Each time the first level wraps around, the timers in the next slot
+ * of the second level are sorted into the first level, and so on up the
+ * levels. So each timer is moved at most three times however long its
+ * timeout, and the timers of a tick are found without searching.
+ *
+ * Slots are circular doubly linked lists with a timer as their head,
+ * so a timer can be deleted without knowing where it is.
+ */
+
+#define __VANESSA_SOCKET_TIMER_L0_BITS 8
+#define __VANESSA_SOCKET_TIMER_LN_BITS 6
+#define __VANESSA_SOCKET_TIMER_L0_SIZE (1 << __VANESSA_SOCKET_TIMER_L0_BITS)
+#define __VANESSA_SOCKET_TIMER_LN_SIZE (1 << __VANESSA_SOCKET_TIMER_LN_BITS)
+#define __VANESSA_SOCKET_TIMER_L0_MASK (__VANESSA_SOCKET_TIMER_L0_SIZE - 1)
+#define __VANESSA_SOCKET_TIMER_LN_MASK (__VANESSA_SOCKET_TIMER_LN_SIZE - 1)
+#define __VANESSA_SOCKET_TIMER_LEVELS  4
+
+/* Ticks covered by levels 0 to n */
+#define __VANESSA_SOCKET_TIMER_SPAN(n) \
+	(1ULL << (__VANESSA_SOCKET_TIMER_L0_BITS + \
+		  (n) * __VANESSA_SOCKET_TIMER_LN_BITS))
+
+#define __VANESSA_SOCKET_TIMER_MAX \
+	(__VANESSA_SOCKET_TIMER_SPAN(__VANESSA_SOCKET_TIMER_LEVELS - 1) - 1)
+
+struct vanessa_socket_timer_wheel_struct {
+	unsigned int tick;		/* Milliseconds */
+	struct timespec base;		/* Time of tick 0 */
+	uint64_t now;			/* Next tick to run */
+	unsigned int count;
+	vanessa_socket_timer_t l0[__VANESSA_SOCKET_TIMER_L0_SIZE];
+	vanessa_socket_timer_t ln[__VANESSA_SOCKET_TIMER_LEVELS - 1]
+				 [__VANESSA_SOCKET_TIMER_LN_SIZE];
+};
+
+
+static void __vanessa_socket_timer_list_init(vanessa_socket_timer_t *head)
+{
+	head->__next = head->__prev = head;
+}
+
+
+static uint64_t
+__vanessa_socket_timer_wheel_ticks(const vanessa_socket_timer_wheel_t *w)
+{
+	struct timespec now;
+	uint64_t ms;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ms = (uint64_t)(now.tv_sec - w->base.tv_sec) * 1000 +
+		(now.tv_nsec - w->base.tv_nsec) / 1000000;
+	return ms / w->tick;
+}
+
+
+/**********************************************************************
+ * __vanessa_socket_timer_wheel_insert
+ * Put a timer in the slot that covers its expiry time
+ * pre: w: timer wheel
+ *      timer: timer that is not in any slot, with __expires set
+ * post: timer is in a slot of w
+ **********************************************************************/
+
+static void
+__vanessa_socket_timer_wheel_insert(vanessa_socket_timer_wheel_t *w,
+				    vanessa_socket_timer_t *timer)
+{
+	vanessa_socket_timer_t *head;
+	uint64_t expires = timer->__expires;
+	int64_t delta = (int64_t)(expires - w->now);
+	int level;
+
+	if (delta < 0) {
+		/* Already due, run it with the current tick */
+		head = w->l0 + (w->now & __VANESSA_SOCKET_TIMER_L0_MASK);
+	} else if (delta < (int64_t)__VANESSA_SOCKET_TIMER_SPAN(0)) {
+		head = w->l0 + (expires & __VANESSA_SOCKET_TIMER_L0_MASK);
+	} else {
+		for (level = 1; level < __VANESSA_SOCKET_TIMER_LEVELS - 1;
+		     level++)
+			if (delta < (int64_t)__VANESSA_SOCKET_TIMER_SPAN(level))
+				break;
+		head = w->ln[level - 1] +
+			((expires >> (__VANESSA_SOCKET_TIMER_L0_BITS +
+				      (level - 1) *
+				      __VANESSA_SOCKET_TIMER_LN_BITS)) &
+			 __VANESSA_SOCKET_TIMER_LN_MASK);
+	}
+
+	timer->__next = head;
+	timer->__prev = head->__prev;
+	head->__prev->__next = timer;
+	head->__prev = timer;
+}
+
+
+static void __vanessa_socket_timer_unlink(vanessa_socket_timer_t *timer)
+{
+	timer->__prev->__next = timer->__next;
+	timer->__next->__prev = timer->__prev;
+	timer->__next = timer->__prev = NULL;
+}
+
+
+/**********************************************************************
+ * __vanessa_socket_timer_wheel_cascade
+ * Sort the timers of a slot of a higher level into lower levels
+ * pre: w: timer wheel
+ *      level: level of slot, 1 or more
+ *      index: index of slot in level
+ * post: The timers of the slot are moved to lower levels
+ * return: index
+ **********************************************************************/
+
+static int
+__vanessa_socket_timer_wheel_cascade(vanessa_socket_timer_wheel_t *w,
+				     int level, int index)
+{
+	vanessa_socket_timer_t *head = w->ln[level - 1] + index;
+	vanessa_socket_timer_t *timer;
+
+	while (head->__next != head) {
+		timer = head->__next;
+		__vanessa_socket_timer_unlink(timer);
+		__vanessa_socket_timer_wheel_insert(w, timer);
+	}
+
+	return index;
+}
+
+
+vanessa_socket_timer_wheel_t *
+vanessa_socket_timer_wheel_create(unsigned int tick)
+{
+	vanessa_socket_timer_wheel_t *w;
+	int i, j;
+
+	if (!tick) {
+		VANESSA_LOGGER_DEBUG("tick must be non-zero");
+		return NULL;
+	}
+
+	w = malloc(sizeof(*w));
+	if (!w) {
+		VANESSA_LOGGER_DEBUG_ERRNO("malloc");
+		return NULL;
+	}
+
+	w->tick = tick;
+	clock_gettime(CLOCK_MONOTONIC, &w->base);
+	w->now = 0;
+	w->count = 0;
+	for (i = 0; i < __VANESSA_SOCKET_TIMER_L0_SIZE; i++)
+		__vanessa_socket_timer_list_init(w->l0 + i);
+	for (i = 0; i < __VANESSA_SOCKET_TIMER_LEVELS - 1; i++)
+		for (j = 0; j < __VANESSA_SOCKET_TIMER_LN_SIZE; j++)
+			__vanessa_socket_timer_list_init(w->ln[i] + j);
+
+	return w;
+}
+
+
+static void __vanessa_socket_timer_list_clear(vanessa_socket_timer_t *head)
+{
+	vanessa_socket_timer_t *timer;
+
+	while (head->__next != head) {
+		timer = head->__next;
+		__vanessa_socket_timer_unlink(timer);
+		timer->__wheel = NULL;
+	}
+}
+
+
+void vanessa_socket_timer_wheel_destroy(vanessa_socket_timer_wheel_t *w)
+{
+	int i, j;
+
+	if (!w)
+		return;
+
+	for (i = 0; i < __VANESSA_SOCKET_TIMER_L0_SIZE; i++)
+		__vanessa_socket_timer_list_clear(w->l0 + i);
+	for (i = 0; i < __VANESSA_SOCKET_TIMER_LEVELS - 1; i++)
+		for (j = 0; j < __VANESSA_SOCKET_TIMER_LN_SIZE; j++)
+			__vanessa_socket_timer_list_clear(w->ln[i] + j);
+
+	free(w);
+}
+
+
+void vanessa_socket_timer_init(vanessa_socket_timer_t *timer,
+			       void (*func)(vanessa_socket_timer_t *timer,
+					    void *data),
+			       void *data)
+{
+	timer->func = func;
+	timer->data = data;
+	timer->__next = timer->__prev = NULL;
+	timer->__expires = 0;
+	timer->__wheel = NULL;
+}
+
+
+void vanessa_socket_timer_add(vanessa_socket_timer_wheel_t *w,
+			      vanessa_socket_timer_t *timer,
+			      unsigned long timeout)
+{
+	uint64_t ticks;
+
+	vanessa_socket_timer_del(timer);
+
+	ticks = (timeout + w->tick - 1) / w->tick;
+	if (ticks > __VANESSA_SOCKET_TIMER_MAX)
+		ticks = __VANESSA_SOCKET_TIMER_MAX;
+
+	timer->__expires = w->now + ticks;
+	timer->__wheel = w;
+	__vanessa_socket_timer_wheel_insert(w, timer);
+	w->count++;
+}
+
+
+void vanessa_socket_timer_del(vanessa_socket_timer_t *timer)
+{
+	if (!timer->__wheel)
+		return;
+
+	__vanessa_socket_timer_unlink(timer);
+	timer->__wheel->count--;
+	timer->__wheel = NULL;
+}
+
+
+int vanessa_socket_timer_pending(const vanessa_socket_timer_t *timer)
+{
+	return timer->__wheel != NULL;
+}
+
+
+unsigned int vanessa_socket_timer_wheel_run(vanessa_socket_timer_wheel_t *w)
+{
+	vanessa_socket_timer_t work;
+	vanessa_socket_timer_t *head;
+	vanessa_socket_timer_t *timer;
+	unsigned int expired = 0;
+	uint64_t target;
+	int index;
+	int level;
+
+	target = __vanessa_socket_timer_wheel_ticks(w);
+
+	while (w->now <= target) {
+		index = w->now & __VANESSA_SOCKET_TIMER_L0_MASK;
+
+		/* When a level wraps, refill it from the next one up */
+		for (level = 1; !index && level < __VANESSA_SOCKET_TIMER_LEVELS;
+		     level++)
+			index = __vanessa_socket_timer_wheel_cascade(w, level,
+				(w->now >> (__VANESSA_SOCKET_TIMER_L0_BITS +
+					    (level - 1) *
+					    __VANESSA_SOCKET_TIMER_LN_BITS)) &
+				__VANESSA_SOCKET_TIMER_LN_MASK);
+		index = w->now & __VANESSA_SOCKET_TIMER_L0_MASK;
+
+		/* Move the tick's timers to a list of their own, so that
+		 * timers added by func go into the wheel, not this batch */
+		head = w->l0 + index;
+		w->now++;
+		if (head->__next == head)
+			continue;
+		work.__next = head->__next;
+		work.__prev = head->__prev;
+		work.__next->__prev = &work;
+		work.__prev->__next = &work;
+		__vanessa_socket_timer_list_init(head);
+
+		while (work.__next != &work) {
+			timer = work.__next;
+			__vanessa_socket_timer_unlink(timer);
+			timer->__wheel = NULL;
+			w->count--;
+			expired++;
+			timer->func(timer, timer->data);
+		}
+	}
+
+	return expired;
+}
+
+
+int vanessa_socket_timer_wheel_next(vanessa_socket_timer_wheel_t *w)
+{
+	struct timespec now;
+	uint64_t tick;
+	int64_t ms;
+	int i;
+
+	if (!w->count)
+		return -1;
+
+	/* Look for the next tick with timers, up to the end of the
+	 * first level, when higher levels next cascade */
+	tick = w->now;
+	for (i = 0; i < __VANESSA_SOCKET_TIMER_L0_SIZE; i++, tick++) {
+		if (!(tick & __VANESSA_SOCKET_TIMER_L0_MASK))
+			break;
+		if (w->l0[tick & __VANESSA_SOCKET_TIMER_L0_MASK].__next !=
+		    w->l0 + (tick & __VANESSA_SOCKET_TIMER_L0_MASK))
+			break;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ms = (int64_t)tick * w->tick -
+		((int64_t)(now.tv_sec - w->base.tv_sec) * 1000 +
+		 (now.tv_nsec - w->base.tv_nsec) / 1000000);
+	if (ms < 0)
+		return 0;
+	if (ms > 0x7fffffff)
+		return 0x7fffffff;
+	return ms;
+}
+
+
+unsigned int
+vanessa_socket_timer_wheel_count(const vanessa_socket_timer_wheel_t *w)
+{
+	return w->count;
+}
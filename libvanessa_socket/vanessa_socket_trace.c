@@ -0,0 +1,63 @@
+/**********************************************************************
+ * vanessa_socket_trace.c                                  October 2026
+ * Simon Horman                                      horms@verge.net.au
+ *
+ * Timestamps of the points in the life of a session
+ *
+ * vanessa_socket
+ * Library to simplify handling of TCP sockets
+ * Copyright (C) 1999-2008  Simon Horman <horms@verge.net.au>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307 USA
+ *
+ **********************************************************************/
+
+#include "vanessa_socket.h"
+
+#include <time.h>
+
+/*
+ * The trace of each thread. Tracing costs a test of this pointer
+ * where it is not set, and a read of the clock for each point where
+ * it is.
+ */
+__thread vanessa_socket_trace_t *__vanessa_socket_trace;
+
+
+vanessa_socket_trace_t *vanessa_socket_trace_set(vanessa_socket_trace_t *trace)
+{
+	vanessa_socket_trace_t *old = __vanessa_socket_trace;
+
+	__vanessa_socket_trace = trace;
+	return old;
+}
+
+
+uint64_t vanessa_socket_trace_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+void vanessa_socket_trace_read(vanessa_socket_trace_t *trace, int side)
+{
+	trace->last[side] = vanessa_socket_trace_now();
+	if (!trace->first[side])
+		trace->first[side] = trace->last[side];
+}
@@ -0,0 +1,590 @@
+/**********************************************************************
+ * vanessa_socket_udp.c                                    October 2026
+ * Simon Horman                                      horms@verge.net.au
+ *
+ * Relay datagrams between clients and a server (we are both)
+ *
+ * vanessa_socket
+ * Library to simplify handling of TCP sockets
+ * Copyright (C) 1999-2008  Simon Horman <horms@verge.net.au>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307 USA
+ *
+ **********************************************************************/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "vanessa_socket.h"
+#include "unused.h"
+
+#include <errno.h>
+#include <time.h>
+
+#ifdef __linux__
+
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <netinet/udp.h>
+
+#ifndef SOL_UDP
+#define SOL_UDP IPPROTO_UDP
+#endif
+
+/* Largest datagram, or GRO/GSO super-datagram, that we handle */
+#define __VANESSA_SOCKET_UDP_MAX 65536
+
+/* Address of the client of a flow, pointed to by flow->data */
+typedef struct {
+	struct sockaddr_storage addr;
+	socklen_t addrlen;
+} __vanessa_socket_udp_name_t;
+
+typedef struct {
+	int listen_socket;
+	struct sockaddr_storage listen_addr;
+	struct addrinfo *dst;
+	int epfd;
+	vanessa_socket_flag_t flag;
+	size_t buffer_length;
+	vanessa_socket_flow_table_t *flows;
+	__vanessa_socket_udp_name_t *name;
+	__vanessa_socket_udp_name_t **name_free;
+	unsigned int nname_free;
+	time_t now;
+	/* Receive side of a batch */
+	struct mmsghdr in[VANESSA_SOCKET_UDP_BATCH];
+	struct iovec in_iov[VANESSA_SOCKET_UDP_BATCH];
+	struct sockaddr_storage in_name[VANESSA_SOCKET_UDP_BATCH];
+	char in_ctl[VANESSA_SOCKET_UDP_BATCH][CMSG_SPACE(sizeof(int))];
+	/* Send side of a batch, pointing at the same data */
+	struct mmsghdr out[VANESSA_SOCKET_UDP_BATCH];
+	struct iovec out_iov[VANESSA_SOCKET_UDP_BATCH];
+	char out_ctl[VANESSA_SOCKET_UDP_BATCH][CMSG_SPACE(sizeof(uint16_t))];
+	char *buffer;
+} __vanessa_socket_udp_t;
+
+
+static time_t __vanessa_socket_udp_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec;
+}
+
+
+/**********************************************************************
+ * __vanessa_socket_udp_gro
+ * Enable GRO on a socket, if requested and supported
+ * pre: u: relay state
+ *      fd: socket
+ * post: UDP_GRO is set on fd if VANESSA_SOCKET_UDP_GSO is set.
+ *       If the kernel does not support it then VANESSA_SOCKET_UDP_GSO
+ *       is cleared and datagrams are relayed one by one.
+ **********************************************************************/
+
+static void __vanessa_socket_udp_gro(__vanessa_socket_udp_t *u, int fd)
+{
+#ifdef UDP_GRO
+	int g = 1;
+
+	if (!(u->flag & VANESSA_SOCKET_UDP_GSO))
+		return;
+	if (setsockopt(fd, SOL_UDP, UDP_GRO, &g, sizeof(g)) < 0) {
+		VANESSA_LOGGER_DEBUG_ERRNO("setsockopt: UDP_GRO");
+		u->flag &= ~VANESSA_SOCKET_UDP_GSO;
+	}
+#else
+	u->flag &= ~VANESSA_SOCKET_UDP_GSO;
+#endif
+}
+
+
+/**********************************************************************
+ * __vanessa_socket_udp_flow_release
+ * Release the resources of a flow.
+ * Called by the flow table when a flow is evicted or expires.
+ * pre: flow: flow being removed
+ *      data: relay state
+ * post: the socket of the flow is closed, which also removes it
+ *       from the epoll set, and its client address is freed
+ **********************************************************************/
+
+static void __vanessa_socket_udp_flow_release(vanessa_socket_flow_t *flow,
+					      void *data)
+{
+	__vanessa_socket_udp_t *u = (__vanessa_socket_udp_t *)data;
+
+	if (flow->fd >= 0 && close(flow->fd) < 0)
+		VANESSA_LOGGER_DEBUG_ERRNO("warning: close");
+	flow->fd = -1;
+	if (flow->data)
+		u->name_free[u->nname_free++] = flow->data;
+	flow->data = NULL;
+}
+
+
+static vanessa_socket_flow_t *
+__vanessa_socket_udp_flow_open(__vanessa_socket_udp_t *u,
+			       const vanessa_socket_flow_key_t *key,
+			       const struct sockaddr *from, socklen_t fromlen)
+{
+	vanessa_socket_flow_t *f;
+	__vanessa_socket_udp_name_t *name;
+	struct addrinfo *ai;
+	struct epoll_event ev;
+	int s = -1;
+
+	for (ai = u->dst; ai; ai = ai->ai_next) {
+		s = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if (s < 0) {
+			VANESSA_LOGGER_DEBUG_ERRNO("socket");
+			continue;
+		}
+		if (!connect(s, ai->ai_addr, ai->ai_addrlen))
+			break;
+		VANESSA_LOGGER_DEBUG_ERRNO("connect");
+		close(s);
+		s = -1;
+	}
+	if (s < 0)
+		return NULL;
+
+	__vanessa_socket_udp_gro(u, s);
+
+	/* Evicts the least recently used flow if the table is full */
+	f = vanessa_socket_flow_insert(u->flows, key, u->now);
+	f->fd = s;
+	name = u->name_free[--u->nname_free];
+	memcpy(&name->addr, from, fromlen);
+	name->addrlen = fromlen;
+	f->data = name;
+
+	ev.events = EPOLLIN;
+	ev.data.ptr = f;
+	if (epoll_ctl(u->epfd, EPOLL_CTL_ADD, s, &ev) < 0) {
+		VANESSA_LOGGER_DEBUG_ERRNO("epoll_ctl");
+		__vanessa_socket_udp_flow_release(f, u);
+		vanessa_socket_flow_remove(u->flows, f);
+		return NULL;
+	}
+
+	return f;
+}
+
+
+/**********************************************************************
+ * __vanessa_socket_udp_recv
+ * Receive a batch of datagrams
+ * pre: u: relay state
+ *      fd: socket to receive from
+ * post: up to VANESSA_SOCKET_UDP_BATCH datagrams are received into
+ *       u->in without blocking
+ * return: number of datagrams received
+ *         0 if none were available
+ *         -1 on error
+ **********************************************************************/
+
+static int __vanessa_socket_udp_recv(__vanessa_socket_udp_t *u, int fd)
+{
+	int i, n;
+
+	for (i = 0; i < VANESSA_SOCKET_UDP_BATCH; i++) {
+		u->in_iov[i].iov_base = u->buffer + i * u->buffer_length;
+		u->in_iov[i].iov_len = u->buffer_length;
+		u->in[i].msg_hdr.msg_name = u->in_name + i;
+		u->in[i].msg_hdr.msg_namelen = sizeof(*u->in_name);
+		u->in[i].msg_hdr.msg_iov = u->in_iov + i;
+		u->in[i].msg_hdr.msg_iovlen = 1;
+		u->in[i].msg_hdr.msg_control = u->in_ctl[i];
+		u->in[i].msg_hdr.msg_controllen = sizeof(u->in_ctl[i]);
+		u->in[i].msg_hdr.msg_flags = 0;
+	}
+
+	n = recvmmsg(fd, u->in, VANESSA_SOCKET_UDP_BATCH, MSG_DONTWAIT, NULL);
+	if (n < 0) {
+		/* ECONNREFUSED is an ICMP error from an earlier send */
+		if (errno == EAGAIN || errno == EWOULDBLOCK ||
+		    errno == EINTR || errno == ECONNREFUSED)
+			return 0;
+		VANESSA_LOGGER_DEBUG_ERRNO("recvmmsg");
+		return -1;
+	}
+
+	return n;
+}
+
+
+/**********************************************************************
+ * __vanessa_socket_udp_out
+ * Set up u->out[o] to send the datagram received in u->in[i]
+ * pre: u: relay state
+ *      o: index of out message to set up
+ *      i: index of in message to send
+ *      to: destination address, NULL for a connected socket
+ *      tolen: length of to
+ * post: u->out[o] refers to the data of u->in[i]. If the data was
+ *       coalesced by GRO then UDP_SEGMENT is set so that it is sent
+ *       as the same train of datagrams.
+ **********************************************************************/
+
+static void __vanessa_socket_udp_out(__vanessa_socket_udp_t *u, int o, int i,
+				     struct sockaddr *to, socklen_t tolen)
+{
+	struct msghdr *out = &u->out[o].msg_hdr;
+	struct msghdr *in = &u->in[i].msg_hdr;
+
+	memset(out, 0, sizeof(*out));
+	u->out_iov[o].iov_base = u->in_iov[i].iov_base;
+	u->out_iov[o].iov_len = u->in[i].msg_len;
+	out->msg_iov = u->out_iov + o;
+	out->msg_iovlen = 1;
+	out->msg_name = to;
+	out->msg_namelen = tolen;
+
+#if defined(UDP_GRO) && defined(UDP_SEGMENT)
+	if (u->flag & VANESSA_SOCKET_UDP_GSO) {
+		struct cmsghdr *cm;
+		uint16_t gso_size = 0;
+
+		for (cm = CMSG_FIRSTHDR(in); cm; cm = CMSG_NXTHDR(in, cm)) {
+			if (cm->cmsg_level == SOL_UDP &&
+			    cm->cmsg_type == UDP_GRO) {
+				int g;
+
+				memcpy(&g, CMSG_DATA(cm), sizeof(g));
+				gso_size = g;
+			}
+		}
+		if (gso_size && u->in[i].msg_len > gso_size) {
+			out->msg_control = u->out_ctl[o];
+			out->msg_controllen = sizeof(u->out_ctl[o]);
+			cm = CMSG_FIRSTHDR(out);
+			cm->cmsg_level = SOL_UDP;
+			cm->cmsg_type = UDP_SEGMENT;
+			cm->cmsg_len = CMSG_LEN(sizeof(gso_size));
+			memcpy(CMSG_DATA(cm), &gso_size, sizeof(gso_size));
+		}
+	}
+#endif
+
+	if (in->msg_flags & MSG_TRUNC)
+		VANESSA_LOGGER_DEBUG("datagram truncated");
+}
+
+
+/**********************************************************************
+ * __vanessa_socket_udp_send
+ * Send a batch of datagrams
+ * pre: u: relay state
+ *      fd: socket to send on
+ *      o: index of first out message to send
+ *      n: number of out messages to send
+ * post: Messages are sent. Datagrams that can't be sent are dropped.
+ **********************************************************************/
+
+static void __vanessa_socket_udp_send(__vanessa_socket_udp_t *u, int fd,
+				      int o, int n)
+{
+	int sent;
+
+	while (n > 0) {
+		sent = sendmmsg(fd, u->out + o, n, 0);
+		if (sent < 0) {
+			if (errno == EINTR)
+				continue;
+			VANESSA_LOGGER_DEBUG_ERRNO("sendmmsg");
+			/* Drop the datagram that failed */
+			sent = 1;
+		}
+		o += sent;
+		n -= sent;
+	}
+}
+
+
+/**********************************************************************
+ * __vanessa_socket_udp_from_client
+ * Relay a batch of datagrams from clients to the server
+ * pre: u: relay state
+ * post: datagrams are read from the listening socket and sent to the
+ *       server over the socket for the flow of each client.
+ *       Consecutive datagrams of the same flow are sent as a batch.
+ * return: 0 on success
+ *         -1 on error
+ **********************************************************************/
+
+static int __vanessa_socket_udp_from_client(__vanessa_socket_udp_t *u)
+{
+	vanessa_socket_flow_key_t key;
+	vanessa_socket_flow_t *f, *flow = NULL;
+	struct sockaddr *from;
+	int i, n, o = 0, start = 0;
+
+	n = __vanessa_socket_udp_recv(u, u->listen_socket);
+	if (n <= 0)
+		return n;
+
+	for (i = 0; i < n; i++) {
+		from = (struct sockaddr *)(u->in_name + i);
+		f = NULL;
+		if (!vanessa_socket_flow_key(&key, from,
+				(struct sockaddr *)&u->listen_addr)) {
+			f = vanessa_socket_flow_lookup(u->flows, &key, u->now);
+			/* Opening a flow may evict another, so pending
+			 * datagrams are sent first */
+			if (!f && o > start) {
+				__vanessa_socket_udp_send(u, flow->fd, start,
+							  o - start);
+				start = o;
+			}
+			if (!f)
+				f = __vanessa_socket_udp_flow_open(u, &key, from,
+					u->in[i].msg_hdr.msg_namelen);
+		}
+		if (f != flow && o > start) {
+			__vanessa_socket_udp_send(u, flow->fd, start,
+						  o - start);
+			start = o;
+		}
+		flow = f;
+		if (!f)
+			continue; /* Drop */
+		__vanessa_socket_udp_out(u, o++, i, NULL, 0);
+	}
+	if (o > start)
+		__vanessa_socket_udp_send(u, flow->fd, start, o - start);
+
+	return 0;
+}
+
+
+/**********************************************************************
+ * __vanessa_socket_udp_from_server
+ * Relay a batch of datagrams from the server to a client
+ * pre: u: relay state
+ *      f: flow that is readable
+ * post: datagrams are read from the server socket of the flow and sent
+ *       to its client from the listening socket
+ * return: 0 on success
+ *         -1 on error
+ **********************************************************************/
+
+static int __vanessa_socket_udp_from_server(__vanessa_socket_udp_t *u,
+					    vanessa_socket_flow_t *f)
+{
+	__vanessa_socket_udp_name_t *name;
+	int i, n;
+
+	/* The flow may have been evicted while handling earlier events */
+	if (f->fd < 0)
+		return 0;
+
+	n = __vanessa_socket_udp_recv(u, f->fd);
+	if (n <= 0)
+		return n;
+
+	vanessa_socket_flow_lookup(u->flows, &f->key, u->now);
+	name = (__vanessa_socket_udp_name_t *)f->data;
+	for (i = 0; i < n; i++)
+		__vanessa_socket_udp_out(u, i, i,
+					 (struct sockaddr *)&name->addr,
+					 name->addrlen);
+	__vanessa_socket_udp_send(u, u->listen_socket, 0, n);
+
+	return 0;
+}
+
+
+/**********************************************************************
+ * vanessa_socket_udp_relay
+ * Relay datagrams between clients and a server.
+ * Datagrams are received from the listening socket in batches using
+ * recvmmsg(2). A datagram socket connected to the server is opened for
+ * each client address seen, its flow, and datagrams are sent to the
+ * server over it in batches using sendmmsg(2). Replies received on the
+ * socket of a flow are sent back to the client of that flow from the
+ * listening socket.
+ * pre: listen_socket: datagram socket to receive from clients on,
+ *                     as returned by vanessa_socket_server_bind()
+ *                     with VANESSA_SOCKET_PROTO_UDP
+ *      dst_host: hostname or ipaddress of server
+ *      dst_port: name or number of server port
+ *      buffer_length: maximum size of datagrams to relay.
+ *                     Larger datagrams are truncated.
+ *                     If 0 then datagrams of any size are relayed.
+ *      idle_timeout: timeout in seconds after which a flow that has
+ *                    not relayed any datagrams is closed.
+ *                    timeout of 0 = infinite timeout
+ *      max_flows: maximum number of flows.
+ *                 If 0 then VANESSA_SOCKET_UDP_MAX_FLOWS is used.
+ *                 When the limit is reached the least recently
+ *                 used flow is closed to make way for a new client.
+ *      flag: If VANESSA_SOCKET_NO_LOOKUP then no host and port lookups
+ *            will be performed
+ *            If VANESSA_SOCKET_UDP_GSO then receive datagrams using
+ *            UDP GRO and send them using UDP GSO, if supported by the
+ *            operating system, so that a train of datagrams is handled
+ *            by a single system call
+ * post: Datagrams are relayed until an error occurs
+ * return: -1 on error
+ *         Does not return otherwise
+ **********************************************************************/
+
+int vanessa_socket_udp_relay(int listen_socket, const char *dst_host,
+			     const char *dst_port, size_t buffer_length,
+			     int idle_timeout, unsigned int max_flows,
+			     vanessa_socket_flag_t flag)
+{
+	__vanessa_socket_udp_t *u;
+	struct addrinfo hints;
+	struct epoll_event ev[VANESSA_SOCKET_UDP_BATCH];
+	socklen_t addrlen;
+	time_t last_expire;
+	unsigned int i;
+	int err, n, status = -1;
+
+	u = calloc(1, sizeof(*u));
+	if (!u) {
+		VANESSA_LOGGER_DEBUG_ERRNO("calloc");
+		return -1;
+	}
+	u->listen_socket = listen_socket;
+	u->flag = flag;
+	u->epfd = -1;
+	if (!max_flows)
+		max_flows = VANESSA_SOCKET_UDP_MAX_FLOWS;
+	if (idle_timeout < 0)
+		idle_timeout = 0;
+	if (!buffer_length || flag & VANESSA_SOCKET_UDP_GSO)
+		buffer_length = __VANESSA_SOCKET_UDP_MAX;
+	u->buffer_length = buffer_length;
+
+	addrlen = sizeof(u->listen_addr);
+	if (getsockname(listen_socket, (struct sockaddr *)&u->listen_addr,
+			&addrlen) < 0) {
+		VANESSA_LOGGER_DEBUG_ERRNO("getsockname");
+		goto out;
+	}
+
+	bzero(&hints, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+	if (flag & VANESSA_SOCKET_NO_LOOKUP)
+		hints.ai_flags = AI_NUMERICHOST|AI_NUMERICSERV;
+	err = getaddrinfo(dst_host, dst_port, &hints, &u->dst);
+	if (err) {
+		u->dst = NULL;
+		VANESSA_LOGGER_DEBUG_UNSAFE("getaddrinfo dst: \"%s\" \"%s\": %s",
+					    dst_host, dst_port,
+					    err == EAI_SYSTEM ?
+					    strerror(errno) : gai_strerror(err));
+		goto out;
+	}
+
+	u->name = malloc(sizeof(*u->name) * max_flows);
+	u->name_free = malloc(sizeof(*u->name_free) * max_flows);
+	u->buffer = malloc(u->buffer_length * VANESSA_SOCKET_UDP_BATCH);
+	if (!u->name || !u->name_free || !u->buffer) {
+		VANESSA_LOGGER_DEBUG_ERRNO("malloc");
+		goto out;
+	}
+	for (i = 0; i < max_flows; i++)
+		u->name_free[i] = u->name + i;
+	u->nname_free = max_flows;
+
+	u->flows = vanessa_socket_flow_table_create(max_flows, idle_timeout,
+			__vanessa_socket_udp_flow_release, u);
+	if (!u->flows) {
+		VANESSA_LOGGER_DEBUG("vanessa_socket_flow_table_create");
+		goto out;
+	}
+
+	u->epfd = epoll_create(1);
+	if (u->epfd < 0) {
+		VANESSA_LOGGER_DEBUG_ERRNO("epoll_create");
+		goto out;
+	}
+	ev[0].events = EPOLLIN;
+	ev[0].data.ptr = NULL;
+	if (epoll_ctl(u->epfd, EPOLL_CTL_ADD, listen_socket, ev) < 0) {
+		VANESSA_LOGGER_DEBUG_ERRNO("epoll_ctl");
+		goto out;
+	}
+	__vanessa_socket_udp_gro(u, listen_socket);
+
+	last_expire = u->now = __vanessa_socket_udp_now();
+	for (;;) {
+		n = epoll_wait(u->epfd, ev, VANESSA_SOCKET_UDP_BATCH,
+			       (idle_timeout &&
+				vanessa_socket_flow_count(u->flows)) ?
+			       1000 : -1);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			VANESSA_LOGGER_DEBUG_ERRNO("epoll_wait");
+			goto out;
+		}
+
+		u->now = __vanessa_socket_udp_now();
+		for (i = 0; i < (unsigned int)n; i++) {
+			if (!ev[i].data.ptr)
+				err = __vanessa_socket_udp_from_client(u);
+			else
+				err = __vanessa_socket_udp_from_server(u,
+						ev[i].data.ptr);
+			if (err < 0)
+				goto out;
+		}
+
+		if (u->now != last_expire) {
+			vanessa_socket_flow_expire(u->flows, u->now);
+			last_expire = u->now;
+		}
+	}
+
+out:
+	vanessa_socket_flow_table_destroy(u->flows);
+	if (u->epfd >= 0)
+		close(u->epfd);
+	if (u->dst)
+		freeaddrinfo(u->dst);
+	free(u->name);
+	free(u->name_free);
+	free(u->buffer);
+	free(u);
+	return status;
+}
+
+#else /* __linux__ */
+
+int vanessa_socket_udp_relay(int UNUSED(listen_socket),
+			     const char *UNUSED(dst_host),
+			     const char *UNUSED(dst_port),
+			     size_t UNUSED(buffer_length),
+			     int UNUSED(idle_timeout),
+			     unsigned int UNUSED(max_flows),
+			     vanessa_socket_flag_t UNUSED(flag))
+{
+	errno = ENOSYS;
+	VANESSA_LOGGER_DEBUG("UDP relaying is not supported on this "
+			     "platform");
+	return -1;
+}
+
+#endif /* __linux__ */
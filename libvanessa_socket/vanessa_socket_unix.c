@@ -0,0 +1,161 @@
+/**********************************************************************
+ * vanessa_socket_unix.c                                   October 2026
+ * Simon Horman                                      horms@verge.net.au
+ *
+ * Helpers for unix domain socket endpoints
+ *
+ * vanessa_socket
+ * Library to simplify handling of TCP sockets
+ * Copyright (C) 1999-2008  Simon Horman <horms@verge.net.au>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307 USA
+ *
+ **********************************************************************/
+
+#include <stddef.h>
+
+#include "vanessa_socket.h"
+
+
+/**********************************************************************
+ * vanessa_socket_host_is_unix
+ * Test if a host string names a unix domain socket
+ * pre: host: host string, may be NULL
+ * return: 1 if host begins with VANESSA_SOCKET_UNIX_PREFIX
+ *         0 otherwise
+ **********************************************************************/
+
+int vanessa_socket_host_is_unix(const char *host)
+{
+	if (!host)
+		return 0;
+
+	return !strncmp(host, VANESSA_SOCKET_UNIX_PREFIX,
+			strlen(VANESSA_SOCKET_UNIX_PREFIX));
+}
+
+
+/**********************************************************************
+ * vanessa_socket_unix_sockaddr
+ * Fill in a sockaddr_un from a unix domain socket host string
+ * pre: host: "unix:/path/to/socket" or "unix:@name". The latter
+ *            names a socket in the Linux abstract namespace.
+ *      addr: sockaddr_un to fill in
+ *      addrlen: where the length of addr will be written
+ * post: addr and addrlen are filled in
+ * return: 0 on success
+ *         -1 on error
+ **********************************************************************/
+
+int vanessa_socket_unix_sockaddr(const char *host, struct sockaddr_un *addr,
+				 socklen_t *addrlen)
+{
+	const char *path;
+	size_t len;
+
+	if (!vanessa_socket_host_is_unix(host)) {
+		VANESSA_LOGGER_DEBUG_UNSAFE("not a unix socket: \"%s\"", host);
+		return -1;
+	}
+	path = host + strlen(VANESSA_SOCKET_UNIX_PREFIX);
+
+	len = strlen(path);
+	if (!len || len > sizeof(addr->sun_path) ||
+	    (*path != '@' && len == sizeof(addr->sun_path))) {
+		VANESSA_LOGGER_DEBUG_UNSAFE("invalid unix socket path: \"%s\"",
+					    path);
+		return -1;
+	}
+
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+
+	if (*path == '@') {
+		/* Abstract namespace: leading NUL, no trailing NUL */
+		memcpy(addr->sun_path + 1, path + 1, len - 1);
+		*addrlen = offsetof(struct sockaddr_un, sun_path) + len;
+	} else {
+		memcpy(addr->sun_path, path, len);
+		*addrlen = offsetof(struct sockaddr_un, sun_path) + len + 1;
+	}
+
+	return 0;
+}
+
+
+/**********************************************************************
+ * vanessa_socket_unix_ntop
+ * Format a unix domain socket address as a host string
+ * pre: addr: unix domain socket address
+ *      addrlen: length of addr, as returned by accept(), getsockname()
+ *               and friends
+ *      str: buffer to write the string to
+ *      len: length of str in bytes
+ * post: str is "unix:/path", "unix:@name" or "unix:" for an unnamed
+ *       socket. Non-printable bytes in abstract names are written as '?'
+ *       and trailing NUL bytes are not shown.
+ * return: 0 on success
+ *         -1 on error
+ **********************************************************************/
+
+int vanessa_socket_unix_ntop(const struct sockaddr_un *addr,
+			     socklen_t addrlen, char *str, size_t len)
+{
+	size_t path_len, prefix_len, i;
+	const char *path;
+
+	prefix_len = strlen(VANESSA_SOCKET_UNIX_PREFIX);
+
+	if (addr->sun_family != AF_UNIX || len < prefix_len + 1) {
+		VANESSA_LOGGER_DEBUG("invalid unix socket address");
+		return -1;
+	}
+
+	path = addr->sun_path;
+	if (addrlen > offsetof(struct sockaddr_un, sun_path))
+		path_len = addrlen - offsetof(struct sockaddr_un, sun_path);
+	else
+		path_len = 0;
+	if (path_len > sizeof(addr->sun_path))
+		path_len = sizeof(addr->sun_path);
+
+	strcpy(str, VANESSA_SOCKET_UNIX_PREFIX);
+	str += prefix_len;
+	len -= prefix_len;
+
+	if (path_len && *path == '\0') {
+		/* Abstract namespace. Callers often only know the size
+		 * of the buffer, not the length of the address, so
+		 * trailing NUL bytes are dropped. A name of all NULs
+		 * is treated as an unnamed socket. */
+		while (path_len && path[path_len - 1] == '\0')
+			path_len--;
+		if (path_len && len > 1) {
+			*str++ = '@';
+			len--;
+			path++;
+			path_len--;
+		}
+	} else {
+		path_len = strnlen(path, path_len);
+	}
+
+	for (i = 0; i < path_len && len > 1; i++, len--)
+		*str++ = isprint((unsigned char)path[i]) ? path[i] : '?';
+	*str = '\0';
+
+	return 0;
+}
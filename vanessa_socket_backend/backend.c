@@ -0,0 +1,462 @@
+/**********************************************************************
+ * backend.c                                               October 2026
+ * Simon Horman                                      horms@verge.net.au
+ *
+ * Serve connections for benchmarks
+ *
+ * vanessa_socket_backend
+ * Echo, sink and source server for benchmarking relays
+ * Copyright (C) 1999-2008  Simon Horman <horms@verge.net.au>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307  USA
+ *
+ **********************************************************************/
+
+#include "backend.h"
+#include "unused.h"
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#ifndef EPOLLEXCLUSIVE
+#define EPOLLEXCLUSIVE 0
+#endif
+
+#define BACKEND_BUFFER 65536	/* Most bytes sent or received at once */
+#define BACKEND_EVENTS 256	/* Events handled for each epoll_wait() */
+#define BACKEND_BUDGET 16	/* Reads or writes per connection per turn */
+
+/*
+ * Each thread runs its own event loop. All threads poll the listening
+ * socket, using EPOLLEXCLUSIVE so that a connection only wakes one of
+ * them, and the thread that accepts a connection serves it until it
+ * closes. Nothing else is shared between threads.
+ *
+ * Data is received into a buffer of the thread and, in echo mode,
+ * sent straight back from it. Only what can't be sent at once is
+ * copied to a buffer of the connection, which is not read from again
+ * until that has been sent. Responses and source data are sent from
+ * a buffer shared by all connections.
+ */
+
+typedef struct backend_conn_struct {
+	int fd;
+	int ready;		/* On the ready list */
+	struct backend_conn_struct *next;	/* On the ready list */
+	char *buf;		/* Echo data waiting to be sent, or NULL */
+	size_t off;		/* Of the data in buf */
+	uint64_t owed;		/* Bytes waiting to be sent */
+	uint64_t received;	/* Bytes of the request being received */
+} backend_conn_t;
+
+/* State of one thread */
+typedef struct {
+	options_t *opt;
+	int listen_socket;
+	int epfd;
+	char *buf;
+	backend_conn_t *ready;	/* Stopped before EAGAIN, to go on with */
+} backend_thread_t;
+
+/* Sent as responses and as source data */
+static char backend_data[BACKEND_BUFFER];
+
+
+/**********************************************************************
+ * backend_send
+ * Send some of what a connection is owed
+ * pre: t: thread
+ *      c: connection, with c->owed non-zero
+ * post: As much as the socket will take, up to BACKEND_BUFFER bytes,
+ *       is sent and deducted from c->owed. In source mode c->owed
+ *       is left as it is, so there is always more to send.
+ * return: bytes sent
+ *         0 if the socket would block
+ *         -1 on error
+ **********************************************************************/
+
+static ssize_t backend_send(backend_thread_t *t, backend_conn_t *c)
+{
+	ssize_t bytes;
+	size_t want;
+
+	want = BACKEND_BUFFER;
+	if (t->opt->mode != MODE_SOURCE && c->owed < want)
+		want = c->owed;
+
+	bytes = send(c->fd, c->buf ? c->buf + c->off : backend_data, want,
+		     MSG_NOSIGNAL);
+	if (bytes < 0) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+			return 0;
+		VANESSA_LOGGER_DEBUG_ERRNO("send");
+		return -1;
+	}
+
+	if (t->opt->mode == MODE_SOURCE)
+		return bytes;
+	c->owed -= bytes;
+	c->off += bytes;
+	return bytes;
+}
+
+
+/**********************************************************************
+ * backend_recv
+ * Receive from a connection
+ * pre: t: thread
+ *      c: connection, with nothing owed unless in source mode
+ * post: Data is received into the buffer of t. In echo mode it is
+ *       sent back, and what can't be sent at once is copied to the
+ *       buffer of c and owed. In response mode a response is owed
+ *       for each complete request. Otherwise it is discarded.
+ * return: bytes received
+ *         0 if the socket would block
+ *         -1 on error, or if the connection has been closed
+ **********************************************************************/
+
+static ssize_t backend_recv(backend_thread_t *t, backend_conn_t *c)
+{
+	options_t *opt = t->opt;
+	ssize_t bytes, sent;
+
+	bytes = recv(c->fd, t->buf, BACKEND_BUFFER, 0);
+	if (bytes < 0) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+			return 0;
+		VANESSA_LOGGER_DEBUG_ERRNO("recv");
+		return -1;
+	}
+	if (!bytes)
+		return -1;
+
+	switch (opt->mode) {
+	case MODE_ECHO:
+		sent = send(c->fd, t->buf, bytes, MSG_NOSIGNAL);
+		if (sent < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK &&
+			    errno != EINTR) {
+				VANESSA_LOGGER_DEBUG_ERRNO("send");
+				return -1;
+			}
+			sent = 0;
+		}
+		if (sent == bytes)
+			break;
+		if (!c->buf && !(c->buf = malloc(BACKEND_BUFFER))) {
+			VANESSA_LOGGER_DEBUG_ERRNO("malloc");
+			return -1;
+		}
+		memcpy(c->buf, t->buf + sent, bytes - sent);
+		c->off = 0;
+		c->owed = bytes - sent;
+		break;
+
+	case MODE_RESPONSE:
+		if (!opt->request_size)
+			break;
+		c->received += bytes;
+		c->owed += c->received / opt->request_size *
+			   opt->response_size;
+		c->received %= opt->request_size;
+		break;
+	}
+
+	return bytes;
+}
+
+
+/**********************************************************************
+ * backend_drive
+ * Make progress on a connection
+ * pre: t: thread
+ *      c: connection
+ * post: What c is owed is sent, and then data is received, until the
+ *       socket would block or BACKEND_BUDGET sends and receives have
+ *       been made, in which case c is put on the ready list. Nothing
+ *       is received while something is owed, which pushes back on
+ *       the client, except in source mode where it is discarded.
+ * return: 0 to carry on with c
+ *         1 if c should be closed
+ **********************************************************************/
+
+static int backend_drive(backend_thread_t *t, backend_conn_t *c)
+{
+	ssize_t bytes;
+	int budget;
+
+	for (budget = BACKEND_BUDGET; budget; budget--) {
+		if (c->owed) {
+			bytes = backend_send(t, c);
+			if (bytes < 0)
+				return 1;
+			if (bytes)
+				continue;
+			/* Wait for EPOLLOUT */
+			if (t->opt->mode != MODE_SOURCE)
+				return 0;
+		}
+
+		bytes = backend_recv(t, c);
+		if (bytes < 0)
+			return 1;
+		if (!bytes)
+			return 0;
+	}
+
+	if (!c->ready) {
+		c->ready = 1;
+		c->next = t->ready;
+		t->ready = c;
+	}
+	return 0;
+}
+
+
+static void backend_handle(backend_thread_t *t, backend_conn_t *c)
+{
+	if (!backend_drive(t, c))
+		return;
+
+	if (close(c->fd) < 0)
+		VANESSA_LOGGER_DEBUG_ERRNO("warning: close");
+	free(c->buf);
+	free(c);
+}
+
+
+/**********************************************************************
+ * backend_accept
+ * Accept connections
+ * pre: t: thread
+ * post: Connections waiting on the listening socket are accepted and
+ *       added to the event loop of t, until there are none left or
+ *       an error occurs.
+ **********************************************************************/
+
+static void backend_accept(backend_thread_t *t)
+{
+	struct epoll_event ev;
+	backend_conn_t *c;
+	int fd, one = 1;
+
+	for (;;) {
+		fd = accept4(t->listen_socket, NULL, NULL,
+			     SOCK_NONBLOCK|SOCK_CLOEXEC);
+		if (fd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				VANESSA_LOGGER_DEBUG_ERRNO("accept4");
+			return;
+		}
+
+		/* Fails for unix domain sockets, which don't need it */
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+		c = calloc(1, sizeof(*c));
+		if (!c) {
+			VANESSA_LOGGER_DEBUG_ERRNO("calloc");
+			close(fd);
+			return;
+		}
+		c->fd = fd;
+		if (t->opt->mode == MODE_SOURCE)
+			c->owed = 1;
+		else if (t->opt->mode == MODE_RESPONSE &&
+			 !t->opt->request_size)
+			c->owed = t->opt->response_size;
+
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN|EPOLLOUT|EPOLLRDHUP|EPOLLET;
+		ev.data.ptr = c;
+		if (epoll_ctl(t->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+			VANESSA_LOGGER_DEBUG_ERRNO("epoll_ctl");
+			close(fd);
+			free(c);
+			return;
+		}
+	}
+}
+
+
+/**********************************************************************
+ * backend_thread
+ * Run the event loop of one thread
+ * pre: data: thread, with opt and listen_socket set
+ * post: Connections are accepted and served, until an error occurs
+ * return: data
+ **********************************************************************/
+
+static void *backend_thread(void *data)
+{
+	backend_thread_t *t = (backend_thread_t *)data;
+	struct epoll_event ev[BACKEND_EVENTS];
+	backend_conn_t *c, *next;
+	int i, n;
+
+	t->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (t->epfd < 0) {
+		VANESSA_LOGGER_DEBUG_ERRNO("epoll_create1");
+		return t;
+	}
+	t->buf = malloc(BACKEND_BUFFER);
+	if (!t->buf) {
+		VANESSA_LOGGER_DEBUG_ERRNO("malloc");
+		return t;
+	}
+
+	/* The listening socket is the only one without a connection */
+	memset(ev, 0, sizeof(*ev));
+	ev->events = EPOLLIN|EPOLLEXCLUSIVE;
+	ev->data.ptr = NULL;
+	if (epoll_ctl(t->epfd, EPOLL_CTL_ADD, t->listen_socket, ev) < 0) {
+		VANESSA_LOGGER_DEBUG_ERRNO("epoll_ctl");
+		return t;
+	}
+
+	for (;;) {
+		n = epoll_wait(t->epfd, ev, BACKEND_EVENTS,
+			       t->ready ? 0 : -1);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			VANESSA_LOGGER_DEBUG_ERRNO("epoll_wait");
+			return t;
+		}
+		for (i = 0; i < n; i++) {
+			c = (backend_conn_t *)ev[i].data.ptr;
+			if (!c)
+				backend_accept(t);
+			else if (!c->ready)
+				backend_handle(t, c);
+		}
+
+		/* Connections added to the list now wait for the next turn */
+		c = t->ready;
+		t->ready = NULL;
+		for (; c; c = next) {
+			next = c->next;
+			c->ready = 0;
+			backend_handle(t, c);
+		}
+	}
+}
+
+
+/* Allow as many file descriptors as possible, for many connections */
+static void backend_rlimit(void)
+{
+	struct rlimit rl;
+
+	if (getrlimit(RLIMIT_NOFILE, &rl) < 0 || rl.rlim_cur == rl.rlim_max)
+		return;
+	rl.rlim_cur = rl.rlim_max;
+	if (setrlimit(RLIMIT_NOFILE, &rl) < 0)
+		VANESSA_LOGGER_DEBUG_ERRNO("setrlimit");
+}
+
+
+int backend_run(options_t *opt)
+{
+	backend_thread_t *t;
+	vanessa_socket_flag_t flag = 0;
+	int i, s;
+	long flags;
+#ifdef HAVE_PTHREAD
+	pthread_t thread;
+	int err;
+#endif
+
+#ifndef HAVE_PTHREAD
+	if (opt->threads > 1) {
+		VANESSA_LOGGER_ERR("Threads are not supported on this "
+				   "platform");
+		return -1;
+	}
+#endif
+
+	for (i = 0; i < BACKEND_BUFFER; i++)
+		backend_data[i] = random();
+	backend_rlimit();
+
+	if (opt->no_lookup)
+		flag |= VANESSA_SOCKET_NO_LOOKUP;
+	s = vanessa_socket_server_bind(opt->listen_port, opt->listen_host,
+				       flag);
+	if (s < 0) {
+		VANESSA_LOGGER_DEBUG("vanessa_socket_server_bind");
+		VANESSA_LOGGER_ERR_UNSAFE("Could not bind to: %s:%s",
+					  str_null_safe(opt->listen_host),
+					  str_null_safe(opt->listen_port));
+		return -1;
+	}
+	flags = fcntl(s, F_GETFL, NULL);
+	if (flags < 0 || fcntl(s, F_SETFL, flags | O_NONBLOCK) < 0) {
+		VANESSA_LOGGER_DEBUG_ERRNO("fcntl");
+		close(s);
+		return -1;
+	}
+
+	t = calloc(opt->threads, sizeof(*t));
+	if (!t) {
+		VANESSA_LOGGER_DEBUG_ERRNO("calloc");
+		close(s);
+		return -1;
+	}
+	for (i = 0; i < opt->threads; i++) {
+		t[i].opt = opt;
+		t[i].listen_socket = s;
+		t[i].epfd = -1;
+	}
+
+	/* Threads only return on error */
+#ifdef HAVE_PTHREAD
+	for (i = 1; i < opt->threads; i++) {
+		err = pthread_create(&thread, NULL, backend_thread, t + i);
+		if (err) {
+			errno = err;
+			VANESSA_LOGGER_DEBUG_ERRNO("pthread_create");
+			return -1;
+		}
+		pthread_detach(thread);
+	}
+#endif
+	backend_thread(t);
+
+	return -1;
+}
+
+#else /* __linux__ */
+
+int backend_run(options_t *UNUSED(opt))
+{
+	VANESSA_LOGGER_ERR("vanessa_socket_backend is not supported on this "
+			   "platform");
+	return -1;
+}
+
+#endif /* __linux__ */
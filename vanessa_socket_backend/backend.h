@@ -0,0 +1,47 @@
+/**********************************************************************
+ * backend.h                                               October 2026
+ * Simon Horman                                      horms@verge.net.au
+ *
+ * Serve connections for benchmarks
+ *
+ * vanessa_socket_backend
+ * Echo, sink and source server for benchmarking relays
+ * Copyright (C) 1999-2008  Simon Horman <horms@verge.net.au>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307  USA
+ *
+ **********************************************************************/
+
+#ifndef BACKEND_STIX
+#define BACKEND_STIX
+
+#include "options.h"
+
+
+/**********************************************************************
+ * backend_run
+ * Serve connections
+ * pre: opt: options
+ * post: The listening socket is bound and connections to it are
+ *       served as opt->mode says by opt->threads threads, each with
+ *       its own epoll(7) event loop, until the process is killed.
+ * return: -1 on error, otherwise does not return
+ **********************************************************************/
+
+int backend_run(options_t *opt);
+
+
+#endif
@@ -0,0 +1,343 @@
+/**********************************************************************
+ * options.c                                               October 2026
+ * Simon Horman                                      horms@verge.net.au
+ *
+ * Read in command line options
+ *
+ * vanessa_socket_backend
+ * Echo, sink and source server for benchmarking relays
+ * Copyright (C) 1999-2008  Simon Horman <horms@verge.net.au>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307  USA
+ *
+ **********************************************************************/
+
+#include "options.h"
+#include "unused.h"
+
+static const char *mode_name[] = { "echo", "sink", "source", "response" };
+
+
+/***********************************************************************
+ * opt_p
+ * Assign an option that is a char *
+ * pre: opt: option to assign
+ *      value: value to copy into opt
+ *      flag:  flags as per options.h
+ * post: Value is copied into opt. Any existing value of opt is freed
+ *       unless f is set to OPT_NOT_SET
+ * return: 0 on success
+ *         -1 on error
+ ***********************************************************************/
+
+static int
+opt_p(char **opt, const char *value, const int flag)
+{
+	if (!(flag & OPT_NOT_SET) && *opt)
+		free(*opt);
+	if (!value) {
+		*opt = NULL;
+		return 0;
+	}
+	*opt = strdup(value);
+	if (!*opt) {
+		VANESSA_LOGGER_DEBUG_ERRNO("strdup");
+		return -1;
+	}
+	return 0;
+}
+
+/***********************************************************************
+ * opt_i
+ * Assign an option that is an int
+ * pre: opt: option to assign
+ *      value: value to assign to opt
+ *      flag:  ignored
+ * post: Value is assigned to opt.
+ * return: 0 on success
+ *         -1 on error
+ ***********************************************************************/
+
+static int
+opt_i(int *opt, const int value, const int UNUSED(flag))
+{
+	*opt = value;
+	return 0;
+}
+
+
+const char *mode_str(int mode)
+{
+	return mode_name[mode];
+}
+
+
+/**********************************************************************
+ * options
+ * Read in command line options
+ * pre: argc: number or elements in argv
+ *      argv: array of strings with command line-options
+ *      opt:  pointer to options structure to fill in
+ * post: global opt is seeded with values according to argc and argv
+ * return: 0 on success
+ *         -1 on error
+ **********************************************************************/
+
+int options(int argc, char **argv, options_t *opt){
+  int c=0;
+  size_t i;
+  char *optarg;
+  poptContext context;
+
+  const struct poptOption pop_opt[] =
+  {
+    {"debug",            'd', POPT_ARG_NONE,   NULL, 'd', NULL, NULL},
+    {"help",             'h', POPT_ARG_NONE,   NULL, 'h', NULL, NULL},
+    {"listen_host",      'l', POPT_ARG_STRING, NULL, 'l', NULL, NULL},
+    {"listen_port",      'L', POPT_ARG_STRING, NULL, 'L', NULL, NULL},
+    {"mode",             'm', POPT_ARG_STRING, NULL, 'm', NULL, NULL},
+    {"no_lookup",        'n', POPT_ARG_NONE,   NULL, 'n', NULL, NULL},
+    {"quiet",            'q', 0,               NULL, 'q', NULL, NULL},
+    {"request_size",     's', POPT_ARG_STRING, NULL, 's', NULL, NULL},
+    {"response_size",    'S', POPT_ARG_STRING, NULL, 'S', NULL, NULL},
+    {"threads",          'T', POPT_ARG_STRING, NULL, 'T', NULL, NULL},
+    {NULL,               0,   0,               NULL, 0,   NULL, NULL}
+  };
+
+  if(argc==0 || argv==NULL) return(0);
+
+	if (opt_i(&opt->debug, DEFAULT_DEBUG, OPT_NOT_SET)) {
+		VANESSA_LOGGER_DEBUG("Error setting default values");
+		return -1;
+	}
+	if (opt_p(&opt->listen_host, DEFAULT_LISTEN_HOST, OPT_NOT_SET)) {
+		VANESSA_LOGGER_DEBUG("Error setting default values");
+		return -1;
+	}
+	if (opt_p(&opt->listen_port, DEFAULT_LISTEN_PORT, OPT_NOT_SET)) {
+		VANESSA_LOGGER_DEBUG("Error setting default values");
+		return -1;
+	}
+	if (opt_i(&opt->mode, DEFAULT_MODE, OPT_NOT_SET)) {
+		VANESSA_LOGGER_DEBUG("Error setting default values");
+		return -1;
+	}
+	if (opt_i(&opt->no_lookup, DEFAULT_NO_LOOKUP, OPT_NOT_SET)) {
+		VANESSA_LOGGER_DEBUG("Error setting default values");
+		return -1;
+	}
+	if (opt_i(&opt->quiet, DEFAULT_QUIET, OPT_NOT_SET)) {
+		VANESSA_LOGGER_DEBUG("Error setting default values");
+		return -1;
+	}
+	if (opt_i(&opt->request_size, DEFAULT_REQUEST_SIZE, OPT_NOT_SET)) {
+		VANESSA_LOGGER_DEBUG("Error setting default values");
+		return -1;
+	}
+	if (opt_i(&opt->response_size, DEFAULT_RESPONSE_SIZE, OPT_NOT_SET)) {
+		VANESSA_LOGGER_DEBUG("Error setting default values");
+		return -1;
+	}
+	if (opt_i(&opt->threads, DEFAULT_THREADS, OPT_NOT_SET)) {
+		VANESSA_LOGGER_DEBUG("Error setting default values");
+		return -1;
+	}
+
+
+  context= poptGetContext(
+    "vanessa_socket_backend",
+    argc,
+    (const char **) argv,
+    pop_opt,
+    0
+  );
+
+  while ((c=poptGetNextOpt(context)) >= 0){
+    optarg=(char *)poptGetOptArg(context);
+    switch (c){
+      case 'd':
+	opt_i(&opt->debug, 1, 0);
+	break;
+      case 'h':
+	usage(0);
+	break;
+      case 'l':
+        opt_p(&opt->listen_host, optarg, 0);
+	break;
+      case 'L':
+        opt_p(&opt->listen_port, optarg, 0);
+	break;
+      case 'm':
+	for(i=0; i<sizeof(mode_name)/sizeof(*mode_name); i++){
+	  if(!strcmp(optarg, mode_name[i])){
+	    break;
+	  }
+	}
+	if(i==sizeof(mode_name)/sizeof(*mode_name)){
+	  usage(-1);
+	}
+	opt_i(&opt->mode, i, 0);
+	break;
+      case 'n':
+	opt_i(&opt->no_lookup, 1, 0);
+	break;
+      case 'q':
+        opt_i(&opt->quiet, 1, 0);
+	break;
+      case 's':
+	if(!vanessa_socket_str_is_digit(optarg)){ usage(-1); }
+	opt_i(&opt->request_size, atoi(optarg), 0);
+	break;
+      case 'S':
+	if(!vanessa_socket_str_is_digit(optarg)){ usage(-1); }
+	opt_i(&opt->response_size, atoi(optarg), 0);
+	break;
+      case 'T':
+        if(!vanessa_socket_str_is_digit(optarg) || !atoi(optarg)){
+          usage(-1);
+        }
+	opt_i(&opt->threads, atoi(optarg), 0);
+	break;
+    }
+  }
+
+  if (c < -1) {
+    fprintf(
+      stderr,
+      "options: %s: %s\n",
+      poptBadOption(context, POPT_BADOPTION_NOALIAS),
+      poptStrerror(c)
+    );
+    usage(-1);
+  }
+
+  if(opt->listen_port==NULL && !vanessa_socket_host_is_unix(opt->listen_host)){
+    usage(-1);
+  }
+  if(opt->mode==MODE_RESPONSE && !opt->response_size){
+    fprintf(stderr, "options: -m|--mode response needs a response\n");
+    usage(-1);
+  }
+
+  poptFreeContext(context);
+
+  return(0);
+}
+
+
+/**********************************************************************
+ * log_options
+ * Log options
+ * pre: opt: options to log
+ *      vl: logger to log to
+ * post: opt is logged to vl
+ * return: none
+ **********************************************************************/
+
+int log_options(options_t opt, vanessa_logger_t *vl){
+
+  vanessa_logger_log(
+    vl,
+    LOG_DEBUG,
+    "debug=%d, "
+    "listen_host=\"%s\", "
+    "listen_port=\"%s\", "
+    "mode=\"%s\", "
+    "no_lookup=%d, "
+    "quiet=%d, "
+    "request_size=%d, "
+    "response_size=%d, "
+    "threads=%d,\n",
+    opt.debug,
+    str_null_safe(opt.listen_host),
+    str_null_safe(opt.listen_port),
+    mode_str(opt.mode),
+    opt.no_lookup,
+    opt.quiet,
+    opt.request_size,
+    opt.response_size,
+    opt.threads
+  );
+
+  return(0);
+}
+
+
+/**********************************************************************
+ * usage
+ * Display usage information
+ * pre: exit_status: exit status to exit with
+ * post: Usage information printed to stdout if exit_status=0,
+ *       stderr otherwise
+ *       Exit with exit_status
+ * return: does not return
+ **********************************************************************/
+
+void usage(int exit_status){
+  FILE *stream;
+
+  stream=(exit_status)?stderr:stdout;
+
+  fprintf(
+    stream,
+    "vanessa_socket_backend version %s Copyright Simon Horman\n"
+    "\n"
+    "Echo, sink and source server for benchmarking relays\n"
+    "\n"
+    "Usage: vanessa_socket_backend [options]\n"
+    "  options:\n"
+    "     -d|--debug:         Turn on verbose debuging to stderr.\n"
+    "     -h|--help:          Display this message.\n"
+    "     -L|--listen_port:   Port to listen on.\n"
+    "                         (mandatory unless listening on a unix\n"
+    "                         domain socket)\n"
+    "     -l|--listen_host:   Address to listen on.\n"
+    "                         May be a hostname or an IP address.\n"
+    "                         May also be unix:/path or unix:@name to\n"
+    "                         listen on a unix domain socket, in which\n"
+    "                         case -L|--listen_port is not used.\n"
+    "                         If not defined then listen on all local\n"
+    "                         addresses.\n"
+    "     -m|--mode:          What is done with each connection. One of:\n"
+    "                         echo: send back what is received\n"
+    "                         sink: discard what is received\n"
+    "                         source: send data as fast as possible\n"
+    "                         response: send -S|--response_size bytes\n"
+    "                         for each -s|--request_size bytes received\n"
+    "                         (default echo)\n"
+    "     -n|--no_lookup:     Turn off lookup of hostnames and portnames.\n"
+    "                         That is, hosts must be given as IP addresses\n"
+    "                         and ports must be given as numbers.\n"
+    "     -q|--quiet:         Only log errors. Overriden by -d|--debug.\n"
+    "     -s|--request_size:  Bytes in each request, for -m|--mode\n"
+    "                         response. If 0 a single response is sent\n"
+    "                         when a connection is accepted. (default %d)\n"
+    "     -S|--response_size: Bytes in each response, for -m|--mode\n"
+    "                         response. (default %d)\n"
+    "     -T|--threads:       Number of threads, each with its own event\n"
+    "                         loop. (default %d)\n"
+    "\n"
+    "     Notes: Default value for binary flags is off.\n"
+    "            -L|--listen_port must be defined unless -l|--listen_host\n"
+    "            is a unix domain socket.\n",
+    VERSION,
+    DEFAULT_REQUEST_SIZE,
+    DEFAULT_RESPONSE_SIZE,
+    DEFAULT_THREADS
+  );
+
+  exit(exit_status);
+}
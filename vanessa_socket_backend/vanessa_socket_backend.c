@@ -0,0 +1,87 @@
+/**********************************************************************
+ * vanessa_socket_backend.c                                October 2026
+ * Simon Horman                                      horms@verge.net.au
+ *
+ * Echo, sink and source server for benchmarking relays
+ *
+ * vanessa_socket_backend
+ * Echo, sink and source server for benchmarking relays
+ * Copyright (C) 1999-2008  Simon Horman <horms@verge.net.au>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307  USA
+ *
+ **********************************************************************/
+
+#include "options.h"
+#include "backend.h"
+
+#include <signal.h>
+
+#define IDENT "vanessa_socket_backend"
+
+
+/**********************************************************************
+ * Muriel the main function
+ **********************************************************************/
+
+int main (int argc, char **argv){
+  vanessa_logger_t *vl;
+  options_t opt;
+
+  /*
+   * Read command line options
+   */
+  options(argc, argv, &opt);
+
+  /*
+   * Set up Logger
+   */
+  if((vl=vanessa_logger_openlog_filehandle(
+    stderr,
+    IDENT,
+    opt.debug?LOG_DEBUG:opt.quiet?LOG_ERR:LOG_INFO,
+    0
+  ))==NULL){
+    fprintf(stderr, "main: vanessa_logger_openlog_filehandle");
+    exit(-1);
+  }
+
+  /*
+   * Set up Logging for libvanessa_socket
+   */
+  vanessa_logger_set(vl);
+
+  /*
+   * Log the options
+   */
+  log_options(opt, vl);
+
+  /*
+   * A client that goes away just closes its connection
+   */
+  signal(SIGPIPE, SIG_IGN);
+
+  vanessa_logger_log(vl, LOG_INFO, "Serving %s on %s:%s with %d threads",
+                     mode_str(opt.mode), str_null_safe(opt.listen_host),
+                     str_null_safe(opt.listen_port), opt.threads);
+
+  backend_run(&opt);
+
+  vanessa_logger_log(vl, LOG_DEBUG, "main: backend_run");
+  vanessa_logger_unset();
+  vanessa_logger_closelog(vl);
+  return(-1);
+}
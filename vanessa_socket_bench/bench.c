@@ -0,0 +1,512 @@
+/**********************************************************************
+ * bench.c                                                 October 2026
+ * Simon Horman                                      horms@verge.net.au
+ *
+ * Drive connections through a relay and measure them
+ *
+ * vanessa_socket_bench
+ * Load generator for TCP/IP relays
+ * Copyright (C) 1999-2008  Simon Horman <horms@verge.net.au>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307  USA
+ *
+ **********************************************************************/
+
+#include "bench.h"
+#include "unused.h"
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#define BENCH_BUFFER  65536	/* Most bytes sent or received at once */
+#define BENCH_EVENTS  256	/* Events handled for each epoll_wait() */
+#define BENCH_TICK    100	/* Longest wait for events, milliseconds */
+#define BENCH_RETRY   10	/* Wait before connecting again, milliseconds */
+#define BENCH_BUDGET  16	/* Reads or writes per connection per turn */
+
+#define BENCH_DOWN       0	/* Waiting to connect again */
+#define BENCH_CONNECTING 1
+#define BENCH_SENDING    2
+#define BENCH_RECEIVING  3
+
+typedef struct {
+	int fd;
+	int state;
+	int ready;		/* On the ready list */
+	size_t off;		/* Of the request or response */
+	uint64_t start;		/* Of the connect or transaction, or when
+				   the connection went down */
+} bench_conn_t;
+
+/* State of one thread */
+typedef struct {
+	options_t *opt;
+	bench_conn_t *conn;
+	int nconn;
+	int ndown;
+	bench_conn_t **ready;	/* Stopped before EAGAIN, to go on with */
+	int nready;
+	int epfd;
+	char *buf;
+	report_t report;
+	int status;
+} bench_thread_t;
+
+/* Sent by all connections, random so that it doesn't compress */
+static char bench_data[BENCH_BUFFER];
+
+
+static uint64_t bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+/**********************************************************************
+ * bench_open
+ * Start connecting
+ * pre: t: thread
+ *      c: connection, not open
+ * post: A non-blocking connection is started and added to the event
+ *       loop. On error c is left down, to be tried again later.
+ * return: 0 on success
+ *         -1 on error
+ **********************************************************************/
+
+static int bench_open(bench_thread_t *t, bench_conn_t *c)
+{
+	struct epoll_event ev;
+	vanessa_socket_flag_t flag;
+
+	flag = VANESSA_SOCKET_NONBLOCK;
+	if (t->opt->no_lookup)
+		flag |= VANESSA_SOCKET_NO_LOOKUP;
+
+	c->start = bench_now();
+	c->fd = vanessa_socket_client_open(t->opt->outgoing_host,
+					   t->opt->outgoing_port, flag);
+	if (c->fd < 0) {
+		VANESSA_LOGGER_DEBUG("vanessa_socket_client_open");
+		goto err;
+	}
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN|EPOLLOUT|EPOLLET;
+	ev.data.ptr = c;
+	if (epoll_ctl(t->epfd, EPOLL_CTL_ADD, c->fd, &ev) < 0) {
+		VANESSA_LOGGER_DEBUG_ERRNO("epoll_ctl");
+		close(c->fd);
+		c->fd = -1;
+		goto err;
+	}
+
+	c->state = BENCH_CONNECTING;
+	c->off = 0;
+	return 0;
+
+err:
+	t->report.connect_errors++;
+	c->start = bench_now();
+	if (c->state != BENCH_DOWN) {
+		c->state = BENCH_DOWN;
+		t->ndown++;
+	}
+	return -1;
+}
+
+
+static void bench_reopen(bench_thread_t *t, bench_conn_t *c)
+{
+	if (close(c->fd) < 0)
+		VANESSA_LOGGER_DEBUG_ERRNO("warning: close");
+	c->fd = -1;
+	bench_open(t, c);
+}
+
+
+/* Start a transaction, or a stream */
+static void bench_start(bench_thread_t *t, bench_conn_t *c, uint64_t now)
+{
+	c->start = now;
+	c->off = 0;
+	if (t->opt->mode == MODE_RECV ||
+	    (t->opt->mode != MODE_SEND && !t->opt->request_size))
+		c->state = BENCH_RECEIVING;
+	else
+		c->state = BENCH_SENDING;
+}
+
+
+/**********************************************************************
+ * bench_drive
+ * Make progress on a connection
+ * pre: t: thread
+ *      c: connection, open
+ *      events: epoll events for c, or EPOLLIN|EPOLLOUT if c is on the
+ *              ready list
+ * post: Data is sent and received until the socket would block, or
+ *       BENCH_BUDGET reads and writes have been made, in which case c
+ *       is put on the ready list. Completed transactions are counted.
+ * return: 0 to carry on with c
+ *         1 if c should be closed and opened again, after a
+ *           transaction in MODE_CONNECT, or an error
+ **********************************************************************/
+
+static int bench_drive(bench_thread_t *t, bench_conn_t *c, uint32_t events)
+{
+	options_t *opt = t->opt;
+	report_t *r = &t->report;
+	socklen_t len;
+	ssize_t bytes;
+	size_t want;
+	uint64_t now;
+	int budget, err;
+
+	for (budget = BENCH_BUDGET; budget; budget--) {
+		switch (c->state) {
+		case BENCH_CONNECTING:
+			if (!(events & (EPOLLOUT|EPOLLERR|EPOLLHUP)))
+				return 0;
+			len = sizeof(err);
+			if (getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err,
+				       &len) < 0 || err) {
+				/* Wait a little rather than spin on a refusal */
+				r->connect_errors++;
+				close(c->fd);
+				c->fd = -1;
+				c->start = bench_now();
+				c->state = BENCH_DOWN;
+				t->ndown++;
+				return 0;
+			}
+			now = bench_now();
+			report_record(&r->connect_time, now - c->start);
+			r->connects++;
+			bench_start(t, c, now);
+			continue;
+
+		case BENCH_SENDING:
+			want = opt->mode == MODE_SEND ?
+			       BENCH_BUFFER : opt->request_size - c->off;
+			if (want > BENCH_BUFFER)
+				want = BENCH_BUFFER;
+			bytes = send(c->fd, bench_data, want, MSG_NOSIGNAL);
+			if (bytes < 0) {
+				if (errno == EAGAIN || errno == EWOULDBLOCK)
+					return 0;
+				if (errno == EINTR)
+					continue;
+				VANESSA_LOGGER_DEBUG_ERRNO("send");
+				r->errors++;
+				return 1;
+			}
+			r->bytes_sent += bytes;
+			if (opt->mode == MODE_SEND)
+				continue;
+			c->off += bytes;
+			if (c->off < (size_t)opt->request_size)
+				continue;
+			if (opt->response_size) {
+				c->state = BENCH_RECEIVING;
+				c->off = 0;
+				continue;
+			}
+			break;
+
+		case BENCH_RECEIVING:
+			want = opt->mode == MODE_RECV ?
+			       BENCH_BUFFER : opt->response_size - c->off;
+			if (want > BENCH_BUFFER)
+				want = BENCH_BUFFER;
+			bytes = recv(c->fd, t->buf, want, 0);
+			if (bytes < 0) {
+				if (errno == EAGAIN || errno == EWOULDBLOCK)
+					return 0;
+				if (errno == EINTR)
+					continue;
+				VANESSA_LOGGER_DEBUG_ERRNO("recv");
+				r->errors++;
+				return 1;
+			}
+			if (!bytes) {
+				VANESSA_LOGGER_DEBUG("connection closed by server");
+				r->errors++;
+				return 1;
+			}
+			r->bytes_received += bytes;
+			if (opt->mode == MODE_RECV)
+				continue;
+			c->off += bytes;
+			if (c->off < (size_t)opt->response_size)
+				continue;
+			break;
+		}
+
+		/* A transaction is complete */
+		now = bench_now();
+		report_record(&r->latency, now - c->start);
+		r->transactions++;
+		if (opt->mode == MODE_CONNECT)
+			return 1;
+		bench_start(t, c, now);
+	}
+
+	if (!c->ready) {
+		c->ready = 1;
+		t->ready[t->nready++] = c;
+	}
+	return 0;
+}
+
+
+static void bench_handle(bench_thread_t *t, bench_conn_t *c,
+			 uint32_t events)
+{
+	if (bench_drive(t, c, events))
+		bench_reopen(t, c);
+}
+
+
+/**********************************************************************
+ * bench_thread
+ * Run the event loop of one thread
+ * pre: data: thread, with opt, conn and nconn set
+ * post: The connections of the thread are driven until the duration
+ *       has passed, and the results are stored in the thread
+ * return: data
+ **********************************************************************/
+
+static void *bench_thread(void *data)
+{
+	bench_thread_t *t = (bench_thread_t *)data;
+	struct epoll_event ev[BENCH_EVENTS];
+	bench_conn_t *c;
+	uint64_t begin, deadline, now;
+	int i, n, nready, timeout;
+
+	t->status = -1;
+	t->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (t->epfd < 0) {
+		VANESSA_LOGGER_DEBUG_ERRNO("epoll_create1");
+		return t;
+	}
+	t->buf = malloc(BENCH_BUFFER);
+	/* Room for connections to go back on while the list is run */
+	t->ready = malloc(t->nconn * 2 * sizeof(*t->ready));
+	if (!t->buf || !t->ready) {
+		VANESSA_LOGGER_DEBUG_ERRNO("malloc");
+		return t;
+	}
+
+	begin = bench_now();
+	deadline = begin + (uint64_t)t->opt->duration * 1000000000;
+
+	for (i = 0; i < t->nconn; i++) {
+		t->conn[i].fd = -1;
+		t->conn[i].state = BENCH_CONNECTING;
+		bench_open(t, t->conn + i);
+	}
+
+	for (;;) {
+		now = bench_now();
+		if (now >= deadline)
+			break;
+
+		timeout = (deadline - now) / 1000000 + 1;
+		if (timeout > BENCH_TICK)
+			timeout = BENCH_TICK;
+		if (t->ndown && timeout > BENCH_RETRY)
+			timeout = BENCH_RETRY;
+		if (t->nready)
+			timeout = 0;
+
+		n = epoll_wait(t->epfd, ev, BENCH_EVENTS, timeout);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			VANESSA_LOGGER_DEBUG_ERRNO("epoll_wait");
+			return t;
+		}
+		for (i = 0; i < n; i++) {
+			c = (bench_conn_t *)ev[i].data.ptr;
+			if (c->ready)
+				continue;
+			bench_handle(t, c, ev[i].events);
+		}
+
+		/* Connections added to the list now wait for the next turn */
+		nready = t->nready;
+		for (i = 0; i < nready; i++) {
+			c = t->ready[i];
+			c->ready = 0;
+			bench_handle(t, c, EPOLLIN|EPOLLOUT);
+		}
+		memmove(t->ready, t->ready + nready,
+			(t->nready - nready) * sizeof(*t->ready));
+		t->nready -= nready;
+
+		if (!t->ndown)
+			continue;
+		now = bench_now();
+		for (i = 0; i < t->nconn; i++) {
+			c = t->conn + i;
+			if (c->state != BENCH_DOWN ||
+			    now - c->start < BENCH_RETRY * 1000000)
+				continue;
+			t->ndown--;
+			c->state = BENCH_CONNECTING;
+			bench_open(t, c);
+		}
+	}
+
+	t->report.elapsed = bench_now() - begin;
+	t->status = 0;
+	return t;
+}
+
+
+/* Allow enough file descriptors for the connections, if possible */
+static void bench_rlimit(int connections)
+{
+	struct rlimit rl;
+
+	if (getrlimit(RLIMIT_NOFILE, &rl) < 0)
+		return;
+	if (rl.rlim_cur != RLIM_INFINITY &&
+	    rl.rlim_cur < (rlim_t)connections + 64) {
+		rl.rlim_cur = (rlim_t)connections + 64;
+		if (rl.rlim_max != RLIM_INFINITY && rl.rlim_cur > rl.rlim_max)
+			rl.rlim_cur = rl.rlim_max;
+		if (setrlimit(RLIMIT_NOFILE, &rl) < 0)
+			VANESSA_LOGGER_DEBUG_ERRNO("setrlimit");
+	}
+}
+
+
+int bench_run(options_t *opt, report_t *r)
+{
+	bench_thread_t *t;
+	bench_conn_t *conn;
+	int i, off, status = -1;
+#ifdef HAVE_PTHREAD
+	pthread_t *thread = NULL;
+	int err, started = 0;
+#endif
+
+#ifndef HAVE_PTHREAD
+	if (opt->threads > 1) {
+		VANESSA_LOGGER_ERR("Threads are not supported on this "
+				   "platform");
+		return -1;
+	}
+#endif
+
+	for (i = 0; i < BENCH_BUFFER; i++)
+		bench_data[i] = random();
+	bench_rlimit(opt->connections);
+
+	t = calloc(opt->threads, sizeof(*t));
+	conn = calloc(opt->connections, sizeof(*conn));
+	if (!t || !conn) {
+		VANESSA_LOGGER_DEBUG_ERRNO("calloc");
+		goto out;
+	}
+
+	for (i = 0, off = 0; i < opt->threads; i++) {
+		t[i].opt = opt;
+		t[i].epfd = -1;
+		t[i].conn = conn + off;
+		t[i].nconn = opt->connections / opt->threads +
+			     (i < opt->connections % opt->threads);
+		off += t[i].nconn;
+	}
+
+#ifdef HAVE_PTHREAD
+	thread = calloc(opt->threads, sizeof(*thread));
+	if (!thread) {
+		VANESSA_LOGGER_DEBUG_ERRNO("calloc");
+		goto out;
+	}
+	for (started = 1; started < opt->threads; started++) {
+		err = pthread_create(thread + started, NULL, bench_thread,
+				     t + started);
+		if (err) {
+			errno = err;
+			VANESSA_LOGGER_DEBUG_ERRNO("pthread_create");
+			break;
+		}
+	}
+	if (started == opt->threads)
+		bench_thread(t);
+	for (i = 1; i < started; i++)
+		pthread_join(thread[i], NULL);
+	if (started < opt->threads)
+		goto out;
+#else
+	bench_thread(t);
+#endif
+
+	memset(r, 0, sizeof(*r));
+	for (i = 0; i < opt->threads; i++) {
+		if (t[i].status < 0)
+			goto out;
+		report_add(r, &t[i].report);
+	}
+	status = 0;
+
+out:
+	if (t) {
+		for (i = 0; i < opt->threads; i++) {
+			if (t[i].epfd >= 0)
+				close(t[i].epfd);
+			free(t[i].buf);
+			free(t[i].ready);
+		}
+	}
+	if (conn) {
+		for (i = 0; i < opt->connections; i++)
+			if (conn[i].fd > 0)
+				close(conn[i].fd);
+	}
+#ifdef HAVE_PTHREAD
+	free(thread);
+#endif
+	free(conn);
+	free(t);
+	return status;
+}
+
+#else /* __linux__ */
+
+int bench_run(options_t *UNUSED(opt), report_t *UNUSED(r))
+{
+	VANESSA_LOGGER_ERR("vanessa_socket_bench is not supported on this "
+			   "platform");
+	return -1;
+}
+
+#endif /* __linux__ */
@@ -0,0 +1,52 @@
+/**********************************************************************
+ * bench.h                                                 October 2026
+ * Simon Horman                                      horms@verge.net.au
+ *
+ * Drive connections through a relay and measure them
+ *
+ * vanessa_socket_bench
+ * Load generator for TCP/IP relays
+ * Copyright (C) 1999-2008  Simon Horman <horms@verge.net.au>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307  USA
+ *
+ **********************************************************************/
+
+#ifndef BENCH_STIX
+#define BENCH_STIX
+
+#include "options.h"
+#include "report.h"
+
+
+/**********************************************************************
+ * bench_run
+ * Run a benchmark
+ * pre: opt: options
+ *      r: where to store the results
+ * post: opt->connections connections are made to the outgoing host
+ *       and port and driven as opt->mode says by opt->threads
+ *       threads, each with its own epoll(7) event loop, for
+ *       opt->duration seconds. Connections that fail are made again.
+ *       The results of the threads are added together in r.
+ * return: 0 on success
+ *         -1 on error
+ **********************************************************************/
+
+int bench_run(options_t *opt, report_t *r);
+
+
+#endif
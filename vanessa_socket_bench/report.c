@@ -0,0 +1,210 @@
+/**********************************************************************
+ * report.c                                                October 2026
+ * Simon Horman                                      horms@verge.net.au
+ *
+ * Results of a benchmark, and how they are reported
+ *
+ * vanessa_socket_bench
+ * Load generator for TCP/IP relays
+ * Copyright (C) 1999-2008  Simon Horman <horms@verge.net.au>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307  USA
+ *
+ **********************************************************************/
+
+#include "report.h"
+
+
+static unsigned int report_bucket(uint64_t value)
+{
+	unsigned int shift;
+
+	if (value < 2 * REPORT_SUB)
+		return value;
+	shift = 63 - __builtin_clzll(value) - REPORT_SUB_BITS;
+	return shift * REPORT_SUB + (value >> shift);
+}
+
+
+void report_record(report_histogram_t *h, uint64_t value)
+{
+	h->bucket[report_bucket(value)]++;
+	h->count++;
+	h->sum += value;
+	if (value > h->max)
+		h->max = value;
+}
+
+
+static void report_histogram_add(report_histogram_t *h,
+				 const report_histogram_t *add)
+{
+	unsigned int i;
+
+	for (i = 0; i < REPORT_BUCKETS; i++)
+		h->bucket[i] += add->bucket[i];
+	h->count += add->count;
+	h->sum += add->sum;
+	if (add->max > h->max)
+		h->max = add->max;
+}
+
+
+void report_add(report_t *r, const report_t *add)
+{
+	r->connects += add->connects;
+	r->connect_errors += add->connect_errors;
+	r->errors += add->errors;
+	r->transactions += add->transactions;
+	r->bytes_sent += add->bytes_sent;
+	r->bytes_received += add->bytes_received;
+	if (add->elapsed > r->elapsed)
+		r->elapsed = add->elapsed;
+	report_histogram_add(&r->connect_time, &add->connect_time);
+	report_histogram_add(&r->latency, &add->latency);
+}
+
+
+uint64_t report_percentile(const report_histogram_t *h, double p)
+{
+	uint64_t rank, seen = 0;
+	unsigned int i, shift;
+
+	if (!h->count)
+		return 0;
+
+	rank = (uint64_t)(h->count * p / 100);
+	if (rank >= h->count)
+		rank = h->count - 1;
+
+	for (i = 0; i < REPORT_BUCKETS; i++) {
+		seen += h->bucket[i];
+		if (seen > rank)
+			break;
+	}
+
+	if (i < 2 * REPORT_SUB)
+		return i;
+	shift = i / REPORT_SUB - 1;
+	return ((uint64_t)(i - shift * REPORT_SUB) << shift) +
+		((uint64_t)1 << shift) / 2;
+}
+
+
+static double report_rate(uint64_t n, uint64_t elapsed)
+{
+	return elapsed ? (double)n * 1000000000 / elapsed : 0;
+}
+
+
+/**********************************************************************
+ * report_histogram_print
+ * Print the percentiles of a histogram, in microseconds
+ * pre: h: histogram of nanoseconds
+ *      name: name of the histogram
+ *      stream: where to print it
+ *      json: non-zero to print a JSON member, rather than text
+ **********************************************************************/
+
+static void report_histogram_print(const report_histogram_t *h,
+				   const char *name, FILE *stream, int json)
+{
+	double mean = h->count ? (double)h->sum / h->count / 1000 : 0;
+
+	if (json)
+		fprintf(stream, "  \"%s_us\": { \"count\": %llu, "
+			"\"mean\": %.1f, \"p50\": %.1f, \"p99\": %.1f, "
+			"\"p999\": %.1f, \"max\": %.1f }", name,
+			(unsigned long long)h->count, mean,
+			report_percentile(h, 50) / 1000.0,
+			report_percentile(h, 99) / 1000.0,
+			report_percentile(h, 99.9) / 1000.0,
+			h->max / 1000.0);
+	else
+		fprintf(stream, "%-16s mean %.1fus p50 %.1fus p99 %.1fus "
+			"p999 %.1fus max %.1fus\n", name, mean,
+			report_percentile(h, 50) / 1000.0,
+			report_percentile(h, 99) / 1000.0,
+			report_percentile(h, 99.9) / 1000.0,
+			h->max / 1000.0);
+}
+
+
+void report_print(const options_t *opt, const report_t *r, FILE *stream)
+{
+	double seconds = r->elapsed / 1000000000.0;
+	double sent = report_rate(r->bytes_sent, r->elapsed);
+	double received = report_rate(r->bytes_received, r->elapsed);
+
+	if (opt->json) {
+		fprintf(stream, "{\n"
+			"  \"mode\": \"%s\",\n"
+			"  \"connections\": %d,\n"
+			"  \"threads\": %d,\n"
+			"  \"request_size\": %d,\n"
+			"  \"response_size\": %d,\n"
+			"  \"seconds\": %.3f,\n"
+			"  \"connects\": %llu,\n"
+			"  \"connects_per_second\": %.1f,\n"
+			"  \"connect_errors\": %llu,\n"
+			"  \"errors\": %llu,\n"
+			"  \"transactions\": %llu,\n"
+			"  \"transactions_per_second\": %.1f,\n"
+			"  \"bytes_sent\": %llu,\n"
+			"  \"bytes_received\": %llu,\n"
+			"  \"bytes_sent_per_second\": %.0f,\n"
+			"  \"bytes_received_per_second\": %.0f,\n",
+			mode_str(opt->mode), opt->connections, opt->threads,
+			opt->request_size, opt->response_size, seconds,
+			(unsigned long long)r->connects,
+			report_rate(r->connects, r->elapsed),
+			(unsigned long long)r->connect_errors,
+			(unsigned long long)r->errors,
+			(unsigned long long)r->transactions,
+			report_rate(r->transactions, r->elapsed),
+			(unsigned long long)r->bytes_sent,
+			(unsigned long long)r->bytes_received, sent, received);
+		report_histogram_print(&r->connect_time, "connect", stream, 1);
+		fprintf(stream, ",\n");
+		report_histogram_print(&r->latency, "latency", stream, 1);
+		fprintf(stream, "\n}\n");
+		return;
+	}
+
+	fprintf(stream, "%s mode, %d connections, %d threads, %.3f seconds\n",
+		mode_str(opt->mode), opt->connections, opt->threads, seconds);
+	fprintf(stream, "%-16s %llu (%.1f/s), %llu errors\n", "connects",
+		(unsigned long long)r->connects,
+		report_rate(r->connects, r->elapsed),
+		(unsigned long long)r->connect_errors);
+	if (opt->mode == MODE_RR || opt->mode == MODE_CONNECT)
+		fprintf(stream, "%-16s %llu (%.1f/s), %llu errors\n",
+			"transactions", (unsigned long long)r->transactions,
+			report_rate(r->transactions, r->elapsed),
+			(unsigned long long)r->errors);
+	else
+		fprintf(stream, "%-16s %llu\n", "errors",
+			(unsigned long long)r->errors);
+	fprintf(stream, "%-16s %llu bytes (%.2f MB/s, %.3f Gbit/s)\n", "sent",
+		(unsigned long long)r->bytes_sent, sent / 1000000,
+		sent * 8 / 1000000000);
+	fprintf(stream, "%-16s %llu bytes (%.2f MB/s, %.3f Gbit/s)\n",
+		"received", (unsigned long long)r->bytes_received,
+		received / 1000000, received * 8 / 1000000000);
+	report_histogram_print(&r->connect_time, "connect", stream, 0);
+	if (opt->mode == MODE_RR || opt->mode == MODE_CONNECT)
+		report_histogram_print(&r->latency, "latency", stream, 0);
+}
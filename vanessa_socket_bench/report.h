@@ -0,0 +1,111 @@
+/**********************************************************************
+ * report.h                                                October 2026
+ * Simon Horman                                      horms@verge.net.au
+ *
+ * Results of a benchmark, and how they are reported
+ *
+ * vanessa_socket_bench
+ * Load generator for TCP/IP relays
+ * Copyright (C) 1999-2008  Simon Horman <horms@verge.net.au>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307  USA
+ *
+ **********************************************************************/
+
+#ifndef REPORT_STIX
+#define REPORT_STIX
+
+#include "options.h"
+
+#include <stdint.h>
+
+/*
+ * Latencies are counted in log-linear buckets. Values below
+ * 2 * REPORT_SUB have a bucket each, above that each power of two is
+ * split into REPORT_SUB buckets. So no bucket is wider than 1/32 of the
+ * values in it, and any 64 bit value fits.
+ */
+#define REPORT_SUB_BITS 5
+#define REPORT_SUB      (1 << REPORT_SUB_BITS)
+#define REPORT_BUCKETS  ((64 - REPORT_SUB_BITS + 1) * REPORT_SUB)
+
+typedef struct {
+	uint64_t bucket[REPORT_BUCKETS];
+	uint64_t count;
+	uint64_t sum;
+	uint64_t max;
+} report_histogram_t;
+
+typedef struct {
+	uint64_t connects;
+	uint64_t connect_errors;
+	uint64_t errors;		/* After connecting */
+	uint64_t transactions;
+	uint64_t bytes_sent;
+	uint64_t bytes_received;
+	uint64_t elapsed;		/* In nanoseconds */
+	report_histogram_t connect_time;	/* In nanoseconds */
+	report_histogram_t latency;		/* Of transactions */
+} report_t;
+
+
+/**********************************************************************
+ * report_record
+ * Count a value in a histogram
+ * pre: h: histogram
+ *      value: value to count
+ **********************************************************************/
+
+void report_record(report_histogram_t *h, uint64_t value);
+
+
+/**********************************************************************
+ * report_add
+ * Add results together
+ * pre: r: results to add to
+ *      add: results to add
+ * post: The counters and histograms of add are added to those of r,
+ *       the elapsed time is the longer of the two
+ **********************************************************************/
+
+void report_add(report_t *r, const report_t *add);
+
+
+/**********************************************************************
+ * report_percentile
+ * Estimate a percentile of a histogram
+ * pre: h: histogram
+ *      p: percentile, from 0 to 100
+ * return: the middle of the bucket that the percentile falls in,
+ *         or 0 if nothing has been counted
+ **********************************************************************/
+
+uint64_t report_percentile(const report_histogram_t *h, double p);
+
+
+/**********************************************************************
+ * report_print
+ * Print results
+ * pre: opt: options the benchmark was run with
+ *      r: results
+ *      stream: where to print them
+ * post: r is printed as text, or as a JSON object if opt->json
+ **********************************************************************/
+
+void report_print(const options_t *opt, const report_t *r, FILE *stream);
+
+
+#endif
@@ -0,0 +1,390 @@
+/**********************************************************************
+ * accesslog.c                                             October 2026
+ * Simon Horman                                      horms@verge.net.au
+ *
+ * Asynchronous access log of sessions
+ *
+ * vanessa_socket_pipe
+ * Trivial TCP/IP pipe based on libvanessa_socket
+ * Copyright (C) 1999-2008  Simon Horman <horms@verge.net.au>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307  USA
+ *
+ **********************************************************************/
+
+#include "accesslog.h"
+#include "ring.h"
+#include "unused.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <time.h>
+
+#define ACCESSLOG_RING   4096	/* Records, must be a power of two */
+#define ACCESSLOG_LINE   ((SOCKADDR_STR_LEN*2)+256)
+
+/*
+ * Points of a trace record, in the order they are logged. Each is
+ * kept in microseconds since the session was accepted, or as
+ * ACCESSLOG_NONE if the session did not get that far.
+ */
+#define ACCESSLOG_OPEN_AT         0
+#define ACCESSLOG_RESOLVE_AT      1
+#define ACCESSLOG_CONNECT_AT      2
+#define ACCESSLOG_CLIENT_FIRST_AT 3
+#define ACCESSLOG_SERVER_FIRST_AT 4
+#define ACCESSLOG_CLIENT_LAST_AT  5
+#define ACCESSLOG_SERVER_LAST_AT  6
+#define ACCESSLOG_CLOSE_AT        7
+#define ACCESSLOG_POINTS          8
+#define ACCESSLOG_NONE            UINT64_MAX
+
+typedef struct {
+	int type;
+	struct timespec when;	/* CLOCK_REALTIME */
+	uint64_t duration;	/* Microseconds */
+	uint64_t point[ACCESSLOG_POINTS];	/* Of a trace record */
+	accesslog_tcp_info_t tcp_info;	/* Of a close record */
+	int has_tcp_info;
+	size_t bytes[2];
+	struct sockaddr_storage from;
+	struct sockaddr_storage to;
+} accesslog_entry_t;
+
+static ring_t *accesslog_ring;
+static int accesslog_fd = -1;
+
+
+int accesslog_enabled(void)
+{
+	return accesslog_ring != NULL;
+}
+
+
+void accesslog_child(void)
+{
+	if (accesslog_fd >= 0 && accesslog_fd != STDOUT_FILENO)
+		close(accesslog_fd);
+	accesslog_fd = -1;
+}
+
+
+static void accesslog_copy(struct sockaddr_storage *dst,
+			   const struct sockaddr *src)
+{
+	size_t len;
+
+	memset(dst, 0, sizeof(*dst));
+	if (!src)
+		return;
+
+	if (src->sa_family == AF_INET)
+		len = sizeof(struct sockaddr_in);
+	else if (src->sa_family == AF_INET6)
+		len = sizeof(struct sockaddr_in6);
+	else if (src->sa_family == AF_UNIX)
+		len = sizeof(struct sockaddr_un);
+	else
+		return;
+	memcpy(dst, src, len);
+}
+
+
+void accesslog_record(int type, const struct sockaddr *from,
+		      const struct sockaddr *to, size_t c2s, size_t s2c,
+		      const struct timespec *start,
+		      const accesslog_tcp_info_t *tcp_info)
+{
+	accesslog_entry_t *e;
+	struct timespec now;
+	uint64_t pos;
+
+	if (!accesslog_ring || !(e = ring_claim(accesslog_ring, &pos)))
+		return;
+
+	e->type = type;
+	clock_gettime(CLOCK_REALTIME, &e->when);
+	e->duration = 0;
+	if (type == ACCESSLOG_CLOSE && start) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		e->duration = (uint64_t)(now.tv_sec - start->tv_sec) *
+			1000000 + (now.tv_nsec - start->tv_nsec) / 1000;
+	}
+	e->has_tcp_info = type == ACCESSLOG_CLOSE && tcp_info;
+	if (e->has_tcp_info)
+		e->tcp_info = *tcp_info;
+	e->bytes[0] = c2s;
+	e->bytes[1] = s2c;
+	accesslog_copy(&e->from, from);
+	accesslog_copy(&e->to, to);
+
+	ring_publish(accesslog_ring, pos);
+}
+
+
+void accesslog_tcp_info_read(accesslog_tcp_info_t *tcp_info, int client,
+			     int server)
+{
+	tcp_info->ok[ACCESSLOG_CLIENT] = !vanessa_socket_tcp_info(client,
+			&tcp_info->side[ACCESSLOG_CLIENT]);
+	tcp_info->ok[ACCESSLOG_SERVER] = server >= 0 &&
+		!vanessa_socket_tcp_info(server,
+					 &tcp_info->side[ACCESSLOG_SERVER]);
+}
+
+
+size_t accesslog_tcp_info_str(const accesslog_tcp_info_t *tcp_info,
+			      char *str, size_t len)
+{
+	const vanessa_socket_tcp_info_t *t;
+	size_t off = 0;
+	int i;
+
+	str[0] = '\0';
+	for (i = 0; i < 2 && off < len; i++) {
+		t = tcp_info->side + i;
+		if (!tcp_info->ok[i])
+			off += snprintf(str + off, len - off,
+					" %s - - - - - -",
+					i == ACCESSLOG_CLIENT ?
+					"client" : "server");
+		else
+			off += snprintf(str + off, len - off,
+					" %s %u.%06u %u.%06u %u %llu %u %u",
+					i == ACCESSLOG_CLIENT ?
+					"client" : "server",
+					t->rtt / 1000000, t->rtt % 1000000,
+					t->rttvar / 1000000,
+					t->rttvar % 1000000, t->retrans,
+					(unsigned long long)t->delivery_rate,
+					t->cwnd, t->unacked);
+	}
+
+	return off < len ? off : len - 1;
+}
+
+
+/**********************************************************************
+ * accesslog_points
+ * Work out the points of a trace record
+ * pre: trace: trace of a session
+ *      point: where to store ACCESSLOG_POINTS points
+ * post: point is filled in, relative to trace->accept
+ **********************************************************************/
+
+static void accesslog_points(const vanessa_socket_trace_t *trace,
+			     uint64_t *point)
+{
+	uint64_t at[ACCESSLOG_POINTS];
+	int i;
+
+	at[ACCESSLOG_OPEN_AT] = trace->open;
+	at[ACCESSLOG_RESOLVE_AT] = trace->resolve;
+	at[ACCESSLOG_CONNECT_AT] = trace->connect;
+	at[ACCESSLOG_CLIENT_FIRST_AT] = trace->first[TRACE_CLIENT];
+	at[ACCESSLOG_SERVER_FIRST_AT] = trace->first[TRACE_SERVER];
+	at[ACCESSLOG_CLIENT_LAST_AT] = trace->last[TRACE_CLIENT];
+	at[ACCESSLOG_SERVER_LAST_AT] = trace->last[TRACE_SERVER];
+	at[ACCESSLOG_CLOSE_AT] = vanessa_socket_trace_now();
+
+	for (i = 0; i < ACCESSLOG_POINTS; i++)
+		point[i] = at[i] && trace->accept && at[i] >= trace->accept ?
+			   (at[i] - trace->accept) / 1000 : ACCESSLOG_NONE;
+}
+
+
+/**********************************************************************
+ * accesslog_points_str
+ * Format the points of a trace record
+ * pre: point: ACCESSLOG_POINTS points
+ *      str: buffer to write to
+ *      len: length of str
+ * post: The points are written to str as seconds, separated by
+ *       spaces, with "-" for those that were not reached
+ * return: length of the string
+ **********************************************************************/
+
+static size_t accesslog_points_str(const uint64_t *point, char *str,
+				   size_t len)
+{
+	size_t off = 0;
+	int i;
+
+	str[0] = '\0';
+	for (i = 0; i < ACCESSLOG_POINTS && off < len; i++) {
+		if (point[i] == ACCESSLOG_NONE)
+			off += snprintf(str + off, len - off, " -");
+		else
+			off += snprintf(str + off, len - off, " %lu.%06lu",
+					(unsigned long)(point[i] / 1000000),
+					(unsigned long)(point[i] % 1000000));
+	}
+
+	return off < len ? off : len - 1;
+}
+
+
+void accesslog_trace(const struct sockaddr *from, const struct sockaddr *to,
+		     const vanessa_socket_trace_t *trace)
+{
+	accesslog_entry_t *e;
+	uint64_t point[ACCESSLOG_POINTS];
+	char from_str[SOCKADDR_STR_LEN];
+	char to_str[SOCKADDR_STR_LEN];
+	char point_str[ACCESSLOG_LINE];
+	uint64_t pos;
+
+	accesslog_points(trace, point);
+
+	if (!accesslog_ring) {
+		if (sockaddr_str(from, from_str, "from") < 0)
+			strcpy(from_str, "-");
+		if (sockaddr_str(to, to_str, "to") < 0)
+			strcpy(to_str, "-");
+		accesslog_points_str(point, point_str, sizeof(point_str));
+		VANESSA_LOGGER_INFO_UNSAFE("Trace: %s->%s%s", from_str,
+					   to_str, point_str);
+		return;
+	}
+
+	if (!(e = ring_claim(accesslog_ring, &pos)))
+		return;
+
+	e->type = ACCESSLOG_TRACE;
+	clock_gettime(CLOCK_REALTIME, &e->when);
+	memcpy(e->point, point, sizeof(e->point));
+	accesslog_copy(&e->from, from);
+	accesslog_copy(&e->to, to);
+
+	ring_publish(accesslog_ring, pos);
+}
+
+
+#ifdef HAVE_PTHREAD
+/**********************************************************************
+ * accesslog_format
+ * Format a record as a line of text
+ * pre: record: record
+ *      str: buffer of at least ACCESSLOG_LINE bytes
+ * return: length of the line
+ **********************************************************************/
+
+static size_t accesslog_format(const void *record, char *str)
+{
+	const accesslog_entry_t *e = (const accesslog_entry_t *)record;
+	char from_str[SOCKADDR_STR_LEN];
+	char to_str[SOCKADDR_STR_LEN];
+	size_t len;
+
+	if (e->from.ss_family == AF_UNSPEC ||
+	    sockaddr_str((struct sockaddr *)&e->from, from_str, "from") < 0)
+		strcpy(from_str, "-");
+	if (e->to.ss_family == AF_UNSPEC ||
+	    sockaddr_str((struct sockaddr *)&e->to, to_str, "to") < 0)
+		strcpy(to_str, "-");
+
+	if (e->type == ACCESSLOG_OPEN)
+		return snprintf(str, ACCESSLOG_LINE, "%lu.%03lu open %s->%s\n",
+				(unsigned long)e->when.tv_sec,
+				(unsigned long)e->when.tv_nsec / 1000000,
+				from_str, to_str);
+
+	if (e->type == ACCESSLOG_TRACE) {
+		len = snprintf(str, ACCESSLOG_LINE, "%lu.%03lu trace %s->%s",
+			       (unsigned long)e->when.tv_sec,
+			       (unsigned long)e->when.tv_nsec / 1000000,
+			       from_str, to_str);
+		len += accesslog_points_str(e->point, str + len,
+					    ACCESSLOG_LINE - 1 - len);
+		str[len++] = '\n';
+		return len;
+	}
+
+	len = snprintf(str, ACCESSLOG_LINE,
+		       "%lu.%03lu close %s->%s %lu %lu %lu.%06lu",
+		       (unsigned long)e->when.tv_sec,
+		       (unsigned long)e->when.tv_nsec / 1000000,
+		       from_str, to_str,
+		       (unsigned long)e->bytes[0], (unsigned long)e->bytes[1],
+		       (unsigned long)(e->duration / 1000000),
+		       (unsigned long)(e->duration % 1000000));
+	if (e->has_tcp_info)
+		len += accesslog_tcp_info_str(&e->tcp_info, str + len,
+					      ACCESSLOG_LINE - 1 - len);
+	str[len++] = '\n';
+	return len;
+}
+
+
+/**********************************************************************
+ * accesslog_dropped
+ * Format a line saying that records were dropped
+ * pre: n: number of records dropped since the last such line
+ *      str: buffer of at least ACCESSLOG_LINE bytes
+ * return: length of the line
+ **********************************************************************/
+
+static size_t accesslog_dropped(uint64_t n, char *str)
+{
+	return snprintf(str, ACCESSLOG_LINE, "%lu dropped %lu\n",
+			(unsigned long)time(NULL), (unsigned long)n);
+}
+#endif
+
+
+int accesslog_init(options_t *opt)
+{
+#ifdef HAVE_PTHREAD
+	if (!opt->access_log)
+		return 0;
+
+	if (!strcmp(opt->access_log, "-"))
+		accesslog_fd = STDOUT_FILENO;
+	else
+		accesslog_fd = open(opt->access_log,
+				    O_WRONLY|O_APPEND|O_CREAT, 0644);
+	if (accesslog_fd < 0) {
+		VANESSA_LOGGER_DEBUG_ERRNO("open");
+		VANESSA_LOGGER_ERR_UNSAFE("Could not open access log: %s",
+					  opt->access_log);
+		return -1;
+	}
+
+	accesslog_ring = ring_create(ACCESSLOG_RING,
+				     sizeof(accesslog_entry_t));
+	if (!accesslog_ring) {
+		VANESSA_LOGGER_DEBUG("ring_create");
+		return -1;
+	}
+
+	if (ring_writer(accesslog_ring, accesslog_fd, ACCESSLOG_LINE,
+			accesslog_format, accesslog_dropped) < 0) {
+		VANESSA_LOGGER_DEBUG("ring_writer");
+		ring_destroy(accesslog_ring);
+		accesslog_ring = NULL;
+		return -1;
+	}
+
+	return 0;
+#else
+	if (!opt->access_log)
+		return 0;
+
+	VANESSA_LOGGER_ERR("The access log is not supported on this platform");
+	return -1;
+#endif
+}
@@ -0,0 +1,153 @@
+/**********************************************************************
+ * accesslog.h                                             October 2026
+ * Simon Horman                                      horms@verge.net.au
+ *
+ * Asynchronous access log of sessions
+ *
+ * vanessa_socket_pipe
+ * Trivial TCP/IP pipe based on libvanessa_socket
+ * Copyright (C) 1999-2008  Simon Horman <horms@verge.net.au>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307  USA
+ *
+ **********************************************************************/
+
+#ifndef ACCESSLOG_STIX
+#define ACCESSLOG_STIX
+
+#include "options.h"
+
+#include <time.h>
+
+#define ACCESSLOG_OPEN  0
+#define ACCESSLOG_CLOSE 1
+#define ACCESSLOG_TRACE 2
+
+#define ACCESSLOG_CLIENT 0
+#define ACCESSLOG_SERVER 1
+
+/* TCP_INFO of the connections of a session */
+typedef struct {
+	vanessa_socket_tcp_info_t side[2];	/* Client, server */
+	int ok[2];		/* Non-zero if side was read */
+} accesslog_tcp_info_t;
+
+/* Long enough for the output of accesslog_tcp_info_str() */
+#define ACCESSLOG_TCP_INFO_STR_LEN 192
+
+
+/**********************************************************************
+ * accesslog_init
+ * Set up the access log, if enabled by opt->access_log
+ * pre: opt: options
+ * post: A ring buffer for records is mapped in memory that is shared
+ *       with child processes, the log file is opened and a thread is
+ *       started that writes records from the ring to the file in
+ *       batches. Should be called before forking.
+ * return: 0 on success, or if the access log is not enabled
+ *         -1 on error
+ **********************************************************************/
+
+int accesslog_init(options_t *opt);
+
+
+/**********************************************************************
+ * accesslog_child
+ * Clean up after forking
+ * post: The log file is closed in this process, records may still
+ *       be added
+ **********************************************************************/
+
+void accesslog_child(void);
+
+
+/**********************************************************************
+ * accesslog_enabled
+ * return: non-zero if the access log is enabled
+ **********************************************************************/
+
+int accesslog_enabled(void);
+
+
+/**********************************************************************
+ * accesslog_record
+ * Add a record to the access log
+ * pre: type: ACCESSLOG_OPEN or ACCESSLOG_CLOSE
+ *      from: address of client
+ *      to: local address that the client connected to
+ *      c2s: bytes relayed from client to server
+ *      s2c: bytes relayed from server to client
+ *      start: time the session was accepted, from CLOCK_MONOTONIC.
+ *             Only used for ACCESSLOG_CLOSE.
+ *      tcp_info: TCP_INFO of the session, or NULL if not collected.
+ *                Only used for ACCESSLOG_CLOSE.
+ * post: The addresses are copied into the ring buffer, they are
+ *       formatted by the writer thread. If the ring is full the
+ *       record is dropped and counted, this never blocks.
+ **********************************************************************/
+
+void accesslog_record(int type, const struct sockaddr *from,
+		      const struct sockaddr *to, size_t c2s, size_t s2c,
+		      const struct timespec *start,
+		      const accesslog_tcp_info_t *tcp_info);
+
+
+/**********************************************************************
+ * accesslog_tcp_info_read
+ * Read TCP_INFO of the connections of a session
+ * pre: tcp_info: where to store it
+ *      client: connection to the client
+ *      server: connection to the server, or -1 if there is none
+ * post: tcp_info is filled in, sides that could not be read, say
+ *       because they are unix domain sockets, are marked as such
+ **********************************************************************/
+
+void accesslog_tcp_info_read(accesslog_tcp_info_t *tcp_info, int client,
+			     int server);
+
+
+/**********************************************************************
+ * accesslog_tcp_info_str
+ * Format TCP_INFO of a session as it appears in close records
+ * pre: tcp_info: TCP_INFO of a session
+ *      str: buffer to write to
+ *      len: length of str
+ * post: " client " and the fields of the client, then " server " and
+ *       the fields of the server, are written to str
+ * return: length of the string
+ **********************************************************************/
+
+size_t accesslog_tcp_info_str(const accesslog_tcp_info_t *tcp_info,
+			      char *str, size_t len);
+
+
+/**********************************************************************
+ * accesslog_trace
+ * Log the trace of a session that is closing
+ * pre: from: address of client
+ *      to: local address that the client connected to
+ *      trace: trace of the session
+ * post: A trace record with the time of each point of trace, and of
+ *       now, relative to when the session was accepted is added to
+ *       the access log as per accesslog_record(). If the access log
+ *       is not enabled it is logged instead.
+ **********************************************************************/
+
+void accesslog_trace(const struct sockaddr *from, const struct sockaddr *to,
+		     const vanessa_socket_trace_t *trace);
+
+
+#endif
@@ -0,0 +1,92 @@
+/**********************************************************************
+ * acl.c                                                   October 2026
+ * Simon Horman                                      horms@verge.net.au
+ *
+ * Access control lists read from a file
+ *
+ * vanessa_socket_pipe
+ * Trivial TCP/IP pipe based on libvanessa_socket
+ * Copyright (C) 1999-2008  Simon Horman <horms@verge.net.au>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307  USA
+ *
+ **********************************************************************/
+
+#include "acl.h"
+
+#include <errno.h>
+
+#define ACL_LINE 1024
+
+
+vanessa_socket_acl_t *acl_read(const char *file)
+{
+	char line[ACL_LINE];
+	char *action, *prefix, *p;
+	unsigned int lineno = 0;
+	vanessa_socket_acl_t *acl;
+	FILE *stream;
+
+	acl = vanessa_socket_acl_create(VANESSA_SOCKET_ACL_ALLOW);
+	if (!acl) {
+		VANESSA_LOGGER_DEBUG("vanessa_socket_acl_create");
+		return NULL;
+	}
+
+	stream = fopen(file, "r");
+	if (!stream) {
+		VANESSA_LOGGER_ERR_UNSAFE("%s: %s", file, strerror(errno));
+		goto err;
+	}
+
+	while (fgets(line, sizeof(line), stream)) {
+		lineno++;
+		if ((p = strchr(line, '#')))
+			*p = '\0';
+		action = strtok(line, " \t\r\n");
+		if (!action)
+			continue;
+		prefix = strtok(NULL, " \t\r\n");
+		if (!prefix || strtok(NULL, " \t\r\n") ||
+		    (strcmp(action, "allow") && strcmp(action, "deny"))) {
+			VANESSA_LOGGER_ERR_UNSAFE("%s:%u: expected allow or "
+						  "deny and a prefix", file,
+						  lineno);
+			goto err;
+		}
+		if (vanessa_socket_acl_add(acl, prefix,
+					   strcmp(action, "allow") ?
+					   VANESSA_SOCKET_ACL_DENY :
+					   VANESSA_SOCKET_ACL_ALLOW) < 0) {
+			VANESSA_LOGGER_ERR_UNSAFE("%s:%u: invalid prefix: %s",
+						  file, lineno, prefix);
+			goto err;
+		}
+	}
+	if (ferror(stream)) {
+		VANESSA_LOGGER_ERR_UNSAFE("%s: %s", file, strerror(errno));
+		goto err;
+	}
+
+	fclose(stream);
+	return acl;
+
+err:
+	if (stream)
+		fclose(stream);
+	vanessa_socket_acl_destroy(acl);
+	return NULL;
+}
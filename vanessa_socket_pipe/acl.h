@@ -0,0 +1,50 @@
+/**********************************************************************
+ * acl.h                                                   October 2026
+ * Simon Horman                                      horms@verge.net.au
+ *
+ * Access control lists read from a file
+ *
+ * vanessa_socket_pipe
+ * Trivial TCP/IP pipe based on libvanessa_socket
+ * Copyright (C) 1999-2008  Simon Horman <horms@verge.net.au>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307  USA
+ *
+ **********************************************************************/
+
+#ifndef ACL_STIX
+#define ACL_STIX
+
+#include "options.h"
+
+
+/**********************************************************************
+ * acl_read
+ * Read an access control list from a file
+ * Each line is allow or deny followed by an IPv4 or IPv6 address,
+ * optionally with a /length, separated by whitespace. Everything after
+ * a # is a comment. The longest prefix that an address falls in
+ * decides, addresses that fall in none are allowed.
+ * pre: file: name of file to read
+ * post: Errors are logged
+ * return: access control list
+ *         NULL on error
+ **********************************************************************/
+
+vanessa_socket_acl_t *acl_read(const char *file);
+
+
+#endif
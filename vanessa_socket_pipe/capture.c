@@ -0,0 +1,433 @@
+/**********************************************************************
+ * capture.c                                               October 2026
+ * Simon Horman                                      horms@verge.net.au
+ *
+ * Capture of relayed data to a pcap file
+ *
+ * vanessa_socket_pipe
+ * Trivial TCP/IP pipe based on libvanessa_socket
+ * Copyright (C) 1999-2008  Simon Horman <horms@verge.net.au>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307  USA
+ *
+ **********************************************************************/
+
+#include "capture.h"
+#include "ring.h"
+#include "unused.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <time.h>
+
+#define CAPTURE_RING   1024	/* Packets, must be a power of two */
+#define CAPTURE_SNAP   BUFFER_SIZE	/* Most data in a packet */
+
+/* pcap file and record headers, IPv6 header, TCP header and data */
+#define CAPTURE_PACKET_MAX (16 + 40 + 20 + CAPTURE_SNAP)
+
+#define CAPTURE_PCAP_MAGIC 0xa1b23c4d	/* Nanosecond timestamps */
+#define CAPTURE_PCAP_RAW   101		/* Packets start at the IP header */
+
+#define CAPTURE_TCP_FIN 0x01
+#define CAPTURE_TCP_SYN 0x02
+#define CAPTURE_TCP_PSH 0x08
+#define CAPTURE_TCP_ACK 0x10
+
+#define CAPTURE_CLIENT 0
+#define CAPTURE_SERVER 1
+
+/*
+ * Packets are made up from what is written by each session, so that
+ * they look like a TCP connection between the client and the address
+ * it connected to that carries the relayed data. Sequence numbers
+ * start at zero, and are advanced for packets that are skipped
+ * because the ring is full, so tools that read the file see a gap
+ * rather than corrupt data. The same goes for a packet that is lost
+ * because its session died while adding it.
+ *
+ * Sessions fill in packets and the writer thread builds the headers,
+ * so that capturing costs a session little more than a copy.
+ */
+
+typedef struct {
+	uint8_t addr[16];	/* Only the first 4 bytes for IPv4 */
+	uint16_t port;		/* Network byte order */
+} capture_end_t;
+
+typedef struct {
+	struct timespec when;	/* CLOCK_REALTIME */
+	int family;
+	capture_end_t src;
+	capture_end_t dst;
+	uint32_t seq;
+	uint32_t ack;
+	uint8_t flags;
+	uint16_t len;
+	char data[CAPTURE_SNAP];
+} capture_packet_t;
+
+struct capture_struct {
+	int client;
+	int family;
+	capture_end_t end[2];	/* Client, server */
+	uint32_t next[2];	/* Next sequence number of each */
+	ssize_t (*write_func)(int fd, const void *buf, size_t count,
+			      void *data);
+	void *data;
+};
+
+static ring_t *capture_ring;
+static int capture_fd = -1;
+static int capture_sample = 1;
+
+
+void capture_child(void)
+{
+	if (capture_fd >= 0)
+		close(capture_fd);
+	capture_fd = -1;
+}
+
+
+/**********************************************************************
+ * capture_packet
+ * Add a packet of a session to the ring
+ * pre: c: capture state
+ *      side: CAPTURE_CLIENT or CAPTURE_SERVER, the sender
+ *      flags: TCP flags
+ *      buf: data, may be NULL if len is 0
+ *      len: bytes in buf, no more than CAPTURE_SNAP
+ * post: The packet is added, unless the ring is full. Either way the
+ *       sequence number of side is advanced past it.
+ **********************************************************************/
+
+static void capture_packet(capture_t *c, int side, uint8_t flags,
+			   const char *buf, size_t len)
+{
+	capture_packet_t *p;
+	uint64_t pos;
+
+	p = ring_claim(capture_ring, &pos);
+	if (p) {
+		clock_gettime(CLOCK_REALTIME, &p->when);
+		p->family = c->family;
+		p->src = c->end[side];
+		p->dst = c->end[!side];
+		p->seq = c->next[side];
+		p->ack = c->next[!side];
+		p->flags = flags;
+		p->len = len;
+		if (len)
+			memcpy(p->data, buf, len);
+		ring_publish(capture_ring, pos);
+	}
+
+	/* SYN and FIN take a sequence number, as data does */
+	c->next[side] += len + !!(flags & (CAPTURE_TCP_SYN|CAPTURE_TCP_FIN));
+}
+
+
+static int capture_end(capture_end_t *e, const struct sockaddr *sa)
+{
+	memset(e, 0, sizeof(*e));
+	if (!sa)
+		return 0;
+
+	if (sa->sa_family == AF_INET) {
+		memcpy(e->addr, &((struct sockaddr_in *)sa)->sin_addr, 4);
+		e->port = ((struct sockaddr_in *)sa)->sin_port;
+	} else if (sa->sa_family == AF_INET6) {
+		memcpy(e->addr, &((struct sockaddr_in6 *)sa)->sin6_addr, 16);
+		e->port = ((struct sockaddr_in6 *)sa)->sin6_port;
+	} else {
+		return 0;
+	}
+
+	return sa->sa_family;
+}
+
+
+capture_t *capture_open(int client, const struct sockaddr *from,
+			const struct sockaddr *to,
+			ssize_t (*write_func)(int fd, const void *buf,
+					      size_t count, void *data),
+			void *data)
+{
+	capture_t *c;
+	uint64_t id;
+	int family;
+
+	if (!capture_ring)
+		return NULL;
+
+	id = ring_count(capture_ring);
+	if (id % capture_sample)
+		return NULL;
+
+	c = calloc(1, sizeof(*c));
+	if (!c) {
+		VANESSA_LOGGER_DEBUG_ERRNO("calloc");
+		return NULL;
+	}
+	c->client = client;
+	c->write_func = write_func;
+	c->data = data;
+
+	c->family = capture_end(&c->end[CAPTURE_CLIENT], from);
+	family = capture_end(&c->end[CAPTURE_SERVER], to);
+	if (!c->family || c->family != family) {
+		/* Say, a unix domain socket: 127.0.0.1:id -> 127.0.0.2:0 */
+		c->family = AF_INET;
+		memset(c->end, 0, sizeof(c->end));
+		c->end[CAPTURE_CLIENT].addr[0] = 127;
+		c->end[CAPTURE_CLIENT].addr[3] = 1;
+		c->end[CAPTURE_CLIENT].port = htons(1 + id % 65535);
+		c->end[CAPTURE_SERVER].addr[0] = 127;
+		c->end[CAPTURE_SERVER].addr[3] = 2;
+	}
+
+	capture_packet(c, CAPTURE_CLIENT, CAPTURE_TCP_SYN, NULL, 0);
+	capture_packet(c, CAPTURE_SERVER, CAPTURE_TCP_SYN|CAPTURE_TCP_ACK,
+		       NULL, 0);
+	capture_packet(c, CAPTURE_CLIENT, CAPTURE_TCP_ACK, NULL, 0);
+
+	return c;
+}
+
+
+void capture_close(capture_t *c)
+{
+	if (!c)
+		return;
+
+	capture_packet(c, CAPTURE_CLIENT, CAPTURE_TCP_FIN|CAPTURE_TCP_ACK,
+		       NULL, 0);
+	capture_packet(c, CAPTURE_SERVER, CAPTURE_TCP_FIN|CAPTURE_TCP_ACK,
+		       NULL, 0);
+	capture_packet(c, CAPTURE_CLIENT, CAPTURE_TCP_ACK, NULL, 0);
+	free(c);
+}
+
+
+ssize_t capture_write(int fd, const void *buf, size_t count, void *data)
+{
+	capture_t *c = (capture_t *)data;
+	const char *p = buf;
+	ssize_t bytes;
+	size_t left, len;
+	int side;
+
+	bytes = c->write_func(fd, buf, count, c->data);
+	if (bytes <= 0)
+		return bytes;
+
+	/* What is written to the client was sent by the server */
+	side = fd == c->client ? CAPTURE_SERVER : CAPTURE_CLIENT;
+	for (left = bytes; left; left -= len, p += len) {
+		len = left < CAPTURE_SNAP ? left : CAPTURE_SNAP;
+		capture_packet(c, side, CAPTURE_TCP_PSH|CAPTURE_TCP_ACK, p,
+			       len);
+	}
+
+	return bytes;
+}
+
+
+#ifdef HAVE_PTHREAD
+static void capture_put16(uint8_t *p, uint16_t v)
+{
+	p[0] = v >> 8;
+	p[1] = v;
+}
+
+
+static void capture_put32(uint8_t *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+
+/* Add to an Internet checksum, RFC 1071 */
+static uint32_t capture_sum(uint32_t sum, const uint8_t *p, size_t len)
+{
+	for (; len > 1; len -= 2, p += 2)
+		sum += (p[0] << 8) | p[1];
+	if (len)
+		sum += p[0] << 8;
+
+	return sum;
+}
+
+
+static uint16_t capture_fold(uint32_t sum)
+{
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+
+	return ~sum;
+}
+
+
+/**********************************************************************
+ * capture_format
+ * Build a pcap record of a packet
+ * pre: record: packet
+ *      out: where to build the record, of at least CAPTURE_PACKET_MAX
+ *           bytes
+ * post: A pcap record header, IPv4 or IPv6 header, TCP header and the
+ *       data of the packet are written to out, with checksums filled in
+ * return: length of the record
+ **********************************************************************/
+
+static size_t capture_format(const void *record, char *out)
+{
+	const capture_packet_t *p = (const capture_packet_t *)record;
+	uint8_t *buf = (uint8_t *)out;
+	uint32_t rec[4];
+	uint8_t *ip = buf + sizeof(rec);
+	uint8_t *tcp;
+	size_t addr_len, ip_len, tcp_len = 20 + p->len;
+	uint32_t sum;
+
+	if (p->family == AF_INET6) {
+		addr_len = 16;
+		ip_len = 40;
+		capture_put32(ip, 0x60000000);
+		capture_put16(ip + 4, tcp_len);
+		ip[6] = IPPROTO_TCP;
+		ip[7] = 64;
+		memcpy(ip + 8, p->src.addr, 16);
+		memcpy(ip + 24, p->dst.addr, 16);
+	} else {
+		addr_len = 4;
+		ip_len = 20;
+		ip[0] = 0x45;
+		ip[1] = 0;
+		capture_put16(ip + 2, ip_len + tcp_len);
+		capture_put32(ip + 4, 0x00004000);	/* Don't fragment */
+		ip[8] = 64;
+		ip[9] = IPPROTO_TCP;
+		capture_put16(ip + 10, 0);
+		memcpy(ip + 12, p->src.addr, 4);
+		memcpy(ip + 16, p->dst.addr, 4);
+		capture_put16(ip + 10, capture_fold(capture_sum(0, ip, 20)));
+	}
+
+	tcp = ip + ip_len;
+	memcpy(tcp, &p->src.port, 2);
+	memcpy(tcp + 2, &p->dst.port, 2);
+	capture_put32(tcp + 4, p->seq);
+	capture_put32(tcp + 8, p->ack);
+	tcp[12] = 5 << 4;
+	tcp[13] = p->flags;
+	capture_put16(tcp + 14, 65535);
+	capture_put32(tcp + 16, 0);
+	memcpy(tcp + 20, p->data, p->len);
+
+	/* Pseudo header, then the segment */
+	sum = capture_sum(0, p->src.addr, addr_len);
+	sum = capture_sum(sum, p->dst.addr, addr_len);
+	sum += IPPROTO_TCP + tcp_len;
+	capture_put16(tcp + 16, capture_fold(capture_sum(sum, tcp, tcp_len)));
+
+	rec[0] = p->when.tv_sec;
+	rec[1] = p->when.tv_nsec;
+	rec[2] = rec[3] = ip_len + tcp_len;
+	memcpy(buf, rec, sizeof(rec));
+
+	return sizeof(rec) + ip_len + tcp_len;
+}
+
+
+/**********************************************************************
+ * capture_dropped
+ * Log that packets were skipped
+ * pre: n: number of packets skipped since they were last logged
+ *      buf: unused, nothing is added to the capture file
+ * return: 0
+ **********************************************************************/
+
+static size_t capture_dropped(uint64_t n, char *UNUSED(buf))
+{
+	VANESSA_LOGGER_INFO_UNSAFE("Capture skipped %lu packets",
+				   (unsigned long)n);
+	return 0;
+}
+#endif
+
+
+int capture_init(options_t *opt)
+{
+#ifdef HAVE_PTHREAD
+	uint32_t head[6];
+
+	if (!opt->capture_file)
+		return 0;
+
+	capture_fd = open(opt->capture_file, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+	if (capture_fd < 0) {
+		VANESSA_LOGGER_DEBUG_ERRNO("open");
+		VANESSA_LOGGER_ERR_UNSAFE("Could not open capture file: %s",
+					  opt->capture_file);
+		return -1;
+	}
+
+	/* pcap file header: version 2.4, UTC, snap length and link type */
+	head[0] = CAPTURE_PCAP_MAGIC;
+	head[1] = 2 | (4 << 16);
+	head[2] = 0;
+	head[3] = 0;
+	head[4] = CAPTURE_PACKET_MAX;
+	head[5] = CAPTURE_PCAP_RAW;
+	if (vanessa_socket_pipe_write_bytes(capture_fd, (char *)head,
+					    sizeof(head))) {
+		VANESSA_LOGGER_DEBUG("vanessa_socket_pipe_write_bytes");
+		goto err;
+	}
+
+	capture_ring = ring_create(CAPTURE_RING, sizeof(capture_packet_t));
+	if (!capture_ring) {
+		VANESSA_LOGGER_DEBUG("ring_create");
+		goto err;
+	}
+	capture_sample = opt->capture_sample;
+
+	if (ring_writer(capture_ring, capture_fd, CAPTURE_PACKET_MAX,
+			capture_format, capture_dropped) < 0) {
+		VANESSA_LOGGER_DEBUG("ring_writer");
+		ring_destroy(capture_ring);
+		capture_ring = NULL;
+		goto err;
+	}
+
+	return 0;
+err:
+	close(capture_fd);
+	capture_fd = -1;
+	return -1;
+#else
+	if (!opt->capture_file)
+		return 0;
+
+	VANESSA_LOGGER_ERR("Capture is not supported on this platform");
+	return -1;
+#endif
+}
@@ -0,0 +1,115 @@
+/**********************************************************************
+ * capture.h                                               October 2026
+ * Simon Horman                                      horms@verge.net.au
+ *
+ * Capture of relayed data to a pcap file
+ *
+ * vanessa_socket_pipe
+ * Trivial TCP/IP pipe based on libvanessa_socket
+ * Copyright (C) 1999-2008  Simon Horman <horms@verge.net.au>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307  USA
+ *
+ **********************************************************************/
+
+#ifndef CAPTURE_STIX
+#define CAPTURE_STIX
+
+#include "options.h"
+
+typedef struct capture_struct capture_t;
+
+
+/**********************************************************************
+ * capture_init
+ * Set up capture, if enabled by opt->capture_file
+ * pre: opt: options
+ * post: A ring buffer for packets is mapped in memory that is shared
+ *       with child processes, the capture file is created with a pcap
+ *       header and a thread is started that writes packets from the
+ *       ring to the file in batches. Should be called before forking.
+ * return: 0 on success, or if capture is not enabled
+ *         -1 on error
+ **********************************************************************/
+
+int capture_init(options_t *opt);
+
+
+/**********************************************************************
+ * capture_child
+ * Clean up after forking
+ * post: The capture file is closed in this process, packets may still
+ *       be added
+ **********************************************************************/
+
+void capture_child(void);
+
+
+/**********************************************************************
+ * capture_open
+ * Start capturing a session, if it is one of those sampled
+ * pre: client: connection to the client, data written to any other
+ *              file descriptor is for the server
+ *      from: address of the client
+ *      to: local address the client connected to
+ *      write_func: function to write relayed data with
+ *      data: opaque data to pass to write_func
+ * post: A TCP handshake between from and to is captured. If from and
+ *       to are not both IPv4 or both IPv6 then made up IPv4 addresses
+ *       are used, with the number of the session as the port of the
+ *       client.
+ * return: capture state
+ *         NULL if capture is not enabled, the session is not sampled
+ *         or on error
+ **********************************************************************/
+
+capture_t *capture_open(int client, const struct sockaddr *from,
+			const struct sockaddr *to,
+			ssize_t (*write_func)(int fd, const void *buf,
+					      size_t count, void *data),
+			void *data);
+
+
+/**********************************************************************
+ * capture_close
+ * Stop capturing a session
+ * pre: c: capture state, may be NULL
+ * post: A FIN from each side is captured and c is freed
+ **********************************************************************/
+
+void capture_close(capture_t *c);
+
+
+/**********************************************************************
+ * capture_write
+ * Write relayed data, capturing what is written
+ * Intended to be passed to vanessa_socket_pipe_func()
+ * pre: fd: file descriptor to write to
+ *      buf: data to write
+ *      count: number of bytes in buf
+ *      data: capture state
+ * post: buf is written using the write_func given to capture_open(),
+ *       and what was written is captured as TCP segments from the
+ *       client if fd is the server or to the client if fd is the
+ *       client. If the ring is full the segments are skipped, and
+ *       the gap they leave in the sequence numbers shows where.
+ * return: as for the write_func given to capture_open()
+ **********************************************************************/
+
+ssize_t capture_write(int fd, const void *buf, size_t count, void *data);
+
+
+#endif
@@ -0,0 +1,364 @@
+/**********************************************************************
+ * compress.c                                              October 2026
+ * Simon Horman                                      horms@verge.net.au
+ *
+ * Streaming compression of one side of a relay
+ *
+ * vanessa_socket_pipe
+ * Trivial TCP/IP pipe based on libvanessa_socket
+ * Copyright (C) 1999-2008  Simon Horman <horms@verge.net.au>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307  USA
+ *
+ **********************************************************************/
+
+#include "compress.h"
+#include "unused.h"
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+/*
+ * Each write is compressed and flushed on its own, so nothing is held
+ * back waiting for more data and the peer can decompress it as soon as
+ * it arrives. The fastest levels are used as the point is to save
+ * bandwidth without adding latency.
+ *
+ * The compressed side is a single zstd frame, or zlib stream, for the
+ * whole session, so that later writes benefit from the history of
+ * earlier ones. The first byte of a zstd frame is 0x28, the first of
+ * a zlib stream has the deflate method, 8, in its low nibble.
+ */
+
+#define COMPRESS_OUT        (BUFFER_SIZE * 4)
+#define COMPRESS_ZSTD_LEVEL 1
+
+#define COMPRESS_UNKNOWN 0
+#define COMPRESS_ZSTD    1
+#define COMPRESS_ZLIB    2
+
+struct compress_struct {
+	int fd;				/* Carries compressed data */
+	int in_algo;			/* Of data read from fd */
+	ssize_t (*write_func)(int fd, const void *buf, size_t count,
+			      void *data);
+	void *data;
+#ifdef HAVE_ZSTD
+	ZSTD_CStream *zc;
+	ZSTD_DStream *zd;
+#endif
+#ifdef HAVE_ZLIB
+	z_stream deflate;
+	z_stream inflate;
+	int deflate_ok;
+	int inflate_ok;
+#endif
+	char out[COMPRESS_OUT];
+};
+
+
+#if defined(HAVE_ZSTD) || defined(HAVE_ZLIB)
+
+compress_t *compress_create(int fd,
+			    ssize_t (*write_func)(int fd, const void *buf,
+						  size_t count, void *data),
+			    void *data)
+{
+	compress_t *c;
+
+	c = calloc(1, sizeof(*c));
+	if (!c) {
+		VANESSA_LOGGER_DEBUG_ERRNO("calloc");
+		return NULL;
+	}
+	c->fd = fd;
+	c->write_func = write_func;
+	c->data = data;
+
+#ifdef HAVE_ZSTD
+	c->zc = ZSTD_createCStream();
+	if (!c->zc) {
+		VANESSA_LOGGER_DEBUG("ZSTD_createCStream");
+		goto err;
+	}
+	ZSTD_CCtx_setParameter(c->zc, ZSTD_c_compressionLevel,
+			       COMPRESS_ZSTD_LEVEL);
+#else
+	if (deflateInit(&c->deflate, Z_BEST_SPEED) != Z_OK) {
+		VANESSA_LOGGER_DEBUG("deflateInit");
+		goto err;
+	}
+	c->deflate_ok = 1;
+#endif
+
+	return c;
+err:
+	compress_destroy(c);
+	return NULL;
+}
+
+
+void compress_destroy(compress_t *c)
+{
+	if (!c)
+		return;
+
+#ifdef HAVE_ZSTD
+	ZSTD_freeCStream(c->zc);
+	ZSTD_freeDStream(c->zd);
+#endif
+#ifdef HAVE_ZLIB
+	if (c->deflate_ok)
+		deflateEnd(&c->deflate);
+	if (c->inflate_ok)
+		inflateEnd(&c->inflate);
+#endif
+	free(c);
+}
+
+
+static int compress_flush(compress_t *c, int fd, size_t len)
+{
+	if (!len)
+		return 0;
+
+	if (vanessa_socket_pipe_write_bytes_func(fd, c->out, len,
+						 c->write_func, c->data)) {
+		VANESSA_LOGGER_DEBUG("vanessa_socket_pipe_write_bytes_func");
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/**********************************************************************
+ * compress_deflate
+ * Compress data and write it
+ * pre: c: compression state
+ *      fd: file descriptor to write to
+ *      buf: data to compress
+ *      count: number of bytes in buf
+ * post: All of buf is compressed, flushed and written
+ * return: 0 on success
+ *         -1 on error
+ **********************************************************************/
+
+static int compress_deflate(compress_t *c, int fd, const void *buf,
+			    size_t count)
+{
+#ifdef HAVE_ZSTD
+	ZSTD_inBuffer in = { buf, count, 0 };
+	ZSTD_outBuffer out;
+	size_t rc;
+
+	do {
+		out.dst = c->out;
+		out.size = sizeof(c->out);
+		out.pos = 0;
+		rc = ZSTD_compressStream2(c->zc, &out, &in, ZSTD_e_flush);
+		if (ZSTD_isError(rc)) {
+			VANESSA_LOGGER_DEBUG_UNSAFE("ZSTD_compressStream2: %s",
+						    ZSTD_getErrorName(rc));
+			return -1;
+		}
+		if (compress_flush(c, fd, out.pos) < 0)
+			return -1;
+	} while (rc);
+#else
+	z_stream *z = &c->deflate;
+
+	z->next_in = (Bytef *)buf;
+	z->avail_in = count;
+	do {
+		z->next_out = (Bytef *)c->out;
+		z->avail_out = sizeof(c->out);
+		if (deflate(z, Z_SYNC_FLUSH) == Z_STREAM_ERROR) {
+			VANESSA_LOGGER_DEBUG("deflate");
+			return -1;
+		}
+		if (compress_flush(c, fd, sizeof(c->out) - z->avail_out) < 0)
+			return -1;
+	} while (!z->avail_out);
+#endif
+
+	return 0;
+}
+
+
+/**********************************************************************
+ * compress_inflate_init
+ * Set up decompression, once the first compressed byte is known
+ * pre: c: compression state
+ *      first: first byte read from c->fd
+ * return: 0 on success
+ *         -1 on error, including if the data is not compressed in a
+ *         way that this build supports
+ **********************************************************************/
+
+static int compress_inflate_init(compress_t *c, unsigned char first)
+{
+#ifdef HAVE_ZSTD
+	if (first == 0x28) {
+		c->zd = ZSTD_createDStream();
+		if (!c->zd) {
+			VANESSA_LOGGER_DEBUG("ZSTD_createDStream");
+			return -1;
+		}
+		c->in_algo = COMPRESS_ZSTD;
+		return 0;
+	}
+#endif
+#ifdef HAVE_ZLIB
+	if ((first & 0x0f) == Z_DEFLATED) {
+		if (inflateInit(&c->inflate) != Z_OK) {
+			VANESSA_LOGGER_DEBUG("inflateInit");
+			return -1;
+		}
+		c->inflate_ok = 1;
+		c->in_algo = COMPRESS_ZLIB;
+		return 0;
+	}
+#endif
+
+	VANESSA_LOGGER_ERR_UNSAFE("Unsupported compressed data, first byte "
+				  "0x%02x", first);
+	return -1;
+}
+
+
+/**********************************************************************
+ * compress_inflate
+ * Decompress data and write it
+ * pre: c: compression state
+ *      fd: file descriptor to write to
+ *      buf: compressed data, read from c->fd
+ *      count: number of bytes in buf
+ * post: All of buf is decompressed and what it decompresses to so far
+ *       is written
+ * return: 0 on success
+ *         -1 on error
+ **********************************************************************/
+
+static int compress_inflate(compress_t *c, int fd, const void *buf,
+			    size_t count)
+{
+#ifdef HAVE_ZSTD
+	ZSTD_inBuffer in;
+	ZSTD_outBuffer out;
+	size_t rc;
+#endif
+#ifdef HAVE_ZLIB
+	z_stream *z = &c->inflate;
+	int rc_z;
+#endif
+
+	if (c->in_algo == COMPRESS_UNKNOWN &&
+	    compress_inflate_init(c, *(const unsigned char *)buf) < 0)
+		return -1;
+
+#ifdef HAVE_ZSTD
+	if (c->in_algo == COMPRESS_ZSTD) {
+		in.src = buf;
+		in.size = count;
+		in.pos = 0;
+		do {
+			out.dst = c->out;
+			out.size = sizeof(c->out);
+			out.pos = 0;
+			rc = ZSTD_decompressStream(c->zd, &out, &in);
+			if (ZSTD_isError(rc)) {
+				VANESSA_LOGGER_DEBUG_UNSAFE(
+					"ZSTD_decompressStream: %s",
+					ZSTD_getErrorName(rc));
+				return -1;
+			}
+			if (compress_flush(c, fd, out.pos) < 0)
+				return -1;
+		} while (in.pos < in.size || out.pos == out.size);
+		return 0;
+	}
+#endif
+#ifdef HAVE_ZLIB
+	z->next_in = (Bytef *)buf;
+	z->avail_in = count;
+	do {
+		z->next_out = (Bytef *)c->out;
+		z->avail_out = sizeof(c->out);
+		rc_z = inflate(z, Z_SYNC_FLUSH);
+		if (rc_z != Z_OK && rc_z != Z_BUF_ERROR &&
+		    rc_z != Z_STREAM_END) {
+			VANESSA_LOGGER_DEBUG_UNSAFE("inflate: %s",
+						    z->msg ? z->msg : "error");
+			return -1;
+		}
+		if (compress_flush(c, fd, sizeof(c->out) - z->avail_out) < 0)
+			return -1;
+		/* Another stream may follow */
+		if (rc_z == Z_STREAM_END)
+			inflateReset(z);
+	} while (z->avail_in || !z->avail_out);
+#endif
+
+	return 0;
+}
+
+
+ssize_t compress_write(int fd, const void *buf, size_t count, void *data)
+{
+	compress_t *c = (compress_t *)data;
+
+	if (!count)
+		return 0;
+
+	if ((fd == c->fd ? compress_deflate :
+	     compress_inflate)(c, fd, buf, count) < 0)
+		return -1;
+
+	return count;
+}
+
+#else /* HAVE_ZSTD || HAVE_ZLIB */
+
+/* So that UNUSED() can be applied to a function pointer parameter */
+typedef ssize_t (*compress_write_func_t)(int fd, const void *buf,
+					 size_t count, void *data);
+
+compress_t *compress_create(int UNUSED(fd),
+			    compress_write_func_t UNUSED(write_func),
+			    void *UNUSED(data))
+{
+	VANESSA_LOGGER_ERR("Compression is not supported by this build");
+	return NULL;
+}
+
+
+void compress_destroy(compress_t *UNUSED(c))
+{
+}
+
+
+ssize_t compress_write(int UNUSED(fd), const void *UNUSED(buf),
+		       size_t UNUSED(count), void *UNUSED(data))
+{
+	return -1;
+}
+
+#endif /* HAVE_ZSTD || HAVE_ZLIB */
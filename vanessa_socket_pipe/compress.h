@@ -0,0 +1,87 @@
+/**********************************************************************
+ * compress.h                                              October 2026
+ * Simon Horman                                      horms@verge.net.au
+ *
+ * Streaming compression of one side of a relay
+ *
+ * vanessa_socket_pipe
+ * Trivial TCP/IP pipe based on libvanessa_socket
+ * Copyright (C) 1999-2008  Simon Horman <horms@verge.net.au>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307  USA
+ *
+ **********************************************************************/
+
+#ifndef COMPRESS_STIX
+#define COMPRESS_STIX
+
+#include "options.h"
+
+typedef struct compress_struct compress_t;
+
+
+/**********************************************************************
+ * compress_create
+ * Set up compression of a session
+ * pre: fd: the connection that carries compressed data
+ *      write_func: function to write data with once it has been
+ *                  compressed or decompressed
+ *      data: opaque data to pass to write_func
+ * post: Data written to fd using compress_write() is compressed with
+ *       zstd, or zlib if vanessa_socket_pipe was built without zstd.
+ *       Data read from fd, and written to the other connection using
+ *       compress_write(), is decompressed. Whether it is zstd or zlib
+ *       is told from its first byte.
+ * return: compression state
+ *         NULL on error, including if vanessa_socket_pipe was built
+ *         without zstd and zlib
+ **********************************************************************/
+
+compress_t *compress_create(int fd,
+			    ssize_t (*write_func)(int fd, const void *buf,
+						  size_t count, void *data),
+			    void *data);
+
+
+/**********************************************************************
+ * compress_destroy
+ * Free compression state
+ * pre: c: compression state, may be NULL
+ * post: c is freed
+ **********************************************************************/
+
+void compress_destroy(compress_t *c);
+
+
+/**********************************************************************
+ * compress_write
+ * Write relayed data, compressing or decompressing it
+ * Intended to be passed to vanessa_socket_pipe_func()
+ * pre: fd: file descriptor to write to
+ *      buf: data to write
+ *      count: number of bytes in buf
+ *      data: compression state
+ * post: buf is compressed if fd is the compressed connection, and
+ *       decompressed otherwise. The result is flushed so that the
+ *       peer can act on it straight away, and all of it is written.
+ * return: count on success
+ *         -1 on error
+ **********************************************************************/
+
+ssize_t compress_write(int fd, const void *buf, size_t count, void *data);
+
+
+#endif
@@ -0,0 +1,1634 @@
+/**********************************************************************
+ * engine.c                                                October 2026
+ * Simon Horman                                      horms@verge.net.au
+ *
+ * Event driven engine that serves all connections from one process
+ *
+ * vanessa_socket_pipe
+ * Trivial TCP/IP pipe based on libvanessa_socket
+ * Copyright (C) 1999-2008  Simon Horman <horms@verge.net.au>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307  USA
+ *
+ **********************************************************************/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "options.h"
+#include "engine.h"
+#include "metrics.h"
+#include "accesslog.h"
+#include "acl.h"
+#include "limit.h"
+#include "unused.h"
+
+#include <errno.h>
+#include <stddef.h>
+#include <signal.h>
+
+#ifdef __linux__
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#ifndef EPOLLEXCLUSIVE
+#define EPOLLEXCLUSIVE 0
+#endif
+
+#define ENGINE_EVENTS 64
+#define ENGINE_TICK   250	/* Milliseconds, granularity of timeouts */
+#define ENGINE_SLAB   64	/* Sessions allocated at a time */
+#define ENGINE_BUFFERS 16	/* Buffers allocated at a time */
+
+#define ENGINE_LISTEN 0
+#define ENGINE_CLIENT 1
+#define ENGINE_SERVER 2
+#define ENGINE_WAKE   3
+
+/*
+ * A session is a client connection and the connection made to the
+ * server for it. Each has a buffer of data read from it that is
+ * waiting to be written to the other. A connection is not read from
+ * while its buffer is not empty, which pushes back on the sender.
+ *
+ * There may be several threads, each running its own event loop with
+ * its own sessions. All threads poll the listening sockets, using
+ * EPOLLEXCLUSIVE so that a connection only wakes one of them, and the
+ * thread that accepts a connection serves it until it closes. The
+ * only state shared between threads is the total number of sessions,
+ * for the connection limit, and the configuration below.
+ */
+
+struct engine_session_struct;
+
+/* Whatever an epoll event refers to */
+typedef struct {
+	int fd;
+	int type;
+	uint32_t events;
+	struct engine_session_struct *session;
+} engine_fd_t;
+
+/*
+ * One direction of a session. Data is read into the scratch buffer of
+ * the thread and written straight out. Only data that can't be written
+ * at once is kept, in buf, which is taken from the buffers of the
+ * thread and handed back once it is written. So sessions that are
+ * idle hold no buffers.
+ */
+typedef struct {
+	engine_fd_t in;
+	char *buf;		/* NULL unless there is data to write */
+	size_t len;
+	size_t off;
+	size_t bytes;		/* Total read from in */
+} engine_half_t;
+
+typedef struct engine_session_struct {
+	engine_half_t half[2];	/* Client to server, server to client */
+	int proxy;		/* Waiting for a PROXY protocol header */
+	int connecting;
+	int closing;
+	int closed;
+	int timeout;		/* Idle timeout, in seconds */
+	struct timespec start;
+	vanessa_socket_trace_t trace;	/* If opt->trace */
+	vanessa_socket_limit_ticket_t ticket;
+	vanessa_socket_timer_t idle;
+	vanessa_socket_timer_t lifetime;	/* If opt->lifetime */
+	vanessa_socket_timer_t sockbuf;	/* Tunes kernel buffers */
+	int sockbuf_clamped[2];	/* Client to server, server to client */
+	struct engine_session_struct *next_dead;
+	struct sockaddr_storage from;	/* Of the client, maybe from */
+	struct sockaddr_storage to;	/* a PROXY protocol header */
+	char from_to_str[(SOCKADDR_STR_LEN*2)+2];
+} __attribute__((aligned(64))) engine_session_t;
+
+/* State of one event loop thread */
+typedef struct {
+	int id;
+	options_t *opt;
+	vanessa_socket_acl_t *acl;
+	unsigned int generation;	/* Of opt, acl and listen_socketv */
+	int epfd;
+	engine_fd_t wake;
+	int *listen_socketv;
+	engine_fd_t *listen;
+	size_t nlisten;
+	int listening;
+	int stopped;		/* Stopped listening for good, to drain */
+	unsigned int *nsession;	/* Total over all threads */
+	engine_session_t *dead;
+	vanessa_socket_timer_wheel_t *timers;
+	vanessa_socket_slab_t *sessions;
+	vanessa_socket_slab_t *buffers;		/* Of BUFFER_SIZE */
+	char *scratch;		/* BUFFER_SIZE, read into by all sessions */
+	metrics_t *metrics;
+} engine_t;
+
+
+/*
+ * The configuration file is read again on SIGHUP, by the first thread.
+ * It binds any listening sockets that have been added and publishes
+ * the new options and listening sockets by advancing engine_generation,
+ * then wakes the other threads. Each thread moves over to them, for
+ * the sessions it accepts from then on, and its existing sessions carry
+ * on as they are. Once all threads have moved over the old options, and
+ * listening sockets that have been removed, are released.
+ */
+static volatile sig_atomic_t engine_hup;
+static int engine_wake_fd = -1;		/* Wakes the first thread */
+static options_t *engine_opt;
+static int *engine_listen_socketv;
+static volatile unsigned int engine_generation;
+static volatile unsigned int engine_switched;	/* Threads on engine_generation */
+static options_t *engine_old_opt;
+static int *engine_old_listen_socketv;
+static vanessa_socket_acl_t *engine_acl;
+static vanessa_socket_acl_t *engine_old_acl;
+
+/*
+ * On SIGTERM, if -D|--drain_timeout is set, the first thread starts
+ * draining and wakes the others. Each stops listening and once all
+ * have the first closes the listening sockets. The first thread exits
+ * once there are no sessions left, or the drain timeout has passed.
+ */
+static volatile sig_atomic_t engine_term;
+static volatile sig_atomic_t engine_draining;
+static volatile unsigned int engine_stopped;	/* Threads not listening */
+static int engine_done;
+static vanessa_socket_timer_t engine_drain_check;
+static vanessa_socket_timer_t engine_drain_deadline;
+
+/* Per source address limits, shared by all threads */
+static vanessa_socket_limit_t *engine_limit;
+
+
+#define engine_half_of(s, fdp) \
+	((fdp)->type == ENGINE_CLIENT ? (s)->half : (s)->half + 1)
+#define engine_other_of(s, fdp) \
+	((fdp)->type == ENGINE_CLIENT ? (s)->half + 1 : (s)->half)
+
+
+/**********************************************************************
+ * engine_set_events
+ * Change the events that are polled for on a file descriptor
+ * pre: e: engine
+ *      fdp: file descriptor, which has been added to e->epfd
+ *      events: events to poll for
+ * return: 0 on success
+ *         -1 on error
+ **********************************************************************/
+
+static int engine_set_events(engine_t *e, engine_fd_t *fdp, uint32_t events)
+{
+	struct epoll_event ev;
+
+	if (fdp->events == events)
+		return 0;
+
+	ev.events = events;
+	ev.data.ptr = fdp;
+	if (epoll_ctl(e->epfd, EPOLL_CTL_MOD, fdp->fd, &ev) < 0) {
+		VANESSA_LOGGER_DEBUG_ERRNO("epoll_ctl");
+		return -1;
+	}
+	fdp->events = events;
+
+	return 0;
+}
+
+
+static int engine_add(engine_t *e, engine_fd_t *fdp, uint32_t events)
+{
+	struct epoll_event ev;
+
+	ev.events = events;
+	ev.data.ptr = fdp;
+	if (epoll_ctl(e->epfd, EPOLL_CTL_ADD, fdp->fd, &ev) < 0) {
+		VANESSA_LOGGER_DEBUG_ERRNO("epoll_ctl");
+		return -1;
+	}
+	fdp->events = events;
+
+	return 0;
+}
+
+
+/**********************************************************************
+ * engine_listen
+ * Start or stop accepting connections
+ * pre: e: engine
+ *      on: 1 to start, 0 to stop
+ * post: The listening sockets are polled for connections, or not.
+ *       Connections that arrive while stopped wait in the backlog.
+ * return: 0 on success
+ *         -1 on error
+ **********************************************************************/
+
+static int engine_listen(engine_t *e, int on)
+{
+	size_t i;
+
+	if (e->listening == on || (on && engine_draining))
+		return 0;
+
+	/* The events of an EPOLLEXCLUSIVE file descriptor can't be
+	 * modified, so listening sockets are removed and added back */
+	for (i = 0; i < e->nlisten; i++) {
+		if (on) {
+			if (engine_add(e, e->listen + i,
+				       EPOLLIN|EPOLLEXCLUSIVE) < 0)
+				return -1;
+		} else if (epoll_ctl(e->epfd, EPOLL_CTL_DEL, e->listen[i].fd,
+				     NULL) < 0) {
+			VANESSA_LOGGER_DEBUG_ERRNO("epoll_ctl");
+			return -1;
+		}
+	}
+	e->listening = on;
+
+	return 0;
+}
+
+
+/**********************************************************************
+ * engine_listen_set
+ * Set the listening sockets of a thread
+ * pre: e: engine, that is not listening
+ *      listen_socketv: listening sockets, terminated by -1
+ * post: The sockets are polled for connections when e starts
+ *       listening
+ * return: 0 on success
+ *         -1 on error
+ **********************************************************************/
+
+static int engine_listen_set(engine_t *e, int *listen_socketv)
+{
+	engine_fd_t *listen;
+	size_t nlisten, i;
+
+	for (nlisten = 0; listen_socketv[nlisten] >= 0; nlisten++)
+		;
+
+	listen = calloc(nlisten, sizeof(*listen));
+	if (!listen) {
+		VANESSA_LOGGER_DEBUG_ERRNO("calloc");
+		return -1;
+	}
+	for (i = 0; i < nlisten; i++) {
+		listen[i].fd = listen_socketv[i];
+		listen[i].type = ENGINE_LISTEN;
+	}
+
+	free(e->listen);
+	e->listen = listen;
+	e->nlisten = nlisten;
+	e->listen_socketv = listen_socketv;
+
+	return 0;
+}
+
+
+/**********************************************************************
+ * engine_bind
+ * Open the listening sockets for some options
+ * pre: opt: options
+ * return: non-blocking listening sockets, terminated by -1.
+ *         To close the sockets and free, call vanessa_socket_closev().
+ *         NULL on error
+ **********************************************************************/
+
+static int *engine_bind(options_t *opt)
+{
+	int *listen_socketv;
+	const char *fromv[3];
+	long flags;
+	size_t i;
+
+	fromv[0] = opt->listen_host ? opt->listen_host : "0.0.0.0";
+	fromv[1] = opt->listen_port;
+	fromv[2] = NULL;
+	listen_socketv = vanessa_socket_server_bindv(fromv, 0);
+	if (!listen_socketv) {
+		VANESSA_LOGGER_DEBUG("vanessa_socket_server_bindv");
+		VANESSA_LOGGER_ERR_UNSAFE("Could not bind to: %s:%s",
+					  str_null_safe(opt->listen_host),
+					  str_null_safe(opt->listen_port));
+		return NULL;
+	}
+
+	for (i = 0; listen_socketv[i] >= 0; i++) {
+		flags = fcntl(listen_socketv[i], F_GETFL, NULL);
+		if (flags < 0 || fcntl(listen_socketv[i], F_SETFL,
+				       flags | O_NONBLOCK) < 0) {
+			VANESSA_LOGGER_DEBUG_ERRNO("fcntl");
+			vanessa_socket_server_unlinkv(listen_socketv);
+			vanessa_socket_closev(listen_socketv);
+			return NULL;
+		}
+	}
+
+	return listen_socketv;
+}
+
+
+/**********************************************************************
+ * engine_wake
+ * Wake a thread from epoll_wait()
+ * pre: fd: eventfd of the thread
+ * post: The thread returns from epoll_wait(), if it is in it.
+ *       Safe to call from a signal handler.
+ **********************************************************************/
+
+static void engine_wake(int fd)
+{
+	uint64_t one = 1;
+
+	/* Only fails if the counter would overflow, which wakes anyway */
+	if (write(fd, &one, sizeof(one)) < 0)
+		return;
+}
+
+
+static void engine_sighup(int UNUSED(sig))
+{
+	int err = errno;
+
+	engine_hup = 1;
+	engine_wake(engine_wake_fd);
+	errno = err;
+}
+
+
+/**********************************************************************
+ * engine_switch
+ * Move a thread over to the options and listening sockets published
+ * by the latest reload
+ * pre: e: engine, with e->generation behind engine_generation
+ * post: Sessions that e accepts from now on use the new options.
+ *       e polls the new listening sockets in place of the old ones
+ *       and the first thread is told that e has moved over.
+ * return: 0 on success
+ *         -1 on error
+ **********************************************************************/
+
+static int engine_switch(engine_t *e)
+{
+	unsigned int generation = engine_generation;
+	int listening = e->listening;
+
+	__sync_synchronize();
+	if (e->listen_socketv != engine_listen_socketv &&
+	    (engine_listen(e, 0) < 0 ||
+	     engine_listen_set(e, engine_listen_socketv) < 0))
+		return -1;
+	e->opt = engine_opt;
+	e->acl = engine_acl;
+	e->generation = generation;
+
+	__sync_add_and_fetch(&engine_switched, 1);
+	if (e->id)
+		engine_wake(engine_wake_fd);
+
+	/* The connection limit may have been raised */
+	if (listening || !e->opt->connection_limit ||
+	    *e->nsession < (unsigned int)e->opt->connection_limit)
+		return engine_listen(e, 1);
+	return 0;
+}
+
+
+/**********************************************************************
+ * engine_reload
+ * Read the configuration file and access control list again, if SIGHUP
+ * has been received
+ * pre: e: engines of all threads, starting with the first
+ * post: Once all threads have moved over to the previous reload,
+ *       what it replaced is released. Then, if SIGHUP has been
+ *       received, the configuration file and access control list are
+ *       read, any new listening sockets are bound and the new options,
+ *       access control list and listening sockets are published to
+ *       all threads. The per source limits are changed straight away,
+ *       the limiter is shared. On error the current ones are kept.
+ **********************************************************************/
+
+static void engine_reload(engine_t *e)
+{
+	options_t *opt;
+	vanessa_socket_acl_t *acl = NULL;
+	int *listen_socketv;
+	int i;
+
+	if (engine_old_opt) {
+		if (engine_switched < (unsigned int)e->opt->threads)
+			return;
+		if (engine_old_listen_socketv &&
+		    engine_old_listen_socketv != engine_listen_socketv) {
+			vanessa_socket_server_unlinkv(engine_old_listen_socketv);
+			vanessa_socket_closev(engine_old_listen_socketv);
+		}
+		options_reload_free(engine_old_opt, engine_opt);
+		free(engine_old_opt);
+		vanessa_socket_acl_destroy(engine_old_acl);
+		engine_old_opt = NULL;
+		engine_old_acl = NULL;
+		engine_old_listen_socketv = NULL;
+	}
+
+	if (!engine_hup || engine_draining)
+		return;
+	engine_hup = 0;
+
+	opt = malloc(sizeof(*opt));
+	if (!opt) {
+		VANESSA_LOGGER_DEBUG_ERRNO("malloc");
+		goto err;
+	}
+	*opt = *engine_opt;
+	if (opt->config_file && options_reload(opt) < 0) {
+		VANESSA_LOGGER_DEBUG("options_reload");
+		goto err;
+	}
+	if (opt->acl_file && !(acl = acl_read(opt->acl_file))) {
+		VANESSA_LOGGER_DEBUG("acl_read");
+		goto err;
+	}
+
+	/* The port of a unix domain socket is ignored */
+	listen_socketv = engine_listen_socketv;
+	if (!str_null_eq(opt->listen_host, engine_opt->listen_host) ||
+	    (!vanessa_socket_host_is_unix(opt->listen_host) &&
+	     !str_null_eq(opt->listen_port, engine_opt->listen_port))) {
+		listen_socketv = engine_bind(opt);
+		if (!listen_socketv) {
+			VANESSA_LOGGER_DEBUG("engine_bind");
+			goto err;
+		}
+	}
+
+	engine_old_opt = engine_opt;
+	engine_old_acl = engine_acl;
+	engine_old_listen_socketv = engine_listen_socketv;
+	engine_opt = opt;
+	engine_acl = acl;
+	engine_listen_socketv = listen_socketv;
+	engine_switched = 0;
+	__sync_synchronize();
+	engine_generation++;
+	limit_reload(engine_limit, opt);
+
+	for (i = 1; i < opt->threads; i++)
+		engine_wake(e[i].wake.fd);
+
+	VANESSA_LOGGER_INFO_UNSAFE("Reloaded configuration: listen=%s:%s "
+				   "server=%s port=%s connection_limit=%d "
+				   "timeout=%d", str_null_safe(opt->listen_host),
+				   str_null_safe(opt->listen_port),
+				   opt->outgoing_host,
+				   str_null_safe(opt->outgoing_port),
+				   opt->connection_limit, opt->timeout);
+	return;
+
+err:
+	if (opt)
+		options_reload_free(opt, engine_opt);
+	free(opt);
+	vanessa_socket_acl_destroy(acl);
+	VANESSA_LOGGER_ERR("Could not reload configuration, keeping current "
+			   "settings");
+}
+
+
+static void engine_sigterm(int UNUSED(sig))
+{
+	int err = errno;
+
+	engine_term = 1;
+	engine_wake(engine_wake_fd);
+	errno = err;
+}
+
+
+static void engine_drain_timeout(vanessa_socket_timer_t *UNUSED(timer),
+				 void *UNUSED(data))
+{
+	engine_done = 1;
+}
+
+
+static void engine_drain_poll(vanessa_socket_timer_t *timer, void *data)
+{
+	engine_t *e = (engine_t *)data;
+
+	if (!*e->nsession)
+		engine_done = 1;
+	else
+		vanessa_socket_timer_add(e->timers, timer, ENGINE_TICK);
+}
+
+
+/**********************************************************************
+ * engine_drain
+ * Drain sessions once SIGTERM has been received
+ * pre: e: engines of all threads, starting with the first
+ * post: On SIGTERM, draining is started and the other threads are
+ *       woken to stop listening. Once all threads have stopped the
+ *       listening sockets are closed. Timers are started that set
+ *       engine_done once there are no sessions or the drain timeout
+ *       has passed.
+ **********************************************************************/
+
+static void engine_drain(engine_t *e)
+{
+	int i;
+
+	if (engine_term && !engine_draining) {
+		VANESSA_LOGGER_INFO_UNSAFE("Draining %u sessions for up to "
+					   "%d seconds", *e->nsession,
+					   e->opt->drain_timeout);
+		engine_draining = 1;
+		for (i = 1; i < e->opt->threads; i++)
+			engine_wake(e[i].wake.fd);
+
+		vanessa_socket_timer_init(&engine_drain_deadline,
+					  engine_drain_timeout, e);
+		vanessa_socket_timer_add(e->timers, &engine_drain_deadline,
+					 e->opt->drain_timeout * 1000UL);
+		vanessa_socket_timer_init(&engine_drain_check,
+					  engine_drain_poll, e);
+		vanessa_socket_timer_add(e->timers, &engine_drain_check,
+					 ENGINE_TICK);
+	}
+
+	if (engine_listen_socketv &&
+	    engine_stopped == (unsigned int)e->opt->threads) {
+		if (engine_old_listen_socketv == engine_listen_socketv)
+			engine_old_listen_socketv = NULL;
+		vanessa_socket_server_unlinkv(engine_listen_socketv);
+		vanessa_socket_closev(engine_listen_socketv);
+		engine_listen_socketv = NULL;
+	}
+}
+
+
+/**********************************************************************
+ * engine_stop
+ * Stop listening for good, once draining has started
+ * pre: e: engine
+ * post: e no longer polls the listening sockets and the first thread
+ *       is told so
+ * return: 0 on success
+ *         -1 on error
+ **********************************************************************/
+
+static int engine_stop(engine_t *e)
+{
+	if (engine_listen(e, 0) < 0)
+		return -1;
+	e->stopped = 1;
+
+	__sync_add_and_fetch(&engine_stopped, 1);
+	if (e->id)
+		engine_wake(engine_wake_fd);
+
+	return 0;
+}
+
+
+/**********************************************************************
+ * engine_buf_get
+ * engine_buf_put
+ * Take a buffer for one direction of a session, and hand it back
+ * pre: e: engine
+ *      h: half of a session
+ * post: engine_buf_get(): If h has no buffer one is taken from
+ *       e->buffers, empty
+ *       engine_buf_put(): If h has a buffer it is handed back,
+ *       along with any data in it
+ * return: engine_buf_get(): 0 on success
+ *                           -1 on error
+ **********************************************************************/
+
+static int engine_buf_get(engine_t *e, engine_half_t *h)
+{
+	if (h->buf)
+		return 0;
+
+	h->buf = vanessa_socket_slab_alloc(e->buffers);
+	if (!h->buf) {
+		VANESSA_LOGGER_DEBUG("vanessa_socket_slab_alloc");
+		return -1;
+	}
+	h->len = h->off = 0;
+
+	return 0;
+}
+
+
+static void engine_buf_put(engine_t *e, engine_half_t *h)
+{
+	vanessa_socket_slab_free(e->buffers, h->buf);
+	h->buf = NULL;
+	h->len = h->off = 0;
+}
+
+
+/**********************************************************************
+ * engine_session_close
+ * Close a session
+ * pre: e: engine
+ *      s: session to close
+ *      log: if non-zero, log the close as fork mode does when a
+ *           connection finishes normally
+ * post: The sockets of s are closed and s is queued to be freed
+ *       once the current batch of events has been handled, as
+ *       there may be other events for it in the batch.
+ **********************************************************************/
+
+static void engine_session_close(engine_t *e, engine_session_t *s, int log)
+{
+	accesslog_tcp_info_t tcp_info;
+	char tcp_info_str[ACCESSLOG_TCP_INFO_STR_LEN];
+	int i;
+
+	if (s->closed)
+		return;
+
+	/* Read while the sockets are still open */
+	tcp_info_str[0] = '\0';
+	if (e->opt->tcp_info) {
+		accesslog_tcp_info_read(&tcp_info, s->half[0].in.fd,
+					s->half[1].in.fd);
+		for (i = 0; i < 2; i++)
+			if (tcp_info.ok[i])
+				metrics_tcp_info(e->metrics, i,
+						 &tcp_info.side[i]);
+		if (!accesslog_enabled())
+			accesslog_tcp_info_str(&tcp_info, tcp_info_str,
+					       sizeof(tcp_info_str));
+	}
+
+	if (accesslog_enabled())
+		accesslog_record(ACCESSLOG_CLOSE, (struct sockaddr *)&s->from,
+				 (struct sockaddr *)&s->to, s->half[0].bytes,
+				 s->half[1].bytes, &s->start,
+				 e->opt->tcp_info ? &tcp_info : NULL);
+	else if (log)
+		VANESSA_LOGGER_INFO_UNSAFE("Closing: %s %d %d%s",
+					   s->from_to_str,
+					   (int)s->half[0].bytes,
+					   (int)s->half[1].bytes,
+					   tcp_info_str);
+	if (e->opt->trace) {
+		metrics_trace(e->metrics, &s->trace);
+		accesslog_trace((struct sockaddr *)&s->from,
+				(struct sockaddr *)&s->to, &s->trace);
+	}
+
+	vanessa_socket_timer_del(&s->idle);
+	vanessa_socket_timer_del(&s->lifetime);
+	vanessa_socket_timer_del(&s->sockbuf);
+	if (engine_limit)
+		vanessa_socket_limit_release(engine_limit, &s->ticket);
+
+	for (i = 0; i < 2; i++) {
+		if (s->half[i].in.fd >= 0 && close(s->half[i].in.fd) < 0)
+			VANESSA_LOGGER_DEBUG_ERRNO("warning: close");
+		s->half[i].in.fd = -1;
+		engine_buf_put(e, s->half + i);
+	}
+
+	metrics_close(e->metrics, &s->start,
+		      s->half[0].bytes + s->half[1].bytes);
+
+	s->closed = 1;
+	s->next_dead = e->dead;
+	e->dead = s;
+
+	/* Another thread may have stopped listening too, but it is
+	 * enough that this one starts again */
+	if (__sync_sub_and_fetch(e->nsession, 1) <
+	    (unsigned int)e->opt->connection_limit)
+		engine_listen(e, 1);
+}
+
+
+/**********************************************************************
+ * engine_send
+ * Write data without blocking
+ * pre: fd: file descriptor to write to
+ *      buf: data to write
+ *      len: number of bytes in buf
+ * post: As much of buf as possible is written without blocking
+ * return: bytes written, which may be less than len
+ *         -1 on error
+ **********************************************************************/
+
+static ssize_t engine_send(int fd, const char *buf, size_t len)
+{
+	ssize_t bytes;
+	size_t off = 0;
+
+	while (off < len) {
+		bytes = send(fd, buf + off, len - off, MSG_NOSIGNAL);
+		if (bytes < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			VANESSA_LOGGER_DEBUG_ERRNO("send");
+			return -1;
+		}
+		off += bytes;
+	}
+
+	return off;
+}
+
+
+/**********************************************************************
+ * engine_flush
+ * Write buffered data for one direction of a session
+ * pre: e: engine
+ *      h: half of the session to write the buffer of
+ *      fd: file descriptor to write to
+ * post: As much of the buffer as possible is written without blocking.
+ *       Once it is all written the buffer is handed back.
+ * return: 0 on success, including if not all data could be written
+ *         -1 on error
+ **********************************************************************/
+
+static int engine_flush(engine_t *e, engine_half_t *h, int fd)
+{
+	ssize_t bytes;
+
+	bytes = engine_send(fd, h->buf + h->off, h->len - h->off);
+	if (bytes < 0)
+		return -1;
+	h->off += bytes;
+	if (h->off == h->len)
+		engine_buf_put(e, h);
+
+	return 0;
+}
+
+
+/**********************************************************************
+ * engine_session_update
+ * Update the events polled for on the sockets of a session to
+ * match its state, and close it if it is finished
+ * pre: e: engine
+ *      s: session
+ * return: 0 on success
+ *         -1 on error
+ **********************************************************************/
+
+static int engine_session_update(engine_t *e, engine_session_t *s)
+{
+	engine_half_t *h, *o;
+	uint32_t events;
+	int i;
+
+	if (s->closing && !s->half[0].len && !s->half[1].len) {
+		engine_session_close(e, s, 1);
+		return 0;
+	}
+
+	for (i = 0; i < 2; i++) {
+		h = s->half + i;
+		o = s->half + !i;
+		if (h->in.fd < 0)
+			continue;
+		events = 0;
+		if (!s->closing && !h->len &&
+		    !(h->in.type == ENGINE_SERVER && s->connecting))
+			events |= EPOLLIN;
+		if (o->len ||
+		    (h->in.type == ENGINE_SERVER && s->connecting))
+			events |= EPOLLOUT;
+		if (engine_set_events(e, &h->in, events) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+
+/**********************************************************************
+ * engine_session_read
+ * Read from one connection of a session and relay to the other
+ * pre: e: engine
+ *      s: session
+ *      fdp: connection that is readable
+ * post: Data is read into the scratch buffer and as much as possible
+ *       is written to the other connection. What is left is kept in
+ *       a buffer for fdp. s->closing is set on EOF.
+ * return: 0 on success
+ *         -1 on error
+ **********************************************************************/
+
+static int engine_session_read(engine_t *e, engine_session_t *s,
+			       engine_fd_t *fdp)
+{
+	engine_half_t *h = engine_half_of(s, fdp);
+	engine_half_t *o = engine_other_of(s, fdp);
+	ssize_t bytes, sent = 0;
+
+	if (h->len)
+		return 0;
+
+	bytes = recv(fdp->fd, e->scratch, BUFFER_SIZE, 0);
+	if (bytes < 0) {
+		if (errno == EINTR || errno == EAGAIN ||
+		    errno == EWOULDBLOCK)
+			return 0;
+		VANESSA_LOGGER_DEBUG_ERRNO("recv");
+		return -1;
+	}
+	if (!bytes) {
+		s->closing = 1;
+		return 0;
+	}
+
+	h->bytes += bytes;
+	metrics_bytes(e->metrics, fdp->type == ENGINE_CLIENT ?
+		      METRICS_C2S : METRICS_S2C, bytes);
+	if (e->opt->trace)
+		vanessa_socket_trace_read(&s->trace,
+					  fdp->type == ENGINE_CLIENT ?
+					  TRACE_CLIENT : TRACE_SERVER);
+
+	/* Data from the client is kept until the server is connected */
+	if (!(fdp->type == ENGINE_CLIENT && s->connecting)) {
+		sent = engine_send(o->in.fd, e->scratch, bytes);
+		if (sent < 0)
+			return -1;
+		if (sent == bytes)
+			return 0;
+	}
+
+	if (engine_buf_get(e, h) < 0)
+		return -1;
+	memcpy(h->buf, e->scratch + sent, bytes - sent);
+	h->len = bytes - sent;
+
+	return 0;
+}
+
+
+/**********************************************************************
+ * engine_session_write
+ * Handle a connection of a session becoming writable
+ * pre: s: session
+ *      fdp: connection that is writable
+ * post: If the connection to the server was in progress then its
+ *       result is checked. Buffered data for fdp is written.
+ * return: 0 on success
+ *         -1 on error
+ **********************************************************************/
+
+static int engine_session_write(engine_t *e, engine_session_t *s,
+				engine_fd_t *fdp)
+{
+	int err;
+	socklen_t len;
+
+	if (fdp->type == ENGINE_SERVER && s->connecting) {
+		len = sizeof(err);
+		if (getsockopt(fdp->fd, SOL_SOCKET, SO_ERROR, &err,
+			       &len) < 0) {
+			VANESSA_LOGGER_DEBUG_ERRNO("getsockopt");
+			return -1;
+		}
+		metrics_connect(e->metrics, &s->start, !err);
+		if (err) {
+			errno = err;
+			VANESSA_LOGGER_DEBUG_ERRNO("connect");
+			VANESSA_LOGGER_ERR_UNSAFE("Could not connect to server: "
+						  "%s:%s",
+						  str_null_safe(e->opt->outgoing_host),
+						  str_null_safe(e->opt->outgoing_port));
+			return -1;
+		}
+		s->connecting = 0;
+		if (e->opt->trace)
+			s->trace.connect = vanessa_socket_trace_now();
+		if (e->opt->sockbuf_max)
+			vanessa_socket_timer_add(e->timers, &s->sockbuf,
+						 SOCKBUF_INTERVAL);
+	}
+
+	return engine_flush(e, engine_other_of(s, fdp), fdp->fd);
+}
+
+
+/**********************************************************************
+ * engine_session_timeout
+ * Close a session that has been idle for too long
+ * pre: timer: idle timer of a session
+ *      data: engine
+ * post: The session is closed
+ **********************************************************************/
+
+static void engine_session_timeout(vanessa_socket_timer_t *timer, void *data)
+{
+	engine_session_t *s;
+
+	s = (engine_session_t *)((char *)timer -
+				 offsetof(engine_session_t, idle));
+	engine_session_close((engine_t *)data, s, 1);
+}
+
+
+/**********************************************************************
+ * engine_session_lifetime
+ * Close a session that has been open for too long, for -e|--lifetime
+ * pre: timer: lifetime timer of a session
+ *      data: engine
+ * post: The session is closed
+ **********************************************************************/
+
+static void engine_session_lifetime(vanessa_socket_timer_t *timer,
+				    void *data)
+{
+	engine_session_t *s;
+
+	s = (engine_session_t *)((char *)timer -
+				 offsetof(engine_session_t, lifetime));
+	engine_session_close((engine_t *)data, s, 1);
+}
+
+
+/**********************************************************************
+ * engine_session_sockbuf
+ * Tune the kernel buffers of a session, for -b|--sockbuf_max
+ * pre: timer: sockbuf timer of a connected session
+ *      data: engine
+ * post: The buffers of both directions are tuned and the timer is
+ *       started again. A direction whose buffers the kernel clamped
+ *       is not tuned again. If tuning fails, say because one side is
+ *       a unix domain socket, it is not tried again.
+ **********************************************************************/
+
+static void engine_session_sockbuf(vanessa_socket_timer_t *timer, void *data)
+{
+	engine_t *e = (engine_t *)data;
+	engine_session_t *s;
+	int fd[2], i, status;
+
+	s = (engine_session_t *)((char *)timer -
+				 offsetof(engine_session_t, sockbuf));
+	fd[0] = s->half[0].in.fd;
+	fd[1] = s->half[1].in.fd;
+
+	for (i = 0; i < 2; i++) {
+		if (s->sockbuf_clamped[i])
+			continue;
+		status = vanessa_socket_tcp_tune(fd[i], fd[!i],
+						 e->opt->sockbuf_min,
+						 e->opt->sockbuf_max);
+		if (status < 0) {
+			VANESSA_LOGGER_DEBUG("vanessa_socket_tcp_tune");
+			return;
+		}
+		s->sockbuf_clamped[i] = status;
+	}
+	if (s->sockbuf_clamped[0] && s->sockbuf_clamped[1])
+		return;
+
+	vanessa_socket_timer_add(e->timers, timer, SOCKBUF_INTERVAL);
+}
+
+
+/**********************************************************************
+ * engine_session_connect
+ * Start connecting to the server for a session
+ * pre: e: engine
+ *      s: session, with the client and its addresses filled in
+ * post: The session is logged, a non-blocking connection to the server
+ *       is started and added to the event loop. If asked to, a PROXY
+ *       protocol header is queued to be sent to the server ahead of
+ *       any data from the client.
+ * return: 0 on success
+ *         -1 on error, the caller should close s
+ **********************************************************************/
+
+static int engine_session_connect(engine_t *e, engine_session_t *s)
+{
+	engine_half_t *h = s->half;
+	char from_str[SOCKADDR_STR_LEN];
+	char to_str[SOCKADDR_STR_LEN];
+	char proxy[VANESSA_SOCKET_PROXY_V2_MAX];
+	vanessa_socket_flag_t flag;
+	ssize_t len;
+	int server;
+
+	if (accesslog_enabled()) {
+		/* Addresses are formatted by the access log writer */
+		accesslog_record(ACCESSLOG_OPEN, (struct sockaddr *)&s->from,
+				 (struct sockaddr *)&s->to, 0, 0, NULL, NULL);
+	} else {
+		if (sockaddr_str((struct sockaddr *)&s->from, from_str,
+				 "peername") < 0 ||
+		    sockaddr_str((struct sockaddr *)&s->to, to_str,
+				 "sockname") < 0) {
+			VANESSA_LOGGER_DEBUG("sockaddr_str");
+			return -1;
+		}
+		snprintf(s->from_to_str, sizeof(s->from_to_str), "%s->%s",
+			 from_str, to_str);
+
+		VANESSA_LOGGER_INFO_UNSAFE("Connect: %s server=%s port=%s",
+					   s->from_to_str,
+					   e->opt->outgoing_host,
+					   str_null_safe(e->opt->outgoing_port));
+	}
+
+	if (e->opt->send_proxy) {
+		len = vanessa_socket_proxy_v2_build(proxy, sizeof(proxy),
+						    (struct sockaddr *)&s->from,
+						    (struct sockaddr *)&s->to);
+		if (len < 0 || h->len + len > BUFFER_SIZE ||
+		    engine_buf_get(e, h) < 0) {
+			VANESSA_LOGGER_DEBUG("vanessa_socket_proxy_v2_build");
+			VANESSA_LOGGER_ERR("Could not build PROXY protocol "
+					   "header");
+			return -1;
+		}
+		memmove(h->buf + len, h->buf, h->len);
+		memcpy(h->buf, proxy, len);
+		h->len += len;
+	}
+
+	flag = VANESSA_SOCKET_NONBLOCK;
+	if (e->opt->no_lookup)
+		flag |= VANESSA_SOCKET_NO_LOOKUP;
+	/* Connections are made non-blocking, so the connect time of the
+	 * trace is filled in by engine_session_write() */
+	if (e->opt->trace)
+		vanessa_socket_trace_set(&s->trace);
+	server = vanessa_socket_client_open(e->opt->outgoing_host,
+					    e->opt->outgoing_port, flag);
+	if (e->opt->trace)
+		vanessa_socket_trace_set(NULL);
+	if (server < 0) {
+		metrics_connect(e->metrics, &s->start, 0);
+		VANESSA_LOGGER_DEBUG("vanessa_socket_client_open");
+		VANESSA_LOGGER_ERR_UNSAFE("Could not connect to server: %s:%s",
+					  str_null_safe(e->opt->outgoing_host),
+					  str_null_safe(e->opt->outgoing_port));
+		return -1;
+	}
+
+	s->half[1].in.fd = server;
+	s->connecting = 1;
+
+	return engine_add(e, &s->half[1].in, EPOLLOUT);
+}
+
+
+/**********************************************************************
+ * engine_session_proxy
+ * Read the PROXY protocol header that a session starts with
+ * pre: e: engine
+ *      s: session that is waiting for a header
+ * post: Data is read from the client. Once the header is complete the
+ *       addresses of s are updated from it, data that follows it is
+ *       kept to be relayed and the connection to the server is started.
+ * return: 0 on success, including if more data is needed
+ *         -1 on error, the caller should close s
+ **********************************************************************/
+
+static int engine_session_proxy(engine_t *e, engine_session_t *s)
+{
+	engine_half_t *h = s->half;
+	ssize_t bytes;
+	ssize_t len;
+
+	/* The header may come in pieces, so it is read into a buffer */
+	if (engine_buf_get(e, h) < 0)
+		return -1;
+
+	bytes = recv(h->in.fd, h->buf + h->len, BUFFER_SIZE - h->len, 0);
+	if (bytes < 0) {
+		if (errno == EINTR || errno == EAGAIN ||
+		    errno == EWOULDBLOCK)
+			return 0;
+		VANESSA_LOGGER_DEBUG_ERRNO("recv");
+		return -1;
+	}
+	if (!bytes) {
+		VANESSA_LOGGER_DEBUG("closed before PROXY protocol header");
+		return -1;
+	}
+	h->len += bytes;
+
+	len = vanessa_socket_proxy_v2_parse(h->buf, h->len, &s->from, &s->to);
+	if (!len && h->len == BUFFER_SIZE) {
+		VANESSA_LOGGER_DEBUG("PROXY protocol header too long");
+		len = -1;
+	}
+	if (len < 0) {
+		VANESSA_LOGGER_ERR("Invalid PROXY protocol header");
+		return -1;
+	}
+	if (!len)
+		return 0;
+
+	h->len -= len;
+	memmove(h->buf, h->buf + len, h->len);
+	h->bytes += h->len;
+	if (!h->len)
+		engine_buf_put(e, h);
+	metrics_bytes(e->metrics, METRICS_C2S, h->len);
+	s->proxy = 0;
+
+	if (engine_session_connect(e, s) < 0)
+		return -1;
+	return engine_session_update(e, s);
+}
+
+
+/**********************************************************************
+ * engine_session_new
+ * Start a session for a newly accepted connection
+ * pre: e: engine
+ *      client: accepted connection, non-blocking, that has been
+ *              counted in e->nsession
+ *      from: address the client connected from,
+ *            in a struct sockaddr_storage
+ *      ticket: admitted by engine_limit, if set
+ * post: The client is added to the event loop. A non-blocking
+ *       connection to the server is started, unless a PROXY protocol
+ *       header is expected first.
+ * return: 0 on success
+ *         -1 on error, client is closed
+ **********************************************************************/
+
+static int engine_session_new(engine_t *e, int client,
+			      struct sockaddr *from,
+			      const vanessa_socket_limit_ticket_t *ticket)
+{
+	engine_session_t *s;
+	struct sockaddr_storage to;
+	socklen_t tolen;
+	struct timespec start;
+
+	metrics_now(&start);
+	metrics_accept(e->metrics);
+
+	memset(&to, 0, sizeof(to));
+	tolen = sizeof(to);
+	if (getsockname(client, (struct sockaddr *)&to, &tolen) < 0) {
+		VANESSA_LOGGER_DEBUG_ERRNO("getsockname");
+		goto err_client;
+	}
+
+	s = vanessa_socket_slab_alloc(e->sessions);
+	if (!s) {
+		VANESSA_LOGGER_DEBUG("vanessa_socket_slab_alloc");
+		goto err_client;
+	}
+	memset(s, 0, sizeof(*s));
+	s->start = start;
+	if (e->opt->trace)
+		s->trace.accept = vanessa_socket_trace_now();
+	s->ticket = *ticket;
+	memcpy(&s->from, from, sizeof(s->from));
+	memcpy(&s->to, &to, sizeof(s->to));
+
+	s->half[0].in.fd = client;
+	s->half[0].in.type = ENGINE_CLIENT;
+	s->half[1].in.fd = -1;
+	s->half[1].in.type = ENGINE_SERVER;
+	s->half[0].in.session = s->half[1].in.session = s;
+
+	/* Keep the timeout the session started with over reloads */
+	s->timeout = e->opt->timeout;
+	vanessa_socket_timer_init(&s->idle, engine_session_timeout, e);
+	vanessa_socket_timer_init(&s->lifetime, engine_session_lifetime, e);
+	vanessa_socket_timer_init(&s->sockbuf, engine_session_sockbuf, e);
+	if (s->timeout)
+		vanessa_socket_timer_add(e->timers, &s->idle,
+					 s->timeout * 1000UL);
+	if (e->opt->lifetime)
+		vanessa_socket_timer_add(e->timers, &s->lifetime,
+					 e->opt->lifetime * 1000UL);
+
+	if (e->opt->accept_proxy)
+		s->proxy = 1;
+	else if (engine_session_connect(e, s) < 0)
+		goto err_session;
+
+	if (engine_add(e, &s->half[0].in, EPOLLIN) < 0)
+		goto err_session;
+
+	return 0;
+
+err_session:
+	engine_session_close(e, s, 0);
+	return -1;
+
+err_client:
+	if (close(client) < 0)
+		VANESSA_LOGGER_DEBUG_ERRNO("warning: close");
+	if (engine_limit)
+		vanessa_socket_limit_release(engine_limit, ticket);
+	metrics_close(e->metrics, &start, 0);
+	__sync_sub_and_fetch(e->nsession, 1);
+	return -1;
+}
+
+
+/**********************************************************************
+ * engine_accept
+ * Accept pending connections on a listening socket
+ * pre: e: engine
+ *      fdp: listening socket
+ * post: Connections are accepted until none are pending or the
+ *       connection limit is reached, in which case accepting stops
+ *       until a session closes
+ * return: 0 on success
+ *         -1 on error
+ **********************************************************************/
+
+static int engine_accept(engine_t *e, engine_fd_t *fdp)
+{
+	struct sockaddr_storage from;
+	socklen_t fromlen;
+	vanessa_socket_limit_ticket_t ticket;
+	int g;
+
+	for (;;) {
+		if (e->opt->connection_limit &&
+		    __sync_add_and_fetch(e->nsession, 1) >
+		    (unsigned int)e->opt->connection_limit) {
+			__sync_sub_and_fetch(e->nsession, 1);
+			VANESSA_LOGGER_DEBUG("too many connections");
+			return engine_listen(e, 0);
+		}
+		if (!e->opt->connection_limit)
+			__sync_add_and_fetch(e->nsession, 1);
+
+		/* Unix domain peers are usually unnamed */
+		memset(&from, 0, sizeof(from));
+		fromlen = sizeof(from);
+		g = accept4(fdp->fd, (struct sockaddr *)&from, &fromlen,
+			    SOCK_NONBLOCK);
+		if (g < 0) {
+			__sync_sub_and_fetch(e->nsession, 1);
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return 0;
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			VANESSA_LOGGER_DEBUG_ERRNO("accept4");
+			metrics_accept_error(e->metrics);
+			/* Out of file descriptors or similar. Don't give
+			 * up, sessions that close will free them. */
+			return 0;
+		}
+
+		if (e->acl && vanessa_socket_acl_check(e->acl,
+				(struct sockaddr *)&from) == VANESSA_SOCKET_ACL_DENY) {
+			VANESSA_LOGGER_DEBUG("denied by access control list");
+			if (close(g) < 0)
+				VANESSA_LOGGER_DEBUG_ERRNO("warning: close");
+			__sync_sub_and_fetch(e->nsession, 1);
+			continue;
+		}
+
+		if (engine_limit &&
+		    vanessa_socket_limit_admit(engine_limit,
+					       (struct sockaddr *)&from,
+					       &ticket) < 0) {
+			VANESSA_LOGGER_DEBUG("over source address limits");
+			if (close(g) < 0)
+				VANESSA_LOGGER_DEBUG_ERRNO("warning: close");
+			__sync_sub_and_fetch(e->nsession, 1);
+			continue;
+		}
+
+		engine_session_new(e, g, (struct sockaddr *)&from, &ticket);
+	}
+}
+
+
+/**********************************************************************
+ * engine_handle
+ * Handle an event for a connection of a session
+ * pre: e: engine
+ *      fdp: connection the event is for
+ *      events: events that occurred
+ * post: Data is relayed and the session is updated or closed
+ **********************************************************************/
+
+static void engine_handle(engine_t *e, engine_fd_t *fdp, uint32_t events)
+{
+	engine_session_t *s = fdp->session;
+	int err;
+	socklen_t len;
+
+	if (s->closed)
+		return;
+
+	/* Data can be read or written, so the session is not idle */
+	if (s->timeout)
+		vanessa_socket_timer_add(e->timers, &s->idle,
+					 s->timeout * 1000UL);
+
+	if (s->proxy) {
+		if (engine_session_proxy(e, s) < 0)
+			goto err;
+		return;
+	}
+
+	if (events & EPOLLERR && !(fdp->type == ENGINE_SERVER &&
+				   s->connecting)) {
+		len = sizeof(err);
+		if (!getsockopt(fdp->fd, SOL_SOCKET, SO_ERROR, &err, &len)) {
+			errno = err;
+			VANESSA_LOGGER_DEBUG_ERRNO("socket error");
+		}
+		goto err;
+	}
+
+	if (events & (EPOLLOUT|EPOLLERR) &&
+	    engine_session_write(e, s, fdp) < 0)
+		goto err;
+
+	if (events & (EPOLLIN|EPOLLHUP)) {
+		/* A hung up socket can't be written to either, so give up
+		 * if there is data that can't be read yet */
+		if (events & EPOLLHUP && engine_half_of(s, fdp)->len)
+			goto err;
+		if (engine_session_read(e, s, fdp) < 0)
+			goto err;
+	}
+
+	if (engine_session_update(e, s) < 0)
+		goto err;
+
+	return;
+err:
+	engine_session_close(e, s, 0);
+}
+
+
+/**********************************************************************
+ * engine_loop
+ * Run the event loop of a thread
+ * pre: e: thread state, with e->listen filled in. For the first
+ *         thread, the states of all threads starting with its own.
+ * post: Connections are accepted and served until an error occurs.
+ *       The first thread also returns once draining is finished.
+ * return: 0 once draining is finished
+ *         -1 on error
+ **********************************************************************/
+
+static int engine_loop(engine_t *e)
+{
+	engine_session_t *s;
+	struct epoll_event ev[ENGINE_EVENTS];
+	uint64_t count;
+	int i, n, status = -1;
+
+	e->timers = vanessa_socket_timer_wheel_create(ENGINE_TICK);
+	if (!e->timers) {
+		VANESSA_LOGGER_DEBUG("vanessa_socket_timer_wheel_create");
+		return -1;
+	}
+
+	e->sessions = vanessa_socket_slab_create(sizeof(engine_session_t),
+						 ENGINE_SLAB);
+	e->buffers = vanessa_socket_slab_create(BUFFER_SIZE, ENGINE_BUFFERS);
+	e->scratch = malloc(BUFFER_SIZE);
+	if (!e->sessions || !e->buffers || !e->scratch) {
+		VANESSA_LOGGER_DEBUG("vanessa_socket_slab_create");
+		goto err_slab;
+	}
+
+	e->epfd = epoll_create(1);
+	if (e->epfd < 0) {
+		VANESSA_LOGGER_DEBUG_ERRNO("epoll_create");
+		goto err_slab;
+	}
+
+	if (engine_add(e, &e->wake, EPOLLIN) < 0 || engine_listen(e, 1) < 0)
+		goto err;
+
+	for (;;) {
+		if (!e->id) {
+			engine_reload(e);
+			engine_drain(e);
+			if (engine_done)
+				break;
+		}
+		if (e->generation != engine_generation && engine_switch(e) < 0)
+			goto err;
+		if (engine_draining && !e->stopped && engine_stop(e) < 0)
+			goto err;
+
+		n = epoll_wait(e->epfd, ev, ENGINE_EVENTS,
+			       vanessa_socket_timer_wheel_next(e->timers));
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			VANESSA_LOGGER_DEBUG_ERRNO("epoll_wait");
+			goto err;
+		}
+
+		/* Also brings the time of the wheel up to date,
+		 * before timers are restarted by the events below */
+		vanessa_socket_timer_wheel_run(e->timers);
+
+		for (i = 0; i < n; i++) {
+			engine_fd_t *fdp = ev[i].data.ptr;
+
+			if (fdp->type == ENGINE_LISTEN) {
+				if (engine_accept(e, fdp) < 0)
+					goto err;
+			} else if (fdp->type == ENGINE_WAKE) {
+				/* Reloads and draining are picked up at the
+				 * top of the loop, all that is needed is to
+				 * wake up */
+				if (read(fdp->fd, &count, sizeof(count)) < 0 &&
+				    errno != EAGAIN) {
+					VANESSA_LOGGER_DEBUG_ERRNO("read");
+					goto err;
+				}
+			} else {
+				engine_handle(e, fdp, ev[i].events);
+			}
+		}
+
+		while ((s = e->dead)) {
+			e->dead = s->next_dead;
+			vanessa_socket_slab_free(e->sessions, s);
+		}
+	}
+
+	if (*e->nsession)
+		VANESSA_LOGGER_INFO_UNSAFE("Exiting with %u sessions still open",
+					   *e->nsession);
+	else
+		VANESSA_LOGGER_INFO("All sessions finished, exiting");
+	status = 0;
+
+err:
+	close(e->epfd);
+err_slab:
+	/* Sessions still open go with them, the process is about to exit */
+	vanessa_socket_slab_destroy(e->sessions);
+	vanessa_socket_slab_destroy(e->buffers);
+	free(e->scratch);
+	vanessa_socket_timer_wheel_destroy(e->timers);
+	return status;
+}
+
+
+#ifdef HAVE_PTHREAD
+static void *engine_thread(void *data)
+{
+	engine_loop((engine_t *)data);
+	VANESSA_LOGGER_ERR("Fatal error in engine thread");
+	exit(-1);
+}
+#endif
+
+
+int engine_main(options_t *opt, vanessa_socket_limit_t *limit)
+{
+	engine_t *e = NULL;
+	unsigned int nsession = 0;
+	int i, started = 0, status = -1;
+
+#ifndef HAVE_PTHREAD
+	if (opt->threads > 1) {
+		VANESSA_LOGGER_ERR("Threads are not supported on this "
+				   "platform");
+		return -1;
+	}
+#endif
+
+	engine_limit = limit;
+
+	/* A client that goes away must not kill every session */
+	signal(SIGPIPE, SIG_IGN);
+
+	/* Options are replaced, and freed, by reloads */
+	engine_opt = malloc(sizeof(*engine_opt));
+	if (!engine_opt) {
+		VANESSA_LOGGER_DEBUG_ERRNO("malloc");
+		return -1;
+	}
+	*engine_opt = *opt;
+
+	if (opt->acl_file) {
+		engine_acl = acl_read(opt->acl_file);
+		if (!engine_acl) {
+			VANESSA_LOGGER_DEBUG("acl_read");
+			goto out;
+		}
+	}
+
+	engine_listen_socketv = engine_bind(opt);
+	if (!engine_listen_socketv) {
+		VANESSA_LOGGER_DEBUG("engine_bind");
+		goto out;
+	}
+
+	e = calloc(opt->threads, sizeof(*e));
+	if (!e) {
+		VANESSA_LOGGER_DEBUG_ERRNO("calloc");
+		goto out;
+	}
+	for (i = 0; i < opt->threads; i++)
+		e[i].wake.fd = -1;
+	for (i = 0; i < opt->threads; i++) {
+		e[i].id = i;
+		e[i].opt = engine_opt;
+		e[i].acl = engine_acl;
+		e[i].epfd = -1;
+		e[i].nsession = &nsession;
+		e[i].metrics = metrics_slot(i);
+		e[i].wake.type = ENGINE_WAKE;
+		e[i].wake.fd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+		if (e[i].wake.fd < 0) {
+			VANESSA_LOGGER_DEBUG_ERRNO("eventfd");
+			goto out;
+		}
+		if (engine_listen_set(e + i, engine_listen_socketv) < 0)
+			goto out;
+	}
+
+	engine_wake_fd = e[0].wake.fd;
+	if (opt->config_file || opt->acl_file)
+		signal(SIGHUP, engine_sighup);
+	if (opt->drain_timeout)
+		signal(SIGTERM, engine_sigterm);
+
+#ifdef HAVE_PTHREAD
+	for (i = 1; i < opt->threads; i++) {
+		pthread_t thread;
+		int err;
+
+		err = pthread_create(&thread, NULL, engine_thread, e + i);
+		if (err) {
+			errno = err;
+			VANESSA_LOGGER_DEBUG_ERRNO("pthread_create");
+			goto out;
+		}
+		pthread_detach(thread);
+		started++;
+	}
+#endif
+
+	status = engine_loop(e);
+
+out:
+	/* Threads that are still running use e until the process exits */
+	if (e && !started) {
+		for (i = 0; i < opt->threads; i++) {
+			if (e[i].wake.fd >= 0)
+				close(e[i].wake.fd);
+			free(e[i].listen);
+		}
+		free(e);
+	}
+	if (engine_listen_socketv) {
+		vanessa_socket_server_unlinkv(engine_listen_socketv);
+		vanessa_socket_closev(engine_listen_socketv);
+	}
+	return status;
+}
+
+#else /* __linux__ */
+
+int engine_main(options_t *UNUSED(opt),
+		vanessa_socket_limit_t *UNUSED(limit))
+{
+	VANESSA_LOGGER_ERR("The epoll engine is not supported on this "
+			   "platform");
+	return -1;
+}
+
+#endif /* __linux__ */
@@ -0,0 +1,50 @@
+/**********************************************************************
+ * engine.h                                                October 2026
+ * Simon Horman                                      horms@verge.net.au
+ *
+ * Event driven engine that serves all connections from one process
+ *
+ * vanessa_socket_pipe
+ * Trivial TCP/IP pipe based on libvanessa_socket
+ * Copyright (C) 1999-2008  Simon Horman <horms@verge.net.au>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307  USA
+ *
+ **********************************************************************/
+
+#ifndef ENGINE_STIX
+#define ENGINE_STIX
+
+#include "options.h"
+
+
+/**********************************************************************
+ * engine_main
+ * Accept connections and pipe them to the server using an epoll(7)
+ * event loop, rather than forking a process for each connection
+ * pre: opt: options
+ *      limit: per source address limits, NULL for none
+ * post: Connections are served by this process until an error occurs,
+ *       or until the sessions open when SIGTERM was received have
+ *       finished if opt->drain_timeout is set
+ * return: 0 once drained
+ *         -1 on error
+ **********************************************************************/
+
+int engine_main(options_t *opt, vanessa_socket_limit_t *limit);
+
+
+#endif
@@ -0,0 +1,78 @@
+/**********************************************************************
+ * limit.c                                                 October 2026
+ * Simon Horman                                      horms@verge.net.au
+ *
+ * Per source address and per prefix connection limits
+ *
+ * vanessa_socket_pipe
+ * Trivial TCP/IP pipe based on libvanessa_socket
+ * Copyright (C) 1999-2008  Simon Horman <horms@verge.net.au>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307  USA
+ *
+ **********************************************************************/
+
+#include "limit.h"
+
+#define LIMIT_CAPACITY 16384	/* Addresses and prefixes tracked */
+#define LIMIT_PREFIX4  24
+#define LIMIT_PREFIX6  64
+
+
+static void limit_rules(const options_t *opt,
+			vanessa_socket_limit_rule_t *source,
+			vanessa_socket_limit_rule_t *prefix)
+{
+	source->max = opt->source_limit;
+	source->rate = opt->source_rate;
+	source->burst = opt->source_rate ? opt->source_rate : 1;
+	prefix->max = opt->prefix_limit;
+	prefix->rate = opt->prefix_rate;
+	prefix->burst = opt->prefix_rate ? opt->prefix_rate : 1;
+}
+
+
+vanessa_socket_limit_t *limit_create(options_t *opt, int *err)
+{
+	vanessa_socket_limit_rule_t source, prefix;
+	vanessa_socket_limit_t *l;
+
+	*err = 0;
+	if (!opt->source_limit && !opt->source_rate &&
+	    !opt->prefix_limit && !opt->prefix_rate && !opt->config_file)
+		return NULL;
+
+	limit_rules(opt, &source, &prefix);
+	l = vanessa_socket_limit_create(LIMIT_CAPACITY, &source, &prefix,
+					LIMIT_PREFIX4, LIMIT_PREFIX6);
+	if (!l) {
+		VANESSA_LOGGER_DEBUG("vanessa_socket_limit_create");
+		*err = -1;
+	}
+	return l;
+}
+
+
+void limit_reload(vanessa_socket_limit_t *l, const options_t *opt)
+{
+	vanessa_socket_limit_rule_t source, prefix;
+
+	if (!l)
+		return;
+
+	limit_rules(opt, &source, &prefix);
+	vanessa_socket_limit_rules(l, &source, &prefix);
+}
@@ -0,0 +1,60 @@
+/**********************************************************************
+ * limit.h                                                 October 2026
+ * Simon Horman                                      horms@verge.net.au
+ *
+ * Per source address and per prefix connection limits
+ *
+ * vanessa_socket_pipe
+ * Trivial TCP/IP pipe based on libvanessa_socket
+ * Copyright (C) 1999-2008  Simon Horman <horms@verge.net.au>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307  USA
+ *
+ **********************************************************************/
+
+#ifndef LIMIT_STIX
+#define LIMIT_STIX
+
+#include "options.h"
+
+
+/**********************************************************************
+ * limit_create
+ * Create a limiter for the per source address and per prefix limits
+ * pre: opt: options
+ * return: limiter. One is created if -f|--config_file is given, even
+ *         if no limits are set, so that reloading it may set some.
+ *         NULL if no limits are set, or on error. In which case
+ *         *err is set to -1.
+ **********************************************************************/
+
+vanessa_socket_limit_t *limit_create(options_t *opt, int *err);
+
+
+/**********************************************************************
+ * limit_reload
+ * Apply the per source address and per prefix limits of reloaded
+ * options to a limiter
+ * pre: l: limiter made by limit_create(), may be NULL
+ *      opt: reloaded options
+ * post: Connections admitted from now on are checked against the
+ *       limits of opt
+ **********************************************************************/
+
+void limit_reload(vanessa_socket_limit_t *l, const options_t *opt);
+
+
+#endif
@@ -0,0 +1,652 @@
+/**********************************************************************
+ * metrics.c                                               October 2026
+ * Simon Horman                                      horms@verge.net.au
+ *
+ * Counters and histograms, served in Prometheus text format
+ *
+ * vanessa_socket_pipe
+ * Trivial TCP/IP pipe based on libvanessa_socket
+ * Copyright (C) 1999-2008  Simon Horman <horms@verge.net.au>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307  USA
+ *
+ **********************************************************************/
+
+#include "metrics.h"
+#include "ring.h"
+#include "unused.h"
+
+#include <errno.h>
+#include <sys/mman.h>
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+#define METRICS_PREFIX "vanessa_socket_pipe_"
+#define METRICS_REQUEST_MAX 4096
+
+/* Times are recorded in microseconds */
+static const metrics_histogram_type_t metrics_connect_time_type = {
+	"connect_seconds",
+	"Time taken to connect to the server.",
+	1000000.0,
+	{ 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000,
+	  250000, 500000, 1000000, 2500000, 5000000 },
+	14
+};
+
+static const metrics_histogram_type_t metrics_session_time_type = {
+	"session_seconds",
+	"Duration of sessions.",
+	1000000.0,
+	{ 10000, 100000, 1000000, 10000000, 60000000, 300000000,
+	  1800000000, 3600000000ULL, 86400000000ULL },
+	9
+};
+
+static const metrics_histogram_type_t metrics_session_bytes_type = {
+	"session_bytes",
+	"Bytes relayed by sessions, in both directions.",
+	1.0,
+	{ 1024, 10240, 102400, 1048576, 10485760, 104857600,
+	  1073741824, 10737418240ULL },
+	8
+};
+
+static const metrics_histogram_type_t metrics_resolve_time_type = {
+	"resolve_seconds",
+	"Time taken to resolve the server's address.",
+	1000000.0,
+	{ 10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000,
+	  100000, 1000000 },
+	13
+};
+
+static const metrics_histogram_type_t metrics_setup_time_type = {
+	"setup_seconds",
+	"Time from accepting a session until connected to the server.",
+	1000000.0,
+	{ 50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000,
+	  100000, 250000, 1000000, 5000000 },
+	14
+};
+
+static const metrics_histogram_type_t metrics_first_byte_time_type = {
+	"first_byte_seconds",
+	"Time until the server sends its first byte, from the client's "
+	"first byte if it sent one after the connection was made, "
+	"otherwise from the connection being made.",
+	1000000.0,
+	{ 50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000,
+	  100000, 250000, 1000000, 5000000 },
+	14
+};
+
+static const metrics_histogram_type_t metrics_rtt_type[2] = {
+	{
+		"client_rtt_seconds",
+		"Smoothed round trip time of the connection to the client "
+		"when sessions close.",
+		1000000.0,
+		{ 50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000,
+		  100000, 250000, 500000, 1000000 },
+		14
+	},
+	{
+		"server_rtt_seconds",
+		"Smoothed round trip time of the connection to the server "
+		"when sessions close.",
+		1000000.0,
+		{ 50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000,
+		  100000, 250000, 500000, 1000000 },
+		14
+	}
+};
+
+/* Bytes a second */
+static const metrics_histogram_type_t metrics_delivery_rate_type[2] = {
+	{
+		"client_delivery_rate_bytes",
+		"Delivery rate of the connection to the client, in bytes "
+		"a second, when sessions close.",
+		1.0,
+		{ 125000, 1250000, 6250000, 12500000, 62500000, 125000000,
+		  625000000, 1250000000, 3125000000ULL, 12500000000ULL },
+		10
+	},
+	{
+		"server_delivery_rate_bytes",
+		"Delivery rate of the connection to the server, in bytes "
+		"a second, when sessions close.",
+		1.0,
+		{ 125000, 1250000, 6250000, 12500000, 62500000, 125000000,
+		  625000000, 1250000000, 3125000000ULL, 12500000000ULL },
+		10
+	}
+};
+
+static metrics_t *metrics;
+static int metrics_nslot;
+static int metrics_listen_socket = -1;
+static int metrics_children;	/* Sessions are served by children */
+
+#define metrics_add(_field, _value) \
+	__sync_fetch_and_add(&(_field), (_value))
+
+
+void metrics_now(struct timespec *ts)
+{
+	clock_gettime(CLOCK_MONOTONIC, ts);
+}
+
+
+static uint64_t metrics_since(const struct timespec *start)
+{
+	struct timespec now;
+
+	metrics_now(&now);
+	return (uint64_t)(now.tv_sec - start->tv_sec) * 1000000 +
+		(now.tv_nsec - start->tv_nsec) / 1000;
+}
+
+
+static void metrics_observe(metrics_histogram_t *h,
+			    const metrics_histogram_type_t *type,
+			    uint64_t value)
+{
+	int i;
+
+	for (i = 0; i < type->nbound && value > type->bound[i]; i++)
+		;
+	metrics_add(h->bucket[i], 1);
+	metrics_add(h->sum, value);
+	metrics_add(h->count, 1);
+}
+
+
+void metrics_child(void)
+{
+	if (metrics_listen_socket >= 0)
+		close(metrics_listen_socket);
+	metrics_listen_socket = -1;
+}
+
+
+void metrics_unlink(void)
+{
+	if (metrics_listen_socket >= 0)
+		vanessa_socket_server_unlink(metrics_listen_socket);
+}
+
+
+metrics_t *metrics_slot(int i)
+{
+	if (!metrics || i >= metrics_nslot)
+		return NULL;
+	return metrics + i;
+}
+
+
+void metrics_accept(metrics_t *m)
+{
+	if (m)
+		metrics_add(m->accepts, 1);
+}
+
+
+void metrics_accept_error(metrics_t *m)
+{
+	if (m)
+		metrics_add(m->accept_errors, 1);
+}
+
+
+void metrics_connect(metrics_t *m, const struct timespec *start, int ok)
+{
+	if (!m)
+		return;
+
+	if (!ok) {
+		metrics_add(m->connect_failures, 1);
+		return;
+	}
+	metrics_add(m->connects, 1);
+	metrics_observe(&m->connect_time, &metrics_connect_time_type,
+			metrics_since(start));
+}
+
+
+void metrics_bytes(metrics_t *m, int dir, size_t bytes)
+{
+	if (m)
+		metrics_add(m->bytes[dir], bytes);
+}
+
+
+void metrics_mirror(metrics_t *m, int dropped, size_t bytes)
+{
+	if (!m)
+		return;
+
+	metrics_add(m->mirrors, 1);
+	if (dropped)
+		metrics_add(m->mirror_drops, 1);
+	metrics_add(m->mirror_bytes, bytes);
+}
+
+
+void metrics_close(metrics_t *m, const struct timespec *start, size_t bytes)
+{
+	if (!m)
+		return;
+
+	metrics_add(m->sessions_closed, 1);
+	metrics_observe(&m->session_time, &metrics_session_time_type,
+			metrics_since(start));
+	metrics_observe(&m->session_bytes, &metrics_session_bytes_type,
+			bytes);
+}
+
+
+void metrics_trace(metrics_t *m, const vanessa_socket_trace_t *trace)
+{
+	uint64_t from;
+
+	if (!m || !trace->accept)
+		return;
+
+	if (trace->open && trace->resolve >= trace->open)
+		metrics_observe(&m->resolve_time, &metrics_resolve_time_type,
+				(trace->resolve - trace->open) / 1000);
+	if (!trace->connect)
+		return;
+	metrics_observe(&m->setup_time, &metrics_setup_time_type,
+			(trace->connect - trace->accept) / 1000);
+
+	if (!trace->first[TRACE_SERVER])
+		return;
+	from = trace->connect;
+	if (trace->first[TRACE_CLIENT] > from &&
+	    trace->first[TRACE_CLIENT] <= trace->first[TRACE_SERVER])
+		from = trace->first[TRACE_CLIENT];
+	if (trace->first[TRACE_SERVER] >= from)
+		metrics_observe(&m->first_byte_time,
+				&metrics_first_byte_time_type,
+				(trace->first[TRACE_SERVER] - from) / 1000);
+}
+
+
+void metrics_tcp_info(metrics_t *m, int side,
+		      const vanessa_socket_tcp_info_t *info)
+{
+	if (!m)
+		return;
+
+	metrics_add(m->retransmits[side], info->retrans);
+	metrics_observe(&m->rtt[side], &metrics_rtt_type[side], info->rtt);
+	if (info->delivery_rate)
+		metrics_observe(&m->delivery_rate[side],
+				&metrics_delivery_rate_type[side],
+				info->delivery_rate);
+}
+
+
+/**********************************************************************
+ * metrics_sum
+ * Add up all slots
+ * pre: total: where to store the sum
+ * post: total holds the sum of each field over all slots
+ **********************************************************************/
+
+static void metrics_sum(metrics_t *total)
+{
+	uint64_t *t = (uint64_t *)total;
+	const uint64_t *p;
+	size_t i, j;
+
+	memset(total, 0, sizeof(*total));
+	for (i = 0; i < (size_t)metrics_nslot; i++) {
+		p = (const uint64_t *)(metrics + i);
+		for (j = 0; j < sizeof(*total) / sizeof(*t); j++)
+			t[j] += p[j];
+	}
+}
+
+
+static void metrics_print_counter(FILE *f, const char *name,
+				  const char *type, const char *help,
+				  uint64_t value)
+{
+	fprintf(f, "# HELP " METRICS_PREFIX "%s %s\n"
+		"# TYPE " METRICS_PREFIX "%s %s\n"
+		METRICS_PREFIX "%s %llu\n",
+		name, help, name, type, name, (unsigned long long)value);
+}
+
+
+static void metrics_print_histogram(FILE *f, const metrics_histogram_t *h,
+				    const metrics_histogram_type_t *type)
+{
+	uint64_t count = 0;
+	int i;
+
+	fprintf(f, "# HELP " METRICS_PREFIX "%s %s\n"
+		"# TYPE " METRICS_PREFIX "%s histogram\n",
+		type->name, type->help, type->name);
+	for (i = 0; i < type->nbound; i++) {
+		count += h->bucket[i];
+		/*
+		 * Bounds must be printed exactly, %g would round those of
+		 * bytes. Scaled bounds have at most 15 significant digits.
+		 */
+		if (type->scale == 1)
+			fprintf(f, METRICS_PREFIX "%s_bucket{le=\"%llu\"} "
+				"%llu\n", type->name,
+				(unsigned long long)type->bound[i],
+				(unsigned long long)count);
+		else
+			fprintf(f, METRICS_PREFIX "%s_bucket{le=\"%.15g\"} "
+				"%llu\n", type->name,
+				type->bound[i] / type->scale,
+				(unsigned long long)count);
+	}
+	count += h->bucket[i];
+	fprintf(f, METRICS_PREFIX "%s_bucket{le=\"+Inf\"} %llu\n"
+		METRICS_PREFIX "%s_sum %.6f\n"
+		METRICS_PREFIX "%s_count %llu\n",
+		type->name, (unsigned long long)count,
+		type->name, h->sum / type->scale,
+		type->name, (unsigned long long)h->count);
+}
+
+
+/**********************************************************************
+ * metrics_print_children
+ * Write the resource usage of children that have been reaped, from
+ * vanessa_socket_rusage_get(), in Prometheus text format
+ * pre: f: stream to write to
+ **********************************************************************/
+
+static void metrics_print_children(FILE *f)
+{
+	vanessa_socket_rusage_t r;
+	metrics_histogram_type_t cpu_type = {
+		"child_cpu_seconds",
+		"CPU time used by each child forked for a session.",
+		1000000.0, { 0 }, VANESSA_SOCKET_RUSAGE_BUCKETS - 1
+	};
+	metrics_histogram_type_t rss_type = {
+		"child_maxrss_bytes",
+		"Largest resident set size of each child forked for a session.",
+		1.0 / 1024, { 0 }, VANESSA_SOCKET_RUSAGE_BUCKETS - 1
+	};
+	metrics_histogram_t h;
+	int i;
+
+	vanessa_socket_rusage_get(&r);
+
+	fprintf(f, "# HELP " METRICS_PREFIX "children_total Children forked "
+		"for sessions that have been reaped.\n"
+		"# TYPE " METRICS_PREFIX "children_total counter\n"
+		METRICS_PREFIX "children_total{status=\"exited\"} %llu\n"
+		METRICS_PREFIX "children_total{status=\"failed\"} %llu\n"
+		METRICS_PREFIX "children_total{status=\"signaled\"} %llu\n",
+		(unsigned long long)r.exited, (unsigned long long)r.failed,
+		(unsigned long long)r.signaled);
+	fprintf(f, "# HELP " METRICS_PREFIX "child_cpu_seconds_total CPU "
+		"time used by children that have been reaped.\n"
+		"# TYPE " METRICS_PREFIX "child_cpu_seconds_total counter\n"
+		METRICS_PREFIX "child_cpu_seconds_total{mode=\"user\"} "
+		"%.6f\n"
+		METRICS_PREFIX "child_cpu_seconds_total{mode=\"system\"} "
+		"%.6f\n",
+		r.utime / 1000000.0, r.stime / 1000000.0);
+	fprintf(f, "# HELP " METRICS_PREFIX "child_context_switches_total "
+		"Context switches of children that have been reaped.\n"
+		"# TYPE " METRICS_PREFIX "child_context_switches_total "
+		"counter\n"
+		METRICS_PREFIX "child_context_switches_total"
+		"{kind=\"voluntary\"} %llu\n"
+		METRICS_PREFIX "child_context_switches_total"
+		"{kind=\"involuntary\"} %llu\n",
+		(unsigned long long)r.nvcsw, (unsigned long long)r.nivcsw);
+	fprintf(f, "# HELP " METRICS_PREFIX "child_cpu_max_seconds Most CPU "
+		"time used by a child that has been reaped.\n"
+		"# TYPE " METRICS_PREFIX "child_cpu_max_seconds gauge\n"
+		METRICS_PREFIX "child_cpu_max_seconds %.6f\n"
+		"# HELP " METRICS_PREFIX "child_maxrss_max_bytes Largest "
+		"resident set size of a child that has been reaped.\n"
+		"# TYPE " METRICS_PREFIX "child_maxrss_max_bytes gauge\n"
+		METRICS_PREFIX "child_maxrss_max_bytes %llu\n",
+		r.cpu_max / 1000000.0,
+		(unsigned long long)r.maxrss_max * 1024);
+
+	/* The library's buckets are not cumulative, as ours are not */
+	for (i = 0; i < VANESSA_SOCKET_RUSAGE_BUCKETS - 1; i++) {
+		cpu_type.bound[i] = (uint64_t)VANESSA_SOCKET_RUSAGE_CPU_MIN << i;
+		rss_type.bound[i] = (uint64_t)VANESSA_SOCKET_RUSAGE_RSS_MIN << i;
+	}
+
+	memset(&h, 0, sizeof(h));
+	for (i = 0; i < VANESSA_SOCKET_RUSAGE_BUCKETS; i++) {
+		h.bucket[i] = r.cpu[i];
+		h.count += r.cpu[i];
+	}
+	h.sum = r.utime + r.stime;
+	metrics_print_histogram(f, &h, &cpu_type);
+
+	memset(&h, 0, sizeof(h));
+	for (i = 0; i < VANESSA_SOCKET_RUSAGE_BUCKETS; i++) {
+		h.bucket[i] = r.rss[i];
+		h.count += r.rss[i];
+	}
+	h.sum = r.maxrss;
+	metrics_print_histogram(f, &h, &rss_type);
+}
+
+
+/**********************************************************************
+ * metrics_print
+ * Write metrics in Prometheus text format
+ * pre: f: stream to write to
+ * post: The sum of all slots is written to f
+ **********************************************************************/
+
+static void metrics_print(FILE *f)
+{
+	metrics_t t;
+	int i;
+
+	metrics_sum(&t);
+
+	metrics_print_counter(f, "accepts_total", "counter",
+			      "Connections accepted.", t.accepts);
+	metrics_print_counter(f, "accept_errors_total", "counter",
+			      "Errors accepting connections.",
+			      t.accept_errors);
+	/* Children can exit without counting themselves closed, say if
+	 * they are killed, but not without being reaped */
+	metrics_print_counter(f, "sessions_active", "gauge",
+			      "Sessions currently open.",
+			      metrics_children ?
+			      vanessa_socket_server_children() :
+			      t.accepts - t.sessions_closed);
+	metrics_print_counter(f, "connects_total", "counter",
+			      "Connections made to the server.", t.connects);
+	metrics_print_counter(f, "connect_failures_total", "counter",
+			      "Failed connections to the server.",
+			      t.connect_failures);
+	fprintf(f, "# HELP " METRICS_PREFIX "bytes_total Bytes relayed.\n"
+		"# TYPE " METRICS_PREFIX "bytes_total counter\n"
+		METRICS_PREFIX "bytes_total{direction=\"client_to_server\"} "
+		"%llu\n"
+		METRICS_PREFIX "bytes_total{direction=\"server_to_client\"} "
+		"%llu\n",
+		(unsigned long long)t.bytes[METRICS_C2S],
+		(unsigned long long)t.bytes[METRICS_S2C]);
+	metrics_print_counter(f, "mirrors_total", "counter",
+			      "Sessions mirrored to a shadow server.",
+			      t.mirrors);
+	metrics_print_counter(f, "mirror_drops_total", "counter",
+			      "Mirrored sessions whose shadow server was "
+			      "dropped.", t.mirror_drops);
+	metrics_print_counter(f, "mirror_bytes_total", "counter",
+			      "Bytes sent to shadow servers.",
+			      t.mirror_bytes);
+	metrics_print_histogram(f, &t.connect_time,
+				&metrics_connect_time_type);
+	metrics_print_histogram(f, &t.session_time,
+				&metrics_session_time_type);
+	metrics_print_histogram(f, &t.session_bytes,
+				&metrics_session_bytes_type);
+	metrics_print_histogram(f, &t.resolve_time,
+				&metrics_resolve_time_type);
+	metrics_print_histogram(f, &t.setup_time, &metrics_setup_time_type);
+	metrics_print_histogram(f, &t.first_byte_time,
+				&metrics_first_byte_time_type);
+	fprintf(f, "# HELP " METRICS_PREFIX "retransmits_total Segments "
+		"retransmitted by sessions that have closed.\n"
+		"# TYPE " METRICS_PREFIX "retransmits_total counter\n"
+		METRICS_PREFIX "retransmits_total{side=\"client\"} %llu\n"
+		METRICS_PREFIX "retransmits_total{side=\"server\"} %llu\n",
+		(unsigned long long)t.retransmits[METRICS_CLIENT],
+		(unsigned long long)t.retransmits[METRICS_SERVER]);
+	for (i = 0; i < 2; i++) {
+		metrics_print_histogram(f, &t.rtt[i], &metrics_rtt_type[i]);
+		metrics_print_histogram(f, &t.delivery_rate[i],
+					&metrics_delivery_rate_type[i]);
+	}
+	if (metrics_children)
+		metrics_print_children(f);
+}
+
+
+/**********************************************************************
+ * metrics_serve
+ * Answer one HTTP request for metrics
+ * pre: fd: accepted connection
+ * post: The request is read and ignored, whatever it is for, the
+ *       metrics are written in reply and fd is closed
+ **********************************************************************/
+
+static void metrics_serve(int fd)
+{
+	char buf[METRICS_REQUEST_MAX];
+	struct timeval tv;
+	size_t len = 0;
+	ssize_t bytes;
+	FILE *f;
+
+	/* Don't let a slow client hold up others for long */
+	tv.tv_sec = 1;
+	tv.tv_usec = 0;
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+	while (len < sizeof(buf) - 1) {
+		bytes = read(fd, buf + len, sizeof(buf) - 1 - len);
+		if (bytes < 0 && errno == EINTR)
+			continue;
+		if (bytes <= 0)
+			break;
+		len += bytes;
+		buf[len] = '\0';
+		if (strstr(buf, "\r\n\r\n") || strstr(buf, "\n\n"))
+			break;
+	}
+
+	f = fdopen(fd, "w");
+	if (!f) {
+		VANESSA_LOGGER_DEBUG_ERRNO("fdopen");
+		close(fd);
+		return;
+	}
+	fprintf(f, "HTTP/1.0 200 OK\r\n"
+		"Content-Type: text/plain; version=0.0.4\r\n"
+		"Connection: close\r\n"
+		"\r\n");
+	metrics_print(f);
+	fclose(f);
+}
+
+
+#ifdef HAVE_PTHREAD
+static void *metrics_thread(void *UNUSED(data))
+{
+	int fd;
+
+	for (;;) {
+		fd = accept(metrics_listen_socket, NULL, NULL);
+		if (fd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			VANESSA_LOGGER_DEBUG_ERRNO("accept");
+			sleep(1);
+			continue;
+		}
+		metrics_serve(fd);
+	}
+
+	return NULL;
+}
+#endif
+
+
+int metrics_init(options_t *opt, int nslot)
+{
+#ifdef HAVE_PTHREAD
+	const char *host;
+
+	if (!opt->metrics_port &&
+	    !vanessa_socket_host_is_unix(opt->metrics_host))
+		return 0;
+
+	metrics = mmap(NULL, sizeof(*metrics) * nslot,
+		       PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+	if (metrics == MAP_FAILED) {
+		metrics = NULL;
+		VANESSA_LOGGER_DEBUG_ERRNO("mmap");
+		return -1;
+	}
+	metrics_nslot = nslot;
+	metrics_children = opt->engine == ENGINE_FORK;
+
+	host = opt->metrics_host ? opt->metrics_host : "127.0.0.1";
+	metrics_listen_socket = vanessa_socket_server_bind(opt->metrics_port,
+							   host, 0);
+	if (metrics_listen_socket < 0) {
+		VANESSA_LOGGER_DEBUG("vanessa_socket_server_bind");
+		VANESSA_LOGGER_ERR_UNSAFE("Could not bind metrics to: %s:%s",
+					  host, str_null_safe(opt->metrics_port));
+		return -1;
+	}
+
+	if (ring_thread(metrics_thread, NULL) < 0) {
+		VANESSA_LOGGER_DEBUG("ring_thread");
+		return -1;
+	}
+
+	return 0;
+#else
+	if (!opt->metrics_port &&
+	    !vanessa_socket_host_is_unix(opt->metrics_host))
+		return 0;
+
+	VANESSA_LOGGER_ERR("Metrics are not supported on this platform");
+	return -1;
+#endif
+}
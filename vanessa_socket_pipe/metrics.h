@@ -0,0 +1,231 @@
+/**********************************************************************
+ * metrics.h                                               October 2026
+ * Simon Horman                                      horms@verge.net.au
+ *
+ * Counters and histograms, served in Prometheus text format
+ *
+ * vanessa_socket_pipe
+ * Trivial TCP/IP pipe based on libvanessa_socket
+ * Copyright (C) 1999-2008  Simon Horman <horms@verge.net.au>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307  USA
+ *
+ **********************************************************************/
+
+#ifndef METRICS_STIX
+#define METRICS_STIX
+
+#include "options.h"
+
+#include <stdint.h>
+#include <time.h>
+
+#define METRICS_BUCKETS 16
+
+/* Upper bounds of histogram buckets, the last is +Inf */
+typedef struct {
+	const char *name;
+	const char *help;
+	double scale;		/* Recorded values are divided by this */
+	uint64_t bound[METRICS_BUCKETS];
+	int nbound;
+} metrics_histogram_type_t;
+
+typedef struct {
+	uint64_t bucket[METRICS_BUCKETS + 1];
+	uint64_t sum;
+	uint64_t count;
+} metrics_histogram_t;
+
+#define METRICS_C2S 0		/* Client to server */
+#define METRICS_S2C 1		/* Server to client */
+
+#define METRICS_CLIENT 0	/* Connection to the client */
+#define METRICS_SERVER 1	/* Connection to the server */
+
+/*
+ * Metrics are kept in slots in memory that is shared with child
+ * processes. Forked children all update slot 0, so updates are atomic.
+ * Each thread of the epoll engine has its own slot, so updates do not
+ * contend for cache lines. Slots are added together when served.
+ */
+typedef struct {
+	uint64_t accepts;
+	uint64_t accept_errors;
+	uint64_t sessions_closed;
+	uint64_t connects;
+	uint64_t connect_failures;
+	uint64_t bytes[2];
+	uint64_t mirrors;
+	uint64_t mirror_drops;
+	uint64_t mirror_bytes;
+	metrics_histogram_t connect_time;
+	metrics_histogram_t session_time;
+	metrics_histogram_t session_bytes;
+	metrics_histogram_t resolve_time;
+	metrics_histogram_t setup_time;
+	metrics_histogram_t first_byte_time;
+	uint64_t retransmits[2];
+	metrics_histogram_t rtt[2];
+	metrics_histogram_t delivery_rate[2];
+} __attribute__((aligned(64))) metrics_t;
+
+
+/**********************************************************************
+ * metrics_init
+ * Set up metrics, if enabled by opt->metrics_port or opt->metrics_host
+ * pre: opt: options
+ *      nslot: number of slots, one for each thread that updates metrics
+ * post: Shared memory for the slots is mapped. A thread is started
+ *       that serves metrics over HTTP in Prometheus text format.
+ *       Should be called before forking so that children share
+ *       the slots.
+ * return: 0 on success, or if metrics are not enabled
+ *         -1 on error
+ **********************************************************************/
+
+int metrics_init(options_t *opt, int nslot);
+
+
+/**********************************************************************
+ * metrics_child
+ * Clean up after forking
+ * post: The socket metrics are served on is closed in this process,
+ *       the slots may still be updated
+ **********************************************************************/
+
+void metrics_child(void);
+
+
+/**********************************************************************
+ * metrics_unlink
+ * Clean up before exiting
+ * post: If metrics are served on a unix domain socket its path is
+ *       removed. Only to be called by the process that called
+ *       metrics_init().
+ **********************************************************************/
+
+void metrics_unlink(void);
+
+
+/**********************************************************************
+ * metrics_slot
+ * Get a slot to update metrics in
+ * pre: i: index of slot, less than the nslot given to metrics_init()
+ * return: slot
+ *         NULL if metrics are not enabled. The update functions
+ *         below do nothing if passed NULL.
+ **********************************************************************/
+
+metrics_t *metrics_slot(int i);
+
+
+/**********************************************************************
+ * metrics_now
+ * Get the current time from a monotonic clock
+ * pre: ts: where to store the time
+ * post: ts is filled in
+ **********************************************************************/
+
+void metrics_now(struct timespec *ts);
+
+
+/**********************************************************************
+ * metrics_accept
+ * metrics_accept_error
+ * Record an accepted connection, or an error accepting one
+ * pre: m: slot
+ **********************************************************************/
+
+void metrics_accept(metrics_t *m);
+void metrics_accept_error(metrics_t *m);
+
+
+/**********************************************************************
+ * metrics_connect
+ * Record the result of connecting to the server
+ * pre: m: slot
+ *      start: time the connection was started, from metrics_now()
+ *      ok: non-zero if the connection succeeded
+ * post: On success the time taken is recorded
+ **********************************************************************/
+
+void metrics_connect(metrics_t *m, const struct timespec *start, int ok);
+
+
+/**********************************************************************
+ * metrics_bytes
+ * Record bytes relayed
+ * pre: m: slot
+ *      dir: METRICS_C2S or METRICS_S2C
+ *      bytes: number of bytes
+ **********************************************************************/
+
+void metrics_bytes(metrics_t *m, int dir, size_t bytes);
+
+
+/**********************************************************************
+ * metrics_mirror
+ * Record the end of mirroring a session to a shadow server
+ * pre: m: slot
+ *      dropped: non-zero if the shadow server was dropped
+ *      bytes: bytes sent to the shadow server
+ **********************************************************************/
+
+void metrics_mirror(metrics_t *m, int dropped, size_t bytes);
+
+
+/**********************************************************************
+ * metrics_close
+ * Record the end of a session
+ * pre: m: slot
+ *      start: time the session was accepted, from metrics_now()
+ *      bytes: total bytes relayed in both directions
+ **********************************************************************/
+
+void metrics_close(metrics_t *m, const struct timespec *start,
+		   size_t bytes);
+
+
+/**********************************************************************
+ * metrics_trace
+ * Record the trace of a session that is closing
+ * pre: m: slot
+ *      trace: trace of the session
+ * post: The time taken to resolve the server, to set up the session
+ *       from accept until connected to the server, and for the server
+ *       to send its first byte are recorded, if the session got that
+ *       far
+ **********************************************************************/
+
+void metrics_trace(metrics_t *m, const vanessa_socket_trace_t *trace);
+
+
+/**********************************************************************
+ * metrics_tcp_info
+ * Record TCP_INFO of a connection of a session that is closing
+ * pre: m: slot
+ *      side: METRICS_CLIENT or METRICS_SERVER
+ *      info: TCP_INFO of the connection
+ * post: The round trip time, delivery rate, if known, and
+ *       retransmits are recorded
+ **********************************************************************/
+
+void metrics_tcp_info(metrics_t *m, int side,
+		      const vanessa_socket_tcp_info_t *info);
+
+
+#endif
@@ -0,0 +1,271 @@
+/**********************************************************************
+ * mirror.c                                                October 2026
+ * Simon Horman                                      horms@verge.net.au
+ *
+ * Copy of the data sent to the server, for a shadow server
+ *
+ * vanessa_socket_pipe
+ * Trivial TCP/IP pipe based on libvanessa_socket
+ * Copyright (C) 1999-2008  Simon Horman <horms@verge.net.au>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307  USA
+ *
+ **********************************************************************/
+
+#include "mirror.h"
+
+#include <errno.h>
+#include <sys/socket.h>
+
+/*
+ * The shadow server must never slow down the session it is a copy of,
+ * so it is only ever written to and read from without blocking. What
+ * it can't take straight away is queued, and if it falls so far behind
+ * that the queue fills it is dropped rather than waited for. A partial
+ * stream would be of no use to it, so it is not picked up again.
+ */
+
+/* Most reads of replies from the shadow server to discard at a time */
+#define MIRROR_DISCARD_READS 8
+
+struct mirror_struct {
+	int fd;				/* Shadow server, -1 once dropped */
+	int client;
+	int dropped;
+	ssize_t (*write_func)(int fd, const void *buf, size_t count,
+			      void *data);
+	void *data;
+	size_t sent;
+	size_t len;
+	size_t max;
+	char *queue;
+};
+
+
+static void mirror_drop(mirror_t *mi, const char *why)
+{
+	VANESSA_LOGGER_DEBUG_UNSAFE("dropping shadow server: %s", why);
+	if (close(mi->fd) < 0)
+		VANESSA_LOGGER_DEBUG_ERRNO("close");
+	mi->fd = -1;
+	mi->dropped = 1;
+}
+
+
+mirror_t *mirror_create(options_t *opt, int client,
+			ssize_t (*write_func)(int fd, const void *buf,
+					      size_t count, void *data),
+			void *data)
+{
+	mirror_t *mi;
+
+	mi = calloc(1, sizeof(*mi));
+	if (!mi) {
+		VANESSA_LOGGER_DEBUG_ERRNO("calloc");
+		return NULL;
+	}
+	mi->queue = malloc(opt->mirror_buffer);
+	if (!mi->queue) {
+		VANESSA_LOGGER_DEBUG_ERRNO("malloc");
+		free(mi);
+		return NULL;
+	}
+	mi->max = opt->mirror_buffer;
+	mi->client = client;
+	mi->write_func = write_func;
+	mi->data = data;
+
+	mi->fd = vanessa_socket_client_src_open(NULL, NULL, opt->mirror_host,
+						opt->mirror_port,
+						(opt->no_lookup ?
+						 VANESSA_SOCKET_NO_LOOKUP : 0) |
+						VANESSA_SOCKET_NONBLOCK);
+	if (mi->fd < 0) {
+		VANESSA_LOGGER_DEBUG("vanessa_socket_client_src_open");
+		mi->dropped = 1;
+	}
+
+	return mi;
+}
+
+
+/**********************************************************************
+ * mirror_flush
+ * Send as much queued data to the shadow server as it will take
+ * without blocking
+ * pre: mi: mirror state, with a shadow server
+ * post: Data that is sent is removed from the queue. If sending fails
+ *       the shadow server is dropped.
+ * return: 0 on success, even if some data is still queued
+ *         -1 if the shadow server was dropped
+ **********************************************************************/
+
+static int mirror_flush(mirror_t *mi)
+{
+	ssize_t bytes;
+
+	if (!mi->len)
+		return 0;
+
+	bytes = send(mi->fd, mi->queue, mi->len, MSG_DONTWAIT | MSG_NOSIGNAL);
+	if (bytes < 0) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+			return 0;
+		mirror_drop(mi, strerror(errno));
+		return -1;
+	}
+	mi->sent += bytes;
+	mi->len -= bytes;
+	memmove(mi->queue, mi->queue + bytes, mi->len);
+
+	return 0;
+}
+
+
+/**********************************************************************
+ * mirror_send
+ * Send data to the shadow server without blocking
+ * pre: mi: mirror state, with a shadow server
+ *      buf: data to send
+ *      count: number of bytes in buf
+ * post: buf is sent after anything already queued, and what can't be
+ *       sent yet is queued. The shadow server is dropped if sending
+ *       fails or the queue is too small.
+ **********************************************************************/
+
+static void mirror_send(mirror_t *mi, const char *buf, size_t count)
+{
+	ssize_t bytes;
+
+	if (mirror_flush(mi) < 0)
+		return;
+
+	if (!mi->len) {
+		bytes = send(mi->fd, buf, count, MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (bytes < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				mirror_drop(mi, strerror(errno));
+				return;
+			}
+			bytes = 0;
+		}
+		mi->sent += bytes;
+		buf += bytes;
+		count -= bytes;
+	}
+
+	if (!count)
+		return;
+	if (count > mi->max - mi->len) {
+		mirror_drop(mi, "fell behind");
+		return;
+	}
+	memcpy(mi->queue + mi->len, buf, count);
+	mi->len += count;
+}
+
+
+/**********************************************************************
+ * mirror_discard
+ * Read and throw away whatever the shadow server has sent, so that it
+ * is not held up by its own replies going unread
+ * pre: mi: mirror state, with a shadow server
+ * post: Data is read until there is none or MIRROR_DISCARD_READS reads
+ *       have been made. If reading fails the shadow server is dropped.
+ **********************************************************************/
+
+static void mirror_discard(mirror_t *mi)
+{
+	char buf[BUFFER_SIZE];
+	ssize_t bytes;
+	int i;
+
+	for (i = 0; i < MIRROR_DISCARD_READS; i++) {
+		bytes = recv(mi->fd, buf, sizeof(buf), MSG_DONTWAIT);
+		if (bytes > 0)
+			continue;
+		if (bytes < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+			mirror_drop(mi, strerror(errno));
+		break;
+	}
+}
+
+
+void mirror_proxy(mirror_t *mi, const struct sockaddr *from,
+		  const struct sockaddr *to)
+{
+	char buf[VANESSA_SOCKET_PROXY_V2_MAX];
+	ssize_t len;
+
+	if (mi->fd < 0)
+		return;
+
+	len = vanessa_socket_proxy_v2_build(buf, sizeof(buf), from, to);
+	if (len < 0) {
+		VANESSA_LOGGER_DEBUG("vanessa_socket_proxy_v2_build");
+		mirror_drop(mi, "could not build PROXY header");
+		return;
+	}
+	mirror_send(mi, buf, len);
+}
+
+
+int mirror_destroy(mirror_t *mi, size_t *bytes)
+{
+	int dropped;
+
+	if (!mi)
+		return 0;
+
+	if (mi->fd >= 0 && !mirror_flush(mi)) {
+		if (mi->len)
+			VANESSA_LOGGER_DEBUG("shadow server misses the end "
+					     "of the session");
+		if (close(mi->fd) < 0)
+			VANESSA_LOGGER_DEBUG_ERRNO("close");
+	}
+	if (bytes)
+		*bytes = mi->sent;
+	dropped = mi->dropped;
+	free(mi->queue);
+	free(mi);
+
+	return dropped;
+}
+
+
+ssize_t mirror_write(int fd, const void *buf, size_t count, void *data)
+{
+	mirror_t *mi = (mirror_t *)data;
+	ssize_t bytes;
+
+	bytes = mi->write_func(fd, buf, count, mi->data);
+	if (mi->fd < 0)
+		return bytes;
+
+	/* Only what the server took, so the shadow sees the same stream.
+	 * Writes to the client are a chance to catch up on the queue */
+	if (fd != mi->client) {
+		if (bytes > 0)
+			mirror_send(mi, buf, bytes);
+	} else if (mirror_flush(mi) < 0) {
+		return bytes;
+	}
+	if (mi->fd >= 0)
+		mirror_discard(mi);
+
+	return bytes;
+}
@@ -0,0 +1,111 @@
+/**********************************************************************
+ * mirror.h                                                October 2026
+ * Simon Horman                                      horms@verge.net.au
+ *
+ * Copy of the data sent to the server, for a shadow server
+ *
+ * vanessa_socket_pipe
+ * Trivial TCP/IP pipe based on libvanessa_socket
+ * Copyright (C) 1999-2008  Simon Horman <horms@verge.net.au>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307  USA
+ *
+ **********************************************************************/
+
+#ifndef MIRROR_STIX
+#define MIRROR_STIX
+
+#include "options.h"
+
+typedef struct mirror_struct mirror_t;
+
+
+/**********************************************************************
+ * mirror_create
+ * Start mirroring a session to a shadow server
+ * pre: opt: options, opt->mirror_host, opt->mirror_port, opt->no_lookup
+ *           and opt->mirror_buffer are used
+ *      client: connection to the client, data written to any other
+ *              file descriptor is for the server
+ *      write_func: function to write relayed data with
+ *      data: opaque data to pass to write_func
+ * post: A non-blocking connection to the shadow server is started. If
+ *       that fails then the session is relayed as usual, without a
+ *       mirror. Should be called before connecting to the real server,
+ *       so that it is the real server that is recorded in the trace
+ *       and scoreboard of the session.
+ * return: mirror state
+ *         NULL on error
+ **********************************************************************/
+
+mirror_t *mirror_create(options_t *opt, int client,
+			ssize_t (*write_func)(int fd, const void *buf,
+					      size_t count, void *data),
+			void *data);
+
+
+/**********************************************************************
+ * mirror_proxy
+ * Send a PROXY protocol v2 header to the shadow server
+ * pre: mi: mirror state
+ *      from: address of the client
+ *      to: local address the client connected to
+ * post: The header is queued ahead of any data
+ **********************************************************************/
+
+void mirror_proxy(mirror_t *mi, const struct sockaddr *from,
+		  const struct sockaddr *to);
+
+
+/**********************************************************************
+ * mirror_destroy
+ * Stop mirroring a session
+ * pre: mi: mirror state, may be NULL
+ *      bytes: where to store the number of bytes sent to the shadow
+ *             server, may be NULL
+ * post: As much queued data as can be sent without blocking is sent,
+ *       the connection to the shadow server is closed and mi is freed
+ * return: 1 if the shadow server was dropped before the session ended
+ *         0 otherwise
+ **********************************************************************/
+
+int mirror_destroy(mirror_t *mi, size_t *bytes);
+
+
+/**********************************************************************
+ * mirror_write
+ * Write relayed data, copying data written to the server to the
+ * shadow server. Intended to be passed to vanessa_socket_pipe_func()
+ * pre: fd: file descriptor to write to
+ *      buf: data to write
+ *      count: number of bytes in buf
+ *      data: mirror state
+ * post: buf is written using the write_func given to mirror_create().
+ *       If fd is not the client then what was written is also sent to the
+ *       shadow server without blocking, queueing what can't be sent
+ *       yet. If the queue would grow past opt->mirror_buffer bytes, or
+ *       sending fails, the shadow server is dropped for the rest of
+ *       the session. Whichever way buf is going, as much queued data
+ *       as the shadow server will take is sent and anything it has
+ *       sent is read and discarded, so that it keeps up while data
+ *       only flows to the client.
+ * return: as for the write_func given to mirror_create()
+ **********************************************************************/
+
+ssize_t mirror_write(int fd, const void *buf, size_t count, void *data);
+
+
+#endif
@@ -29,6 +29,13 @@
 #include "options.h"
 #include "unused.h"
 
+#include <errno.h>
+
+#define CONFIG_LINE 1024
+
+/* Command line options that the configuration file is applied to */
+static options_t options_cmdline;
+
 
 /***********************************************************************
  * opt_p
@@ -48,7 +55,7 @@ opt_p(char **opt, const char *value, const int flag)
 	if (!(flag & OPT_NOT_SET) && !opt)
 		free(opt);
 	if (!value) {
-		opt = NULL;
+		*opt = NULL;
 		return 0;
 	}
 	*opt = strdup(value);
@@ -78,6 +85,103 @@ opt_i(int *opt, const int value, const int UNUSED(flag))
 }
 
 
+/**********************************************************************
+ * config_file_read
+ * Read a configuration file
+ * Each line is the long name of an option followed by its value,
+ * separated by whitespace. Everything after a # is a comment. Only
+ * options that can be changed by reloading the file are allowed:
+ * acl_file, connection_limit, listen_host, listen_port, outgoing_host,
+ * outgoing_port, prefix_limit, prefix_rate, source_limit, source_rate
+ * and timeout.
+ * pre: file: name of file to read
+ *      opt: options to apply the settings of the file to
+ * post: The settings are applied to opt. Errors are reported on
+ *       stderr, and opt may be partly updated if there is one.
+ * return: 0 on success
+ *         -1 on error
+ **********************************************************************/
+
+static int config_file_read(const char *file, options_t *opt)
+{
+	char line[CONFIG_LINE];
+	char *name, *value, *p;
+	unsigned int lineno = 0;
+	int status = -1;
+	FILE *stream;
+
+	stream = fopen(file, "r");
+	if (!stream) {
+		fprintf(stderr, "options: %s: %s\n", file, strerror(errno));
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), stream)) {
+		lineno++;
+		if ((p = strchr(line, '#')))
+			*p = '\0';
+		name = strtok(line, " \t\r\n");
+		if (!name)
+			continue;
+		value = strtok(NULL, " \t\r\n");
+		if (!value || strtok(NULL, " \t\r\n")) {
+			fprintf(stderr, "options: %s:%u: expected a name and "
+				"a value\n", file, lineno);
+			goto out;
+		}
+
+		if ((!strcmp(name, "connection_limit") ||
+		     !strcmp(name, "prefix_limit") ||
+		     !strcmp(name, "prefix_rate") ||
+		     !strcmp(name, "source_limit") ||
+		     !strcmp(name, "source_rate") ||
+		     !strcmp(name, "timeout")) &&
+		    !vanessa_socket_str_is_digit(value)) {
+			fprintf(stderr, "options: %s:%u: %s must be a "
+				"number\n", file, lineno, name);
+			goto out;
+		}
+
+		if (!strcmp(name, "connection_limit")) {
+			opt_i(&opt->connection_limit, atoi(value), 0);
+		} else if (!strcmp(name, "prefix_limit")) {
+			opt_i(&opt->prefix_limit, atoi(value), 0);
+		} else if (!strcmp(name, "prefix_rate")) {
+			opt_i(&opt->prefix_rate, atoi(value), 0);
+		} else if (!strcmp(name, "source_limit")) {
+			opt_i(&opt->source_limit, atoi(value), 0);
+		} else if (!strcmp(name, "source_rate")) {
+			opt_i(&opt->source_rate, atoi(value), 0);
+		} else if (!strcmp(name, "timeout")) {
+			opt_i(&opt->timeout, atoi(value), 0);
+		} else if (!strcmp(name, "acl_file")) {
+			opt_p(&opt->acl_file, value, OPT_NOT_SET);
+		} else if (!strcmp(name, "listen_host")) {
+			opt_p(&opt->listen_host, value, OPT_NOT_SET);
+		} else if (!strcmp(name, "listen_port")) {
+			opt_p(&opt->listen_port, value, OPT_NOT_SET);
+		} else if (!strcmp(name, "outgoing_host")) {
+			opt_p(&opt->outgoing_host, value, OPT_NOT_SET);
+		} else if (!strcmp(name, "outgoing_port")) {
+			opt_p(&opt->outgoing_port, value, OPT_NOT_SET);
+		} else {
+			fprintf(stderr, "options: %s:%u: unknown or "
+				"unreloadable option: %s\n", file, lineno,
+				name);
+			goto out;
+		}
+	}
+	if (ferror(stream)) {
+		fprintf(stderr, "options: %s: %s\n", file, strerror(errno));
+		goto out;
+	}
+
+	status = 0;
+out:
+	fclose(stream);
+	return status;
+}
+
 
 /**********************************************************************
  * options
@@ -97,21 +201,78 @@ int options(int argc, char **argv, options_t *opt){
 
   const struct poptOption pop_opt[] =
   {
+    {"accept_proxy",     'A', POPT_ARG_NONE,   NULL, 'A', NULL, NULL},
+    {"access_log",       'a', POPT_ARG_STRING, NULL, 'a', NULL, NULL},
+    {"acl_file",         'C', POPT_ARG_STRING, NULL, 'C', NULL, NULL},
+    {"capture_file",     'F', POPT_ARG_STRING, NULL, 'F', NULL, NULL},
+    {"capture_sample",   'N', POPT_ARG_STRING, NULL, 'N', NULL, NULL},
+    {"compress",         'z', POPT_ARG_STRING, NULL, 'z', NULL, NULL},
+    {"config_file",      'f', POPT_ARG_STRING, NULL, 'f', NULL, NULL},
     {"connection_limit", 'c', POPT_ARG_STRING, NULL, 'c', NULL, NULL},
     {"debug",            'd', POPT_ARG_NONE,   NULL, 'd', NULL, NULL},
+    {"drain_timeout",    'D', POPT_ARG_STRING, NULL, 'D', NULL, NULL},
+    {"engine",           'E', POPT_ARG_STRING, NULL, 'E', NULL, NULL},
     {"help",             'h', POPT_ARG_NONE,   NULL, 'h', NULL, NULL},
+    {"lifetime",         'e', POPT_ARG_STRING, NULL, 'e', NULL, NULL},
     {"listen_host",      'l', POPT_ARG_STRING, NULL, 'l', NULL, NULL},
     {"listen_port",      'L', POPT_ARG_STRING, NULL, 'L', NULL, NULL},
+    {"metrics_host",     'm', POPT_ARG_STRING, NULL, 'm', NULL, NULL},
+    {"metrics_port",     'M', POPT_ARG_STRING, NULL, 'M', NULL, NULL},
+    {"mirror_buffer",    'w', POPT_ARG_STRING, NULL, 'w', NULL, NULL},
+    {"mirror_host",      'y', POPT_ARG_STRING, NULL, 'y', NULL, NULL},
+    {"mirror_port",      'Y', POPT_ARG_STRING, NULL, 'Y', NULL, NULL},
     {"no_lookup",        'n', POPT_ARG_NONE,   NULL, 'n', NULL, NULL},
     {"outgoing_host",    'o', POPT_ARG_STRING, NULL, 'o', NULL, NULL},
     {"outgoing_port",    'O', POPT_ARG_STRING, NULL, 'O', NULL, NULL},
+    {"prefix_limit",     'S', POPT_ARG_STRING, NULL, 'S', NULL, NULL},
+    {"prefix_rate",      'R', POPT_ARG_STRING, NULL, 'R', NULL, NULL},
     {"quiet",            'q', 0,               NULL, 'q', NULL, NULL},
+    {"scoreboard",       'k', POPT_ARG_STRING, NULL, 'k', NULL, NULL},
+    {"send_proxy",       'P', POPT_ARG_NONE,   NULL, 'P', NULL, NULL},
+    {"sockbuf_max",      'b', POPT_ARG_STRING, NULL, 'b', NULL, NULL},
+    {"sockbuf_min",      'B', POPT_ARG_STRING, NULL, 'B', NULL, NULL},
+    {"source_limit",     's', POPT_ARG_STRING, NULL, 's', NULL, NULL},
+    {"source_rate",      'r', POPT_ARG_STRING, NULL, 'r', NULL, NULL},
+    {"tcp_info",         'i', POPT_ARG_NONE,   NULL, 'i', NULL, NULL},
+    {"threads",          'T', POPT_ARG_STRING, NULL, 'T', NULL, NULL},
     {"timeout",          't', POPT_ARG_STRING, NULL, 't', NULL, NULL},
+    {"trace",            'x', POPT_ARG_NONE,   NULL, 'x', NULL, NULL},
+    {"udp",              'u', POPT_ARG_NONE,   NULL, 'u', NULL, NULL},
+    {"udp_gso",          'G', POPT_ARG_NONE,   NULL, 'G', NULL, NULL},
     {NULL,               0,   0,               NULL, 0,   NULL, NULL}
   };
 
   if(argc==0 || argv==NULL) return(0);
 
+	if (opt_i(&opt->accept_proxy, DEFAULT_ACCEPT_PROXY, OPT_NOT_SET)) {
+		VANESSA_LOGGER_DEBUG("Error setting default values");
+		return -1;
+	}
+	if (opt_p(&opt->access_log, DEFAULT_ACCESS_LOG, OPT_NOT_SET)) {
+		VANESSA_LOGGER_DEBUG("Error setting default values");
+		return -1;
+	}
+	if (opt_p(&opt->acl_file, DEFAULT_ACL_FILE, OPT_NOT_SET)) {
+		VANESSA_LOGGER_DEBUG("Error setting default values");
+		return -1;
+	}
+	if (opt_p(&opt->capture_file, DEFAULT_CAPTURE_FILE, OPT_NOT_SET)) {
+		VANESSA_LOGGER_DEBUG("Error setting default values");
+		return -1;
+	}
+	if (opt_i(&opt->capture_sample, DEFAULT_CAPTURE_SAMPLE,
+		  OPT_NOT_SET)) {
+		VANESSA_LOGGER_DEBUG("Error setting default values");
+		return -1;
+	}
+	if (opt_i(&opt->compress, DEFAULT_COMPRESS, OPT_NOT_SET)) {
+		VANESSA_LOGGER_DEBUG("Error setting default values");
+		return -1;
+	}
+	if (opt_p(&opt->config_file, DEFAULT_CONFIG_FILE, OPT_NOT_SET)) {
+		VANESSA_LOGGER_DEBUG("Error setting default values");
+		return -1;
+	}
 	if (opt_i(&opt->connection_limit, DEFAULT_CONNECTION_LIMIT,
 		  OPT_NOT_SET)) {
 		VANESSA_LOGGER_DEBUG("Error setting default values");
@@ -121,6 +282,18 @@ int options(int argc, char **argv, options_t *opt){
 		VANESSA_LOGGER_DEBUG("Error setting default values");
 		return -1;
 	}
+	if (opt_i(&opt->drain_timeout, DEFAULT_DRAIN_TIMEOUT, OPT_NOT_SET)) {
+		VANESSA_LOGGER_DEBUG("Error setting default values");
+		return -1;
+	}
+	if (opt_i(&opt->engine, DEFAULT_ENGINE, OPT_NOT_SET)) {
+		VANESSA_LOGGER_DEBUG("Error setting default values");
+		return -1;
+	}
+	if (opt_i(&opt->lifetime, DEFAULT_LIFETIME, OPT_NOT_SET)) {
+		VANESSA_LOGGER_DEBUG("Error setting default values");
+		return -1;
+	}
 	if (opt_p(&opt->listen_host, DEFAULT_LISTEN_HOST, OPT_NOT_SET)) {
 		VANESSA_LOGGER_DEBUG("Error setting default values");
 		return -1;
@@ -129,6 +302,26 @@ int options(int argc, char **argv, options_t *opt){
 		VANESSA_LOGGER_DEBUG("Error setting default values");
 		return -1;
 	}
+	if (opt_p(&opt->metrics_host, DEFAULT_METRICS_HOST, OPT_NOT_SET)) {
+		VANESSA_LOGGER_DEBUG("Error setting default values");
+		return -1;
+	}
+	if (opt_p(&opt->metrics_port, DEFAULT_METRICS_PORT, OPT_NOT_SET)) {
+		VANESSA_LOGGER_DEBUG("Error setting default values");
+		return -1;
+	}
+	if (opt_i(&opt->mirror_buffer, DEFAULT_MIRROR_BUFFER, OPT_NOT_SET)) {
+		VANESSA_LOGGER_DEBUG("Error setting default values");
+		return -1;
+	}
+	if (opt_p(&opt->mirror_host, DEFAULT_MIRROR_HOST, OPT_NOT_SET)) {
+		VANESSA_LOGGER_DEBUG("Error setting default values");
+		return -1;
+	}
+	if (opt_p(&opt->mirror_port, DEFAULT_MIRROR_PORT, OPT_NOT_SET)) {
+		VANESSA_LOGGER_DEBUG("Error setting default values");
+		return -1;
+	}
 	if (opt_i(&opt->no_lookup, DEFAULT_NO_LOOKUP, OPT_NOT_SET)) {
 		VANESSA_LOGGER_DEBUG("Error setting default values");
 		return -1;
@@ -141,14 +334,62 @@ int options(int argc, char **argv, options_t *opt){
 		VANESSA_LOGGER_DEBUG("Error setting default values");
 		return -1;
 	}
+	if (opt_i(&opt->prefix_limit, DEFAULT_PREFIX_LIMIT, OPT_NOT_SET)) {
+		VANESSA_LOGGER_DEBUG("Error setting default values");
+		return -1;
+	}
+	if (opt_i(&opt->prefix_rate, DEFAULT_PREFIX_RATE, OPT_NOT_SET)) {
+		VANESSA_LOGGER_DEBUG("Error setting default values");
+		return -1;
+	}
 	if (opt_i(&opt->quiet, DEFAULT_QUIET, OPT_NOT_SET)) {
 		VANESSA_LOGGER_DEBUG("Error setting default values");
 		return -1;
 	}
+	if (opt_p(&opt->scoreboard, DEFAULT_SCOREBOARD, OPT_NOT_SET)) {
+		VANESSA_LOGGER_DEBUG("Error setting default values");
+		return -1;
+	}
+	if (opt_i(&opt->sockbuf_max, DEFAULT_SOCKBUF_MAX, OPT_NOT_SET)) {
+		VANESSA_LOGGER_DEBUG("Error setting default values");
+		return -1;
+	}
+	if (opt_i(&opt->sockbuf_min, DEFAULT_SOCKBUF_MIN, OPT_NOT_SET)) {
+		VANESSA_LOGGER_DEBUG("Error setting default values");
+		return -1;
+	}
+	if (opt_i(&opt->source_limit, DEFAULT_SOURCE_LIMIT, OPT_NOT_SET)) {
+		VANESSA_LOGGER_DEBUG("Error setting default values");
+		return -1;
+	}
+	if (opt_i(&opt->source_rate, DEFAULT_SOURCE_RATE, OPT_NOT_SET)) {
+		VANESSA_LOGGER_DEBUG("Error setting default values");
+		return -1;
+	}
+	if (opt_i(&opt->tcp_info, DEFAULT_TCP_INFO, OPT_NOT_SET)) {
+		VANESSA_LOGGER_DEBUG("Error setting default values");
+		return -1;
+	}
+	if (opt_i(&opt->threads, DEFAULT_THREADS, OPT_NOT_SET)) {
+		VANESSA_LOGGER_DEBUG("Error setting default values");
+		return -1;
+	}
 	if (opt_i(&opt->timeout, DEFAULT_TIMEOUT, OPT_NOT_SET)) {
 		VANESSA_LOGGER_DEBUG("Error setting default values");
 		return -1;
 	}
+	if (opt_i(&opt->trace, DEFAULT_TRACE, OPT_NOT_SET)) {
+		VANESSA_LOGGER_DEBUG("Error setting default values");
+		return -1;
+	}
+	if (opt_i(&opt->udp, DEFAULT_UDP, OPT_NOT_SET)) {
+		VANESSA_LOGGER_DEBUG("Error setting default values");
+		return -1;
+	}
+	if (opt_i(&opt->udp_gso, DEFAULT_UDP_GSO, OPT_NOT_SET)) {
+		VANESSA_LOGGER_DEBUG("Error setting default values");
+		return -1;
+	}
 
 
   context= poptGetContext(
@@ -162,6 +403,35 @@ int options(int argc, char **argv, options_t *opt){
   while ((c=poptGetNextOpt(context)) >= 0){
     optarg=(char *)poptGetOptArg(context);
     switch (c){
+      case 'A':
+	opt_i(&opt->accept_proxy, 1, 0);
+	break;
+      case 'a':
+        opt_p(&opt->access_log, optarg, 0);
+	break;
+      case 'C':
+        opt_p(&opt->acl_file, optarg, 0);
+	break;
+      case 'F':
+        opt_p(&opt->capture_file, optarg, 0);
+	break;
+      case 'N':
+	if(!vanessa_socket_str_is_digit(optarg) || !atoi(optarg)){
+	  usage(-1);
+	}
+	opt_i(&opt->capture_sample, atoi(optarg), 0);
+	break;
+      case 'z':
+	if(!strcmp(optarg, "client")){
+	  opt_i(&opt->compress, COMPRESS_CLIENT, 0);
+	}
+	else if(!strcmp(optarg, "server")){
+	  opt_i(&opt->compress, COMPRESS_SERVER, 0);
+	}
+	else {
+	  usage(-1);
+	}
+	break;
       case 'c':
 	if(!vanessa_socket_str_is_digit(optarg)){ usage(-1); }
 	opt_i(&opt->connection_limit, atoi(optarg), 0);
@@ -169,18 +439,69 @@ int options(int argc, char **argv, options_t *opt){
       case 'd':
 	opt_i(&opt->debug, 1, 0);
 	break;
+      case 'D':
+	if(!vanessa_socket_str_is_digit(optarg)){ usage(-1); }
+	opt_i(&opt->drain_timeout, atoi(optarg), 0);
+	break;
+      case 'f':
+        opt_p(&opt->config_file, optarg, 0);
+	break;
+      case 'E':
+	if(!strcmp(optarg, "fork")){
+	  opt_i(&opt->engine, ENGINE_FORK, 0);
+	}
+	else if(!strcmp(optarg, "epoll")){
+	  opt_i(&opt->engine, ENGINE_EPOLL, 0);
+	}
+	else {
+	  usage(-1);
+	}
+	break;
       case 'h':
 	usage(0);
 	break;
+      case 'e':
+	if(!vanessa_socket_str_is_digit(optarg)){ usage(-1); }
+	opt_i(&opt->lifetime, atoi(optarg), 0);
+	break;
       case 'l':
         opt_p(&opt->listen_host, optarg, 0);
 	break;
       case 'L':
         opt_p(&opt->listen_port, optarg, 0);
 	break;
+      case 'm':
+        opt_p(&opt->metrics_host, optarg, 0);
+	break;
+      case 'M':
+        opt_p(&opt->metrics_port, optarg, 0);
+	break;
+      case 'w':
+	if(!vanessa_socket_str_is_digit(optarg) || !atoi(optarg)){
+	  usage(-1);
+	}
+	opt_i(&opt->mirror_buffer, atoi(optarg), 0);
+	break;
+      case 'y':
+        opt_p(&opt->mirror_host, optarg, 0);
+	break;
+      case 'Y':
+        opt_p(&opt->mirror_port, optarg, 0);
+	break;
       case 'n':
 	opt_i(&opt->no_lookup, 1, 0);
 	break;
+      case 'P':
+	opt_i(&opt->send_proxy, 1, 0);
+	break;
+      case 'b':
+	if(!vanessa_socket_str_is_digit(optarg)){ usage(-1); }
+	opt_i(&opt->sockbuf_max, atoi(optarg), 0);
+	break;
+      case 'B':
+	if(!vanessa_socket_str_is_digit(optarg)){ usage(-1); }
+	opt_i(&opt->sockbuf_min, atoi(optarg), 0);
+	break;
       case 'o':
         opt_p(&opt->outgoing_host, optarg, 0);
 	break;
@@ -190,10 +511,47 @@ int options(int argc, char **argv, options_t *opt){
       case 'q':
         opt_i(&opt->quiet, 1, 0);
 	break;
+      case 'k':
+        opt_p(&opt->scoreboard, optarg, 0);
+	break;
+      case 'R':
+	if(!vanessa_socket_str_is_digit(optarg)){ usage(-1); }
+	opt_i(&opt->prefix_rate, atoi(optarg), 0);
+	break;
+      case 'r':
+	if(!vanessa_socket_str_is_digit(optarg)){ usage(-1); }
+	opt_i(&opt->source_rate, atoi(optarg), 0);
+	break;
+      case 'S':
+	if(!vanessa_socket_str_is_digit(optarg)){ usage(-1); }
+	opt_i(&opt->prefix_limit, atoi(optarg), 0);
+	break;
+      case 's':
+	if(!vanessa_socket_str_is_digit(optarg)){ usage(-1); }
+	opt_i(&opt->source_limit, atoi(optarg), 0);
+	break;
+      case 'i':
+        opt_i(&opt->tcp_info, 1, 0);
+	break;
+      case 'T':
+        if(!vanessa_socket_str_is_digit(optarg) || !atoi(optarg)){
+          usage(-1);
+        }
+	opt_i(&opt->threads, atoi(optarg), 0);
+	break;
       case 't':
         if(!vanessa_socket_str_is_digit(optarg)){ usage(-1); }
 	opt_i(&opt->timeout, atoi(optarg), 0);
 	break;
+      case 'x':
+        opt_i(&opt->trace, 1, 0);
+	break;
+      case 'u':
+        opt_i(&opt->udp, 1, 0);
+	break;
+      case 'G':
+        opt_i(&opt->udp_gso, 1, 0);
+	break;
     }
   }
 
@@ -207,12 +565,80 @@ int options(int argc, char **argv, options_t *opt){
     usage(-1);
   }
 
-  if(opt->outgoing_host==NULL || opt->listen_port==NULL){
+  if(opt->config_file!=NULL){
+    options_cmdline=*opt;
+    if(config_file_read(opt->config_file, opt)<0){
+      exit(-1);
+    }
+  }
+
+  if(opt->outgoing_host==NULL || (opt->listen_port==NULL &&
+     !vanessa_socket_host_is_unix(opt->listen_host))){
+    usage(-1);
+  }
+  if(opt->udp && (vanessa_socket_host_is_unix(opt->listen_host) ||
+     vanessa_socket_host_is_unix(opt->outgoing_host))){
+    fprintf(stderr, "options: unix domain sockets can't be used with "
+            "-u|--udp\n");
+    usage(-1);
+  }
+  if(opt->udp && (opt->access_log!=NULL || opt->acl_file!=NULL ||
+     opt->metrics_port!=NULL ||
+     vanessa_socket_host_is_unix(opt->metrics_host) ||
+     opt->trace || opt->tcp_info || opt->drain_timeout || opt->lifetime ||
+     opt->source_limit || opt->source_rate ||
+     opt->prefix_limit || opt->prefix_rate ||
+     opt->accept_proxy || opt->send_proxy || opt->sockbuf_max ||
+     opt->engine!=ENGINE_FORK)){
+    fprintf(stderr, "options: -a, -A, -b, -C, -D, -e, -E epoll, -i, -M, "
+            "-P, -r, -R, -s, -S and -x can't be used with -u|--udp\n");
+    usage(-1);
+  }
+  if(opt->sockbuf_max && opt->sockbuf_min>opt->sockbuf_max){
+    fprintf(stderr, "options: -B|--sockbuf_min must not be more than "
+            "-b|--sockbuf_max\n");
+    usage(-1);
+  }
+  if(opt->scoreboard!=NULL && (opt->engine!=ENGINE_FORK || opt->udp)){
+    fprintf(stderr, "options: -k|--scoreboard requires -E|--engine fork "
+            "and TCP\n");
+    usage(-1);
+  }
+  if(opt->capture_file!=NULL && (opt->engine!=ENGINE_FORK || opt->udp)){
+    fprintf(stderr, "options: -F|--capture_file requires -E|--engine fork "
+            "and TCP\n");
+    usage(-1);
+  }
+  if(opt->compress!=COMPRESS_NONE && (opt->engine!=ENGINE_FORK ||
+     opt->udp)){
+    fprintf(stderr, "options: -z|--compress requires -E|--engine fork "
+            "and TCP\n");
+    usage(-1);
+  }
+  if(opt->mirror_host!=NULL && (opt->engine!=ENGINE_FORK || opt->udp)){
+    fprintf(stderr, "options: -y|--mirror_host requires -E|--engine fork "
+            "and TCP\n");
+    usage(-1);
+  }
+  if(opt->mirror_host!=NULL && opt->compress==COMPRESS_SERVER){
+    fprintf(stderr, "options: -y|--mirror_host can't be used with "
+            "-z|--compress server\n");
+    usage(-1);
+  }
+  if(opt->threads>1 && opt->engine!=ENGINE_EPOLL){
+    fprintf(stderr, "options: -T|--threads requires -E|--engine epoll\n");
     usage(-1);
   }
   if(opt->outgoing_port==NULL){
     opt->outgoing_port=opt->listen_port;
   }
+  if(opt->outgoing_port==NULL &&
+     !vanessa_socket_host_is_unix(opt->outgoing_host)){
+    usage(-1);
+  }
+  if(opt->mirror_port==NULL){
+    opt->mirror_port=opt->outgoing_port;
+  }
   
   poptFreeContext(context);
 
@@ -220,6 +646,97 @@ int options(int argc, char **argv, options_t *opt){
 }
 
 
+/**********************************************************************
+ * options_reload
+ * Read the configuration file again
+ * pre: opt: options filled in by options(), with opt->config_file set
+ * post: On success opt is the command line options with the settings
+ *       of the configuration file applied on top of them, as options()
+ *       does. The strings of opt are not freed, as they may be in use,
+ *       options_reload_free() can free them once they aren't.
+ *       On error opt is unchanged.
+ * return: 0 on success
+ *         -1 on error
+ **********************************************************************/
+
+int options_reload(options_t *opt)
+{
+	options_t new = options_cmdline;
+
+	if (!opt->config_file) {
+		fprintf(stderr, "options: no -f|--config_file to reload\n");
+		return -1;
+	}
+
+	if (config_file_read(opt->config_file, &new) < 0)
+		goto err;
+
+	if (!new.outgoing_host) {
+		fprintf(stderr, "options: %s: outgoing_host must be set\n",
+			opt->config_file);
+		goto err;
+	}
+	if (!new.listen_port && !vanessa_socket_host_is_unix(new.listen_host)) {
+		fprintf(stderr, "options: %s: listen_port must be set\n",
+			opt->config_file);
+		goto err;
+	}
+	if (!new.outgoing_port)
+		new.outgoing_port = new.listen_port;
+	if (!new.outgoing_port &&
+	    !vanessa_socket_host_is_unix(new.outgoing_host)) {
+		fprintf(stderr, "options: %s: outgoing_port must be set\n",
+			opt->config_file);
+		goto err;
+	}
+
+	*opt = new;
+	return 0;
+err:
+	options_reload_free(&new, opt);
+	return -1;
+}
+
+
+/* Number of options that a configuration file can set to a string */
+#define OPTIONS_RELOAD_STR 5
+
+static void options_reload_str(const options_t *opt, char **str)
+{
+	str[0] = opt->acl_file;
+	str[1] = opt->listen_host;
+	str[2] = opt->listen_port;
+	str[3] = opt->outgoing_host;
+	str[4] = opt->outgoing_port;
+}
+
+
+void options_reload_free(options_t *opt, const options_t *keep)
+{
+	char *str[OPTIONS_RELOAD_STR];
+	char *used[(OPTIONS_RELOAD_STR * 3) + 1];
+	size_t i, j, nused, nkeep;
+
+	/* Those of the command line and keep, which may share strings */
+	options_reload_str(&options_cmdline, used);
+	options_reload_str(keep, used + OPTIONS_RELOAD_STR);
+	used[OPTIONS_RELOAD_STR * 2] = keep->mirror_port;
+	nkeep = nused = (OPTIONS_RELOAD_STR * 2) + 1;
+
+	/* Each once, outgoing_port may be listen_port */
+	options_reload_str(opt, str);
+	for (i = 0; i < OPTIONS_RELOAD_STR; i++) {
+		for (j = 0; j < nused && str[i] != used[j]; j++)
+			;
+		if (j == nused)
+			used[nused++] = str[i];
+	}
+
+	for (i = nkeep; i < nused; i++)
+		free(used[i]);
+}
+
+
 /**********************************************************************
  * log_options
  * Log options 
@@ -234,24 +751,81 @@ int log_options(options_t opt, vanessa_logger_t *vl){
   vanessa_logger_log(
     vl,
     LOG_DEBUG,
+    "accept_proxy=%d, "
+    "access_log=\"%s\", "
+    "acl_file=\"%s\", "
+    "capture_file=\"%s\", "
+    "capture_sample=%d, "
+    "compress=\"%s\", "
+    "config_file=\"%s\", "
     "connection_limit=%d, "
     "debug=%d, "
+    "drain_timeout=%d, "
+    "engine=\"%s\", "
+    "lifetime=%d, "
     "listen_host=\"%s\", "
     "listen_port=\"%s\", "
+    "metrics_host=\"%s\", "
+    "metrics_port=\"%s\", "
+    "mirror_buffer=%d, "
+    "mirror_host=\"%s\", "
+    "mirror_port=\"%s\", "
     "no_lookup=%d, "
     "outgoing_host=\"%s\", "
     "outgoing_port=\"%s\", "
+    "prefix_limit=%d, "
+    "prefix_rate=%d, "
     "quiet=%d, "
-    "timeout=%d,\n",
+    "scoreboard=\"%s\", "
+    "send_proxy=%d, "
+    "sockbuf_max=%d, "
+    "sockbuf_min=%d, "
+    "source_limit=%d, "
+    "source_rate=%d, "
+    "tcp_info=%d, "
+    "threads=%d, "
+    "timeout=%d, "
+    "trace=%d, "
+    "udp=%d, "
+    "udp_gso=%d,\n",
+    opt.accept_proxy,
+    str_null_safe(opt.access_log),
+    str_null_safe(opt.acl_file),
+    str_null_safe(opt.capture_file),
+    opt.capture_sample,
+    opt.compress==COMPRESS_CLIENT?"client":
+      opt.compress==COMPRESS_SERVER?"server":"none",
+    str_null_safe(opt.config_file),
     opt.connection_limit,
     opt.debug,
+    opt.drain_timeout,
+    opt.engine==ENGINE_EPOLL?"epoll":"fork",
+    opt.lifetime,
     str_null_safe(opt.listen_host),
     str_null_safe(opt.listen_port),
+    str_null_safe(opt.metrics_host),
+    str_null_safe(opt.metrics_port),
+    opt.mirror_buffer,
+    str_null_safe(opt.mirror_host),
+    str_null_safe(opt.mirror_port),
     opt.no_lookup,
     str_null_safe(opt.outgoing_host),
     str_null_safe(opt.outgoing_port),
+    opt.prefix_limit,
+    opt.prefix_rate,
     opt.quiet,
-    opt.timeout
+    str_null_safe(opt.scoreboard),
+    opt.send_proxy,
+    opt.sockbuf_max,
+    opt.sockbuf_min,
+    opt.source_limit,
+    opt.source_rate,
+    opt.tcp_info,
+    opt.threads,
+    opt.timeout,
+    opt.trace,
+    opt.udp,
+    opt.udp_gso
   );
 
   return(0);
@@ -281,6 +855,37 @@ void usage(int exit_status){
     "\n"
     "Usage: vanessa_socket_pipe [options]\n"
     "  options:\n"
+    "     -A|--accept_proxy:  Expect connections to start with a PROXY\n"
+    "                         protocol v2 header, as sent by\n"
+    "                         -P|--send_proxy of another proxy, and\n"
+    "                         use the client addresses it carries.\n"
+    "     -a|--access_log:    File to log the opening and closing of\n"
+    "                         sessions to, or - for stdout. Records\n"
+    "                         are written in batches by a separate\n"
+    "                         thread, and dropped if it falls behind,\n"
+    "                         rather than delaying sessions. Replaces\n"
+    "                         the Connect and Closing log messages.\n"
+    "     -C|--acl_file:      File of prefixes to allow or deny\n"
+    "                         connections from, read again on SIGHUP.\n"
+    "                         See the man page for its format.\n"
+    "     -F|--capture_file:  File to capture the data relayed by\n"
+    "                         sessions to, in pcap format with made up\n"
+    "                         IP and TCP headers. Packets are skipped\n"
+    "                         rather than delay sessions if writing\n"
+    "                         falls behind. Only used with\n"
+    "                         -E|--engine fork.\n"
+    "     -N|--capture_sample:\n"
+    "                         Capture one session in this many.\n"
+    "                         (default %d)\n"
+    "     -z|--compress:      Compress data relayed to and from one side\n"
+    "                         of sessions, for use between two proxies\n"
+    "                         over a slow link. One of:\n"
+    "                         client: the client side is compressed\n"
+    "                         server: the server side is compressed\n"
+    "                         Only used with -E|--engine fork.\n"
+    "     -f|--config_file:   File of settings that override those on\n"
+    "                         the command line, and are read again on\n"
+    "                         SIGHUP. See the man page for its format.\n"
     "     -c|--connection_limit:\n"
     "                         Maximum number of connections to accept\n"
     "                         simultaneously. A value of zero sets\n"
@@ -288,12 +893,51 @@ void usage(int exit_status){
     "                         connections.\n"
     "                         (default %d)\n"
     "     -d|--debug:         Turn on verbose debuging to stderr.\n"
+    "     -D|--drain_timeout: On SIGTERM stop accepting connections and\n"
+    "                         wait up to this many seconds for open\n"
+    "                         sessions to finish before exiting.\n"
+    "                         Value of zero exits straight away.\n"
+    "                         (default %d)\n"
+    "     -E|--engine:        How connections are served. One of:\n"
+    "                         fork: fork a process for each connection\n"
+    "                         epoll: serve all connections from a single\n"
+    "                         process using an event loop\n"
+    "                         (default fork)\n"
     "     -h|--help:          Display this message.\n"
-    "     -L|--listen_port:   Port to listen on. (mandatory)\n"
+    "     -e|--lifetime:      Close sessions this many seconds after they\n"
+    "                         are accepted, even if they are busy.\n"
+    "                         Value of zero sets no limit.\n"
+    "                         (default %d)\n"
+    "     -L|--listen_port:   Port to listen on.\n"
+    "                         (mandatory unless listening on a unix\n"
+    "                         domain socket)\n"
     "     -l|--listen_host:   Address to listen on.\n"
     "                         May be a hostname or an IP address.\n"
+    "                         May also be unix:/path or unix:@name to\n"
+    "                         listen on a unix domain socket, in which\n"
+    "                         case -L|--listen_port is not used.\n"
     "                         If not defined then listen on all local\n"
     "                         addresses.\n"
+    "     -M|--metrics_port:  Port to serve metrics on, in Prometheus\n"
+    "                         text format over HTTP. Metrics are only\n"
+    "                         served if this or a unix domain socket\n"
+    "                         -m|--metrics_host is given.\n"
+    "     -m|--metrics_host:  Address to serve metrics on.\n"
+    "                         May also be unix:/path or unix:@name.\n"
+    "                         (default 127.0.0.1)\n"
+    "     -w|--mirror_buffer: Bytes of data for -y|--mirror_host that\n"
+    "                         may wait to be sent to it before it is\n"
+    "                         dropped from the session. (default %d)\n"
+    "     -Y|--mirror_port:   Port of -y|--mirror_host.\n"
+    "                         If not specified -O|--outgoing_port will\n"
+    "                         be used.\n"
+    "     -y|--mirror_host:   Shadow server to send a copy of the data\n"
+    "                         sent to the server to. Its replies are\n"
+    "                         discarded, and it is dropped rather than\n"
+    "                         slow sessions down. May also be\n"
+    "                         unix:/path or unix:@name. Only used with\n"
+    "                         -E|--engine fork, and not with\n"
+    "                         -z|--compress server.\n"
     "     -n|--no_lookup:     Turn off lookup of hostnames and portnames.\n"
     "                         That is, hosts must be given as IP addresses\n"
     "                         and ports must be given as numbers.\n"
@@ -301,15 +945,88 @@ void usage(int exit_status){
     "                         If not specified -l|--listen_port will be used\n"
     "     -o|--outgoing_host: Define host to connect to.\n"
     "                         May be a hostname or an IP address. (mandatory)\n"
+    "                         May also be unix:/path or unix:@name to\n"
+    "                         connect to a unix domain socket, in which\n"
+    "                         case -O|--outgoing_port is not used.\n"
+    "     -S|--prefix_limit:  Maximum number of connections to accept\n"
+    "                         simultaneously from each /24 IPv4 or /64\n"
+    "                         IPv6 prefix. Zero for no limit.\n"
+    "                         (default %d)\n"
+    "     -R|--prefix_rate:   Maximum number of new connections to accept\n"
+    "                         a second from each /24 IPv4 or /64 IPv6\n"
+    "                         prefix. Zero for no limit. (default %d)\n"
     "     -q|--quiet:         Only log errors. Overriden by -d|--debug.\n"
+    "     -k|--scoreboard:    File to map a scoreboard to, in which each\n"
+    "                         child publishes its addresses, state,\n"
+    "                         bytes relayed and start time, for other\n"
+    "                         processes to read. Only used with\n"
+    "                         -E|--engine fork.\n"
+    "     -P|--send_proxy:    Send a PROXY protocol v2 header with the\n"
+    "                         addresses of the client to the server\n"
+    "                         before relaying.\n"
+    "     -b|--sockbuf_max:   Tune the kernel send and receive buffers\n"
+    "                         of sessions to suit the bandwidth-delay\n"
+    "                         product measured as they run, up to this\n"
+    "                         many bytes. Zero to leave buffers to the\n"
+    "                         kernel. (default %d)\n"
+    "     -B|--sockbuf_min:   Smallest kernel buffer to set when tuning.\n"
+    "                         (default %d)\n"
+    "     -s|--source_limit:  Maximum number of connections to accept\n"
+    "                         simultaneously from each source address.\n"
+    "                         Zero for no limit. (default %d)\n"
+    "     -r|--source_rate:   Maximum number of new connections to accept\n"
+    "                         a second from each source address.\n"
+    "                         Zero for no limit. (default %d)\n"
+    "     -i|--tcp_info:      Read TCP_INFO from both connections of\n"
+    "                         each session when it closes. RTT,\n"
+    "                         retransmits, delivery rate, cwnd and\n"
+    "                         unacknowledged bytes are added to the\n"
+    "                         close record and metrics.\n"
+    "                         Can't be used with -u|--udp.\n"
+    "     -T|--threads:       Number of event loop threads, each serving\n"
+    "                         its own connections. Only used with\n"
+    "                         -E|--engine epoll.\n"
+    "                         (default %d)\n"
     "     -t|--timeout:       Idle timeout in seconds.\n"
     "                         Value of zero sets infinite timeout.\n"
     "                         (default %d)\n"
+    "     -x|--trace:         Record when each session is accepted,\n"
+    "                         resolves and connects to the server, and\n"
+    "                         first and last reads from each side. A\n"
+    "                         trace record is logged when it closes\n"
+    "                         and the times are added to metrics.\n"
+    "                         Can't be used with -u|--udp.\n"
+    "     -u|--udp:           Relay UDP datagrams rather than TCP\n"
+    "                         connections. Each client address is a flow\n"
+    "                         with its own socket to the server.\n"
+    "                         -c|--connection_limit limits the number\n"
+    "                         of flows, the least recently used flow\n"
+    "                         is closed when it is reached, and\n"
+    "                         -t|--timeout is the idle timeout of a flow.\n"
+    "                         Can't be used with -a, -A, -b, -C, -D, -e,\n"
+    "                         -E epoll, -i, -M, -P, -r, -R, -s, -S or -x.\n"
+    "     -G|--udp_gso:       Use UDP GRO and GSO, if supported by the\n"
+    "                         kernel, to receive and send trains of\n"
+    "                         datagrams with a single system call.\n"
+    "                         Only used with -u|--udp.\n"
     "\n"
     "     Notes: Default value for binary flags is off.\n"
-    "            -L|--listen_port and -o|--outgoing_host must be defined.\n",
+    "            -o|--outgoing_host must be defined.\n"
+    "            -L|--listen_port must be defined unless -l|--listen_host\n"
+    "            is a unix domain socket.\n",
     VERSION,
+    DEFAULT_CAPTURE_SAMPLE,
     DEFAULT_CONNECTION_LIMIT,
+    DEFAULT_DRAIN_TIMEOUT,
+    DEFAULT_LIFETIME,
+    DEFAULT_MIRROR_BUFFER,
+    DEFAULT_PREFIX_LIMIT,
+    DEFAULT_PREFIX_RATE,
+    DEFAULT_SOCKBUF_MAX,
+    DEFAULT_SOCKBUF_MIN,
+    DEFAULT_SOURCE_LIMIT,
+    DEFAULT_SOURCE_RATE,
+    DEFAULT_THREADS,
     DEFAULT_TIMEOUT
   );
 
@@ -42,26 +42,100 @@
 
 #define BUFFER_SIZE 4096
 
+#define ENGINE_FORK  0
+#define ENGINE_EPOLL 1
+
+/* Side of a session that is compressed, see -z|--compress */
+#define COMPRESS_NONE   0
+#define COMPRESS_CLIENT 1
+#define COMPRESS_SERVER 2
+
+/* Milliseconds between tuning of socket buffers, see -b|--sockbuf_max */
+#define SOCKBUF_INTERVAL 1000
+
+/* Slots of -k|--scoreboard if there is no -c|--connection_limit */
+#define SCOREBOARD_SLOTS 4096
+
+/* Sides of a session in a trace, as passed to vanessa_socket_pipe() */
+#define TRACE_SERVER VANESSA_SOCKET_TRACE_A
+#define TRACE_CLIENT VANESSA_SOCKET_TRACE_B
+
+#define DEFAULT_ACCEPT_PROXY     0
+#define DEFAULT_ACCESS_LOG       NULL
+#define DEFAULT_ACL_FILE         NULL
+#define DEFAULT_CAPTURE_FILE     NULL
+#define DEFAULT_CAPTURE_SAMPLE   1 /*capture one session in this many*/
+#define DEFAULT_COMPRESS         COMPRESS_NONE
+#define DEFAULT_CONFIG_FILE      NULL
 #define DEFAULT_CONNECTION_LIMIT 0
 #define DEFAULT_DEBUG            0
+#define DEFAULT_DRAIN_TIMEOUT    0 /*in seconds*/
+#define DEFAULT_ENGINE           ENGINE_FORK
+#define DEFAULT_LIFETIME         0 /*in seconds*/
 #define DEFAULT_LISTEN_HOST      NULL
 #define DEFAULT_LISTEN_PORT      NULL
+#define DEFAULT_METRICS_HOST     NULL
+#define DEFAULT_METRICS_PORT     NULL
+#define DEFAULT_MIRROR_BUFFER    262144 /*bytes*/
+#define DEFAULT_MIRROR_HOST      NULL
+#define DEFAULT_MIRROR_PORT      NULL
 #define DEFAULT_NO_LOOKUP        0
 #define DEFAULT_OUTGOING_HOST    NULL
 #define DEFAULT_OUTGOING_PORT    NULL
+#define DEFAULT_PREFIX_LIMIT     0
+#define DEFAULT_PREFIX_RATE      0 /*connections a second*/
+#define DEFAULT_TCP_INFO         0
+#define DEFAULT_THREADS          1
 #define DEFAULT_TIMEOUT          1800 /*in seconds*/
+#define DEFAULT_TRACE            0
 #define DEFAULT_QUIET            0
+#define DEFAULT_SCOREBOARD       NULL
+#define DEFAULT_SEND_PROXY       0
+#define DEFAULT_SOCKBUF_MAX      0 /*bytes, 0 to not tune*/
+#define DEFAULT_SOCKBUF_MIN      65536 /*bytes*/
+#define DEFAULT_SOURCE_LIMIT     0
+#define DEFAULT_SOURCE_RATE      0 /*connections a second*/
+#define DEFAULT_UDP              0
+#define DEFAULT_UDP_GSO          0
 
 typedef struct {
+  int             accept_proxy;
+  char            *access_log;
+  char            *acl_file;
+  char            *capture_file;
+  int             capture_sample;
+  int             compress;
+  char            *config_file;
   int             connection_limit;
   int             debug;
+  int             drain_timeout;
+  int             engine;
+  int             lifetime;
   char            *listen_host;
   char            *listen_port;
+  char            *metrics_host;
+  char            *metrics_port;
+  int             mirror_buffer;
+  char            *mirror_host;
+  char            *mirror_port;
   int             no_lookup;
   char            *outgoing_host;
   char            *outgoing_port;
+  int             prefix_limit;
+  int             prefix_rate;
   int             quiet;
+  char            *scoreboard;
+  int             send_proxy;
+  int             sockbuf_max;
+  int             sockbuf_min;
+  int             source_limit;
+  int             source_rate;
+  int             tcp_info;
+  int             threads;
   int             timeout;
+  int             trace;
+  int             udp;
+  int             udp_gso;
 } options_t;
 
 /*Flag values for options()*/
@@ -82,6 +156,35 @@ typedef struct {
 int options(int argc, char **argv, options_t *opt);
 
 
+/**********************************************************************
+ * options_reload
+ * Read the configuration file again
+ * pre: opt: options filled in by options(), with opt->config_file set
+ * post: On success opt is the command line options with the settings
+ *       of the configuration file applied on top of them, as options()
+ *       does. The strings of opt are not freed, as they may be in use,
+ *       options_reload_free() can free them once they aren't.
+ *       On error opt is unchanged.
+ * return: 0 on success
+ *         -1 on error
+ **********************************************************************/
+
+int options_reload(options_t *opt);
+
+
+/**********************************************************************
+ * options_reload_free
+ * Free strings that options_reload() read from the configuration file
+ * pre: opt: options, as set by options() or options_reload()
+ *      keep: options whose strings are still in use
+ * post: The strings that the configuration file may set in opt are
+ *       freed, unless they came from the command line or keep uses
+ *       them. opt should not be used afterwards.
+ **********************************************************************/
+
+void options_reload_free(options_t *opt, const options_t *keep);
+
+
 /**********************************************************************
  * log_options
  * Log options 
@@ -122,4 +225,33 @@ void usage(int exit_status);
   (string==NULL)?"(null)":string
 
 
+/**********************************************************************
+ * str_null_eq
+ * Compare strings, either of which may be NULL
+ * pre: a, b: strings to compare
+ * return: non-zero if both are NULL or both are the same string
+ *         0 otherwise
+ **********************************************************************/
+
+#define str_null_eq(a, b) \
+  (((a)==NULL || (b)==NULL)?(a)==(b):!strcmp((a), (b)))
+
+
+/**********************************************************************
+ * sockaddr_str
+ * Format a socket address as "host:port", or "unix:/path" for
+ * unix domain sockets
+ * pre: sa: address to format
+ *      str: buffer to write to, of at least SOCKADDR_STR_LEN bytes
+ *      what: name of the address for error messages
+ * post: str is filled in
+ * return: 0 on success
+ *         -1 on error
+ **********************************************************************/
+
+#define SOCKADDR_STR_LEN (NI_MAXHOST+NI_MAXSERV+1)
+
+int sockaddr_str(const struct sockaddr *sa, char *str, const char *what);
+
+
 #endif
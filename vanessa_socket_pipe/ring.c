@@ -0,0 +1,340 @@
+/**********************************************************************
+ * ring.c                                                  October 2026
+ * Simon Horman                                      horms@verge.net.au
+ *
+ * Ring of records shared by processes, emptied by a writer thread
+ *
+ * vanessa_socket_pipe
+ * Trivial TCP/IP pipe based on libvanessa_socket
+ * Copyright (C) 1999-2008  Simon Horman <horms@verge.net.au>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307  USA
+ *
+ **********************************************************************/
+
+#include "ring.h"
+#include "unused.h"
+
+#include <errno.h>
+#include <stddef.h>
+#include <time.h>
+#include <sys/mman.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+/*
+ * Records are claimed by advancing head, and handed to the writer by
+ * setting seq to one more than the position they were claimed at.
+ * The writer hands them back by setting seq to the position they will
+ * next be claimed at. So a record whose seq is behind head is full,
+ * and one whose seq is its position while head is past it has been
+ * claimed but not published.
+ *
+ * Publishing and skipping both compare and swap seq, so a record that
+ * is published just as the writer gives up on it is either written or
+ * dropped, never left behind to block the ring on its next lap. A
+ * process that is only slow, rather than dead, could still be filling
+ * in a record after it has been skipped and claimed again, RING_STALL
+ * is long enough to make that unlikely.
+ */
+
+typedef struct {
+	volatile uint64_t seq;
+} __attribute__((aligned(16))) ring_slot_t;
+
+struct ring_struct {
+	volatile uint64_t head __attribute__((aligned(64)));
+	volatile uint64_t tail __attribute__((aligned(64)));
+	volatile uint64_t dropped __attribute__((aligned(64)));
+	volatile uint64_t count;
+	size_t slots;
+	size_t stride;		/* Bytes from one slot to the next */
+	size_t len;		/* Bytes mapped */
+	int stalled;		/* Only used by the writer */
+	struct timespec stall;	/* When the writer found tail unpublished */
+	char slot[] __attribute__((aligned(64)));
+};
+
+typedef struct {
+	ring_t *r;
+	int fd;
+	size_t max;
+	size_t (*format)(const void *record, char *buf);
+	size_t (*dropped)(uint64_t n, char *buf);
+	char buf[RING_BATCH];
+} ring_writer_t;
+
+
+static ring_slot_t *ring_slot(ring_t *r, uint64_t pos)
+{
+	return (ring_slot_t *)(r->slot + (pos & (r->slots - 1)) * r->stride);
+}
+
+
+ring_t *ring_create(size_t slots, size_t size)
+{
+	ring_t *r;
+	size_t stride, len;
+	uint64_t i;
+
+	stride = sizeof(ring_slot_t) + ((size + 15) & ~(size_t)15);
+	len = offsetof(ring_t, slot) + slots * stride;
+
+	r = mmap(NULL, len, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS,
+		 -1, 0);
+	if (r == MAP_FAILED) {
+		VANESSA_LOGGER_DEBUG_ERRNO("mmap");
+		return NULL;
+	}
+	r->slots = slots;
+	r->stride = stride;
+	r->len = len;
+	for (i = 0; i < slots; i++)
+		ring_slot(r, i)->seq = i;
+
+	return r;
+}
+
+
+void ring_destroy(ring_t *r)
+{
+	if (r)
+		munmap(r, r->len);
+}
+
+
+void *ring_claim(ring_t *r, uint64_t *pos)
+{
+	ring_slot_t *slot;
+	int64_t diff;
+
+	*pos = r->head;
+	for (;;) {
+		slot = ring_slot(r, *pos);
+		diff = (int64_t)(slot->seq - *pos);
+		if (diff == 0) {
+			if (__sync_bool_compare_and_swap(&r->head, *pos,
+							 *pos + 1))
+				return slot + 1;
+			*pos = r->head;
+		} else if (diff < 0) {
+			__sync_fetch_and_add(&r->dropped, 1);
+			return NULL;
+		} else {
+			*pos = r->head;
+		}
+	}
+}
+
+
+void ring_publish(ring_t *r, uint64_t pos)
+{
+	/* A full barrier, so the record is filled in before it is seen */
+	__sync_bool_compare_and_swap(&ring_slot(r, pos)->seq, pos, pos + 1);
+}
+
+
+/**********************************************************************
+ * ring_stalled
+ * Check whether the writer has waited too long for the oldest record
+ * pre: r: ring, whose oldest record is claimed but not published
+ * return: non-zero if it was first found so more than RING_STALL ago
+ *         0 otherwise
+ **********************************************************************/
+
+static int ring_stalled(ring_t *r)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (!r->stalled) {
+		r->stalled = 1;
+		r->stall = now;
+		return 0;
+	}
+
+	return (now.tv_sec - r->stall.tv_sec) * 1000 +
+	       (now.tv_nsec - r->stall.tv_nsec) / 1000000 >= RING_STALL;
+}
+
+
+void *ring_peek(ring_t *r)
+{
+	ring_slot_t *slot;
+	uint64_t tail, seq;
+
+	for (;;) {
+		tail = r->tail;
+		slot = ring_slot(r, tail);
+		seq = slot->seq;
+		if (seq == tail + 1) {
+			__sync_synchronize();
+			r->stalled = 0;
+			return slot + 1;
+		}
+
+		if (seq != tail || r->head == tail || !ring_stalled(r))
+			return NULL;
+
+		/* Lost the race with ring_publish(), it's ready now */
+		if (!__sync_bool_compare_and_swap(&slot->seq, tail,
+						  tail + r->slots))
+			continue;
+		__sync_fetch_and_add(&r->dropped, 1);
+		r->stalled = 0;
+		r->tail++;
+	}
+}
+
+
+void ring_consume(ring_t *r)
+{
+	uint64_t tail = r->tail;
+
+	__sync_synchronize();
+	ring_slot(r, tail)->seq = tail + r->slots;
+	r->tail++;
+}
+
+
+uint64_t ring_dropped(ring_t *r)
+{
+	return r->dropped;
+}
+
+
+uint64_t ring_count(ring_t *r)
+{
+	return __sync_fetch_and_add(&r->count, 1);
+}
+
+
+#ifdef HAVE_PTHREAD
+int ring_thread(void *(*func)(void *), void *data)
+{
+	pthread_t thread;
+	sigset_t mask, omask;
+	int err;
+
+	sigfillset(&mask);
+	pthread_sigmask(SIG_SETMASK, &mask, &omask);
+	err = pthread_create(&thread, NULL, func, data);
+	pthread_sigmask(SIG_SETMASK, &omask, NULL);
+	if (err) {
+		errno = err;
+		VANESSA_LOGGER_DEBUG_ERRNO("pthread_create");
+		return -1;
+	}
+	pthread_detach(thread);
+
+	return 0;
+}
+
+
+static void *ring_writer_thread(void *data)
+{
+	ring_writer_t *w = (ring_writer_t *)data;
+	struct timespec idle;
+	uint64_t reported = 0;
+	uint64_t dropped;
+	time_t last = 0, now;
+	size_t len;
+	void *record;
+
+	idle.tv_sec = 0;
+	idle.tv_nsec = RING_IDLE * 1000000;
+
+	for (;;) {
+		len = 0;
+		while (len + w->max <= sizeof(w->buf) &&
+		       (record = ring_peek(w->r))) {
+			len += w->format(record, w->buf + len);
+			ring_consume(w->r);
+		}
+
+		dropped = ring_dropped(w->r);
+		if (w->dropped && dropped != reported &&
+		    len + w->max <= sizeof(w->buf) &&
+		    (now = time(NULL)) != last) {
+			len += w->dropped(dropped - reported, w->buf + len);
+			reported = dropped;
+			last = now;
+		}
+
+		if (!len)
+			nanosleep(&idle, NULL);
+		else if (vanessa_socket_pipe_write_bytes(w->fd, w->buf, len))
+			VANESSA_LOGGER_DEBUG("vanessa_socket_pipe_write_bytes");
+	}
+
+	return NULL;
+}
+
+
+int ring_writer(ring_t *r, int fd, size_t max,
+		size_t (*format)(const void *record, char *buf),
+		size_t (*dropped)(uint64_t n, char *buf))
+{
+	ring_writer_t *w;
+
+	w = malloc(sizeof(*w));
+	if (!w) {
+		VANESSA_LOGGER_DEBUG_ERRNO("malloc");
+		return -1;
+	}
+	w->r = r;
+	w->fd = fd;
+	w->max = max;
+	w->format = format;
+	w->dropped = dropped;
+
+	if (ring_thread(ring_writer_thread, w) < 0) {
+		VANESSA_LOGGER_DEBUG("ring_thread");
+		free(w);
+		return -1;
+	}
+
+	return 0;
+}
+
+#else /* HAVE_PTHREAD */
+
+/* So that UNUSED() can be applied to function pointer parameters */
+typedef void *(*ring_thread_func_t)(void *data);
+typedef size_t (*ring_format_func_t)(const void *record, char *buf);
+typedef size_t (*ring_dropped_func_t)(uint64_t n, char *buf);
+
+int ring_thread(ring_thread_func_t UNUSED(func), void *UNUSED(data))
+{
+	VANESSA_LOGGER_DEBUG("threads are not supported");
+	return -1;
+}
+
+
+int ring_writer(ring_t *UNUSED(r), int UNUSED(fd), size_t UNUSED(max),
+		ring_format_func_t UNUSED(format),
+		ring_dropped_func_t UNUSED(dropped))
+{
+	VANESSA_LOGGER_DEBUG("threads are not supported");
+	return -1;
+}
+
+#endif /* HAVE_PTHREAD */
@@ -0,0 +1,180 @@
+/**********************************************************************
+ * ring.h                                                  October 2026
+ * Simon Horman                                      horms@verge.net.au
+ *
+ * Ring of records shared by processes, emptied by a writer thread
+ *
+ * vanessa_socket_pipe
+ * Trivial TCP/IP pipe based on libvanessa_socket
+ * Copyright (C) 1999-2008  Simon Horman <horms@verge.net.au>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307  USA
+ *
+ **********************************************************************/
+
+#ifndef RING_STIX
+#define RING_STIX
+
+#include "options.h"
+
+#include <stdint.h>
+
+typedef struct ring_struct ring_t;
+
+/* Milliseconds a claimed record may go unpublished before it is skipped */
+#define RING_STALL 1000
+
+#define RING_BATCH 65536	/* Bytes written by ring_writer() at once */
+#define RING_IDLE  50		/* Milliseconds it sleeps when idle */
+
+
+/**********************************************************************
+ * ring_create
+ * Create a ring
+ * pre: slots: number of records, must be a power of two
+ *      size: size of each record in bytes
+ * post: The ring is mapped in memory that is shared with child
+ *       processes, so it should be created before forking
+ * return: ring
+ *         NULL on error
+ **********************************************************************/
+
+ring_t *ring_create(size_t slots, size_t size);
+
+
+/**********************************************************************
+ * ring_destroy
+ * Unmap a ring
+ * pre: r: ring, may be NULL
+ * post: r is unmapped in this process
+ **********************************************************************/
+
+void ring_destroy(ring_t *r);
+
+
+/**********************************************************************
+ * ring_claim
+ * Claim a record to fill in
+ * Safe to call from any number of threads and processes at once
+ * pre: r: ring
+ *      pos: where to store the position of the record
+ * return: record, to be handed to the writer by ring_publish()
+ *         NULL if the ring is full, the record is counted as dropped.
+ *         This never blocks.
+ **********************************************************************/
+
+void *ring_claim(ring_t *r, uint64_t *pos);
+
+
+/**********************************************************************
+ * ring_publish
+ * Hand a filled in record to the writer
+ * pre: r: ring
+ *      pos: position of the record, from ring_claim()
+ * post: The record may be returned by ring_peek(). If the writer has
+ *       already skipped it as per ring_peek() nothing is done.
+ **********************************************************************/
+
+void ring_publish(ring_t *r, uint64_t pos);
+
+
+/**********************************************************************
+ * ring_peek
+ * Look at the oldest record
+ * Only to be called by a single writer
+ * pre: r: ring
+ * post: If the oldest record was claimed more than RING_STALL ago and
+ *       still hasn't been published, say because the process that
+ *       claimed it died, it is skipped and counted as dropped, so that
+ *       the writer does not wait for it for ever
+ * return: record, to be handed back by ring_consume() once the writer
+ *         is done with it
+ *         NULL if the oldest record has not been published
+ **********************************************************************/
+
+void *ring_peek(ring_t *r);
+
+
+/**********************************************************************
+ * ring_consume
+ * Hand back the record returned by ring_peek()
+ * Only to be called by a single writer
+ * pre: r: ring
+ * post: The record may be claimed again
+ **********************************************************************/
+
+void ring_consume(ring_t *r);
+
+
+/**********************************************************************
+ * ring_dropped
+ * pre: r: ring
+ * return: number of records dropped because the ring was full or they
+ *         were skipped, since it was created
+ **********************************************************************/
+
+uint64_t ring_dropped(ring_t *r);
+
+
+/**********************************************************************
+ * ring_count
+ * Count something across all processes that share a ring
+ * pre: r: ring
+ * return: number of times this has been called on r before, by any
+ *         process
+ **********************************************************************/
+
+uint64_t ring_count(ring_t *r);
+
+
+/**********************************************************************
+ * ring_thread
+ * Start a detached thread that no signals are delivered to, so that
+ * they, in particular SIGCHLD, go to the main thread
+ * pre: func: function to run in the thread
+ *      data: passed to func
+ * return: 0 on success
+ *         -1 on error, or if threads are not supported
+ **********************************************************************/
+
+int ring_thread(void *(*func)(void *), void *data);
+
+
+/**********************************************************************
+ * ring_writer
+ * Start a writer thread that empties a ring into a file
+ * pre: r: ring
+ *      fd: file descriptor to write to
+ *      max: most bytes that format or dropped add to buf at once,
+ *           no more than RING_BATCH
+ *      format: formats a record into buf and returns the number of
+ *              bytes written to buf
+ *      dropped: told how many more records have been dropped, at most
+ *               once a second. May add to buf as format does, and
+ *               returns the number of bytes written to buf. May be NULL.
+ * post: Records are formatted and written to fd RING_BATCH bytes at a
+ *       time, the thread sleeps for RING_IDLE when the ring is empty.
+ *       r and fd are used until the process exits.
+ * return: 0 on success
+ *         -1 on error, or if threads are not supported
+ **********************************************************************/
+
+int ring_writer(ring_t *r, int fd, size_t max,
+		size_t (*format)(const void *record, char *buf),
+		size_t (*dropped)(uint64_t n, char *buf));
+
+
+#endif
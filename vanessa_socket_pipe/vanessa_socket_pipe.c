@@ -27,9 +27,21 @@
  **********************************************************************/
 
 #include "options.h"
+#include "accesslog.h"
+#include "acl.h"
+#include "capture.h"
+#include "compress.h"
+#include "engine.h"
+#include "limit.h"
+#include "metrics.h"
+#include "mirror.h"
+#include "unused.h"
 
 #include <errno.h>
 #include <sys/socket.h>
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
 
 #define CONNECT_RETRY 3
 #define ERR_SLEEP 1
@@ -43,11 +55,348 @@ static size_t get_salen(const struct sockaddr *sa)
 #else
 	if (sa->sa_family == AF_INET)
 		return sizeof(struct sockaddr_in);
+	else if (sa->sa_family == AF_UNIX)
+		return sizeof(struct sockaddr_un);
 	else
 		return sizeof(struct sockaddr_in6);
 #endif
 }
 
+
+/**********************************************************************
+ * sockaddr_str
+ * Format a socket address as "host:port", or "unix:/path" for
+ * unix domain sockets
+ * pre: sa: address to format
+ *      str: buffer to write to, of at least SOCKADDR_STR_LEN bytes
+ *      what: name of the address for error messages
+ * post: str is filled in
+ * return: 0 on success
+ *         -1 on error
+ **********************************************************************/
+
+int sockaddr_str(const struct sockaddr *sa, char *str, const char *what)
+{
+	char host_str[NI_MAXHOST];
+	char serv_str[NI_MAXSERV];
+	int rc;
+
+	if (sa->sa_family == AF_UNIX)
+		return vanessa_socket_unix_ntop((struct sockaddr_un *)sa,
+						get_salen(sa), str,
+						SOCKADDR_STR_LEN);
+
+	rc = getnameinfo(sa, get_salen(sa), host_str, NI_MAXHOST,
+			 serv_str, NI_MAXSERV, NI_NUMERICHOST|NI_NUMERICSERV);
+	if (rc) {
+		VANESSA_LOGGER_DEBUG_UNSAFE("getnameinfo %s: %s", what,
+					    gai_strerror(rc));
+		return -1;
+	}
+
+	sprintf(str, "%s:%s", host_str, serv_str);
+	return 0;
+}
+
+
+/**********************************************************************
+ * udp_main
+ * Relay UDP datagrams, rather than TCP connections
+ * pre: opt: options
+ * post: Datagrams are relayed by this process until an error occurs
+ * return: -1 on error
+ **********************************************************************/
+
+static int udp_main(options_t *opt)
+{
+	int s;
+	vanessa_socket_flag_t flag;
+
+	flag = VANESSA_SOCKET_PROTO_UDP;
+	if (opt->no_lookup)
+		flag |= VANESSA_SOCKET_NO_LOOKUP;
+	if (opt->udp_gso)
+		flag |= VANESSA_SOCKET_UDP_GSO;
+
+	s = vanessa_socket_server_bind(opt->listen_port, opt->listen_host,
+				       flag);
+	if (s < 0) {
+		VANESSA_LOGGER_DEBUG("vanessa_socket_server_bind");
+		VANESSA_LOGGER_ERR_UNSAFE("Could not bind to: %s:%s",
+					  str_null_safe(opt->listen_host),
+					  str_null_safe(opt->listen_port));
+		return -1;
+	}
+
+	VANESSA_LOGGER_INFO_UNSAFE("Relaying UDP to server=%s port=%s",
+				   opt->outgoing_host, opt->outgoing_port);
+
+	if (vanessa_socket_udp_relay(s, opt->outgoing_host,
+				     opt->outgoing_port, 0, opt->timeout,
+				     opt->connection_limit, flag) < 0) {
+		VANESSA_LOGGER_DEBUG("vanessa_socket_udp_relay");
+		close(s);
+		return -1;
+	}
+
+	close(s);
+	return 0;
+}
+
+
+/**********************************************************************
+ * listen_bind
+ * Open the listening socket for some options, with -E|--engine fork
+ * pre: opt: options
+ * return: listening sockets, terminated by -1.
+ *         To close the sockets and free, call vanessa_socket_closev().
+ *         NULL on error
+ **********************************************************************/
+
+static int *listen_bind(options_t *opt)
+{
+	int *listen_socketv;
+	const char *fromv[3];
+
+	fromv[0] = opt->listen_host ? opt->listen_host : "0.0.0.0";
+	fromv[1] = opt->listen_port;
+	fromv[2] = NULL;
+	listen_socketv = vanessa_socket_server_bindv(fromv, 0);
+	if (!listen_socketv) {
+		VANESSA_LOGGER_DEBUG("vanessa_socket_server_bindv");
+		VANESSA_LOGGER_ERR_UNSAFE("Could not bind to: %s:%s",
+					  str_null_safe(opt->listen_host),
+					  str_null_safe(opt->listen_port));
+	}
+
+	return listen_socketv;
+}
+
+
+/**********************************************************************
+ * reload
+ * Read the configuration file and access control list again, once
+ * SIGHUP has made vanessa_socket_server_acceptv() return
+ * pre: opt: options in use
+ *      listen_socketv: listening sockets in use
+ *      limit: limiter made by limit_create(), may be NULL
+ * post: The settings that children forked from now on use are
+ *       changed: the server, the timeout, the connection limit, the
+ *       per source limits and the access control list. If the address to listen on has changed
+ *       it is bound before the old one is closed. The strings and
+ *       access control list that are replaced are freed, as nothing
+ *       can be using them while no connection is being accepted. On
+ *       error the current settings are kept.
+ * return: listening sockets to use from now on
+ **********************************************************************/
+
+static int *reload(options_t *opt, int *listen_socketv,
+		   vanessa_socket_limit_t *limit)
+{
+	options_t new = *opt;
+	options_t old;
+	sigset_t mask, omask;
+	vanessa_socket_acl_t *acl = NULL;
+	int *new_socketv = listen_socketv;
+
+	if (opt->config_file && options_reload(&new) < 0) {
+		VANESSA_LOGGER_ERR("Could not reload configuration, "
+				   "keeping current settings");
+		return listen_socketv;
+	}
+
+	if (new.acl_file && !(acl = acl_read(new.acl_file))) {
+		VANESSA_LOGGER_ERR("Could not reload access control list, "
+				   "keeping current settings");
+		goto err;
+	}
+
+	/* The port of a unix domain socket is ignored */
+	if (!str_null_eq(new.listen_host, opt->listen_host) ||
+	    (!vanessa_socket_host_is_unix(new.listen_host) &&
+	     !str_null_eq(new.listen_port, opt->listen_port))) {
+		new_socketv = listen_bind(&new);
+		if (!new_socketv) {
+			VANESSA_LOGGER_ERR("Could not reload configuration, "
+					   "keeping current settings");
+			goto err;
+		}
+		vanessa_socket_server_unlinkv(listen_socketv);
+		vanessa_socket_closev(listen_socketv);
+	}
+
+	vanessa_socket_acl_destroy(vanessa_socket_server_acl(acl));
+
+	/* Others, such as mirror_port, may have been derived from these */
+	old = *opt;
+	opt->acl_file = new.acl_file;
+	opt->listen_host = new.listen_host;
+	opt->listen_port = new.listen_port;
+	opt->outgoing_host = new.outgoing_host;
+	opt->outgoing_port = new.outgoing_port;
+	opt->connection_limit = new.connection_limit;
+	opt->timeout = new.timeout;
+	opt->source_limit = new.source_limit;
+	opt->source_rate = new.source_rate;
+	opt->prefix_limit = new.prefix_limit;
+	opt->prefix_rate = new.prefix_rate;
+	options_reload_free(&old, opt);
+
+	/* The reaper releases what children hold on the limiter */
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &mask, &omask);
+	limit_reload(limit, opt);
+	sigprocmask(SIG_SETMASK, &omask, NULL);
+
+	if (!opt->config_file)
+		VANESSA_LOGGER_INFO("Reloaded access control list");
+	else
+		VANESSA_LOGGER_INFO_UNSAFE("Reloaded configuration: "
+					   "listen=%s:%s server=%s port=%s "
+					   "connection_limit=%d timeout=%d",
+					   str_null_safe(opt->listen_host),
+					   str_null_safe(opt->listen_port),
+					   opt->outgoing_host,
+					   str_null_safe(opt->outgoing_port),
+					   opt->connection_limit,
+					   opt->timeout);
+	return new_socketv;
+
+err:
+	options_reload_free(&new, opt);
+	vanessa_socket_acl_destroy(acl);
+	return listen_socketv;
+}
+
+
+/**********************************************************************
+ * drain_main
+ * Wait for sessions to finish, once SIGTERM has been received
+ * pre: opt: options
+ * post: The number of sessions still open, if any, is logged
+ * return: 0
+ **********************************************************************/
+
+static int drain_main(options_t *opt)
+{
+	unsigned int left;
+
+	VANESSA_LOGGER_INFO_UNSAFE("Draining sessions for up to %d seconds",
+				   opt->drain_timeout);
+	left = vanessa_socket_server_drain(opt->drain_timeout);
+	if (left)
+		VANESSA_LOGGER_INFO_UNSAFE("Exiting with %u sessions still open",
+					   left);
+	else
+		VANESSA_LOGGER_INFO("All sessions finished, exiting");
+
+	return 0;
+}
+
+
+/**********************************************************************
+ * sockbuf_write
+ * Write relayed data, tuning the kernel buffers of the session from
+ * time to time, for -b|--sockbuf_max with -E|--engine fork
+ * pre: fd: file descriptor to write to
+ *      buf: data to write
+ *      count: number of bytes in buf
+ *      data: sockbuf_t of the session
+ * post: As for vanessa_socket_pipe_fd_write(). If SOCKBUF_INTERVAL has
+ *       passed since the direction of fd was last tuned it is tuned
+ *       again, unless the kernel clamped its buffers last time. If
+ *       tuning fails, say because one side is a unix domain socket, it
+ *       is not tried again.
+ * return: as for vanessa_socket_pipe_fd_write()
+ **********************************************************************/
+
+typedef struct {
+	int server;
+	int client;
+	int min;
+	int max;
+	uint64_t next[2];	/* When to next tune writes to the server,
+				 * and to the client */
+	int clamped[2];		/* Don't tune writes to the server, or to
+				 * the client, again */
+	int stopped;
+} sockbuf_t;
+
+static ssize_t sockbuf_write(int fd, const void *buf, size_t count,
+			     void *data)
+{
+	sockbuf_t *sb = (sockbuf_t *)data;
+	int to_client = fd == sb->client;
+	uint64_t now;
+	int status;
+
+	if (!sb->stopped && !sb->clamped[to_client]) {
+		now = vanessa_socket_trace_now();
+		if (now >= sb->next[to_client]) {
+			sb->next[to_client] = now +
+				SOCKBUF_INTERVAL * (uint64_t)1000000;
+			/* What is written to one was read from the other */
+			status = vanessa_socket_tcp_tune(to_client ?
+							 sb->server :
+							 sb->client, fd,
+							 sb->min, sb->max);
+			if (status < 0) {
+				VANESSA_LOGGER_DEBUG("vanessa_socket_tcp_tune");
+				sb->stopped = 1;
+			} else {
+				sb->clamped[to_client] = status;
+			}
+		}
+	}
+
+	return vanessa_socket_pipe_fd_write(fd, buf, count, NULL);
+}
+
+
+/**********************************************************************
+ * lifetime_select
+ * Wait for data to relay, for -e|--lifetime with -E|--engine fork
+ * pre: as for select(2), data is unused
+ *      lifetime_end: time to close the session by, from
+ *                    vanessa_socket_trace_now()
+ * post: The wait is cut short at lifetime_end. Once it has passed the
+ *       sets are cleared without waiting.
+ * return: as for select(2), 0 once lifetime_end has passed
+ **********************************************************************/
+
+static uint64_t lifetime_end;
+
+static int lifetime_select(int n, fd_set *readfds, fd_set *writefds,
+			   fd_set *exceptfds, struct timeval *timeout,
+			   void *UNUSED(data))
+{
+	struct timeval left;
+	uint64_t now, us;
+
+	now = vanessa_socket_trace_now();
+	if (now >= lifetime_end) {
+		if (readfds)
+			FD_ZERO(readfds);
+		if (writefds)
+			FD_ZERO(writefds);
+		if (exceptfds)
+			FD_ZERO(exceptfds);
+		return 0;
+	}
+
+	us = (lifetime_end - now + 999) / 1000;
+	left.tv_sec = us / 1000000;
+	left.tv_usec = us % 1000000;
+	if (timeout && (timeout->tv_sec < left.tv_sec ||
+			(timeout->tv_sec == left.tv_sec &&
+			 timeout->tv_usec < left.tv_usec)))
+		left = *timeout;
+
+	return select(n, readfds, writefds, exceptfds, &left);
+}
+
+
 /**********************************************************************
  * Muriel the main function
  **********************************************************************/
@@ -61,14 +410,31 @@ int main (int argc, char **argv){
   vanessa_logger_t *vl;
   options_t opt;
   char from_to_str[((NI_MAXHOST+NI_MAXSERV+1)*2)+2];
-  char from_host_str[NI_MAXHOST];
-  char to_host_str[NI_MAXHOST];
-  char from_serv_str[NI_MAXSERV];
-  char to_serv_str[NI_MAXSERV];
+  char from_str[NI_MAXHOST+NI_MAXSERV+1];
+  char to_str[NI_MAXHOST+NI_MAXSERV+1];
   size_t bytes_written=0;
   size_t bytes_read=0;
-  int timeout=0;
-  int rc;
+  int status;
+  int i;
+  metrics_t *m;
+  struct timespec start;
+  struct timespec connect_start;
+  vanessa_socket_trace_t trace;
+  sockbuf_t sockbuf;
+  capture_t *capture;
+  compress_t *compress=NULL;
+  mirror_t *mirror=NULL;
+  size_t mirror_bytes=0;
+  int mirror_dropped;
+  ssize_t (*write_func)(int fd, const void *buf, size_t count, void *data);
+  void *write_data;
+  accesslog_tcp_info_t tcp_info;
+  char tcp_info_str[ACCESSLOG_TCP_INFO_STR_LEN];
+  pid_t parent=0;
+  vanessa_socket_limit_t *limit;
+  vanessa_socket_acl_t *acl;
+  vanessa_socket_scoreboard_t *scoreboard;
+  int *listen_socketv;
 
   extern int errno;
 
@@ -101,94 +467,295 @@ int main (int argc, char **argv){
   log_options(opt, vl);
 
   /*
-   * Set a signal handler to clean up zombies
+   * Set a signal handler to clean up zombies, and add up
+   * the resources they used for metrics
+   */
+  signal(SIGCHLD,   vanessa_socket_handler_reaper_rusage);
+
+  /*
+   * Datagrams are relayed by this process, there are
+   * no connections to fork for
+   */
+  if(opt.udp){
+    exit(udp_main(&opt));
+  }
+
+  /*
+   * Serve metrics, if asked to. They are shared by each process
+   * forked below, or each thread of the engine.
+   */
+  if(metrics_init(&opt, opt.engine==ENGINE_EPOLL?opt.threads:1)<0){
+    vanessa_logger_log(vl, LOG_DEBUG, "main: metrics_init");
+    exit(-1);
+  }
+
+  /*
+   * Log sessions asynchronously, if asked to
+   */
+  if(accesslog_init(&opt)<0){
+    vanessa_logger_log(vl, LOG_DEBUG, "main: accesslog_init");
+    exit(-1);
+  }
+
+  /*
+   * Capture sessions asynchronously, if asked to
+   */
+  if(capture_init(&opt)<0){
+    vanessa_logger_log(vl, LOG_DEBUG, "main: capture_init");
+    exit(-1);
+  }
+
+  /*
+   * Limit connections from each source address and prefix,
+   * if asked to
+   */
+  limit=limit_create(&opt, &status);
+  if(status<0){
+    vanessa_logger_log(vl, LOG_DEBUG, "main: limit_create");
+    exit(-1);
+  }
+
+  /*
+   * Serve all connections from this process, rather than
+   * forking a process for each one
+   */
+  if(opt.engine==ENGINE_EPOLL){
+    status=engine_main(&opt, limit);
+    metrics_unlink();
+    exit(status);
+  }
+
+  /*
+   * Close connections that are over the per source limits
+   * before forking for them
+   */
+  vanessa_socket_server_limit(limit);
+
+  /*
+   * Give each child a slot to publish what it is doing in,
+   * if asked to
    */
-  signal(SIGCHLD,   vanessa_socket_handler_reaper);
+  if(opt.scoreboard!=NULL){
+    scoreboard=vanessa_socket_scoreboard_create(
+      opt.scoreboard,
+      opt.connection_limit?opt.connection_limit:SCOREBOARD_SLOTS
+    );
+    if(scoreboard==NULL){
+      vanessa_logger_log(vl, LOG_DEBUG,
+                         "main: vanessa_socket_scoreboard_create");
+      vanessa_logger_log(vl, LOG_ERR, "Could not create scoreboard: %s\n",
+                         opt.scoreboard);
+      exit(-1);
+    }
+    vanessa_socket_server_scoreboard(scoreboard);
+  }
+
+  /*
+   * Refuse connections from clients that the access control
+   * list denies before forking for them, if there is one
+   */
+  if(opt.acl_file!=NULL){
+    acl=acl_read(opt.acl_file);
+    if(acl==NULL){
+      vanessa_logger_log(vl, LOG_DEBUG, "main: acl_read");
+      exit(-1);
+    }
+    vanessa_socket_server_acl(acl);
+  }
+
+  /*
+   * Read the configuration file and access control list
+   * again on SIGHUP, if there are any
+   */
+  if(opt.config_file!=NULL || opt.acl_file!=NULL){
+    signal(SIGHUP, vanessa_socket_handler_reload);
+  }
+
+  /*
+   * Stop accepting connections on SIGTERM and let those that
+   * are open finish, if asked to
+   */
+  if(opt.drain_timeout){
+    parent=getpid();
+    signal(SIGTERM, vanessa_socket_handler_drain);
+  }
+
+  /*
+   * Unix domain peers are usually unnamed, so make sure that
+   * there is no junk in the path
+   */
+  memset(&peername, 0, sizeof(peername));
+  memset(&sockname, 0, sizeof(sockname));
+
+  /*
+   * The library fills in the trace of each session as it goes,
+   * starting with accept in the parent
+   */
+  memset(&trace, 0, sizeof(trace));
+  if(opt.trace){
+    vanessa_socket_trace_set(&trace);
+  }
 
   /* 
    * Listen on a port
-   * If you want to make a TCP/IP server that forks on connect
-   * then this is the function for you
    */
-  if((client=vanessa_socket_server_connect(
-    opt.listen_port, 
-    opt.listen_host,
+  if((listen_socketv=listen_bind(&opt))==NULL){
+    vanessa_logger_log(vl, LOG_DEBUG, "main: listen_bind");
+    exit(-1);
+  }
+
+  /*
+   * Fork on connect. The parent only returns to reload
+   * its settings on SIGHUP, or to drain on SIGTERM.
+   */
+  while((client=vanessa_socket_server_acceptv(
+    listen_socketv,
     opt.connection_limit, 
     (struct sockaddr *) &peername,
     (struct sockaddr *) &sockname,
     0
   ))<0){
-    vanessa_logger_log(vl, LOG_DEBUG, "main: vanessa_socket_server_connect");
+    if(vanessa_socket_server_draining()){
+      vanessa_socket_server_unlinkv(listen_socketv);
+      vanessa_socket_closev(listen_socketv);
+      status=drain_main(&opt);
+      metrics_unlink();
+      exit(status);
+    }
+    if(vanessa_socket_server_reload_pending()){
+      listen_socketv=reload(&opt, listen_socketv, limit);
+      continue;
+    }
+    vanessa_logger_log(vl, LOG_DEBUG, "main: vanessa_socket_server_acceptv");
+    exit(-1);
+  }
+
+  if(opt.config_file!=NULL || opt.acl_file!=NULL){
+    signal(SIGHUP, SIG_IGN);
+  }
+  if(opt.drain_timeout){
+    /*
+     * Keep going while the parent drains, even if SIGTERM is sent to
+     * the whole process group, but not once it has exited
+     */
+    signal(SIGTERM, SIG_IGN);
+#ifdef PR_SET_PDEATHSIG
+    if(prctl(PR_SET_PDEATHSIG, SIGKILL)<0 || getppid()!=parent){
+      exit(-1);
+    }
+#endif
+  }
+  metrics_child();
+  accesslog_child();
+  capture_child();
+  m=metrics_slot(0);
+  metrics_now(&start);
+  metrics_accept(m);
+  if(opt.lifetime){
+    lifetime_end=vanessa_socket_trace_now()+
+      opt.lifetime*(uint64_t)1000000000;
+  }
+
+  /*
+   * Another proxy may have told us who the client really is
+   */
+  if(opt.accept_proxy && vanessa_socket_proxy_v2_recv(
+    client,
+    &peername,
+    &sockname,
+    opt.timeout
+  )<0){
+    vanessa_logger_log(vl, LOG_DEBUG, "main: vanessa_socket_proxy_v2_recv");
+    vanessa_logger_log(vl, LOG_ERR, "Invalid PROXY protocol header\n");
+    metrics_close(m, &start, 0);
+    exit(-1);
+  }
+  if(opt.accept_proxy){
+    vanessa_socket_scoreboard_peer(
+      (struct sockaddr *)&peername,
+      (struct sockaddr *)&sockname
+    );
+  }
+
+  /*
+   * The access log formats addresses itself, away from the session
+   */
+  if(accesslog_enabled()){
+    accesslog_record(
+      ACCESSLOG_OPEN,
+      (struct sockaddr *)&peername,
+      (struct sockaddr *)&sockname,
+      0,
+      0,
+      NULL,
+      NULL
+    );
+  }
+  else {
+    /*
+     * Convert the address that a client connected from
+     * and the address (local to this host) that the 
+     * client connected to to a string for later reference
+     *
+     * N.B. inet_ntoa uses a global buffer which is
+     *       why two calls are required, lest the second call
+     *       overwrite the result of the first
+     */
+    printf("peername len=%d\n", get_salen((struct sockaddr *)&peername));
+    if (sockaddr_str((struct sockaddr *)&peername, from_str, "peername")) {
+          VANESSA_LOGGER_ERR("Fatal error formatting peername");
+          exit(-1);
+    }
+    if (sockaddr_str((struct sockaddr *)&sockname, to_str, "sockname")) {
+          VANESSA_LOGGER_ERR("Fatal error formatting sockname");
+          exit(-1);
+    }
+
+    strcpy(from_to_str, from_str);
+    strcat(from_to_str, "->");
+    strcat(from_to_str, to_str);
+
+    /*
+     * Log the session
+     */ 
     vanessa_logger_log(
       vl,
-      LOG_ERR,
-      "Could not bind to: %s:%s\n", 
-      str_null_safe(opt.listen_host), 
-      str_null_safe(opt.listen_port)
+      LOG_INFO,
+      "Connect: %s server=%s port=%s\n",
+      from_to_str,
+      opt.outgoing_host,
+      str_null_safe(opt.outgoing_port)
     );
-    exit(-1);
   }
 
   /*
-   * Convert the address that a client connected from
-   * and the address (local to this host) that the 
-   * client connected to to a string for later reference
-   *
-   * N.B. inet_ntoa uses a global buffer which is
-   *       why two calls are required, lest the second call
-   *       overwrite the result of the first
-   */
-  printf("peername len=%d\n", get_salen((struct sockaddr *)&peername));
-  rc = getnameinfo((struct sockaddr *)&peername,
-                   get_salen((struct sockaddr *)&peername),
-                   from_host_str, NI_MAXHOST, from_serv_str, NI_MAXSERV,
-                   NI_NUMERICHOST|NI_NUMERICSERV);
-  if (rc) {
-        VANESSA_LOGGER_DEBUG_UNSAFE("getnameinfo peername: %s",
-                                    gai_strerror(rc));
-        VANESSA_LOGGER_ERR("Fatal error formatting peername");
-        exit(-1);
-  }
-  rc = getnameinfo((struct sockaddr *)&sockname,
-                   get_salen((struct sockaddr *)&sockname),
-                   to_host_str, NI_MAXHOST, to_serv_str, NI_MAXSERV,
-                   NI_NUMERICHOST|NI_NUMERICSERV);
-  if (rc) {
-        VANESSA_LOGGER_DEBUG_UNSAFE("getnameinfo sockname: %s",
-                                    gai_strerror(rc));
-        VANESSA_LOGGER_ERR("Fatal error formatting sockname");
-        exit(-1);
-  }
-
-  strcpy(from_to_str, from_host_str);
-  strcat(from_to_str, ":");
-  strcat(from_to_str, from_serv_str);
-  strcat(from_to_str, "->");
-  strcat(from_to_str, to_host_str);
-  strcat(from_to_str, ":");
-  strcat(from_to_str, to_serv_str);
-
-  /*
-   * Log the session
-   */ 
-  vanessa_logger_log(
-    vl,
-    LOG_INFO,
-    "Connect: %s server=%s port=%s\n",
-    from_to_str,
-    opt.outgoing_host,
-    opt.outgoing_port
-  );
+   * Start connecting to the shadow server, without waiting for it
+   */
+  write_func=opt.sockbuf_max?sockbuf_write:vanessa_socket_pipe_fd_write;
+  write_data=&sockbuf;
+  if(opt.mirror_host!=NULL){
+    mirror=mirror_create(&opt, client, write_func, write_data);
+    if(!mirror){
+      vanessa_logger_log(vl, LOG_DEBUG, "main: mirror_create");
+      metrics_close(m, &start, 0);
+      exit(-1);
+    }
+    write_func=mirror_write;
+    write_data=mirror;
+  }
 
   /* 
    * Talk to the real server for the client
    * IF you wish to create a TCP client then this is the call for you
    */
-  if((server=vanessa_socket_client_open(
+  metrics_now(&connect_start);
+  server=vanessa_socket_client_open(
     opt.outgoing_host, 
     opt.outgoing_port, 
     opt.no_lookup
-  ))<0){
+  );
+  metrics_connect(m, &connect_start, server>=0);
+  if(server<0){
     vanessa_logger_log(vl, LOG_DEBUG, "main: vanessa_socket_client_open");
     vanessa_logger_log(
       vl,
@@ -197,10 +764,49 @@ int main (int argc, char **argv){
       str_null_safe(opt.outgoing_host),
       str_null_safe(opt.outgoing_port)
     );
+    metrics_close(m, &start, 0);
+    accesslog_record(
+      ACCESSLOG_CLOSE,
+      (struct sockaddr *)&peername,
+      (struct sockaddr *)&sockname,
+      0,
+      0,
+      &start,
+      NULL
+    );
+    if(opt.trace){
+      metrics_trace(m, &trace);
+      accesslog_trace(
+        (struct sockaddr *)&peername,
+        (struct sockaddr *)&sockname,
+        &trace
+      );
+    }
     sleep(ERR_SLEEP);
     exit(-1);
   }
 
+  /*
+   * Tell the server who the client is
+   */
+  if(opt.send_proxy && vanessa_socket_proxy_v2_send(
+    server,
+    (struct sockaddr *)&peername,
+    (struct sockaddr *)&sockname
+  )<0){
+    vanessa_logger_log(vl, LOG_DEBUG, "main: vanessa_socket_proxy_v2_send");
+    vanessa_logger_log(vl, LOG_ERR, "Could not send PROXY protocol header\n");
+    metrics_close(m, &start, 0);
+    exit(-1);
+  }
+  if(opt.send_proxy && mirror){
+    mirror_proxy(
+      mirror,
+      (struct sockaddr *)&peername,
+      (struct sockaddr *)&sockname
+    );
+  }
+
   /* 
    * Buffer for reads and writes to the server
    */ 
@@ -215,17 +821,96 @@ int main (int argc, char **argv){
    * If you need to have file descriptors talk to each other
    * then this is the function for you.
    */
-  if(vanessa_socket_pipe(
+  memset(&sockbuf, 0, sizeof(sockbuf));
+  sockbuf.server=server;
+  sockbuf.client=client;
+  sockbuf.min=opt.sockbuf_min;
+  sockbuf.max=opt.sockbuf_max;
+  if(opt.compress!=COMPRESS_NONE){
+    compress=compress_create(
+      opt.compress==COMPRESS_SERVER?server:client,
+      write_func,
+      write_data
+    );
+    if(!compress){
+      vanessa_logger_log(vl, LOG_DEBUG, "main: compress_create");
+      metrics_close(m, &start, 0);
+      exit(-1);
+    }
+    write_func=compress_write;
+    write_data=compress;
+  }
+  capture=capture_open(
+    client,
+    (struct sockaddr *)&peername,
+    (struct sockaddr *)&sockname,
+    write_func,
+    write_data
+  );
+  if(capture){
+    write_func=capture_write;
+    write_data=capture;
+  }
+  status=vanessa_socket_pipe_func(
     server,
     server,
     client,
     client,
     buffer,
     BUFFER_SIZE,
-    timeout,
+    opt.timeout,
     &bytes_written,
-    &bytes_read
-  )<0){
+    &bytes_read,
+    vanessa_socket_pipe_fd_read,
+    write_func,
+    opt.lifetime?lifetime_select:NULL,
+    write_data
+  );
+  capture_close(capture);
+  compress_destroy(compress);
+  if(mirror){
+    mirror_dropped=mirror_destroy(mirror, &mirror_bytes);
+    metrics_mirror(m, mirror_dropped, mirror_bytes);
+  }
+  vanessa_socket_scoreboard_state(VANESSA_SOCKET_SCOREBOARD_CLOSE);
+
+  /*
+   * See how the network treated the session, while the sockets
+   * are still open
+   */
+  tcp_info_str[0]='\0';
+  if(opt.tcp_info){
+    accesslog_tcp_info_read(&tcp_info, client, server);
+    for(i=0; i<2; i++){
+      if(tcp_info.ok[i]){
+        metrics_tcp_info(m, i, &tcp_info.side[i]);
+      }
+    }
+    if(!accesslog_enabled()){
+      accesslog_tcp_info_str(&tcp_info, tcp_info_str, sizeof(tcp_info_str));
+    }
+  }
+  metrics_bytes(m, METRICS_C2S, bytes_read);
+  metrics_bytes(m, METRICS_S2C, bytes_written);
+  metrics_close(m, &start, bytes_read+bytes_written);
+  accesslog_record(
+    ACCESSLOG_CLOSE,
+    (struct sockaddr *)&peername,
+    (struct sockaddr *)&sockname,
+    bytes_read,
+    bytes_written,
+    &start,
+    opt.tcp_info?&tcp_info:NULL
+  );
+  if(opt.trace){
+    metrics_trace(m, &trace);
+    accesslog_trace(
+      (struct sockaddr *)&peername,
+      (struct sockaddr *)&sockname,
+      &trace
+    );
+  }
+  if(status<0){
     vanessa_logger_log(vl, LOG_DEBUG, "main: vanessa_socket_pipe");
     exit(-1);
   }
@@ -233,14 +918,17 @@ int main (int argc, char **argv){
   /*
    * Time to leave
    */
-  vanessa_logger_log(
-    vl,
-    LOG_INFO,
-    "Closing: %s %d %d\n", 
-    from_to_str, 
-    bytes_read, 
-    bytes_written
-  );
+  if(!accesslog_enabled()){
+    vanessa_logger_log(
+      vl,
+      LOG_INFO,
+      "Closing: %s %d %d%s\n", 
+      from_to_str, 
+      bytes_read, 
+      bytes_written,
+      tcp_info_str
+    );
+  }
 
   close(server);
   close(client);